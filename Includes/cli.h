@@ -11,6 +11,7 @@
 #define CLI_UART_TX_STREAM_LEN          256
 #define CLI_UART_RX_READ_SZ_10MS        32
 #define CLI_UART_TX_WRITE_SZ_5MS        64
+#define CLI_USB_CONNECT_TIMEOUT_MS      2000
 
 #define CLI_PROMPT_STR                  "> "
 #define CLI_PROMPT_LEN                  2
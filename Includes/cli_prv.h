@@ -54,5 +54,18 @@ extern const CLI_Command_Definition_t xCommandDef_rakJoin;
 extern const CLI_Command_Definition_t xCommandDef_rakSend;
 extern const CLI_Command_Definition_t xCommandDef_rakAT;
 extern const CLI_Command_Definition_t xCommandDef_rakReset;
+extern const CLI_Command_Definition_t xCommandDef_rakStats;
+extern const CLI_Command_Definition_t xCommandDef_rakBench;
+extern const CLI_Command_Definition_t xCommandDef_rakBatch;
+extern const CLI_Command_Definition_t xCommandDef_rakAirtime;
+extern const CLI_Command_Definition_t xCommandDef_rakStore;
+extern const CLI_Command_Definition_t xCommandDef_rakConfirm;
+extern const CLI_Command_Definition_t xCommandDef_rakLb;
+extern const CLI_Command_Definition_t xCommandDef_rakTimeouts;
+extern const CLI_Command_Definition_t xCommandDef_rakHealth;
+extern const CLI_Command_Definition_t xCommandDef_rakP2p;
+extern const CLI_Command_Definition_t xCommandDef_rakBulk;
+extern const CLI_Command_Definition_t xCommandDef_rakFrag;
+extern const CLI_Command_Definition_t xCommandDef_rakClassC;
 
 #endif /* _CLI_PRIV */
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "semphr.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Debug configuration */
 #define RAK3172_DEBUG_LOGS      0
@@ -16,19 +17,165 @@
     #define RAK_DEBUG(fmt, ...)
 #endif
 
-/* Configuration */
-#define RAK3172_UART_ID         uart0
+/* Configuration, primary module */
+#define RAK3172_UART_INDEX      0       /* uart0 */
 #define RAK3172_TX_PIN          0
 #define RAK3172_RX_PIN          1
-#define RAK3172_BAUD_RATE       115200
+#define RAK3172_BAUD_RATE       115200  /* Factory default, always probed first */
+
+/* Baud rate upgrade negotiated at startup (AT+BAUD, stored by the module) */
+#define RAK3172_BAUD_UPGRADE    1
+#define RAK3172_BAUD_CANDIDATES { 921600, 460800, 230400 }
+#define RAK3172_PING_TIMEOUT_MS 300
+#define RAK3172_BENCH_PINGS     8       /* Pings averaged for the link round trip */
 
 #define RAK3172_RST_PIN         25
 
+/* Second module on uart1, used by the uplink load balancer (rak3172_lb.c) */
+#define RAK3172_SECOND_MODULE   0       /* 1 when the second RAK3172 is fitted */
+#define RAK3172_MAX_DEVICES     2
+#define RAK3172_UART2_INDEX     1       /* uart1 */
+#define RAK3172_TX2_PIN         4
+#define RAK3172_RX2_PIN         5
+#define RAK3172_RST2_PIN        6
+
+/* Boot: the module is ready once it prints this line or answers AT */
+#define RAK3172_BOOT_BANNER     "Current Work Mode"
+#define RAK3172_BOOT_TIMEOUT_MS 3000
+#define RAK3172_BOOT_POLL_MS    100
+#define RAK3172_RESET_PULSE_MS  10
+
 #define RAK3172_RX_BUFFER_SIZE  512
+#define RAK3172_RX_RING_SIZE    1024    /* Power of 2, filled by the UART IRQ */
+#define RAK3172_LINE_STAMPS     8       /* Power of 2, arrival times of the last lines */
 #define RAK3172_RESPONSE_TIMEOUT_MS  2000
 #define RAK3172_MAX_PAYLOAD     255
 
+#define RAK3172_CMD_QUEUE_LEN   8       /* Pending asynchronous commands */
+#define RAK3172_TX_BUFFER_SIZE  (12 + RAK3172_MAX_PAYLOAD * 2 + 2)  /* "AT+SEND=255:" + hex + CRLF */
+#define RAK3172_NOTIFY_INDEX    1       /* Task notification slot used by blocking calls */
+#define RAK3172_EVENT_QUEUE_LEN 10
+#define RAK3172_POOL_BLOCKS     8       /* Payload blocks shared by queued events */
+#define RAK3172_MAX_PORT_HANDLERS   8   /* fPort specific downlink handlers */
+#define RAK3172_DEFAULT_REGION  RAK3172_REGION_EU868    /* Until read back from the module */
+#define RAK3172_CFM_SWITCH_TIMEOUT_MS   2000    /* AT+CFM issued ahead of an uplink of the other type */
+
+/* Class A receive windows, commands are held back until they close (rak3172.c) */
+#define RAK3172_RXWIN_RX1_DELAY_MS  1000    /* End of uplink to RX1, AT+RX1DL */
+#define RAK3172_RXWIN_RX2_DELAY_MS  2000    /* End of uplink to RX2, AT+RX2DL */
+#define RAK3172_RXWIN_LEN_MS        500     /* RX2 preamble search at the slowest data rate, with margin */
+#define RAK3172_RXWIN_MAX_HELD      4       /* Commands set aside, plus one deferred; further ones run anyway */
+
+/* Uplink aggregation (rak3172_batch.c) */
+#define RAK3172_BATCH_PORT      10
+#define RAK3172_BATCH_MAX_AGE_MS    30000   /* Oldest record waits at most this long */
+#define RAK3172_BATCH_SEND_TIMEOUT_MS   10000
+#define RAK3172_BATCH_RETRY_MS  1000    /* Module busy or command queue full, send again after */
+#define RAK3172_BATCH_MAX_RETRIES   5   /* Per chunk, then its records are counted lost */
+#define RAK3172_BATCH_LOCK_RETRY_MS 10  /* Timer callbacks never wait for the mutex */
+
+/* Join state machine (rak3172_join.c) */
+#define RAK3172_JOIN_MAX_ATTEMPTS   8
+#define RAK3172_JOIN_ATTEMPT_TIMEOUT_MS 15000   /* AT+JOIN to JOINED/JOIN_FAILED */
+#define RAK3172_JOIN_BACKOFF_MS     10000   /* First retry delay, doubled each time */
+#define RAK3172_JOIN_BACKOFF_MAX_MS 600000
+#define RAK3172_JOIN_LATENCY_SAMPLES    16
+
+/* Store-and-forward uplink log (rak3172_store.c) */
+#define RAK3172_STORE_SECTORS   16      /* 64 KiB at the end of the on-board flash */
+#define RAK3172_STORE_POLL_MS   5000    /* Drain retry while joined and pending */
+#define RAK3172_STORE_SEND_TIMEOUT_MS   10000
+#define RAK3172_STORE_QUEUE_LEN 4       /* Records accepted ahead of the flash write */
+#define RAK3172_STORE_QUIET_MS  50      /* Module silent this long before flash work */
+#define RAK3172_STORE_QUIET_MAX_MS  10000   /* Give up waiting for silence, write anyway */
+#define RAK3172_STORE_QUIET_POLL_MS 20
+
+/* Confirmed uplinks (rak3172_confirm.c) */
+#define RAK3172_CFM_QUEUE_LEN   4
+#define RAK3172_CFM_MAX_ATTEMPTS    4
+#define RAK3172_CFM_AIRTIME_BUDGET_MS   3000    /* Per uplink, all attempts; runtime adjustable */
+#define RAK3172_CFM_ACK_TIMEOUT_MS  8000    /* AT+SEND accepted to +EVT:SEND_CONFIRMED_* */
+#define RAK3172_CFM_WINDOW      16      /* Recent outcomes behind the delivery ratio */
+#define RAK3172_CFM_MIN_RATIO_PCT   50  /* Below it, fall back to unconfirmed uplinks */
+#define RAK3172_CFM_PROBE_EVERY 8       /* Confirmed probe every N fallback uplinks */
+#define RAK3172_CFM_HIST_BINS   8
+
+/* Uplink load balancer (rak3172_lb.c) */
+#define RAK3172_LB_SLOTS        4       /* Uplinks in flight over all modules */
+#define RAK3172_LB_SEND_TIMEOUT_MS  10000
+
+/* Adaptive timeouts (rak3172_timeout.c) */
+#define RAK3172_TMO_MIN_SAMPLES 8       /* Replies seen before the learned deadline is used */
+#define RAK3172_TMO_VAR_MULT    4       /* Deviations above the smoothed latency */
+#define RAK3172_TMO_MARGIN_MS   50
+#define RAK3172_TMO_MAX_BACKOFF 3       /* Deadline doubles at most 3 times after timeouts */
 
+/* Health monitor (rak3172_health.c) */
+#define RAK3172_HEALTH_PERIOD_MS    5000
+#define RAK3172_HEALTH_IDLE_MS      30000   /* Probe only after this long without a line from the module */
+#define RAK3172_HEALTH_MAX_FAILURES 3       /* Consecutive failed probes before a reset */
+#define RAK3172_HEALTH_PROBE_TIMEOUT_MS 1000
+
+/* LoRa P2P (rak3172_p2p.c) */
+#define RAK3172_P2P_RING_LEN    16      /* Received packets waiting for a consumer */
+#define RAK3172_P2P_PRECV_CONTINUOUS    65534   /* AT+PRECV: no timeout, back to receive after AT+PSEND */
+#define RAK3172_P2P_MODE_SWITCH_MS  5000    /* AT+NWM restarts the module */
+#define RAK3172_P2P_TX_DONE_MARGIN_MS   200 /* Wait for +EVT:TXP2P DONE beyond the airtime */
+#define RAK3172_P2P_BUSY_RETRIES    5       /* AT+PSEND refused while the previous packet is on air */
+#define RAK3172_P2P_BUSY_RETRY_MS   50
+
+/* Bulk transfer over P2P (rak3172_bulk.c) */
+#define RAK3172_BULK_CHUNK          200     /* Fragment payload, a 6 byte header comes on top */
+#define RAK3172_BULK_MAX_FRAGMENTS  256     /* 50 KiB per transfer */
+#define RAK3172_BULK_WINDOW_INIT    4
+#define RAK3172_BULK_WINDOW_MAX     32      /* Width of the ACK bitmap */
+#define RAK3172_BULK_ACK_TIMEOUT_MS 3000    /* Sender wait for an ACK after a burst, on top of the ACK delay and ACK airtime */
+#define RAK3172_BULK_ACK_DELAY_MS   500     /* Receiver ACKs on its own after a full fragment's airtime plus this */
+#define RAK3172_BULK_MAX_TIMEOUTS   8       /* Consecutive bursts without an ACK before giving up */
+#define RAK3172_BULK_LINGER_MS      3000    /* Receiver answers retransmissions after completion, past the sender ACK timeout */
+#define RAK3172_BULK_SELFTEST_MAX   4096
+
+/* Fragmented data blocks (rak3172_frag.c) */
+#define RAK3172_FRAG_PORT           201     /* TS004 fPort */
+#define RAK3172_FRAG_BUFFER_SIZE    8192    /* Reserved for one downlink block */
+#define RAK3172_FRAG_MAX_FRAGMENTS  256     /* Multiple of 8, bitmap size */
+#define RAK3172_FRAG_MAX_SIZE       240
+#define RAK3172_FRAG_MAX_PARITY     32      /* Parity rows held, bounds the fragments missing at once */
+#define RAK3172_FRAG_RETRY_MS       1000    /* Scheduler queue full, try again after */
+
+/* Class C downlinks to USB (rak3172_classc.c) */
+#define RAK3172_CLASSC_BUFFER_SIZE  2048    /* Formatted downlinks waiting for USB */
+#define RAK3172_CLASSC_TASK_PRIORITY    3   /* Above Task_RAK3172, output starts at once */
+#define RAK3172_CLASSC_STACK_WORDS  384     /* RAKUsb, the USB stdio driver runs on it */
+#define RAK3172_CLASSC_HIST_BUCKETS 16      /* Power-of-two latency buckets, 1 us to 16 ms and above */
+
+/* Duty-cycle scheduler (rak3172_sched.c) */
+#define RAK3172_SCHED_QUEUE_LEN 8
+#define RAK3172_SCHED_SEND_TIMEOUT_MS   10000
+#define RAK3172_SCHED_BUSY_BACKOFF_MS   1000    /* Retry delay when the module refuses anyway */
+#define RAK3172_SCHED_LOCK_RETRY_MS 10      /* Timer callback never waits for the mutex */
+
+
+
+/* Result of an AT command */
+typedef enum {
+    RAK3172_OK = 0,
+    RAK3172_ERR_ERROR,          /* ERROR / AT_ERROR */
+    RAK3172_ERR_PARAM,          /* AT_PARAM_ERROR */
+    RAK3172_ERR_BUSY,           /* AT_BUSY_ERROR */
+    RAK3172_ERR_OVERFLOW,       /* AT_TEST_PARAM_OVERFLOW */
+    RAK3172_ERR_NO_CLASSB,      /* AT_NO_CLASSB_ENABLE */
+    RAK3172_ERR_NO_NETWORK,     /* AT_NO_NETWORK_JOINED */
+    RAK3172_ERR_RX,             /* AT_RX_ERROR */
+    RAK3172_ERR_MODE,           /* AT_MODE_NO_SUPPORT */
+    RAK3172_ERR_TIMEOUT,        /* No final result code before the deadline */
+    RAK3172_ERR_QUEUE_FULL,     /* Command queue full */
+    RAK3172_ERR_INVALID,        /* Invalid argument */
+    RAK3172_ERR_DUTY_CYCLE,     /* No sub-band has duty-cycle budget, not sent */
+    RAK3172_ERR_PAYLOAD_SIZE,   /* Payload too long for the region and data rate, not sent */
+    RAK3172_ERR_ABORTED,        /* Not run, an earlier transaction step failed */
+    RAK3172_ERR_NO_ACK          /* Confirmed uplink never acknowledged */
+} RAK3172_Status_t;
 
 /* Event types */
 typedef enum {
@@ -40,9 +187,22 @@ typedef enum {
     RAK3172_EVENT_TX_SUCCESS,
     RAK3172_EVENT_TX_FAILED,
     RAK3172_EVENT_RX_DATA,
-    RAK3172_EVENT_RESPONSE
+    RAK3172_EVENT_RESPONSE,
+    RAK3172_EVENT_TX_DONE,
+    RAK3172_EVENT_RX_P2P,
+    RAK3172_EVENT_JOIN_RETRY,   /* Attempt failed, next one after the backoff */
+    RAK3172_EVENT_JOIN_GAVE_UP  /* RAK3172_JOIN_MAX_ATTEMPTS failed */
 } RAK3172_Event_t;
 
+/* Receive window a downlink arrived in */
+typedef enum {
+    RAK3172_RX_WINDOW_1,
+    RAK3172_RX_WINDOW_2,
+    RAK3172_RX_WINDOW_B,
+    RAK3172_RX_WINDOW_C,
+    RAK3172_RX_WINDOW_P2P
+} RAK3172_RxWindow_t;
+
 /* Structure for received LoRa data */
 typedef struct {
     uint8_t port;
@@ -50,33 +210,166 @@ typedef struct {
     uint16_t length;
     int16_t rssi;
     int8_t snr;
+    RAK3172_RxWindow_t window;
+    bool multicast;
 } RAK3172_RxData_t;
 
-/* Event structure */
+/* Handle of a payload pool block */
+typedef uint8_t RAK3172_PoolHandle_t;
+#define RAK3172_POOL_NONE       ((RAK3172_PoolHandle_t)0xFF)
+
+/* Event descriptor. Events with a payload (RX_DATA, RX_P2P) reference a
+ * pool block holding a RAK3172_RxData_t, which stays allocated until
+ * RAK3172_ReleaseEvent is called. */
 typedef struct {
     RAK3172_Event_t type;
-    char response[RAK3172_RX_BUFFER_SIZE];
-    RAK3172_RxData_t rxData;
+    uint16_t length;                /* Payload bytes, 0 when no block */
+    RAK3172_PoolHandle_t handle;    /* RAK3172_POOL_NONE when no block */
 } RAK3172_EventData_t;
 
+/* Payload pool statistics */
+typedef struct {
+    uint32_t allocs;            /* Successful allocations */
+    uint32_t failures;          /* Allocations refused, pool empty */
+    uint16_t inUse;             /* Blocks currently allocated */
+    uint16_t highWater;         /* Maximum blocks allocated at once */
+} RAK3172_PoolStats_t;
+
+/* UART receive statistics */
+typedef struct {
+    uint32_t rxBytes;           /* Bytes stored in the RX ring */
+    uint32_t rxLines;           /* Line terminators seen by the IRQ */
+    uint32_t ringDrops;         /* Bytes lost because the RX ring was full */
+    uint32_t hwOverruns;        /* Hardware FIFO overruns reported by the UART */
+    uint32_t txBytes;           /* Bytes handed to the TX port */
+    uint32_t txDma;             /* Commands sent by DMA */
+    uint16_t ringHighWater;     /* Maximum RX ring fill level */
+} RAK3172_UartStats_t;
+
+/* UART link state and boot metrics */
+typedef struct {
+    uint32_t baud;              /* Current UART baud rate */
+    uint32_t rttBeforeUs;       /* Average AT round trip at RAK3172_BAUD_RATE, 0 if not measured */
+    uint32_t rttAfterUs;        /* Average AT round trip after the upgrade */
+    bool upgraded;              /* Running above RAK3172_BAUD_RATE */
+    bool bannerSeen;            /* Last boot detected through the banner */
+    uint32_t bootMs;            /* Reset release to module ready, last boot */
+    uint32_t firstCmdMs;        /* Reset release to first successful command, 0 if none */
+} RAK3172_LinkInfo_t;
+
+/* Command engine statistics */
+typedef struct {
+    uint32_t submitted;         /* Commands accepted in the queue */
+    uint32_t completed;         /* Commands with a final result code */
+    uint32_t timeouts;          /* Commands that hit their deadline */
+    uint32_t queueFull;         /* Submissions rejected, queue full */
+    uint32_t queueHighWater;    /* Maximum number of queued commands */
+    uint32_t totalWaitMs;       /* Sum of time spent in the queue */
+    uint32_t totalExecMs;       /* Sum of time on the wire */
+    uint32_t eventDrops;        /* Events lost, event queue full */
+    uint32_t busy;              /* AT_BUSY_ERROR replies */
+    uint32_t rxWinCycles;       /* Uplinks followed by receive windows */
+    uint32_t rxWinHeld;         /* Commands held back during the windows, busy errors avoided */
+    uint32_t rxWinHeldMs;       /* Sum of submit to result time of held commands */
+    uint32_t rxWinHeldMaxMs;
+    uint32_t rxWinOverflow;     /* Run during the windows, nowhere left to hold them */
+    uint32_t cfmSwitches;       /* AT+CFM issued ahead of an uplink */
+} RAK3172_CmdStats_t;
+
+/* Wiring of one module */
+typedef struct {
+    const char *name;
+    uint8_t uartIndex;          /* 0 = uart0, 1 = uart1 */
+    uint8_t txPin;
+    uint8_t rxPin;
+    uint8_t rstPin;
+    const struct xRAK3172_TX_PORT *txPort;  /* NULL: DMA, blocking if no channel */
+} RAK3172_DevConfig_t;
+
+/* Driver instance, one per module */
+typedef struct RAK3172_Dev RAK3172_Dev_t;
+
+/* One step of a command transaction */
+typedef struct {
+    const char *cmd;            /* AT command */
+    const char *undo;           /* Optional, restores the previous state on rollback */
+    RAK3172_Status_t status;    /* Result, RAK3172_ERR_ABORTED if never run */
+} RAK3172_TxnItem_t;
+
+/* Completion callback for asynchronous commands.
+ * Runs in the RAK3172 task: keep it short and never call blocking
+ * RAK3172 functions from it. response holds the data lines of the reply
+ * and is only valid during the call. */
+typedef void (*RAK3172_CmdCallback_t)(RAK3172_Status_t status, const char *response, void *ctx);
+
 /* Callback type for received data */
 typedef void (*RAK3172_RxCallback_t)(const RAK3172_RxData_t *data);
 
 /* Public API */
 BaseType_t RAK3172_Init(void);
 BaseType_t RAK3172_HardwareReset(void);
-BaseType_t RAK3172_SendCommand(const char *cmd, char *response, uint32_t timeout_ms);
-BaseType_t RAK3172_GetVersion(char *version, size_t max_len);
-BaseType_t RAK3172_Join(uint32_t timeout_ms);
-BaseType_t RAK3172_SendData(uint8_t port, const uint8_t *data, uint16_t length);
-BaseType_t RAK3172_SendDataUnconfirmed(uint8_t port, const uint8_t *data, uint16_t length);
-BaseType_t RAK3172_SetDevEUI(const char *deveui);
-BaseType_t RAK3172_SetAppEUI(const char *appeui);
-BaseType_t RAK3172_SetAppKey(const char *appkey);
-BaseType_t RAK3172_SetRegion(const char *region);
+RAK3172_Status_t RAK3172_SubmitCommand(const char *cmd, RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_SubmitSend(uint8_t port, const uint8_t *data, uint16_t length,
+                                    RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_SendCommand(const char *cmd, char *response, size_t response_len, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_SendCommandUrgent(const char *cmd, char *response, size_t response_len, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_RunTransaction(RAK3172_TxnItem_t *items, size_t count, bool rollback,
+                                        uint32_t timeout_ms, uint32_t *elapsed_ms);
+RAK3172_Status_t RAK3172_GetVersion(char *version, size_t max_len);
+RAK3172_Status_t RAK3172_Join(uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_SendData(uint8_t port, const uint8_t *data, uint16_t length);
+RAK3172_Status_t RAK3172_SendDataUnconfirmed(uint8_t port, const uint8_t *data, uint16_t length);
+RAK3172_Status_t RAK3172_SendConfirmedOnce(uint8_t port, const uint8_t *data, uint16_t length);
+RAK3172_Status_t RAK3172_SetDevEUI(const char *deveui);
+RAK3172_Status_t RAK3172_SetAppEUI(const char *appeui);
+RAK3172_Status_t RAK3172_SetAppKey(const char *appkey);
+RAK3172_Status_t RAK3172_SetRegion(const char *region);
+RAK3172_Status_t RAK3172_SetDataRate(uint8_t dr);
+RAK3172_Status_t RAK3172_ReadDataRate(void);
+uint8_t RAK3172_GetDataRate(void);
+bool RAK3172_IsJoined(void);
 BaseType_t RAK3172_RegisterRxCallback(RAK3172_RxCallback_t callback);
+BaseType_t RAK3172_RegisterPortHandler(uint8_t port, RAK3172_RxCallback_t callback);
+BaseType_t RAK3172_PostEvent(RAK3172_Event_t type);
+BaseType_t RAK3172_WaitEvent(RAK3172_EventData_t *event, uint32_t timeout_ms);
+const RAK3172_RxData_t *RAK3172_EventRxData(const RAK3172_EventData_t *event);
+void RAK3172_ReleaseEvent(RAK3172_EventData_t *event);
+void RAK3172_GetUartStats(RAK3172_UartStats_t *stats);
+void RAK3172_GetCmdStats(RAK3172_CmdStats_t *stats);
+const char *RAK3172_StatusString(RAK3172_Status_t status);
+RAK3172_Status_t RAK3172_Ping(uint32_t *rtt_us);
+void RAK3172_GetLinkInfo(RAK3172_LinkInfo_t *info);
+
+/* Multi-instance API. Every call above acts on the primary module (the
+ * one RAK3172_Init() opens); the configuration shadow, join state machine
+ * and the uplink services built on it are primary-only. Both modules are
+ * expected on the same region. */
+RAK3172_Dev_t *RAK3172_DevOpen(const RAK3172_DevConfig_t *config);
+RAK3172_Dev_t *RAK3172_GetDev(uint8_t index);
+uint8_t RAK3172_DevIndex(const RAK3172_Dev_t *dev);
+const char *RAK3172_DevName(const RAK3172_Dev_t *dev);
+BaseType_t RAK3172_DevHardwareReset(RAK3172_Dev_t *dev);
+RAK3172_Status_t RAK3172_DevSubmitCommand(RAK3172_Dev_t *dev, const char *cmd,
+                                          RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_DevSubmitSend(RAK3172_Dev_t *dev, uint8_t port, const uint8_t *data, uint16_t length,
+                                       RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_DevSendCommand(RAK3172_Dev_t *dev, const char *cmd, char *response,
+                                        size_t response_len, uint32_t timeout_ms);
+RAK3172_Status_t RAK3172_DevPing(RAK3172_Dev_t *dev, uint32_t *rtt_us);
+RAK3172_Status_t RAK3172_DevReadDataRate(RAK3172_Dev_t *dev);
+uint8_t RAK3172_DevGetDataRate(const RAK3172_Dev_t *dev);
+bool RAK3172_DevIsJoined(const RAK3172_Dev_t *dev);
+uint32_t RAK3172_DevRxIdleMs(const RAK3172_Dev_t *dev);
+bool RAK3172_DevIsQuiet(const RAK3172_Dev_t *dev, uint32_t idle_ms);
+void RAK3172_DevSimulateHang(RAK3172_Dev_t *dev, bool hang);
+void RAK3172_DevSimulateModule(RAK3172_Dev_t *dev, bool on);
+size_t RAK3172_DevInjectRx(RAK3172_Dev_t *dev, const char *data, size_t len);
+BaseType_t RAK3172_DevWaitEvent(RAK3172_Dev_t *dev, RAK3172_EventData_t *event, uint32_t timeout_ms);
+void RAK3172_DevGetUartStats(const RAK3172_Dev_t *dev, RAK3172_UartStats_t *stats);
+void RAK3172_DevGetCmdStats(const RAK3172_Dev_t *dev, RAK3172_CmdStats_t *stats);
+void RAK3172_DevGetLinkInfo(const RAK3172_Dev_t *dev, RAK3172_LinkInfo_t *info);
 
-/* Task */
+/* Task, one per module, pvParameters is its RAK3172_Dev_t */
 void Task_RAK3172(void *pvParameters);
 
 #endif /* RAK3172_H */
\ No newline at end of file
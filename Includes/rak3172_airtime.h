@@ -0,0 +1,13 @@
+#ifndef RAK3172_AIRTIME_H
+#define RAK3172_AIRTIME_H
+
+#include "rak3172.h"
+#include "rak3172_region.h"
+
+/* LoRaWAN frame overhead around FRMPayload: MHDR, FHDR without FOpts, FPort, MIC */
+#define RAK3172_LORAWAN_OVERHEAD    13
+
+uint32_t RAK3172_TimeOnAirUs(const RAK3172_DataRate_t *drInfo, uint16_t phyLen);
+uint32_t RAK3172_UplinkAirtimeUs(uint8_t dr, uint16_t payloadLen);
+
+#endif /* RAK3172_AIRTIME_H */
@@ -0,0 +1,58 @@
+#ifndef RAK3172_AT_H
+#define RAK3172_AT_H
+
+#include "rak3172.h"
+#include <stddef.h>
+
+/* Classification of a complete line received from the module */
+typedef enum {
+    RAK3172_LINE_EMPTY,         /* Blank line between replies */
+    RAK3172_LINE_ECHO,          /* Echo of the command being executed */
+    RAK3172_LINE_DATA,          /* Payload of a query reply */
+    RAK3172_LINE_OK,            /* Final result: OK */
+    RAK3172_LINE_ERROR,         /* Final result: ERROR / AT_*_ERROR */
+    RAK3172_LINE_URC            /* Unsolicited event: +EVT:... */
+} RAK3172_LineType_t;
+
+/* Classify one line (without CR/LF). cmd is the pending command used to
+ * recognise echoes, it may be NULL. For RAK3172_LINE_ERROR the detailed
+ * status is written to *status when status is not NULL. */
+RAK3172_LineType_t RAK3172_ClassifyLine(const char *line, size_t len,
+                                        const char *cmd,
+                                        RAK3172_Status_t *status);
+
+/* Unsolicited events decoded from +EVT: lines */
+typedef enum {
+    RAK3172_URC_UNKNOWN,            /* Not recognised, ignored */
+    RAK3172_URC_PARTIAL,            /* First line of a multi-line event */
+    RAK3172_URC_JOINED,
+    RAK3172_URC_JOIN_FAILED,
+    RAK3172_URC_TX_DONE,
+    RAK3172_URC_TX_P2P_DONE,        /* P2P packet sent, radio back to receive */
+    RAK3172_URC_SEND_CONFIRMED_OK,
+    RAK3172_URC_SEND_CONFIRMED_FAILED,
+    RAK3172_URC_RX,                 /* LoRaWAN downlink, rx filled */
+    RAK3172_URC_RX_P2P              /* LoRa P2P packet, rx filled */
+} RAK3172_UrcType_t;
+
+/* State kept between lines: RUI3 v3 firmware splits a downlink over
+ * "+EVT:RX_1, RSSI -70, SNR 8", "+EVT:UNICAST" and "+EVT:2:1234" */
+typedef struct {
+    RAK3172_UrcType_t pending;      /* RAK3172_URC_RX / _RX_P2P or UNKNOWN */
+    RAK3172_RxWindow_t window;
+    bool multicast;
+    int16_t rssi;
+    int8_t snr;
+} RAK3172_UrcParser_t;
+
+/* Decode one +EVT: line. Payload bytes are hex-decoded straight into rx. */
+RAK3172_UrcType_t RAK3172_ParseUrc(RAK3172_UrcParser_t *parser,
+                                   const char *line, size_t len,
+                                   RAK3172_RxData_t *rx);
+
+/* Table-driven hex codec used for AT+SEND payloads and downlinks */
+extern const char cRak3172HexDigits[16];
+void RAK3172_HexEncode(const uint8_t *data, size_t len, char *out);
+int32_t RAK3172_HexDecode(const char *hex, size_t hex_len, uint8_t *out, size_t max_len);
+
+#endif /* RAK3172_AT_H */
@@ -0,0 +1,35 @@
+#ifndef RAK3172_BATCH_H
+#define RAK3172_BATCH_H
+
+#include "rak3172.h"
+
+/* Uplink aggregation.
+ * Small records are packed as <length><bytes> into one frame, sent on
+ * RAK3172_BATCH_PORT when the next record would not fit the current data
+ * rate, when the oldest record reaches its age limit, or on an explicit
+ * flush. Two frame buffers: one filling while the other is on the air.
+ * A frame is cut into uplinks at send time, so a data rate drop after the
+ * records were packed splits it. Chunks refused for duty cycle or a busy
+ * module are sent again; records that never make it are counted. */
+
+typedef struct {
+    uint32_t records;           /* Records accepted */
+    uint32_t rejected;          /* Records refused (too long, both buffers busy) */
+    uint32_t frames;            /* Frames submitted */
+    uint32_t bytes;             /* FRMPayload bytes submitted */
+    uint32_t flushSize;         /* Frames sent because they were full */
+    uint32_t flushAge;          /* Frames sent on the age deadline */
+    uint32_t flushExplicit;     /* Frames sent by RAK3172_BatchFlush() */
+    uint32_t sendErrors;        /* Uplinks that failed for good */
+    uint32_t retries;           /* Uplinks sent again after duty cycle or busy */
+    uint32_t recordsLost;       /* Records in failed uplinks or too long for the data rate */
+    uint32_t airtimeMs;         /* Time on air of the frames sent */
+    uint32_t airtimeSavedMs;    /* Versus one uplink per record */
+} RAK3172_BatchStats_t;
+
+RAK3172_Status_t RAK3172_BatchInit(void);
+RAK3172_Status_t RAK3172_BatchAdd(const uint8_t *record, uint8_t length);
+RAK3172_Status_t RAK3172_BatchFlush(void);
+void RAK3172_GetBatchStats(RAK3172_BatchStats_t *stats);
+
+#endif /* RAK3172_BATCH_H */
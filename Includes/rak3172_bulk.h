@@ -0,0 +1,57 @@
+#ifndef RAK3172_BULK_H
+#define RAK3172_BULK_H
+
+#include "rak3172.h"
+
+/* Bulk transfer between two dongles over LoRa P2P.
+ * A blob is cut into RAK3172_BULK_CHUNK byte fragments sent with
+ * selective repeat: each burst holds up to window fragments not yet
+ * acknowledged, the last one asks for an ACK. The ACK carries the first
+ * missing fragment and a 32 bit map of the ones after it, so only the
+ * lost fragments are sent again. The window grows by one after a clean
+ * burst and is halved on loss. Fragments are copied straight to their
+ * place in the receive buffer.
+ *
+ * Frames, little endian:
+ *   DATA  B1 (B3 = ACK requested) | session | seq:16 | total:16 | data
+ *   ACK   B2 | session | base:16 | bitmap:32 (bit i = fragment base+1+i) */
+
+/* Frame transport, P2P on target; another pair can stand in for it.
+ * send returns once the frame is off air. airtimeMs is optional, the ACK
+ * timers are stretched by it so a slow link is not ACKed mid-burst. */
+typedef struct xRAK3172_BULK_LINK
+{
+    RAK3172_Status_t (*send)(void *ctx, const uint8_t *data, uint8_t length);
+    BaseType_t (*recv)(void *ctx, uint8_t *data, uint8_t *length, uint32_t timeout_ms);
+    uint32_t (*airtimeMs)(void *ctx, uint8_t length);
+    void *ctx;
+} RAK3172_BulkLink_t;
+
+extern const RAK3172_BulkLink_t xRak3172BulkP2p;
+
+typedef struct {
+    uint32_t bytes;
+    uint16_t fragments;
+    uint32_t framesSent;        /* Data frames (sender) or ACKs (receiver) */
+    uint32_t framesReceived;
+    uint32_t retransmissions;   /* Sender: fragments sent again */
+    uint32_t duplicates;        /* Receiver: fragments received again */
+    uint32_t timeouts;          /* Sender: bursts without an ACK */
+    uint8_t window;             /* Sender: final, smallest and largest window */
+    uint8_t windowMin;
+    uint8_t windowMax;
+    uint32_t elapsedMs;
+    uint32_t bytesPerSec;       /* Delivered throughput */
+} RAK3172_BulkStats_t;
+
+RAK3172_Status_t RAK3172_BulkSend(const RAK3172_BulkLink_t *link, uint8_t session,
+                                  const uint8_t *data, size_t length, RAK3172_BulkStats_t *stats);
+RAK3172_Status_t RAK3172_BulkReceive(const RAK3172_BulkLink_t *link, uint8_t *buffer, size_t max_len,
+                                     size_t *length, uint32_t timeout_ms, RAK3172_BulkStats_t *stats);
+
+/* Transfer length bytes between two tasks joined by an in-memory channel
+ * losing loss_pct % of the frames, and check the result */
+RAK3172_Status_t RAK3172_BulkSelfTest(size_t length, uint8_t loss_pct,
+                                      RAK3172_BulkStats_t *tx, RAK3172_BulkStats_t *rx);
+
+#endif /* RAK3172_BULK_H */
@@ -0,0 +1,40 @@
+#ifndef RAK3172_CLASSC_H
+#define RAK3172_CLASSC_H
+
+#include "rak3172.h"
+
+/* Class C downlink delivery to the host.
+ * RAK3172_ClassCStart() switches the primary module to class C, the
+ * radio then listens on RX2 whenever it is not transmitting. Every
+ * LoRaWAN downlink is formatted in the RAK3172 task right after its URC
+ * is parsed and put on a message buffer, ahead of the event queue and
+ * port handlers. A dedicated task above Task_RAK3172 writes it to USB
+ * straight away, the CLI output path is not involved.
+ *
+ * Line: +DL:<us>:<window>:<port>:<rssi>:<snr>:<hex>\r\n, where us is
+ * time_us_64() of the URC's last byte, stamped in the UART IRQ. The time
+ * from that stamp until the line has been handed to the USB stack and
+ * flushed is kept in a power-of-two histogram; the host still has to
+ * poll it in. */
+
+typedef struct {
+    bool active;                /* Module in class C, downlinks pushed */
+    uint32_t downlinks;         /* Lines queued for USB */
+    uint32_t dropped;           /* Message buffer full */
+    uint32_t written;           /* Lines written to USB */
+    uint32_t totalUs;           /* Sum of last byte to USB write latencies, over written */
+    uint32_t maxUs;
+    uint32_t histogram[RAK3172_CLASSC_HIST_BUCKETS];   /* [0]: 0 us, [i]: 2^(i-1) to 2^i - 1 us, last: above */
+    uint32_t stackFreeWords;    /* RAKUsb stack high-water mark, words never used */
+} RAK3172_ClassCStats_t;
+
+RAK3172_Status_t RAK3172_ClassCInit(void);
+RAK3172_Status_t RAK3172_ClassCStart(void);
+RAK3172_Status_t RAK3172_ClassCStop(void);
+void RAK3172_ClassCClearStats(void);
+void RAK3172_GetClassCStats(RAK3172_ClassCStats_t *stats);
+
+/* Called by the driver for each downlink of the primary module */
+void RAK3172_ClassCHandleRx(const RAK3172_RxData_t *rx, uint64_t lineUs);
+
+#endif /* RAK3172_CLASSC_H */
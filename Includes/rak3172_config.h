@@ -0,0 +1,47 @@
+#ifndef RAK3172_CONFIG_H
+#define RAK3172_CONFIG_H
+
+#include "rak3172.h"
+
+/* RAM shadow of the module settings.
+ * Reads are served from the shadow once a value is known, writes of an
+ * unchanged value are skipped. Staged values stay dirty until committed,
+ * all in one transaction.
+ * The shadow is dropped on RAK3172_HardwareReset(). */
+
+typedef enum {
+    RAK3172_CFG_DEVEUI,
+    RAK3172_CFG_APPEUI,
+    RAK3172_CFG_APPKEY,
+    RAK3172_CFG_BAND,
+    RAK3172_CFG_DR,
+    RAK3172_CFG_ADR,
+    RAK3172_CFG_CLASS,
+    RAK3172_CFG_TXPOWER,
+    RAK3172_CFG_CONFIRM,        /* Uplink type, 1 = confirmed; set per uplink by the driver */
+    RAK3172_CFG_VERSION,        /* Read only */
+    RAK3172_CFG_COUNT
+} RAK3172_ConfigItem_t;
+
+#define RAK3172_CFG_VALUE_LEN   48
+
+typedef struct {
+    uint32_t hits;              /* Reads served from the shadow */
+    uint32_t misses;            /* Reads that went to the module */
+    uint32_t writes;            /* Values written to the module */
+    uint32_t skipped;           /* Writes avoided, value unchanged */
+    uint32_t invalidations;     /* Shadow dropped (reset) */
+} RAK3172_ConfigStats_t;
+
+RAK3172_Status_t RAK3172_ConfigInit(void);
+RAK3172_Status_t RAK3172_ConfigGet(RAK3172_ConfigItem_t item, char *value, size_t max_len);
+RAK3172_Status_t RAK3172_ConfigSet(RAK3172_ConfigItem_t item, const char *value);
+RAK3172_Status_t RAK3172_ConfigStage(RAK3172_ConfigItem_t item, const char *value);
+RAK3172_Status_t RAK3172_ConfigCommit(RAK3172_Status_t *itemStatus, uint32_t *elapsed_ms);
+void RAK3172_ConfigInvalidate(RAK3172_ConfigItem_t item);
+void RAK3172_ConfigInvalidateAll(void);
+bool RAK3172_ConfigPeek(RAK3172_ConfigItem_t item, char *value, size_t max_len, bool *dirty);
+const char *RAK3172_ConfigName(RAK3172_ConfigItem_t item);
+void RAK3172_GetConfigStats(RAK3172_ConfigStats_t *stats);
+
+#endif /* RAK3172_CONFIG_H */
@@ -0,0 +1,60 @@
+#ifndef RAK3172_CONFIRM_H
+#define RAK3172_CONFIRM_H
+
+#include "rak3172.h"
+
+/* Confirmed uplink manager.
+ * Uplinks are queued and sent one at a time by the "RAKCfm" task; each
+ * gets a sequence number and is outstanding until the matching
+ * +EVT:SEND_CONFIRMED_OK/FAILED (or the ack timeout). Unacknowledged
+ * uplinks are retransmitted while their airtime budget lasts. When the
+ * recent delivery ratio drops below RAK3172_CFM_MIN_RATIO_PCT, uplinks go
+ * out unconfirmed, with a confirmed probe now and then to detect
+ * recovery.
+ * At most one confirmed uplink is outstanding: the ack URC carries no
+ * sequence number and is matched to it. The driver sets AT+CFM per
+ * uplink, so the other uplink paths (batch, scheduler, store, load
+ * balancer) always go out unconfirmed and never produce an ack URC. */
+
+typedef enum {
+    RAK3172_CFM_ACKED,          /* Acknowledged by the network */
+    RAK3172_CFM_UNCONFIRMED,    /* Sent unconfirmed, link fallback */
+    RAK3172_CFM_NO_ACK,         /* Attempts or airtime budget exhausted */
+    RAK3172_CFM_SEND_ERROR      /* Module refused the uplink */
+} RAK3172_CfmResult_t;
+
+/* Called from the manager task once the uplink is settled */
+typedef void (*RAK3172_CfmCallback_t)(uint32_t seq, RAK3172_CfmResult_t result, void *ctx);
+
+typedef struct {
+    uint32_t queued;
+    uint32_t rejected;          /* Queue full or invalid */
+    uint32_t acked;
+    uint32_t ackedFirst;        /* Acked without retransmission */
+    uint32_t retransmissions;
+    uint32_t noAck;
+    uint32_t budgetStops;       /* Retransmission stopped by the airtime budget */
+    uint32_t fallbacks;         /* Sent unconfirmed */
+    uint32_t probes;            /* Confirmed probes while fallen back */
+    uint32_t sendErrors;
+    uint32_t unmatched;         /* Ack URCs with no uplink outstanding */
+    uint32_t airtimeMs;         /* All attempts */
+    uint8_t ratioPct;           /* Delivery ratio over the recent window */
+    bool fallback;              /* Currently sending unconfirmed */
+    uint32_t budgetMs;
+    uint32_t ackHist[RAK3172_CFM_HIST_BINS];    /* AT+SEND accepted to ack */
+} RAK3172_CfmStats_t;
+
+/* Upper bound of each histogram bin in ms, the last one is open */
+extern const uint32_t RAK3172_CfmHistEdgesMs[RAK3172_CFM_HIST_BINS - 1];
+
+RAK3172_Status_t RAK3172_ConfirmInit(void);
+RAK3172_Status_t RAK3172_ConfirmSend(uint8_t port, const uint8_t *data, uint8_t length,
+                                     RAK3172_CfmCallback_t callback, void *ctx, uint32_t *seq);
+void RAK3172_ConfirmSetBudget(uint32_t budget_ms);
+void RAK3172_GetConfirmStats(RAK3172_CfmStats_t *stats);
+
+/* Called by the driver */
+void RAK3172_ConfirmHandleUrc(bool acked);
+
+#endif /* RAK3172_CONFIRM_H */
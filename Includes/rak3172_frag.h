@@ -0,0 +1,61 @@
+#ifndef RAK3172_FRAG_H
+#define RAK3172_FRAG_H
+
+#include "rak3172.h"
+
+/* Fragmented data block transport, after LoRaWAN TS004, on
+ * RAK3172_FRAG_PORT. A block is cut into N fragments of fragSize bytes,
+ * followed by parity fragments: parity n is the XOR of the fragments
+ * selected by the TS004 matrix line n. Any N independent fragments give
+ * the block back, so lost frames need no retransmission request.
+ *
+ * Downlink: FragSessionSetupReq reserves the static block buffer, each
+ * DataFragment is placed at its offset and marked in a bitmap, parity
+ * rows are kept reduced against what is missing and solve fragments as
+ * soon as they can. Uplink: RAK3172_FragSend() announces the session the
+ * same way and queues fragments and parity on the scheduler. */
+
+/* Runs in the RAK3172 task once a downlink block is complete. The block
+ * stays valid until the next session setup. */
+typedef void (*RAK3172_FragCallback_t)(const uint8_t *block, size_t length);
+
+typedef struct {
+    bool active;                /* Downlink session set up */
+    bool complete;
+    uint8_t index;              /* FragIndex 0-3 */
+    uint16_t nbFrag;
+    uint8_t fragSize;
+    uint16_t received;          /* Uncoded fragments received */
+    uint16_t recovered;         /* Fragments solved from parity */
+    uint8_t parityRows;         /* Parity rows held for missing fragments */
+    uint32_t parityReceived;
+    uint32_t parityDropped;     /* Redundant or no room left */
+    uint32_t duplicates;
+    uint32_t sessions;          /* Downlink sessions set up */
+    uint32_t blocks;            /* Downlink blocks completed */
+    uint32_t uplinkFragments;   /* Queued by RAK3172_FragSend() */
+} RAK3172_FragStats_t;
+
+/* Result of RAK3172_FragSelfTest() */
+typedef struct {
+    uint32_t runs;
+    uint32_t recovered;         /* Blocks rebuilt intact */
+    uint32_t lost;              /* Fragments dropped by the channel */
+    uint32_t needed;            /* Fragments received before completion, over all recovered runs */
+    uint16_t nbFrag;
+    uint16_t nbParity;
+} RAK3172_FragTestResult_t;
+
+RAK3172_Status_t RAK3172_FragInit(void);
+void RAK3172_FragSetCallback(RAK3172_FragCallback_t callback);
+RAK3172_Status_t RAK3172_FragSend(const uint8_t *data, size_t length, uint8_t frag_size, uint8_t redundancy_pct);
+const uint8_t *RAK3172_FragGetBlock(size_t *length);
+void RAK3172_GetFragStats(RAK3172_FragStats_t *stats);
+
+/* Encode a block of length bytes, drop loss_pct % of the fragments and
+ * run the rest through the downlink decoder, runs times. Uses the
+ * downlink buffer, refused while a downlink session is open. */
+RAK3172_Status_t RAK3172_FragSelfTest(size_t length, uint8_t frag_size, uint8_t redundancy_pct,
+                                      uint8_t loss_pct, uint32_t runs, RAK3172_FragTestResult_t *result);
+
+#endif /* RAK3172_FRAG_H */
@@ -0,0 +1,34 @@
+#ifndef RAK3172_HEALTH_H
+#define RAK3172_HEALTH_H
+
+#include "rak3172.h"
+
+/* Health monitor of the primary module.
+ * The "RAKHealth" task sends AT only when nothing has been heard from the
+ * module for RAK3172_HEALTH_IDLE_MS, so a busy link costs nothing. After
+ * RAK3172_HEALTH_MAX_FAILURES probes in a row without a reply the module
+ * is reset through its RST pin, the settings held by the configuration
+ * shadow are written back in one transaction and, if the module was
+ * joined or joining, the join state machine is restarted. */
+
+typedef struct {
+    bool enabled;
+    uint32_t probes;
+    uint32_t probeFailures;
+    uint8_t consecutive;        /* Failed probes since the last reply */
+    uint32_t recoveries;        /* Resets that brought the module back */
+    uint32_t failedRecoveries;  /* Module still silent after the reset */
+    uint32_t restored;          /* Settings written back, all recoveries */
+    uint32_t restoreErrors;     /* Replays that did not complete */
+    uint32_t rejoins;
+    uint32_t lastRecoveryMs;    /* Reset to settings restored */
+    uint32_t maxRecoveryMs;
+    uint32_t totalRecoveryMs;
+    uint32_t sinceRecoveryMs;   /* Time since the last recovery, 0 if none */
+} RAK3172_HealthStats_t;
+
+RAK3172_Status_t RAK3172_HealthInit(void);
+void RAK3172_HealthEnable(bool enable);
+void RAK3172_GetHealthStats(RAK3172_HealthStats_t *stats);
+
+#endif /* RAK3172_HEALTH_H */
@@ -0,0 +1,47 @@
+#ifndef RAK3172_JOIN_H
+#define RAK3172_JOIN_H
+
+#include "rak3172.h"
+
+/* OTAA join state machine.
+ * RAK3172_JoinStart() returns at once; one attempt at a time is made
+ * (AT+JOIN with a single module attempt) and its outcome is taken from the
+ * +EVT:JOINED / +EVT:JOIN_FAILED URCs. Failed attempts are retried after a
+ * jittered exponential backoff, up to RAK3172_JOIN_MAX_ATTEMPTS. Progress
+ * is published as RAK3172_EVENT_JOIN_* events. */
+
+typedef enum {
+    RAK3172_JOIN_IDLE,
+    RAK3172_JOIN_JOINING,       /* AT+JOIN sent, waiting for the URC */
+    RAK3172_JOIN_BACKOFF,       /* Waiting before the next attempt */
+    RAK3172_JOIN_JOINED,
+    RAK3172_JOIN_FAILED         /* Attempts exhausted */
+} RAK3172_JoinState_t;
+
+typedef struct {
+    RAK3172_JoinState_t state;
+    uint8_t attempt;            /* Current or last attempt, 1-based */
+    uint32_t elapsedMs;         /* Since RAK3172_JoinStart() */
+    uint32_t nextAttemptMs;     /* Backoff left */
+    uint32_t joins;             /* Successful joins */
+    uint32_t attempts;          /* AT+JOIN sent */
+    uint32_t failures;          /* Attempts refused or failed */
+    uint32_t timeouts;          /* Attempts without any URC */
+    uint8_t samples;            /* Latencies behind the percentiles */
+    uint32_t p50Ms;             /* Join latency, start to JOINED */
+    uint32_t p90Ms;
+    uint32_t p99Ms;
+} RAK3172_JoinStatus_t;
+
+RAK3172_Status_t RAK3172_JoinInit(void);
+RAK3172_Status_t RAK3172_JoinStart(void);
+RAK3172_Status_t RAK3172_JoinCancel(void);
+RAK3172_JoinState_t RAK3172_GetJoinState(void);
+void RAK3172_GetJoinStatus(RAK3172_JoinStatus_t *status);
+const char *RAK3172_JoinStateString(RAK3172_JoinState_t state);
+
+/* Called by the driver */
+void RAK3172_JoinHandleUrc(bool joined);
+void RAK3172_JoinReset(void);
+
+#endif /* RAK3172_JOIN_H */
@@ -0,0 +1,32 @@
+#ifndef RAK3172_LB_H
+#define RAK3172_LB_H
+
+#include "rak3172.h"
+
+/* Uplink load balancer over every opened module.
+ * Each uplink goes to a joined module whose duty-cycle off-time has run
+ * out, the one with the fewest uplinks in flight first (round robin on a
+ * tie). With two modules on the same sub-bands the uplink capacity under
+ * the duty-cycle limit doubles. Payloads are copied, the callback runs in
+ * the task of the module that sent it. */
+
+typedef struct {
+    uint32_t sent;              /* Accepted by the module */
+    uint32_t errors;            /* Refused or timed out */
+    uint32_t inFlight;
+} RAK3172_LbDevStats_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t noModule;          /* No joined module with budget */
+    uint32_t noSlot;            /* Every payload slot in flight */
+    RAK3172_LbDevStats_t dev[RAK3172_MAX_DEVICES];
+} RAK3172_LbStats_t;
+
+RAK3172_Status_t RAK3172_LbInit(void);
+RAK3172_Status_t RAK3172_LbJoin(void);
+RAK3172_Status_t RAK3172_LbSend(uint8_t port, const uint8_t *data, uint8_t length,
+                                RAK3172_CmdCallback_t callback, void *ctx);
+void RAK3172_GetLbStats(RAK3172_LbStats_t *stats);
+
+#endif /* RAK3172_LB_H */
@@ -0,0 +1,50 @@
+#ifndef RAK3172_LOG_H
+#define RAK3172_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Append-only ring log of uplink records on NOR flash.
+ * Only reaches the flash through RAK3172_FlashDev_t and needs neither the
+ * SDK nor FreeRTOS, so it runs unchanged against a simulated device.
+ * One record per page with its own CRC; a sector is erased only when the
+ * head wraps onto it, so erases rotate evenly over the whole region and a
+ * torn write costs one slot. The caller serializes access. */
+
+#define RAK3172_LOG_SLOT_SIZE       256u                            /* One flash page */
+#define RAK3172_LOG_HEADER_SIZE     12u
+#define RAK3172_LOG_MAX_DATA        (RAK3172_LOG_SLOT_SIZE - RAK3172_LOG_HEADER_SIZE)
+
+/* Flash access. Offsets are relative to the log region; program() gets
+ * whole, slot-aligned pages and may only clear bits, erase() one sector. */
+typedef struct {
+    uint32_t sectorSize;
+    uint32_t sectorCount;
+    void *ctx;
+    void (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+    bool (*program)(void *ctx, uint32_t offset, const void *data, size_t len);
+    bool (*erase)(void *ctx, uint32_t offset);
+} RAK3172_FlashDev_t;
+
+typedef struct {
+    const RAK3172_FlashDev_t *dev;
+    uint32_t slotCount;
+    uint32_t slotsPerSector;
+    uint32_t head;              /* Next slot to write */
+    uint32_t tail;              /* Oldest slot that may be pending */
+    uint32_t pending;           /* Records written and not consumed */
+    uint32_t nextSeq;
+    uint32_t erases;            /* Since init */
+    uint32_t dropped;           /* Pending records lost to a wrap */
+    uint32_t corrupt;           /* Torn or damaged slots skipped */
+    uint8_t page[RAK3172_LOG_SLOT_SIZE];
+} RAK3172_Log_t;
+
+bool RAK3172_LogInit(RAK3172_Log_t *log, const RAK3172_FlashDev_t *dev);
+bool RAK3172_LogAppend(RAK3172_Log_t *log, uint8_t port, const uint8_t *data, uint8_t length);
+bool RAK3172_LogPeek(RAK3172_Log_t *log, uint8_t *port, uint8_t *data, uint8_t *length);
+bool RAK3172_LogConsume(RAK3172_Log_t *log);
+bool RAK3172_LogClear(RAK3172_Log_t *log);
+
+#endif /* RAK3172_LOG_H */
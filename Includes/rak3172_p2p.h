@@ -0,0 +1,60 @@
+#ifndef RAK3172_P2P_H
+#define RAK3172_P2P_H
+
+#include "rak3172.h"
+
+/* LoRa P2P mode of the primary module.
+ * RAK3172_P2pStart() switches the module out of LoRaWAN, applies the
+ * radio settings in one AT+P2P and leaves it in continuous receive
+ * (AT+PRECV=RAK3172_P2P_PRECV_CONTINUOUS), which the module keeps across
+ * packets and transmissions: nothing has to be re-armed. Every
+ * +EVT:RXP2P is stamped with time_us_64() as it is decoded and stored in
+ * a fixed ring of RAK3172_P2P_RING_LEN packets; a full ring drops the new
+ * packet and counts it. One consumer task reads the ring. */
+
+typedef struct {
+    uint32_t freqHz;
+    uint8_t sf;                 /* 5-12 */
+    uint16_t bwKhz;             /* 125, 250 or 500 */
+    uint8_t cr;                 /* 0-3 for 4/5-4/8 */
+    uint16_t preamble;
+    int8_t txPower;             /* dBm */
+} RAK3172_P2pConfig_t;
+
+typedef struct {
+    uint64_t timestampUs;       /* time_us_64() when the packet was decoded */
+    uint32_t seq;               /* Packet number since RAK3172_P2pInit() */
+    int16_t rssi;
+    int8_t snr;
+    uint8_t length;
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+} RAK3172_P2pPacket_t;
+
+typedef struct {
+    bool running;               /* Module in continuous receive */
+    uint32_t received;          /* Packets decoded */
+    uint32_t delivered;         /* Packets read by the consumer */
+    uint32_t dropped;           /* Ring full */
+    uint16_t highWater;         /* Ring fill level */
+    uint32_t sent;
+    uint32_t sendErrors;
+    uint32_t busyRetries;       /* AT+PSEND refused while the radio was busy, sent again */
+    uint32_t txDoneMissing;     /* No +EVT:TXP2P DONE within the airtime, assumed sent */
+    uint64_t firstUs;           /* First and last packet since the stats were cleared */
+    uint64_t lastUs;
+} RAK3172_P2pStats_t;
+
+RAK3172_Status_t RAK3172_P2pInit(void);
+RAK3172_Status_t RAK3172_P2pStart(const RAK3172_P2pConfig_t *config);
+RAK3172_Status_t RAK3172_P2pStop(bool lorawan);
+RAK3172_Status_t RAK3172_P2pSend(const uint8_t *data, uint8_t length);
+uint32_t RAK3172_P2pAirtimeUs(uint8_t length);
+BaseType_t RAK3172_P2pRead(RAK3172_P2pPacket_t *packet, uint32_t timeout_ms);
+void RAK3172_P2pClearStats(void);
+void RAK3172_GetP2pStats(RAK3172_P2pStats_t *stats);
+
+/* Called by the driver */
+void RAK3172_P2pHandleRx(const RAK3172_RxData_t *rx);
+void RAK3172_P2pHandleTxDone(void);
+
+#endif /* RAK3172_P2P_H */
@@ -0,0 +1,17 @@
+#ifndef RAK3172_POOL_H
+#define RAK3172_POOL_H
+
+#include "rak3172.h"
+
+/* Fixed-block payload pool.
+ * Blocks are large enough for a RAK3172_RxData_t, allocation and release
+ * are O(1) (free-index stack) and safe from any task. */
+#define RAK3172_POOL_BLOCK_SIZE     sizeof(RAK3172_RxData_t)
+
+void RAK3172_PoolInit(void);
+RAK3172_PoolHandle_t RAK3172_PoolAlloc(void);
+void RAK3172_PoolFree(RAK3172_PoolHandle_t handle);
+void *RAK3172_PoolGet(RAK3172_PoolHandle_t handle);
+void RAK3172_GetPoolStats(RAK3172_PoolStats_t *stats);
+
+#endif /* RAK3172_POOL_H */
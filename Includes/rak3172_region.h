@@ -0,0 +1,66 @@
+#ifndef RAK3172_REGION_H
+#define RAK3172_REGION_H
+
+#include "rak3172.h"
+
+/* Regional parameters (LoRaWAN RP002-1.0.3), constant tables in flash.
+ * Looked up by the region and data rate the driver has set or read back,
+ * so payload limits and airtime are known without asking the module. */
+
+/* Radio settings of one data rate. sf == 0 is FSK, maxPayload == 0 marks
+ * a data rate the region does not allow for uplinks. */
+typedef struct {
+    uint8_t sf;                 /* Spreading factor 7..12 */
+    uint16_t bw_khz;            /* Bandwidth 125, 250 or 500 */
+    uint8_t cr;                 /* Coding rate 4/(4+cr), 1..4 */
+    uint8_t maxPayload;         /* Largest FRMPayload without FOpts */
+} RAK3172_DataRate_t;
+
+/* Evenly spaced uplink channels */
+typedef struct {
+    uint32_t firstFreq;         /* Hz */
+    uint32_t step;              /* Hz */
+    uint8_t count;
+} RAK3172_ChannelBlock_t;
+
+/* Regulatory sub-band with a duty-cycle limit */
+typedef struct {
+    const char *name;
+    uint32_t minFreq;
+    uint32_t maxFreq;
+    uint16_t dutyDivisor;       /* 100 for 1 %, 1000 for 0.1 % */
+} RAK3172_SubBand_t;
+
+typedef struct {
+    const char *name;
+    uint8_t bandCode;           /* AT+BAND value */
+    uint8_t defaultDr;
+    const RAK3172_DataRate_t *dataRates;
+    uint8_t numDataRates;
+    const RAK3172_ChannelBlock_t *channels;     /* Default channel plan */
+    uint8_t numChannelBlocks;
+    const RAK3172_SubBand_t *subBands;          /* Empty: no duty-cycle limit */
+    uint8_t numSubBands;
+} RAK3172_RegionInfo_t;
+
+typedef enum {
+    RAK3172_REGION_EU868,
+    RAK3172_REGION_US915,
+    RAK3172_REGION_AS923,
+    RAK3172_REGION_AU915,
+    RAK3172_REGION_IN865,
+    RAK3172_REGION_KR920,
+    RAK3172_REGION_COUNT
+} RAK3172_Region_t;
+
+RAK3172_Region_t RAK3172_GetRegion(void);
+const RAK3172_RegionInfo_t *RAK3172_GetRegionInfo(RAK3172_Region_t region);
+bool RAK3172_FindRegion(const char *name, RAK3172_Region_t *region);
+bool RAK3172_FindRegionByCode(uint8_t bandCode, RAK3172_Region_t *region);
+const RAK3172_DataRate_t *RAK3172_GetDataRateInfo(uint8_t dr);
+
+/* Called by the configuration shadow after AT+BAND was written */
+void RAK3172_RegionRefresh(void);
+uint8_t RAK3172_GetMaxPayload(void);
+
+#endif /* RAK3172_REGION_H */
@@ -0,0 +1,51 @@
+#ifndef RAK3172_RX_H
+#define RAK3172_RX_H
+
+#include "rak3172.h"
+
+/* Receive path between the UART IRQ and Task_RAK3172, no hardware access.
+ * A byte ring with a single producer (the IRQ, or a simulated module) and
+ * a single consumer (the task). The producer fills from a local copy of
+ * head and publishes it once per burst; the consumer cuts lines out of
+ * the ring in place of the old per-byte queue. */
+
+#define RAK3172_RX_RING_MASK    (RAK3172_RX_RING_SIZE - 1)
+
+typedef struct {
+    uint8_t data[RAK3172_RX_RING_SIZE];
+    volatile uint32_t head;             /* Written by the producer only */
+    volatile uint32_t tail;             /* Written by the consumer only */
+} RAK3172_RxRing_t;
+
+/* Line being assembled: CR dropped, cut at RAK3172_RX_BUFFER_SIZE - 1 */
+typedef struct {
+    char data[RAK3172_RX_BUFFER_SIZE];
+    uint16_t length;
+} RAK3172_RxLine_t;
+
+/* A complete line, NUL terminated, without its CR LF */
+typedef void (*RAK3172_LineHandler_t)(void *ctx, char *line, size_t length);
+
+/* Producer: store c at *head. Returns the fill level with it, 0 when the
+ * ring is full and c is dropped. */
+static inline uint32_t RAK3172_RxRingPush(RAK3172_RxRing_t *ring, uint32_t *head, uint8_t c)
+{
+    uint32_t fill = *head - ring->tail;
+
+    if(fill >= RAK3172_RX_RING_SIZE)
+        return 0;
+
+    ring->data[*head & RAK3172_RX_RING_MASK] = c;
+    (*head)++;
+    return fill + 1;
+}
+
+static inline bool RAK3172_RxRingEmpty(const RAK3172_RxRing_t *ring)
+{
+    return ring->head == ring->tail;
+}
+
+uint32_t RAK3172_RxSplit(RAK3172_RxRing_t *ring, RAK3172_RxLine_t *line,
+                         RAK3172_LineHandler_t handler, void *ctx);
+
+#endif /* RAK3172_RX_H */
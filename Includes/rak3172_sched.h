@@ -0,0 +1,46 @@
+#ifndef RAK3172_SCHED_H
+#define RAK3172_SCHED_H
+
+#include "rak3172.h"
+
+/* Duty-cycle aware uplink scheduler.
+ * Every uplink the module accepts is charged to a sub-band, which then
+ * stays off for airtime / duty cycle (the off-time rule the module itself
+ * applies). Queued uplinks leave in priority order, and only when a band
+ * is free, so the module never has to refuse them. Sub-bands come from the
+ * region table; regions without any are not limited. */
+
+/* Sub-band state as seen by the scheduler */
+typedef struct {
+    const char *name;
+    uint16_t dutyDivisor;       /* 100 for 1 %, 1000 for 0.1 % */
+    bool enabled;               /* At least one channel in the band */
+    uint32_t readyInMs;         /* Off-time left */
+    uint32_t usedMs;            /* Airtime in the current hour */
+    uint32_t budgetMs;          /* Airtime allowed per hour */
+} RAK3172_BandStatus_t;
+
+typedef struct {
+    uint32_t queued;            /* Uplinks accepted in the queue */
+    uint32_t rejected;          /* Queue full or payload too long */
+    uint32_t sent;              /* Uplinks accepted by the module */
+    uint32_t deferred;          /* Dispatches postponed for duty cycle */
+    uint32_t moduleBusy;        /* Refused by the module despite the budget */
+    uint32_t errors;            /* Dropped after another error */
+    uint32_t totalWaitMs;       /* Queue time of the uplinks sent */
+} RAK3172_SchedStats_t;
+
+RAK3172_Status_t RAK3172_SchedInit(void);
+RAK3172_Status_t RAK3172_SchedSend(uint8_t port, const uint8_t *data, uint8_t length, uint8_t priority);
+void RAK3172_GetSchedStats(RAK3172_SchedStats_t *stats);
+uint8_t RAK3172_GetBandStatus(RAK3172_BandStatus_t *bands, uint8_t max_bands);
+
+/* Duty-cycle accounting, used by the driver for every AT+SEND.
+ * Each module keeps its own off-time, the unprefixed calls are for the
+ * primary one. */
+uint32_t RAK3172_DevDutyCycleWaitMs(const RAK3172_Dev_t *dev);
+void RAK3172_DevDutyCycleCharge(const RAK3172_Dev_t *dev, uint32_t airtimeUs);
+uint32_t RAK3172_DutyCycleWaitMs(void);
+void RAK3172_DutyCycleCharge(uint32_t airtimeUs);
+
+#endif /* RAK3172_SCHED_H */
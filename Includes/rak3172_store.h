@@ -0,0 +1,40 @@
+#ifndef RAK3172_STORE_H
+#define RAK3172_STORE_H
+
+#include "rak3172.h"
+#include "rak3172_log.h"
+
+/* Store-and-forward uplinks.
+ * Records are appended to a ring log (rak3172_log.c) in the last
+ * RAK3172_STORE_SECTORS of the on-board flash, so they survive a reboot,
+ * and are sent oldest first whenever the device is joined and the duty
+ * cycle allows it. A record is marked sent only once the module accepts
+ * the uplink. Flash program and erase turn interrupts off, so all of it
+ * runs in a low-priority store task once the module is quiet; the
+ * driver task never waits on the flash. */
+
+typedef struct {
+    uint32_t queued;            /* Accepted, not yet in flash */
+    uint32_t pending;           /* Records waiting in flash */
+    uint32_t capacity;          /* Slots in the log */
+    uint32_t recovered;         /* Pending records found at boot */
+    uint32_t appended;
+    uint32_t drained;           /* Sent and marked */
+    uint32_t dropped;           /* Overwritten before being sent */
+    uint32_t rejected;          /* Refused by RAK3172_StoreSend() */
+    uint32_t sendErrors;        /* Uplinks the module refused for good */
+    uint32_t corrupt;           /* Torn or damaged slots seen */
+    uint32_t erases;
+    uint32_t noisyWrites;       /* Flash work after RAK3172_STORE_QUIET_MAX_MS without silence */
+    uint32_t appendUs;          /* Flash time of the appends, total */
+    uint32_t appendMaxUs;       /* Includes a sector erase */
+    uint32_t consumeUs;         /* Flash time of the sent marks, total */
+} RAK3172_StoreStats_t;
+
+RAK3172_Status_t RAK3172_StoreInit(void);
+RAK3172_Status_t RAK3172_StoreSend(uint8_t port, const uint8_t *data, uint8_t length);
+RAK3172_Status_t RAK3172_StoreDrain(void);
+RAK3172_Status_t RAK3172_StoreClear(void);
+void RAK3172_GetStoreStats(RAK3172_StoreStats_t *stats);
+
+#endif /* RAK3172_STORE_H */
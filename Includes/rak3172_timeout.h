@@ -0,0 +1,51 @@
+#ifndef RAK3172_TIMEOUT_H
+#define RAK3172_TIMEOUT_H
+
+#include "rak3172.h"
+
+/* Adaptive timeouts.
+ * Every command class keeps a smoothed latency and its mean deviation
+ * (Jacobson/Karels, as TCP does for its RTO). Once enough replies were
+ * seen the deadline is srtt + RAK3172_TMO_VAR_MULT * rttvar plus a fixed
+ * margin, kept between the class floor and ceiling; the timeout given by
+ * the caller stays the upper bound. A timeout doubles the class deadline
+ * until the next reply, so a slow spell does not keep failing. Latencies
+ * exclude the time spent on the wire (commands) or in the air (acks).
+ * Commands that restart the LoRaWAN stack or the radio take from a few
+ * ms to seconds; a learned deadline would cut them short and their late
+ * reply would complete the next command, so they keep the caller's. */
+
+typedef enum {
+    RAK3172_TMO_PING,           /* AT */
+    RAK3172_TMO_QUERY,          /* AT+XXX=? */
+    RAK3172_TMO_SET,            /* AT+XXX=value */
+    RAK3172_TMO_SEND,           /* AT+SEND reply */
+    RAK3172_TMO_JOIN,           /* AT+JOIN reply */
+    RAK3172_TMO_OTHER,
+    RAK3172_TMO_SLOW,           /* Restarts the stack or the radio, caller's timeout only */
+    RAK3172_TMO_JOIN_EVT,       /* AT+JOIN accepted to +EVT:JOINED / JOIN_FAILED */
+    RAK3172_TMO_ACK_EVT,        /* End of uplink to +EVT:SEND_CONFIRMED_* */
+    RAK3172_TMO_CLASS_COUNT
+} RAK3172_TmoClass_t;
+
+typedef struct {
+    const char *name;
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t srttMs;            /* Smoothed latency */
+    uint32_t rttvarMs;          /* Mean deviation */
+    uint32_t maxMs;             /* Largest latency seen */
+    uint32_t floorMs;
+    uint32_t ceilingMs;
+    uint32_t timeoutMs;         /* Deadline used now, 0 while still learning */
+    uint8_t backoff;            /* Doublings since the last reply */
+} RAK3172_TmoEntry_t;
+
+RAK3172_TmoClass_t RAK3172_TimeoutClassify(const char *cmd);
+uint32_t RAK3172_TimeoutGet(RAK3172_TmoClass_t cls, uint32_t max_ms);
+void RAK3172_TimeoutSample(RAK3172_TmoClass_t cls, uint32_t latency_ms);
+void RAK3172_TimeoutExpired(RAK3172_TmoClass_t cls);
+void RAK3172_TimeoutReset(void);
+uint8_t RAK3172_GetTimeoutTable(RAK3172_TmoEntry_t *entries, uint8_t max_entries);
+
+#endif /* RAK3172_TIMEOUT_H */
@@ -0,0 +1,41 @@
+#ifndef RAK3172_TX_H
+#define RAK3172_TX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Transmit channel of one RAK3172 UART, owned by its driver instance.
+ * uartIndex and done/ctx are set by the driver before init(), the port
+ * keeps its own state (DMA channel) in the rest.
+ */
+typedef struct xRAK3172_TX_CHANNEL
+{
+    uint8_t uartIndex;
+    void (*done)(void *ctx);
+    void *ctx;
+    int dmaChannel;
+} RAK3172_TxChannel_t;
+
+/**
+ * Transmit side of a RAK3172 UART.
+ * write() starts sending and returns at once, the buffer must stay valid
+ * while busy() reports true. Asynchronous ports call the channel's done
+ * callback when the transfer completes (from IRQ context on target). A
+ * host stand-in only has to implement these three functions.
+ */
+typedef struct xRAK3172_TX_PORT
+{
+    bool (*init)(RAK3172_TxChannel_t *chan);
+    bool (*write)(RAK3172_TxChannel_t *chan, const uint8_t * const data, size_t length);
+    bool (*busy)(RAK3172_TxChannel_t *chan);
+} RAK3172_TxPort_t;
+
+/* DMA channel feeding the UART TX FIFO, completion from DMA_IRQ_1 */
+extern const RAK3172_TxPort_t xRak3172DmaTx;
+
+/* Fallback when no DMA channel is free: uart_write_blocking */
+extern const RAK3172_TxPort_t xRak3172BlockingTx;
+
+#endif /* RAK3172_TX_H */
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "hardware/uart.h"
+#include "pico/stdio_usb.h"
 
 #define CLI_MAX_ARGS 10
 
@@ -261,12 +262,15 @@ void Task_CLI(void *pvParameters)
 {
     (void) pvParameters;
     
+    /* Wait for the USB host to open the port, without holding up the other tasks */
+    for(uint32_t i = 0; i < CLI_USB_CONNECT_TIMEOUT_MS / 10 && !stdio_usb_connected(); i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    
     printf("CLI Task started\n");
     printf("Free heap in CLI task: %u bytes\n", xPortGetFreeHeapSize());
     
-    // Attendre que le système soit stable
-    vTaskDelay(pdMS_TO_TICKS(500));
-    
     /* Register commands */
     FreeRTOS_CLIRegisterCommand(&xCommandDef_ps);
     FreeRTOS_CLIRegisterCommand(&xCommandDef_heapStat);
@@ -281,6 +285,19 @@ void Task_CLI(void *pvParameters)
     FreeRTOS_CLIRegisterCommand(&xCommandDef_rakSend);
     FreeRTOS_CLIRegisterCommand(&xCommandDef_rakAT);
     FreeRTOS_CLIRegisterCommand(&xCommandDef_rakReset);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakStats);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakBench);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakBatch);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakAirtime);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakStore);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakConfirm);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakLb);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakTimeouts);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakHealth);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakP2p);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakBulk);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakFrag);
+    FreeRTOS_CLIRegisterCommand(&xCommandDef_rakClassC);
 
     printf("Commands registered\n");
     
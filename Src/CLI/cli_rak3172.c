@@ -1,7 +1,24 @@
 #include "FreeRTOS.h"
 #include "task.h"
+#include "pico/stdlib.h"
 #include "cli_prv.h"
 #include "rak3172.h"
+#include "rak3172_pool.h"
+#include "rak3172_at.h"
+#include "rak3172_batch.h"
+#include "rak3172_sched.h"
+#include "rak3172_airtime.h"
+#include "rak3172_config.h"
+#include "rak3172_confirm.h"
+#include "rak3172_join.h"
+#include "rak3172_store.h"
+#include "rak3172_lb.h"
+#include "rak3172_timeout.h"
+#include "rak3172_health.h"
+#include "rak3172_p2p.h"
+#include "rak3172_bulk.h"
+#include "rak3172_frag.h"
+#include "rak3172_classc.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -14,10 +31,11 @@ static void prvRakVersionCommand(ConsoleIO_t * const pxConsoleIO,
                                  char * ppcArgv[])
 {
     char version[64];
+    RAK3172_LinkInfo_t xLink;
     
     pxConsoleIO->print("Getting RAK3172 version...\n");
     
-    if(RAK3172_GetVersion(version, sizeof(version)) == pdPASS)
+    if(RAK3172_GetVersion(version, sizeof(version)) == RAK3172_OK)
     {
         snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
                 "RAK3172 Firmware: %s\n", version);
@@ -27,6 +45,18 @@ static void prvRakVersionCommand(ConsoleIO_t * const pxConsoleIO,
     {
         pxConsoleIO->print("ERROR: Failed to get version\n");
     }
+    
+    RAK3172_GetLinkInfo(&xLink);
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "UART link: %lu baud%s\n",
+            (unsigned long)xLink.baud, xLink.upgraded ? " (negotiated)" : "");
+    pxConsoleIO->print(pcCliScratchBuffer);
+    
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "Last boot: ready after %lu ms (%s), first command OK after %lu ms\n",
+            (unsigned long)xLink.bootMs, xLink.bannerSeen ? "banner" : "AT",
+            (unsigned long)xLink.firstCmdMs);
+    pxConsoleIO->print(pcCliScratchBuffer);
 }
 
 const CLI_Command_Definition_t xCommandDef_rakVersion =
@@ -38,67 +68,114 @@ const CLI_Command_Definition_t xCommandDef_rakVersion =
     prvRakVersionCommand
 };
 
+/* Print the configuration shadow without touching the UART */
+static void prvRakConfigShow(ConsoleIO_t * const pxConsoleIO)
+{
+    char value[RAK3172_CFG_VALUE_LEN];
+    RAK3172_ConfigStats_t xStats;
+    
+    pxConsoleIO->print("\nRAK3172 configuration shadow:\n");
+    
+    for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+    {
+        bool dirty = false;
+        bool known = RAK3172_ConfigPeek((RAK3172_ConfigItem_t)i, value, sizeof(value), &dirty);
+        
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "  %-8s %s%s\n",
+                RAK3172_ConfigName((RAK3172_ConfigItem_t)i),
+                known ? value : "(not read)",
+                dirty ? " (dirty)" : "");
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    RAK3172_GetConfigStats(&xStats);
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "Hits %lu, misses %lu, writes %lu, skipped %lu, invalidations %lu\n\n",
+            (unsigned long)xStats.hits,
+            (unsigned long)xStats.misses,
+            (unsigned long)xStats.writes,
+            (unsigned long)xStats.skipped,
+            (unsigned long)xStats.invalidations);
+    pxConsoleIO->print(pcCliScratchBuffer);
+}
+
 /* Command: rak-config - Configure LoRaWAN credentials */
 static void prvRakConfigCommand(ConsoleIO_t * const pxConsoleIO,
                                 uint32_t ulArgc,
                                 char * ppcArgv[])
 {
+    if(ulArgc == 2 && strcmp(ppcArgv[1], "show") == 0)
+    {
+        prvRakConfigShow(pxConsoleIO);
+        return;
+    }
+    
     if(ulArgc < 4)
     {
         pxConsoleIO->print("Usage: rak-config <deveui> <appeui> <appkey>\n");
+        pxConsoleIO->print("       rak-config show\n");
         pxConsoleIO->print("Example: rak-config 0000000000000000 0000000000000000 00000000000000000000000000000000\n");
         return;
     }
     
-    const char *deveui = ppcArgv[1];
-    const char *appeui = ppcArgv[2];
-    const char *appkey = ppcArgv[3];
+    static const RAK3172_ConfigItem_t xItems[] = { RAK3172_CFG_DEVEUI, RAK3172_CFG_APPEUI, RAK3172_CFG_APPKEY };
+    RAK3172_Status_t xItemStatus[RAK3172_CFG_COUNT];
+    bool xWritten[3] = { false, false, false };
+    RAK3172_Status_t xStatus = RAK3172_OK;
+    uint32_t ulElapsed = 0;
     
     pxConsoleIO->print("Configuring RAK3172...\n");
     
-    if(RAK3172_SetDevEUI(deveui) == pdPASS)
+    /* Values the module already holds are not written again */
+    for(int i = 0; i < 3 && xStatus == RAK3172_OK; i++)
     {
-        pxConsoleIO->print("DevEUI set OK\n");
+        xStatus = RAK3172_ConfigStage(xItems[i], ppcArgv[1 + i]);
+        if(xStatus == RAK3172_OK)
+        {
+            char value[RAK3172_CFG_VALUE_LEN];
+            RAK3172_ConfigPeek(xItems[i], value, sizeof(value), &xWritten[i]);
+        }
     }
-    else
-    {
-        pxConsoleIO->print("ERROR: Failed to set DevEUI\n");
-        return;
-    }
-    
-    vTaskDelay(pdMS_TO_TICKS(100));
     
-    if(RAK3172_SetAppEUI(appeui) == pdPASS)
-    {
-        pxConsoleIO->print("AppEUI set OK\n");
-    }
-    else
+    if(xStatus != RAK3172_OK)
     {
-        pxConsoleIO->print("ERROR: Failed to set AppEUI\n");
+        pxConsoleIO->print("ERROR: Invalid value\n");
         return;
     }
     
-    vTaskDelay(pdMS_TO_TICKS(100));
+    /* One transaction, stops and rolls back on the first error */
+    xStatus = RAK3172_ConfigCommit(xItemStatus, &ulElapsed);
     
-    if(RAK3172_SetAppKey(appkey) == pdPASS)
+    for(int i = 0; i < 3; i++)
     {
-        pxConsoleIO->print("AppKey set OK\n");
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "%-8s %s\n",
+                RAK3172_ConfigName(xItems[i]),
+                !xWritten[i] ? "unchanged" : RAK3172_StatusString(xItemStatus[xItems[i]]));
+        pxConsoleIO->print(pcCliScratchBuffer);
     }
-    else
+    
+    if(xStatus != RAK3172_OK)
     {
-        pxConsoleIO->print("ERROR: Failed to set AppKey\n");
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: Configuration failed (%s), rolled back\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
         return;
     }
     
-    pxConsoleIO->print("Configuration complete!\n");
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "Configuration complete! (%lu ms)\n", (unsigned long)ulElapsed);
+    pxConsoleIO->print(pcCliScratchBuffer);
 }
 
 const CLI_Command_Definition_t xCommandDef_rakConfig =
 {
     "rak-config",
     "rak-config:\n"
-    "  Configure LoRaWAN credentials\n"
+    "  Configure LoRaWAN credentials, or show the cached module settings\n"
     "  Usage: rak-config <deveui> <appeui> <appkey>\n"
+    "         rak-config show\n"
     "  Example: rak-config 0000000000000000 0000000000000000 00000000000000000000000000000000\n\n",
     prvRakConfigCommand
 };
@@ -108,16 +185,70 @@ static void prvRakJoinCommand(ConsoleIO_t * const pxConsoleIO,
                               uint32_t ulArgc,
                               char * ppcArgv[])
 {
-    pxConsoleIO->print("Joining LoRaWAN network...\n");
-    pxConsoleIO->print("This may take up to 30 seconds...\n");
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 2 && strcmp(ppcArgv[1], "status") == 0)
+    {
+        RAK3172_JoinStatus_t xJoin;
+        char pcBuffer[512];
+        
+        RAK3172_GetJoinStatus(&xJoin);
+        
+        snprintf(pcBuffer, sizeof(pcBuffer),
+                "\nRAK3172 join:\n"
+                "  State:            %s\n"
+                "  Attempt:          %u/%d\n"
+                "  Elapsed:          %10lu ms\n"
+                "  Next attempt in:  %10lu ms\n"
+                "  Joins:            %10lu\n"
+                "  Attempts:         %10lu\n"
+                "  Failures:         %10lu\n"
+                "  Timeouts:         %10lu\n"
+                "  Latency p50/p90/p99: %lu / %lu / %lu ms (%u samples)\n\n",
+                RAK3172_JoinStateString(xJoin.state),
+                (unsigned int)xJoin.attempt,
+                RAK3172_JOIN_MAX_ATTEMPTS,
+                (unsigned long)xJoin.elapsedMs,
+                (unsigned long)xJoin.nextAttemptMs,
+                (unsigned long)xJoin.joins,
+                (unsigned long)xJoin.attempts,
+                (unsigned long)xJoin.failures,
+                (unsigned long)xJoin.timeouts,
+                (unsigned long)xJoin.p50Ms,
+                (unsigned long)xJoin.p90Ms,
+                (unsigned long)xJoin.p99Ms,
+                (unsigned int)xJoin.samples);
+        pxConsoleIO->print(pcBuffer);
+        return;
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "cancel") == 0)
+    {
+        xStatus = RAK3172_JoinCancel();
+    }
+    else if(ulArgc == 1)
+    {
+        xStatus = RAK3172_JoinStart();
+        if(xStatus == RAK3172_OK)
+        {
+            pxConsoleIO->print("Joining LoRaWAN network in the background, see rak-join status\n");
+            return;
+        }
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-join [status | cancel]\n");
+        return;
+    }
     
-    if(RAK3172_Join(30000) == pdPASS)
+    if(xStatus == RAK3172_OK)
     {
-        pxConsoleIO->print("Successfully joined LoRaWAN network!\n");
+        pxConsoleIO->print("OK\n");
     }
     else
     {
-        pxConsoleIO->print("ERROR: Failed to join network\n");
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
     }
 }
 
@@ -125,8 +256,8 @@ const CLI_Command_Definition_t xCommandDef_rakJoin =
 {
     "rak-join",
     "rak-join:\n"
-    "  Join LoRaWAN network\n"
-    "  Usage: rak-join\n\n",
+    "  Start joining the LoRaWAN network, show join progress or stop joining\n"
+    "  Usage: rak-join [status | cancel]\n\n",
     prvRakJoinCommand
 };
 
@@ -146,32 +277,37 @@ static void prvRakSendCommand(ConsoleIO_t * const pxConsoleIO,
     const char *hexData = ppcArgv[2];
     
     /* Convert hex string to bytes */
-    uint16_t dataLen = strlen(hexData) / 2;
+    size_t hexLen = strlen(hexData);
     uint8_t data[RAK3172_MAX_PAYLOAD];
     
-    if(dataLen > RAK3172_MAX_PAYLOAD)
+    if(hexLen / 2 > RAK3172_MAX_PAYLOAD)
     {
         pxConsoleIO->print("ERROR: Data too long (max 255 bytes)\n");
         return;
     }
     
-    for(uint16_t i = 0; i < dataLen; i++)
+    int32_t lDecoded = RAK3172_HexDecode(hexData, hexLen, data, sizeof(data));
+    if(lDecoded <= 0)
     {
-        char byteStr[3] = {hexData[i*2], hexData[i*2+1], '\0'};
-        data[i] = (uint8_t)strtol(byteStr, NULL, 16);
+        pxConsoleIO->print("ERROR: Invalid hex data\n");
+        return;
     }
+    uint16_t dataLen = (uint16_t)lDecoded;
     
     snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
             "Sending %d bytes on port %d...\n", dataLen, port);
     pxConsoleIO->print(pcCliScratchBuffer);
     
-    if(RAK3172_SendDataUnconfirmed(port, data, dataLen) == pdPASS)
+    RAK3172_Status_t xStatus = RAK3172_SendDataUnconfirmed(port, data, dataLen);
+    if(xStatus == RAK3172_OK)
     {
         pxConsoleIO->print("Data sent successfully!\n");
     }
     else
     {
-        pxConsoleIO->print("ERROR: Failed to send data\n");
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: Failed to send data (%s)\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
     }
 }
 
@@ -207,13 +343,19 @@ static void prvRakATCommand(ConsoleIO_t * const pxConsoleIO,
     }
     
     char response[512];
-    if(RAK3172_SendCommand(cmd, response, 5000) == pdPASS)
+    RAK3172_Status_t xStatus = RAK3172_SendCommand(cmd, response, sizeof(response), 5000);
+    
+    pxConsoleIO->print(response);
+    
+    if(xStatus == RAK3172_OK)
     {
-        pxConsoleIO->print(response);
+        pxConsoleIO->print("OK\n");
     }
     else
     {
-        pxConsoleIO->print("ERROR: Command timeout\n");
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
     }
 }
 
@@ -251,4 +393,1490 @@ const CLI_Command_Definition_t xCommandDef_rakReset =
     "  Perform hardware reset of RAK3172\n"
     "  Usage: rak-reset\n\n",
     prvRakResetCommand
-};
\ No newline at end of file
+};
+
+/* Command: rak-stats - Show RAK3172 driver statistics */
+static void prvRakStatsCommand(ConsoleIO_t * const pxConsoleIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[])
+{
+    char pcBuffer[512];
+    RAK3172_UartStats_t xStats;
+    RAK3172_CmdStats_t xCmdStats;
+    RAK3172_PoolStats_t xPoolStats;
+    
+    RAK3172_LinkInfo_t xLink;
+    
+    RAK3172_GetUartStats(&xStats);
+    RAK3172_GetCmdStats(&xCmdStats);
+    RAK3172_GetPoolStats(&xPoolStats);
+    RAK3172_GetLinkInfo(&xLink);
+    
+    snprintf(pcBuffer, sizeof(pcBuffer),
+            "\nRAK3172 UART (%lu baud):\n"
+            "  Bytes received:   %10lu\n"
+            "  Lines received:   %10lu\n"
+            "  Ring drops:       %10lu\n"
+            "  HW FIFO overruns: %10lu\n"
+            "  Ring high-water:  %5u / %u\n"
+            "  TX bytes:         %10lu\n"
+            "  TX via DMA:       %10lu\n"
+            "  AT RTT at boot:   %10lu us\n"
+            "  AT RTT now:       %10lu us\n\n",
+            (unsigned long)xLink.baud,
+            (unsigned long)xStats.rxBytes,
+            (unsigned long)xStats.rxLines,
+            (unsigned long)xStats.ringDrops,
+            (unsigned long)xStats.hwOverruns,
+            (unsigned int)xStats.ringHighWater,
+            (unsigned int)RAK3172_RX_RING_SIZE,
+            (unsigned long)xStats.txBytes,
+            (unsigned long)xStats.txDma,
+            (unsigned long)xLink.rttBeforeUs,
+            (unsigned long)xLink.rttAfterUs);
+    pxConsoleIO->print(pcBuffer);
+    
+    uint32_t ulDone = xCmdStats.completed ? xCmdStats.completed : 1;
+    snprintf(pcBuffer, sizeof(pcBuffer),
+            "RAK3172 commands:\n"
+            "  Submitted:        %10lu\n"
+            "  Completed:        %10lu\n"
+            "  Timeouts:         %10lu\n"
+            "  Queue full:       %10lu\n"
+            "  Queue high-water: %5lu / %u\n"
+            "  Avg queue wait:   %10lu ms\n"
+            "  Avg execution:    %10lu ms\n"
+            "  Events dropped:   %10lu\n"
+            "  Busy replies:     %10lu\n"
+            "  RX window cycles: %10lu\n"
+            "  Held for RX:      %10lu (avg %lu ms, max %lu ms)\n"
+            "  RX hold overflow: %10lu\n"
+            "  AT+CFM switches:  %10lu\n\n",
+            (unsigned long)xCmdStats.submitted,
+            (unsigned long)xCmdStats.completed,
+            (unsigned long)xCmdStats.timeouts,
+            (unsigned long)xCmdStats.queueFull,
+            (unsigned long)xCmdStats.queueHighWater,
+            (unsigned int)RAK3172_CMD_QUEUE_LEN,
+            (unsigned long)(xCmdStats.totalWaitMs / ulDone),
+            (unsigned long)(xCmdStats.totalExecMs / ulDone),
+            (unsigned long)xCmdStats.eventDrops,
+            (unsigned long)xCmdStats.busy,
+            (unsigned long)xCmdStats.rxWinCycles,
+            (unsigned long)xCmdStats.rxWinHeld,
+            (unsigned long)(xCmdStats.rxWinHeld ? xCmdStats.rxWinHeldMs / xCmdStats.rxWinHeld : 0),
+            (unsigned long)xCmdStats.rxWinHeldMaxMs,
+            (unsigned long)xCmdStats.rxWinOverflow,
+            (unsigned long)xCmdStats.cfmSwitches);
+    pxConsoleIO->print(pcBuffer);
+    
+    snprintf(pcBuffer, sizeof(pcBuffer),
+            "RAK3172 payload pool (%u x %u bytes):\n"
+            "  In use:           %5u\n"
+            "  High-water:       %5u\n"
+            "  Allocations:      %10lu\n"
+            "  Failures:         %10lu\n\n",
+            (unsigned int)RAK3172_POOL_BLOCKS,
+            (unsigned int)RAK3172_POOL_BLOCK_SIZE,
+            (unsigned int)xPoolStats.inUse,
+            (unsigned int)xPoolStats.highWater,
+            (unsigned long)xPoolStats.allocs,
+            (unsigned long)xPoolStats.failures);
+    pxConsoleIO->print(pcBuffer);
+}
+
+const CLI_Command_Definition_t xCommandDef_rakStats =
+{
+    "rak-stats",
+    "rak-stats:\n"
+    "  Show RAK3172 driver statistics\n"
+    "  Usage: rak-stats\n\n",
+    prvRakStatsCommand
+};
+
+#define RAK_BENCH_MAX_TASKS     8
+
+/* One submitter task of rak-bench sim */
+typedef struct {
+    RAK3172_Dev_t *dev;
+    uint32_t count;
+    uint32_t done;
+    uint32_t failed;
+    uint32_t queueFull;         /* Refused submissions, tried again */
+    uint32_t totalUs;
+    uint32_t maxUs;
+} RakBenchSubmitter_t;
+
+static RakBenchSubmitter_t xBenchSubmitters[RAK_BENCH_MAX_TASKS];
+static TaskHandle_t xBenchWaiter;
+
+static void prvRakBenchSubmitterTask(void *pvParameters)
+{
+    RakBenchSubmitter_t *pxSub = (RakBenchSubmitter_t *)pvParameters;
+    
+    while(pxSub->done + pxSub->failed < pxSub->count)
+    {
+        uint32_t ulStart = time_us_32();
+        RAK3172_Status_t xStatus = RAK3172_DevSendCommand(pxSub->dev, "AT", NULL, 0, 1000);
+        uint32_t ulUs = time_us_32() - ulStart;
+        
+        if(xStatus == RAK3172_ERR_QUEUE_FULL)
+        {
+            pxSub->queueFull++;
+            vTaskDelay(1);
+            continue;
+        }
+        
+        if(xStatus != RAK3172_OK)
+        {
+            pxSub->failed++;
+            continue;
+        }
+        
+        pxSub->done++;
+        pxSub->totalUs += ulUs;
+        if(ulUs > pxSub->maxUs)
+            pxSub->maxUs = ulUs;
+    }
+    
+    xTaskNotifyGiveIndexed(xBenchWaiter, RAK3172_NOTIFY_INDEX);
+    vTaskDelete(NULL);
+}
+
+/* ulTasks tasks each send ulCount commands through the queue at once,
+ * answered by the driver instead of the module */
+static void prvRakBenchSim(ConsoleIO_t * const pxConsoleIO, uint32_t ulTasks, uint32_t ulCount)
+{
+    RAK3172_Dev_t *dev = RAK3172_GetDev(0);
+    RAK3172_CmdStats_t xBefore, xAfter;
+    uint32_t ulStarted = 0, ulFinished = 0;
+    
+    memset(xBenchSubmitters, 0, sizeof(xBenchSubmitters));
+    xBenchWaiter = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, 0);
+    
+    RAK3172_DevGetCmdStats(dev, &xBefore);
+    RAK3172_DevSimulateModule(dev, true);
+    uint64_t ullStart = time_us_64();
+    
+    for(uint32_t i = 0; i < ulTasks; i++)
+    {
+        xBenchSubmitters[i].dev = dev;
+        xBenchSubmitters[i].count = ulCount;
+        if(xTaskCreate(prvRakBenchSubmitterTask, "RAKBench", 384, &xBenchSubmitters[i],
+                       uxTaskPriorityGet(NULL), NULL) != pdPASS)
+            break;
+        ulStarted++;
+    }
+    
+    /* Every command completes, at the latest on its deadline */
+    while(ulFinished < ulStarted)
+        ulFinished += ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+    
+    uint32_t ulElapsedUs = (uint32_t)(time_us_64() - ullStart);
+    RAK3172_DevSimulateModule(dev, false);
+    RAK3172_DevGetCmdStats(dev, &xAfter);
+    
+    if(ulStarted < ulTasks)
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "WARNING: only %lu submitter tasks started\n", (unsigned long)ulStarted);
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    uint32_t ulDone = 0;
+    for(uint32_t i = 0; i < ulStarted; i++)
+    {
+        RakBenchSubmitter_t *pxSub = &xBenchSubmitters[i];
+        
+        ulDone += pxSub->done;
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "  Task %lu: %lu done, %lu failed, %lu queue full, avg %lu us, max %lu us\n",
+                (unsigned long)i, (unsigned long)pxSub->done, (unsigned long)pxSub->failed,
+                (unsigned long)pxSub->queueFull,
+                (unsigned long)(pxSub->done ? pxSub->totalUs / pxSub->done : 0),
+                (unsigned long)pxSub->maxUs);
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    uint32_t ulCompleted = xAfter.completed - xBefore.completed;
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "%lu commands from %lu tasks in %lu ms: %lu commands/s\n"
+            "Queue: avg wait %lu ms, high water %lu/%d\n",
+            (unsigned long)ulDone, (unsigned long)ulStarted, (unsigned long)(ulElapsedUs / 1000),
+            (unsigned long)(ulElapsedUs ? (uint64_t)ulDone * 1000000 / ulElapsedUs : 0),
+            (unsigned long)(ulCompleted ? (xAfter.totalWaitMs - xBefore.totalWaitMs) / ulCompleted : 0),
+            (unsigned long)xAfter.queueHighWater, RAK3172_CMD_QUEUE_LEN);
+    pxConsoleIO->print(pcCliScratchBuffer);
+}
+
+/* Command: rak-bench - Measure AT command round trip */
+static void prvRakBenchCommand(ConsoleIO_t * const pxConsoleIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[])
+{
+    if(ulArgc >= 2 && strcmp(ppcArgv[1], "sim") == 0)
+    {
+        uint32_t ulTasks = (ulArgc > 2) ? (uint32_t)atoi(ppcArgv[2]) : 4;
+        uint32_t ulCount = (ulArgc > 3) ? (uint32_t)atoi(ppcArgv[3]) : 100;
+        
+        if(ulTasks == 0 || ulTasks > RAK_BENCH_MAX_TASKS || ulCount == 0 || ulCount > 10000)
+        {
+            pxConsoleIO->print("Usage: rak-bench sim [tasks] [count] (1-8, 1-10000)\n");
+            return;
+        }
+        
+        prvRakBenchSim(pxConsoleIO, ulTasks, ulCount);
+        return;
+    }
+    
+    uint32_t ulCount = (ulArgc > 1) ? (uint32_t)atoi(ppcArgv[1]) : 20;
+    uint32_t ulMin = UINT32_MAX, ulMax = 0, ulTotal = 0, ulFailed = 0;
+    RAK3172_LinkInfo_t xLink;
+    
+    if(ulCount == 0 || ulCount > 1000)
+    {
+        pxConsoleIO->print("Usage: rak-bench [count] (1-1000) | sim [tasks] [count]\n");
+        return;
+    }
+    
+    RAK3172_GetLinkInfo(&xLink);
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "Pinging RAK3172 %lu times at %lu baud...\n",
+            (unsigned long)ulCount, (unsigned long)xLink.baud);
+    pxConsoleIO->print(pcCliScratchBuffer);
+    
+    for(uint32_t i = 0; i < ulCount; i++)
+    {
+        uint32_t ulRtt;
+        
+        if(RAK3172_Ping(&ulRtt) != RAK3172_OK)
+        {
+            ulFailed++;
+            continue;
+        }
+        
+        ulTotal += ulRtt;
+        if(ulRtt < ulMin)
+            ulMin = ulRtt;
+        if(ulRtt > ulMax)
+            ulMax = ulRtt;
+    }
+    
+    if(ulFailed == ulCount)
+    {
+        pxConsoleIO->print("ERROR: No response from RAK3172\n");
+        return;
+    }
+    
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "AT round trip: min %lu us, avg %lu us, max %lu us, %lu failed\n",
+            (unsigned long)ulMin,
+            (unsigned long)(ulTotal / (ulCount - ulFailed)),
+            (unsigned long)ulMax,
+            (unsigned long)ulFailed);
+    pxConsoleIO->print(pcCliScratchBuffer);
+    
+    if(xLink.rttBeforeUs)
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "At %d baud (boot): avg %lu us\n",
+                RAK3172_BAUD_RATE, (unsigned long)xLink.rttBeforeUs);
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakBench =
+{
+    "rak-bench",
+    "rak-bench:\n"
+    "  Measure AT command round trip on the current UART link, or the command\n"
+    "  queue throughput with several submitter tasks against a simulated module\n"
+    "  Usage: rak-bench [count] | sim [tasks] [count]\n\n",
+    prvRakBenchCommand
+};
+
+/* Command: rak-batch - Aggregate small records into one uplink */
+static void prvRakBatchCommand(ConsoleIO_t * const pxConsoleIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 3 && strcmp(ppcArgv[1], "add") == 0)
+    {
+        uint8_t record[RAK3172_MAX_PAYLOAD];
+        int32_t lDecoded = RAK3172_HexDecode(ppcArgv[2], strlen(ppcArgv[2]), record, sizeof(record));
+        
+        if(lDecoded <= 0)
+        {
+            pxConsoleIO->print("ERROR: Invalid hex data\n");
+            return;
+        }
+        
+        xStatus = RAK3172_BatchAdd(record, (uint8_t)lDecoded);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "flush") == 0)
+    {
+        xStatus = RAK3172_BatchFlush();
+    }
+    else if(ulArgc == 1)
+    {
+        RAK3172_BatchStats_t xStats;
+        char pcBuffer[512];
+        
+        RAK3172_GetBatchStats(&xStats);
+        
+        uint32_t ulFrames = xStats.frames ? xStats.frames : 1;
+        snprintf(pcBuffer, sizeof(pcBuffer),
+                "\nRAK3172 uplink batching (port %d, DR%u):\n"
+                "  Records:          %10lu\n"
+                "  Rejected:         %10lu\n"
+                "  Frames:           %10lu\n"
+                "  Records/frame:    %6lu.%02lu\n"
+                "  Bytes sent:       %10lu\n"
+                "  Flush size/age/explicit: %lu / %lu / %lu\n"
+                "  Send errors:      %10lu (%lu retries)\n"
+                "  Records lost:     %10lu\n"
+                "  Airtime used:     %10lu ms\n"
+                "  Airtime saved:    %10lu ms\n\n",
+                RAK3172_BATCH_PORT,
+                (unsigned int)RAK3172_GetDataRate(),
+                (unsigned long)xStats.records,
+                (unsigned long)xStats.rejected,
+                (unsigned long)xStats.frames,
+                (unsigned long)(xStats.records / ulFrames),
+                (unsigned long)((xStats.records % ulFrames) * 100 / ulFrames),
+                (unsigned long)xStats.bytes,
+                (unsigned long)xStats.flushSize,
+                (unsigned long)xStats.flushAge,
+                (unsigned long)xStats.flushExplicit,
+                (unsigned long)xStats.sendErrors,
+                (unsigned long)xStats.retries,
+                (unsigned long)xStats.recordsLost,
+                (unsigned long)xStats.airtimeMs,
+                (unsigned long)xStats.airtimeSavedMs);
+        pxConsoleIO->print(pcBuffer);
+        return;
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-batch [add <hex_record> | flush]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakBatch =
+{
+    "rak-batch",
+    "rak-batch:\n"
+    "  Pack small records into one uplink, or show batching statistics\n"
+    "  Usage: rak-batch [add <hex_record> | flush]\n"
+    "  Example: rak-batch add 0102A0\n\n",
+    prvRakBatchCommand
+};
+
+/* Command: rak-airtime - Duty-cycle budget per sub-band */
+static void prvRakAirtimeCommand(ConsoleIO_t * const pxConsoleIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[])
+{
+    RAK3172_BandStatus_t xBands[8];
+    RAK3172_SchedStats_t xStats;
+    uint8_t ucDr = RAK3172_GetDataRate();
+    
+    uint8_t ucMax = RAK3172_GetMaxPayload();
+    
+    uint8_t ucCount = RAK3172_GetBandStatus(xBands, sizeof(xBands) / sizeof(xBands[0]));
+    RAK3172_GetSchedStats(&xStats);
+    
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "\n%s DR%u: %lu ms on air for 10 bytes, %lu ms for %u bytes\n\n",
+            RAK3172_GetRegionInfo(RAK3172_GetRegion())->name,
+            (unsigned int)ucDr,
+            (unsigned long)(RAK3172_UplinkAirtimeUs(ucDr, 10) / 1000),
+            (unsigned long)(RAK3172_UplinkAirtimeUs(ucDr, ucMax) / 1000),
+            (unsigned int)ucMax);
+    pxConsoleIO->print(pcCliScratchBuffer);
+    
+    if(ucCount == 0)
+    {
+        pxConsoleIO->print("No duty-cycle limit in this region\n");
+    }
+    else
+    {
+        pxConsoleIO->print("Band  Duty    Ready in   Used/hour   Budget/hour\n");
+    }
+    
+    for(uint8_t i = 0; i < ucCount; i++)
+    {
+        if(!xBands[i].enabled)
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "%-4s  %3u.%u%%  (no channel)\n",
+                    xBands[i].name,
+                    100 / xBands[i].dutyDivisor, (1000 / xBands[i].dutyDivisor) % 10);
+        }
+        else
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "%-4s  %3u.%u%%  %7lu ms  %7lu ms  %9lu ms\n",
+                    xBands[i].name,
+                    100 / xBands[i].dutyDivisor, (1000 / xBands[i].dutyDivisor) % 10,
+                    (unsigned long)xBands[i].readyInMs,
+                    (unsigned long)xBands[i].usedMs,
+                    (unsigned long)xBands[i].budgetMs);
+        }
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    uint32_t ulSent = xStats.sent ? xStats.sent : 1;
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "\nScheduler: %lu queued, %lu sent, %lu deferred, %lu refused by module, "
+            "%lu errors, %lu rejected, avg wait %lu ms\n\n",
+            (unsigned long)xStats.queued,
+            (unsigned long)xStats.sent,
+            (unsigned long)xStats.deferred,
+            (unsigned long)xStats.moduleBusy,
+            (unsigned long)xStats.errors,
+            (unsigned long)xStats.rejected,
+            (unsigned long)(xStats.totalWaitMs / ulSent));
+    pxConsoleIO->print(pcCliScratchBuffer);
+}
+
+const CLI_Command_Definition_t xCommandDef_rakAirtime =
+{
+    "rak-airtime",
+    "rak-airtime:\n"
+    "  Show remaining duty-cycle budget per sub-band and scheduler counters\n"
+    "  Usage: rak-airtime\n\n",
+    prvRakAirtimeCommand
+};
+/* Command: rak-store - Flash-backed uplink queue */
+static void prvRakStoreCommand(ConsoleIO_t * const pxConsoleIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 4 && strcmp(ppcArgv[1], "add") == 0)
+    {
+        uint8_t record[RAK3172_LOG_MAX_DATA];
+        int port = atoi(ppcArgv[2]);
+        int32_t lDecoded = RAK3172_HexDecode(ppcArgv[3], strlen(ppcArgv[3]), record, sizeof(record));
+        
+        if(port < 1 || port > 223)
+        {
+            pxConsoleIO->print("ERROR: Port must be 1-223\n");
+            return;
+        }
+        
+        if(lDecoded <= 0)
+        {
+            pxConsoleIO->print("ERROR: Invalid hex data\n");
+            return;
+        }
+        
+        xStatus = RAK3172_StoreSend((uint8_t)port, record, (uint8_t)lDecoded);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "drain") == 0)
+    {
+        xStatus = RAK3172_StoreDrain();
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "clear") == 0)
+    {
+        xStatus = RAK3172_StoreClear();
+    }
+    else if(ulArgc == 1)
+    {
+        RAK3172_StoreStats_t xStats;
+        char pcBuffer[512];
+        
+        RAK3172_GetStoreStats(&xStats);
+        
+        uint32_t ulAppends = xStats.appended ? xStats.appended : 1;
+        uint32_t ulDrained = xStats.drained ? xStats.drained : 1;
+        snprintf(pcBuffer, sizeof(pcBuffer),
+                "\nRAK3172 uplink store (%d KiB flash):\n"
+                "  Queued:           %10lu\n"
+                "  Pending:          %10lu / %lu\n"
+                "  Recovered:        %10lu\n"
+                "  Appended:         %10lu\n"
+                "  Drained:          %10lu\n"
+                "  Dropped:          %10lu\n"
+                "  Rejected:         %10lu\n"
+                "  Send errors:      %10lu\n"
+                "  Corrupt slots:    %10lu\n"
+                "  Sector erases:    %10lu\n"
+                "  Noisy writes:     %10lu\n"
+                "  Append avg/max:   %lu / %lu us\n"
+                "  Mark sent avg:    %10lu us\n\n",
+                RAK3172_STORE_SECTORS * 4,
+                (unsigned long)xStats.queued,
+                (unsigned long)xStats.pending,
+                (unsigned long)xStats.capacity,
+                (unsigned long)xStats.recovered,
+                (unsigned long)xStats.appended,
+                (unsigned long)xStats.drained,
+                (unsigned long)xStats.dropped,
+                (unsigned long)xStats.rejected,
+                (unsigned long)xStats.sendErrors,
+                (unsigned long)xStats.corrupt,
+                (unsigned long)xStats.erases,
+                (unsigned long)xStats.noisyWrites,
+                (unsigned long)(xStats.appendUs / ulAppends),
+                (unsigned long)xStats.appendMaxUs,
+                (unsigned long)(xStats.consumeUs / ulDrained));
+        pxConsoleIO->print(pcBuffer);
+        return;
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-store [add <port> <hex_data> | drain | clear]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakStore =
+{
+    "rak-store",
+    "rak-store:\n"
+    "  Queue an uplink in flash until it can be sent, or show store statistics\n"
+    "  Usage: rak-store [add <port> <hex_data> | drain | clear]\n"
+    "  Example: rak-store add 2 48656C6C6F\n\n",
+    prvRakStoreCommand
+};
+
+/* Command: rak-confirm - Confirmed uplinks */
+static void prvRakConfirmCommand(ConsoleIO_t * const pxConsoleIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[])
+{
+    if(ulArgc >= 4 && strcmp(ppcArgv[1], "send") == 0)
+    {
+        uint8_t data[RAK3172_MAX_PAYLOAD];
+        uint32_t ulSeq;
+        int32_t lDecoded = RAK3172_HexDecode(ppcArgv[3], strlen(ppcArgv[3]), data, sizeof(data));
+        
+        if(lDecoded <= 0)
+        {
+            pxConsoleIO->print("ERROR: Invalid hex data\n");
+            return;
+        }
+        
+        RAK3172_Status_t xStatus = RAK3172_ConfirmSend((uint8_t)atoi(ppcArgv[2]), data, (uint8_t)lDecoded,
+                                                       NULL, NULL, &ulSeq);
+        if(xStatus == RAK3172_OK)
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "Queued as #%lu\n", (unsigned long)ulSeq);
+        else
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+        return;
+    }
+    else if(ulArgc >= 3 && strcmp(ppcArgv[1], "budget") == 0)
+    {
+        RAK3172_ConfirmSetBudget((uint32_t)atoi(ppcArgv[2]));
+        pxConsoleIO->print("OK\n");
+        return;
+    }
+    else if(ulArgc != 1)
+    {
+        pxConsoleIO->print("Usage: rak-confirm [send <port> <hex_data> | budget <ms>]\n");
+        return;
+    }
+    
+    RAK3172_CfmStats_t xStats;
+    char pcBuffer[512];
+    
+    RAK3172_GetConfirmStats(&xStats);
+    
+    uint32_t ulSettled = xStats.acked + xStats.noAck;
+    uint32_t ulRatio = ulSettled ? (xStats.acked * 100 / ulSettled) : 0;
+    snprintf(pcBuffer, sizeof(pcBuffer),
+            "\nRAK3172 confirmed uplinks (budget %lu ms):\n"
+            "  Queued/rejected:  %lu / %lu\n"
+            "  Acked:            %10lu (%lu first try)\n"
+            "  Not acked:        %10lu\n"
+            "  Delivery ratio:   %9lu%% (recent %u%%)\n"
+            "  Retransmissions:  %10lu\n"
+            "  Budget stops:     %10lu\n"
+            "  Unconfirmed:      %10lu (%lu probes)%s\n"
+            "  Send errors:      %10lu\n"
+            "  Unmatched acks:   %10lu\n"
+            "  Airtime:          %10lu ms\n"
+            "  Ack latency:\n",
+            (unsigned long)xStats.budgetMs,
+            (unsigned long)xStats.queued,
+            (unsigned long)xStats.rejected,
+            (unsigned long)xStats.acked,
+            (unsigned long)xStats.ackedFirst,
+            (unsigned long)xStats.noAck,
+            (unsigned long)ulRatio,
+            (unsigned int)xStats.ratioPct,
+            (unsigned long)xStats.retransmissions,
+            (unsigned long)xStats.budgetStops,
+            (unsigned long)xStats.fallbacks,
+            (unsigned long)xStats.probes,
+            xStats.fallback ? ", link poor" : "",
+            (unsigned long)xStats.sendErrors,
+            (unsigned long)xStats.unmatched,
+            (unsigned long)xStats.airtimeMs);
+    
+    pxConsoleIO->print(pcBuffer);
+    
+    for(int i = 0; i < RAK3172_CFM_HIST_BINS; i++)
+    {
+        if(i < RAK3172_CFM_HIST_BINS - 1)
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "    < %5lu ms: %lu\n",
+                    (unsigned long)RAK3172_CfmHistEdgesMs[i], (unsigned long)xStats.ackHist[i]);
+        else
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "   >= %5lu ms: %lu\n",
+                    (unsigned long)RAK3172_CfmHistEdgesMs[i - 1], (unsigned long)xStats.ackHist[i]);
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    pxConsoleIO->print("\n");
+}
+
+const CLI_Command_Definition_t xCommandDef_rakConfirm =
+{
+    "rak-confirm",
+    "rak-confirm:\n"
+    "  Queue a confirmed uplink, set the retransmission airtime budget,\n"
+    "  or show delivery statistics and the ack latency histogram\n"
+    "  Usage: rak-confirm [send <port> <hex_data> | budget <ms>]\n\n",
+    prvRakConfirmCommand
+};
+
+/* Command: rak-lb - Uplink load balancing over all modules */
+static void prvRakLbCommand(ConsoleIO_t * const pxConsoleIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 4 && strcmp(ppcArgv[1], "send") == 0)
+    {
+        uint8_t data[RAK3172_MAX_PAYLOAD];
+        int32_t lDecoded = RAK3172_HexDecode(ppcArgv[3], strlen(ppcArgv[3]), data, sizeof(data));
+        
+        if(lDecoded <= 0)
+        {
+            pxConsoleIO->print("ERROR: Invalid hex data\n");
+            return;
+        }
+        
+        xStatus = RAK3172_LbSend((uint8_t)atoi(ppcArgv[2]), data, (uint8_t)lDecoded, NULL, NULL);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "join") == 0)
+    {
+        xStatus = RAK3172_LbJoin();
+    }
+    else if(ulArgc >= 4 && strcmp(ppcArgv[1], "at") == 0)
+    {
+        RAK3172_Dev_t *dev = RAK3172_GetDev((uint8_t)atoi(ppcArgv[2]));
+        char pcResponse[RAK3172_RX_BUFFER_SIZE];
+        
+        if(!dev)
+        {
+            pxConsoleIO->print("ERROR: No such module\n");
+            return;
+        }
+        
+        xStatus = RAK3172_DevSendCommand(dev, ppcArgv[3], pcResponse, sizeof(pcResponse), 5000);
+        if(pcResponse[0])
+            pxConsoleIO->print(pcResponse);
+    }
+    else if(ulArgc == 1)
+    {
+        RAK3172_LbStats_t xStats;
+        
+        RAK3172_GetLbStats(&xStats);
+        
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "\nRAK3172 load balancer:\n"
+                "  Submitted:        %10lu\n"
+                "  No module free:   %10lu\n"
+                "  No slot free:     %10lu\n",
+                (unsigned long)xStats.submitted,
+                (unsigned long)xStats.noModule,
+                (unsigned long)xStats.noSlot);
+        pxConsoleIO->print(pcCliScratchBuffer);
+        
+        for(uint8_t i = 0; i < RAK3172_MAX_DEVICES; i++)
+        {
+            RAK3172_Dev_t *dev = RAK3172_GetDev(i);
+            
+            if(!dev)
+                continue;
+            
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "  %-5s %-7s DR%u  sent %lu, errors %lu, in flight %lu, off %lu ms\n",
+                    RAK3172_DevName(dev),
+                    RAK3172_DevIsJoined(dev) ? "joined" : "offline",
+                    RAK3172_DevGetDataRate(dev),
+                    (unsigned long)xStats.dev[i].sent,
+                    (unsigned long)xStats.dev[i].errors,
+                    (unsigned long)xStats.dev[i].inFlight,
+                    (unsigned long)RAK3172_DevDutyCycleWaitMs(dev));
+            pxConsoleIO->print(pcCliScratchBuffer);
+        }
+        
+        pxConsoleIO->print("\n");
+        return;
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-lb [send <port> <hex_data> | join | at <module> <command>]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakLb =
+{
+    "rak-lb",
+    "rak-lb:\n"
+    "  Send an uplink on the least loaded module, join all modules,\n"
+    "  run an AT command on one module, or show per-module statistics\n"
+    "  Usage: rak-lb [send <port> <hex_data> | join | at <module> <command>]\n"
+    "  Example: rak-lb at 1 AT+DEVEUI=?\n\n",
+    prvRakLbCommand
+};
+
+/* Command: rak-timeouts - Learned command deadlines */
+static void prvRakTimeoutsCommand(ConsoleIO_t * const pxConsoleIO,
+                                  uint32_t ulArgc,
+                                  char * ppcArgv[])
+{
+    RAK3172_TmoEntry_t xEntries[RAK3172_TMO_CLASS_COUNT];
+    
+    if(ulArgc >= 2 && strcmp(ppcArgv[1], "reset") == 0)
+    {
+        RAK3172_TimeoutReset();
+        pxConsoleIO->print("OK\n");
+        return;
+    }
+    else if(ulArgc != 1)
+    {
+        pxConsoleIO->print("Usage: rak-timeouts [reset]\n");
+        return;
+    }
+    
+    uint8_t ucCount = RAK3172_GetTimeoutTable(xEntries, RAK3172_TMO_CLASS_COUNT);
+    
+    pxConsoleIO->print("\nClass     Samples  Timeouts  Latency  Dev  Max ms   Floor  Ceiling  Deadline\n");
+    
+    for(uint8_t i = 0; i < ucCount; i++)
+    {
+        RAK3172_TmoEntry_t *pxEntry = &xEntries[i];
+        
+        if(pxEntry->timeoutMs)
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "%-8s  %7lu  %8lu  %7lu  %3lu  %6lu  %6lu  %7lu  %6lu ms%s\n",
+                    pxEntry->name,
+                    (unsigned long)pxEntry->samples,
+                    (unsigned long)pxEntry->timeouts,
+                    (unsigned long)pxEntry->srttMs,
+                    (unsigned long)pxEntry->rttvarMs,
+                    (unsigned long)pxEntry->maxMs,
+                    (unsigned long)pxEntry->floorMs,
+                    (unsigned long)pxEntry->ceilingMs,
+                    (unsigned long)pxEntry->timeoutMs,
+                    pxEntry->backoff ? " (backed off)" : "");
+        }
+        else
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "%-8s  %7lu  %8lu  %7lu  %3lu  %6lu  %6lu  %7lu  %s\n",
+                    pxEntry->name,
+                    (unsigned long)pxEntry->samples,
+                    (unsigned long)pxEntry->timeouts,
+                    (unsigned long)pxEntry->srttMs,
+                    (unsigned long)pxEntry->rttvarMs,
+                    (unsigned long)pxEntry->maxMs,
+                    (unsigned long)pxEntry->floorMs,
+                    (unsigned long)pxEntry->ceilingMs,
+                    pxEntry->ceilingMs ? "learning" : "caller");
+        }
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+    
+    pxConsoleIO->print("\n");
+}
+
+const CLI_Command_Definition_t xCommandDef_rakTimeouts =
+{
+    "rak-timeouts",
+    "rak-timeouts:\n"
+    "  Show the latency learned per command class and the deadline derived from it,\n"
+    "  or forget what was learned\n"
+    "  Usage: rak-timeouts [reset]\n\n",
+    prvRakTimeoutsCommand
+};
+
+/* Command: rak-health - Liveness probe and automatic recovery */
+static void prvRakHealthCommand(ConsoleIO_t * const pxConsoleIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[])
+{
+    if(ulArgc >= 2 && strcmp(ppcArgv[1], "on") == 0)
+    {
+        RAK3172_HealthEnable(true);
+        pxConsoleIO->print("OK\n");
+        return;
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "off") == 0)
+    {
+        RAK3172_HealthEnable(false);
+        pxConsoleIO->print("OK\n");
+        return;
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "hang") == 0)
+    {
+        /* Module replies are ignored until the monitor resets it */
+        RAK3172_DevSimulateHang(RAK3172_GetDev(0), true);
+        pxConsoleIO->print("RAK3172 now ignored until the next reset\n");
+        return;
+    }
+    else if(ulArgc != 1)
+    {
+        pxConsoleIO->print("Usage: rak-health [on | off | hang]\n");
+        return;
+    }
+    
+    RAK3172_HealthStats_t xStats;
+    char pcBuffer[512];
+    
+    RAK3172_GetHealthStats(&xStats);
+    
+    uint32_t ulRecoveries = xStats.recoveries ? xStats.recoveries : 1;
+    snprintf(pcBuffer, sizeof(pcBuffer),
+            "\nRAK3172 health monitor (%s, probe after %d s idle):\n"
+            "  Idle for:         %10lu ms\n"
+            "  Probes:           %10lu\n"
+            "  Probe failures:   %10lu (%u in a row)\n"
+            "  Recoveries:       %10lu\n"
+            "  Failed resets:    %10lu\n"
+            "  Settings restored:%10lu (%lu replay errors)\n"
+            "  Rejoins:          %10lu\n"
+            "  Recovery time:    %lu ms last, %lu avg, %lu max\n"
+            "  Last recovery:    %10lu ms ago\n\n",
+            xStats.enabled ? "on" : "off",
+            RAK3172_HEALTH_IDLE_MS / 1000,
+            (unsigned long)RAK3172_DevRxIdleMs(RAK3172_GetDev(0)),
+            (unsigned long)xStats.probes,
+            (unsigned long)xStats.probeFailures,
+            (unsigned int)xStats.consecutive,
+            (unsigned long)xStats.recoveries,
+            (unsigned long)xStats.failedRecoveries,
+            (unsigned long)xStats.restored,
+            (unsigned long)xStats.restoreErrors,
+            (unsigned long)xStats.rejoins,
+            (unsigned long)xStats.lastRecoveryMs,
+            (unsigned long)(xStats.totalRecoveryMs / ulRecoveries),
+            (unsigned long)xStats.maxRecoveryMs,
+            (unsigned long)xStats.sinceRecoveryMs);
+    pxConsoleIO->print(pcBuffer);
+}
+
+const CLI_Command_Definition_t xCommandDef_rakHealth =
+{
+    "rak-health",
+    "rak-health:\n"
+    "  Show the liveness probe and recovery counters, pause or resume the probes,\n"
+    "  or make the driver ignore the module to exercise the recovery\n"
+    "  Usage: rak-health [on | off | hang]\n\n",
+    prvRakHealthCommand
+};
+
+/* Read every packet waiting in the P2P ring, counting breaks in the
+ * sequence numbers the bench puts in the first 4 payload bytes */
+static uint32_t prvRakP2pDrain(uint32_t *pulExpected, uint32_t *pulGaps)
+{
+    RAK3172_P2pPacket_t xPacket;
+    uint32_t ulCount = 0;
+    
+    while(RAK3172_P2pRead(&xPacket, 0) == pdPASS)
+    {
+        uint32_t ulValue = ((uint32_t)xPacket.data[0] << 24) | ((uint32_t)xPacket.data[1] << 16) |
+                           ((uint32_t)xPacket.data[2] << 8) | xPacket.data[3];
+        
+        if(ulValue != *pulExpected)
+            (*pulGaps)++;
+        *pulExpected = ulValue + 1;
+        ulCount++;
+    }
+    
+    return ulCount;
+}
+
+/* Feed count packets at pps through the driver as a simulated module
+ * would send them and check that every one comes out of the ring */
+static void prvRakP2pBench(ConsoleIO_t * const pxConsoleIO, uint32_t ulPps, uint32_t ulCount)
+{
+    RAK3172_Dev_t *dev = RAK3172_GetDev(0);
+    RAK3172_P2pStats_t xStats;
+    RAK3172_UartStats_t xUartBefore, xUartAfter;
+    char pcLine[64];
+    uint32_t ulExpected = 0, ulGaps = 0, ulReceived = 0;
+    uint32_t ulPerTick = (ulPps + configTICK_RATE_HZ - 1) / configTICK_RATE_HZ;
+    TickType_t xPeriod = pdMS_TO_TICKS(1000UL * ulPerTick / ulPps);
+    TickType_t xWake = xTaskGetTickCount();
+    
+    if(xPeriod == 0)
+        xPeriod = 1;
+    
+    /* Leftovers of an earlier run */
+    prvRakP2pDrain(&ulExpected, &ulGaps);
+    ulExpected = 0;
+    ulGaps = 0;
+    
+    RAK3172_P2pClearStats();
+    RAK3172_DevGetUartStats(dev, &xUartBefore);
+    uint64_t ullStart = time_us_64();
+    
+    for(uint32_t ulSent = 0; ulSent < ulCount; )
+    {
+        for(uint32_t i = 0; i < ulPerTick && ulSent < ulCount; i++, ulSent++)
+        {
+            int len = snprintf(pcLine, sizeof(pcLine), "+EVT:RXP2P:-%u:%u:%08lX00112233\r\n",
+                               (unsigned int)(40 + ulSent % 60), (unsigned int)(ulSent % 10),
+                               (unsigned long)ulSent);
+            RAK3172_DevInjectRx(dev, pcLine, (size_t)len);
+        }
+        
+        ulReceived += prvRakP2pDrain(&ulExpected, &ulGaps);
+        vTaskDelayUntil(&xWake, xPeriod);
+    }
+    
+    /* Let the driver finish the last lines */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    ulReceived += prvRakP2pDrain(&ulExpected, &ulGaps);
+    if(ulExpected != ulCount)
+        ulGaps++;
+    
+    uint32_t ulElapsedUs = (uint32_t)(time_us_64() - ullStart);
+    RAK3172_GetP2pStats(&xStats);
+    RAK3172_DevGetUartStats(dev, &xUartAfter);
+    
+    uint32_t ulSpanUs = (uint32_t)(xStats.lastUs - xStats.firstUs);
+    snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+            "Injected %lu at %lu/s: %lu delivered, %lu dropped in ring, %lu bytes lost in UART ring, "
+            "%lu gaps\nSustained %lu packets/s over %lu ms, ring high water %u/%d\n",
+            (unsigned long)ulCount, (unsigned long)ulPps,
+            (unsigned long)ulReceived,
+            (unsigned long)xStats.dropped,
+            (unsigned long)(xUartAfter.ringDrops - xUartBefore.ringDrops),
+            (unsigned long)ulGaps,
+            (unsigned long)(ulSpanUs ? (uint64_t)(xStats.received - 1) * 1000000 / ulSpanUs : 0),
+            (unsigned long)(ulElapsedUs / 1000),
+            (unsigned int)xStats.highWater, RAK3172_P2P_RING_LEN);
+    pxConsoleIO->print(pcCliScratchBuffer);
+}
+
+/* Command: rak-p2p - LoRa P2P mode */
+static void prvRakP2pCommand(ConsoleIO_t * const pxConsoleIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 5 && strcmp(ppcArgv[1], "start") == 0)
+    {
+        RAK3172_P2pConfig_t xConfig = {
+            .freqHz = (uint32_t)strtoul(ppcArgv[2], NULL, 10),
+            .sf = (uint8_t)atoi(ppcArgv[3]),
+            .bwKhz = (uint16_t)atoi(ppcArgv[4]),
+            .cr = (ulArgc > 5) ? (uint8_t)atoi(ppcArgv[5]) : 0,
+            .preamble = (ulArgc > 6) ? (uint16_t)atoi(ppcArgv[6]) : 8,
+            .txPower = (ulArgc > 7) ? (int8_t)atoi(ppcArgv[7]) : 14,
+        };
+        
+        xStatus = RAK3172_P2pStart(&xConfig);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "stop") == 0)
+    {
+        xStatus = RAK3172_P2pStop(ulArgc >= 3 && strcmp(ppcArgv[2], "lorawan") == 0);
+    }
+    else if(ulArgc >= 3 && strcmp(ppcArgv[1], "send") == 0)
+    {
+        uint8_t data[RAK3172_MAX_PAYLOAD];
+        int32_t lDecoded = RAK3172_HexDecode(ppcArgv[2], strlen(ppcArgv[2]), data, sizeof(data));
+        
+        if(lDecoded <= 0)
+        {
+            pxConsoleIO->print("ERROR: Invalid hex data\n");
+            return;
+        }
+        
+        xStatus = RAK3172_P2pSend(data, (uint8_t)lDecoded);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "read") == 0)
+    {
+        RAK3172_P2pPacket_t xPacket;
+        uint32_t ulWaitMs = (ulArgc > 2) ? (uint32_t)atoi(ppcArgv[2]) : 0;
+        
+        while(RAK3172_P2pRead(&xPacket, ulWaitMs) == pdPASS)
+        {
+            int len = snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "#%lu %llu us RSSI %d SNR %d: ",
+                               (unsigned long)xPacket.seq, (unsigned long long)xPacket.timestampUs,
+                               xPacket.rssi, xPacket.snr);
+            size_t max = (CLI_OUTPUT_SCRATCH_BUF_LEN - len - 2) / 2;
+            size_t count = (xPacket.length < max) ? xPacket.length : max;
+            
+            RAK3172_HexEncode(xPacket.data, count, &pcCliScratchBuffer[len]);
+            pcCliScratchBuffer[len + 2 * count] = '\n';
+            pcCliScratchBuffer[len + 2 * count + 1] = '\0';
+            pxConsoleIO->print(pcCliScratchBuffer);
+            ulWaitMs = 0;
+        }
+        return;
+    }
+    else if(ulArgc >= 4 && strcmp(ppcArgv[1], "bench") == 0)
+    {
+        uint32_t ulPps = (uint32_t)atoi(ppcArgv[2]);
+        uint32_t ulCount = (uint32_t)atoi(ppcArgv[3]);
+        
+        if(ulPps == 0 || ulPps > 10000 || ulCount == 0)
+        {
+            pxConsoleIO->print("Usage: rak-p2p bench <packets/s> <count>\n");
+            return;
+        }
+        
+        prvRakP2pBench(pxConsoleIO, ulPps, ulCount);
+        return;
+    }
+    else if(ulArgc == 1)
+    {
+        RAK3172_P2pStats_t xStats;
+        char pcBuffer[512];
+        
+        RAK3172_GetP2pStats(&xStats);
+        
+        uint32_t ulSpanUs = (uint32_t)(xStats.lastUs - xStats.firstUs);
+        snprintf(pcBuffer, sizeof(pcBuffer),
+                "\nRAK3172 P2P (%s):\n"
+                "  Received:         %10lu (%lu packets/s)\n"
+                "  Delivered:        %10lu\n"
+                "  Dropped:          %10lu\n"
+                "  Ring high water:  %6u / %d\n"
+                "  Sent:             %10lu (%lu errors)\n"
+                "  Busy retries:     %10lu\n"
+                "  TX done missing:  %10lu\n\n",
+                xStats.running ? "receiving" : "stopped",
+                (unsigned long)xStats.received,
+                (unsigned long)(ulSpanUs ? (uint64_t)(xStats.received - 1) * 1000000 / ulSpanUs : 0),
+                (unsigned long)xStats.delivered,
+                (unsigned long)xStats.dropped,
+                (unsigned int)xStats.highWater, RAK3172_P2P_RING_LEN,
+                (unsigned long)xStats.sent,
+                (unsigned long)xStats.sendErrors,
+                (unsigned long)xStats.busyRetries,
+                (unsigned long)xStats.txDoneMissing);
+        pxConsoleIO->print(pcBuffer);
+        return;
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-p2p [start <freq_hz> <sf> <bw_khz> [cr] [preamble] [power] | "
+                           "stop [lorawan] | send <hex_data> | read [wait_ms] | bench <packets/s> <count>]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakP2p =
+{
+    "rak-p2p",
+    "rak-p2p:\n"
+    "  Switch to LoRa P2P and receive continuously, send a packet, read received\n"
+    "  packets, show P2P statistics, or measure the loss-free packet rate with a\n"
+    "  simulated module\n"
+    "  Usage: rak-p2p [start <freq_hz> <sf> <bw_khz> [cr] [preamble] [power] |\n"
+    "                  stop [lorawan] | send <hex_data> | read [wait_ms] |\n"
+    "                  bench <packets/s> <count>]\n"
+    "  Example: rak-p2p start 868000000 7 125\n\n",
+    prvRakP2pCommand
+};
+
+/* Transfer buffer for rak-bulk send/recv, the peer checks the pattern */
+static uint8_t ucBulkBuffer[RAK3172_BULK_SELFTEST_MAX];
+
+static uint8_t prvBulkPattern(size_t i)
+{
+    return (uint8_t)(i * 31 + 7);
+}
+
+static void prvRakBulkPrintStats(ConsoleIO_t * const pxConsoleIO, const char *pcLabel,
+                                 const RAK3172_BulkStats_t *pxStats, bool xSender)
+{
+    int len = snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%s: %lu bytes in %u fragments, %lu ms, %lu bytes/s\n"
+                       "  Frames sent %lu, received %lu\n",
+                       pcLabel, (unsigned long)pxStats->bytes, (unsigned int)pxStats->fragments,
+                       (unsigned long)pxStats->elapsedMs, (unsigned long)pxStats->bytesPerSec,
+                       (unsigned long)pxStats->framesSent, (unsigned long)pxStats->framesReceived);
+    
+    if(xSender)
+    {
+        uint32_t ulRatio = pxStats->fragments ?
+                           pxStats->retransmissions * 1000 / pxStats->fragments : 0;
+        
+        snprintf(&pcCliScratchBuffer[len], CLI_OUTPUT_SCRATCH_BUF_LEN - len,
+                "  Retransmissions %lu (%lu.%lu%%), ACK timeouts %lu, window %u (%u-%u)\n",
+                (unsigned long)pxStats->retransmissions,
+                (unsigned long)(ulRatio / 10), (unsigned long)(ulRatio % 10),
+                (unsigned long)pxStats->timeouts,
+                pxStats->window, pxStats->windowMin, pxStats->windowMax);
+    }
+    else
+    {
+        snprintf(&pcCliScratchBuffer[len], CLI_OUTPUT_SCRATCH_BUF_LEN - len,
+                "  Duplicates %lu\n", (unsigned long)pxStats->duplicates);
+    }
+    
+    pxConsoleIO->print(pcCliScratchBuffer);
+}
+
+/* Command: rak-bulk - bulk transfer over P2P */
+static void prvRakBulkCommand(ConsoleIO_t * const pxConsoleIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[])
+{
+    RAK3172_BulkStats_t xTx = {0};
+    RAK3172_BulkStats_t xRx = {0};
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 4 && strcmp(ppcArgv[1], "test") == 0)
+    {
+        size_t xLength = (size_t)strtoul(ppcArgv[2], NULL, 10);
+        uint8_t ucLoss = (uint8_t)atoi(ppcArgv[3]);
+        
+        xStatus = RAK3172_BulkSelfTest(xLength, ucLoss, &xTx, &xRx);
+        prvRakBulkPrintStats(pxConsoleIO, "Sender", &xTx, true);
+        prvRakBulkPrintStats(pxConsoleIO, "Receiver", &xRx, false);
+    }
+    else if(ulArgc >= 3 && strcmp(ppcArgv[1], "send") == 0)
+    {
+        size_t xLength = (size_t)strtoul(ppcArgv[2], NULL, 10);
+        uint8_t ucSession = (ulArgc > 3) ? (uint8_t)atoi(ppcArgv[3]) : 1;
+        
+        if(xLength == 0 || xLength > sizeof(ucBulkBuffer))
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "ERROR: Length must be 1-%d\n", RAK3172_BULK_SELFTEST_MAX);
+            pxConsoleIO->print(pcCliScratchBuffer);
+            return;
+        }
+        
+        for(size_t i = 0; i < xLength; i++)
+            ucBulkBuffer[i] = prvBulkPattern(i);
+        
+        xStatus = RAK3172_BulkSend(&xRak3172BulkP2p, ucSession, ucBulkBuffer, xLength, &xTx);
+        prvRakBulkPrintStats(pxConsoleIO, "Sender", &xTx, true);
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "recv") == 0)
+    {
+        uint32_t ulTimeoutMs = (ulArgc > 2) ? (uint32_t)atoi(ppcArgv[2]) * 1000 : 60000;
+        size_t xLength = 0;
+        
+        xStatus = RAK3172_BulkReceive(&xRak3172BulkP2p, ucBulkBuffer, sizeof(ucBulkBuffer),
+                                      &xLength, ulTimeoutMs, &xRx);
+        prvRakBulkPrintStats(pxConsoleIO, "Receiver", &xRx, false);
+        
+        for(size_t i = 0; i < xLength && xStatus == RAK3172_OK; i++)
+        {
+            if(ucBulkBuffer[i] != prvBulkPattern(i))
+            {
+                pxConsoleIO->print("ERROR: Data differs from the test pattern\n");
+                return;
+            }
+        }
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-bulk [test <bytes> <loss_pct> | send <bytes> [session] | recv [timeout_s]]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakBulk =
+{
+    "rak-bulk",
+    "rak-bulk:\n"
+    "  Transfer a test pattern to another dongle over LoRa P2P with selective\n"
+    "  repeat, or between two tasks over an in-memory channel dropping loss_pct %\n"
+    "  of the frames, and report throughput and retransmissions\n"
+    "  Usage: rak-bulk [test <bytes> <loss_pct> | send <bytes> [session] | recv [timeout_s]]\n"
+    "  Example: rak-bulk test 4096 20\n\n",
+    prvRakBulkCommand
+};
+
+/* Command: rak-frag - fragmented data blocks */
+static void prvRakFragCommand(ConsoleIO_t * const pxConsoleIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus;
+    
+    if(ulArgc >= 6 && strcmp(ppcArgv[1], "test") == 0)
+    {
+        RAK3172_FragTestResult_t xResult;
+        size_t xLength = (size_t)strtoul(ppcArgv[2], NULL, 10);
+        uint32_t ulRuns = (ulArgc > 6) ? (uint32_t)atoi(ppcArgv[6]) : 100;
+        
+        xStatus = RAK3172_FragSelfTest(xLength, (uint8_t)atoi(ppcArgv[3]), (uint8_t)atoi(ppcArgv[4]),
+                                       (uint8_t)atoi(ppcArgv[5]), ulRuns, &xResult);
+        if(xStatus == RAK3172_OK)
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "%u fragments + %u parity, %lu runs: %lu recovered (%lu%%), "
+                    "%lu fragments lost, %lu.%02lu fragments needed per block\n",
+                    xResult.nbFrag, xResult.nbParity, (unsigned long)xResult.runs,
+                    (unsigned long)xResult.recovered,
+                    (unsigned long)(xResult.recovered * 100 / xResult.runs),
+                    (unsigned long)xResult.lost,
+                    (unsigned long)(xResult.recovered ? xResult.needed / xResult.recovered : 0),
+                    (unsigned long)(xResult.recovered ? (xResult.needed % xResult.recovered) * 100 / xResult.recovered : 0));
+            pxConsoleIO->print(pcCliScratchBuffer);
+            return;
+        }
+    }
+    else if(ulArgc >= 3 && strcmp(ppcArgv[1], "send") == 0)
+    {
+        size_t xLength = (size_t)strtoul(ppcArgv[2], NULL, 10);
+        uint8_t ucRedundancy = (ulArgc > 3) ? (uint8_t)atoi(ppcArgv[3]) : 20;
+        uint8_t ucSize = (ulArgc > 4) ? (uint8_t)atoi(ppcArgv[4]) : 0;
+        
+        if(xLength == 0 || xLength > sizeof(ucBulkBuffer))
+        {
+            snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                    "ERROR: Length must be 1-%d\n", RAK3172_BULK_SELFTEST_MAX);
+            pxConsoleIO->print(pcCliScratchBuffer);
+            return;
+        }
+        
+        for(size_t i = 0; i < xLength; i++)
+            ucBulkBuffer[i] = prvBulkPattern(i);
+        
+        xStatus = RAK3172_FragSend(ucBulkBuffer, xLength, ucSize, ucRedundancy);
+    }
+    else if(ulArgc == 1)
+    {
+        RAK3172_FragStats_t xStats;
+        char pcBuffer[512];
+        
+        RAK3172_GetFragStats(&xStats);
+        
+        snprintf(pcBuffer, sizeof(pcBuffer),
+                "\nRAK3172 fragmentation (port %d):\n"
+                "  Session:          %s, index %u, %u x %u bytes\n"
+                "  Fragments:        %u received, %u recovered, %u missing\n"
+                "  Parity:           %lu received, %lu dropped, %u rows held\n"
+                "  Duplicates:       %lu\n"
+                "  Sessions/blocks:  %lu / %lu\n"
+                "  Uplink fragments: %lu\n\n",
+                RAK3172_FRAG_PORT,
+                !xStats.active ? "none" : (xStats.complete ? "complete" : "receiving"),
+                xStats.index, xStats.nbFrag, xStats.fragSize,
+                xStats.received, xStats.recovered,
+                (unsigned int)(xStats.nbFrag - xStats.received - xStats.recovered),
+                (unsigned long)xStats.parityReceived, (unsigned long)xStats.parityDropped,
+                xStats.parityRows,
+                (unsigned long)xStats.duplicates,
+                (unsigned long)xStats.sessions, (unsigned long)xStats.blocks,
+                (unsigned long)xStats.uplinkFragments);
+        pxConsoleIO->print(pcBuffer);
+        return;
+    }
+    else
+    {
+        pxConsoleIO->print("Usage: rak-frag [send <bytes> [redundancy_pct] [frag_size] | "
+                           "test <bytes> <frag_size> <redundancy_pct> <loss_pct> [runs]]\n");
+        return;
+    }
+    
+    if(xStatus == RAK3172_OK)
+    {
+        pxConsoleIO->print("OK\n");
+    }
+    else
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+    }
+}
+
+const CLI_Command_Definition_t xCommandDef_rakFrag =
+{
+    "rak-frag",
+    "rak-frag:\n"
+    "  Show the downlink fragmentation session, send a test pattern as a\n"
+    "  fragmented block with parity, or measure block recovery at a given\n"
+    "  fragment loss rate\n"
+    "  Usage: rak-frag [send <bytes> [redundancy_pct] [frag_size] |\n"
+    "                   test <bytes> <frag_size> <redundancy_pct> <loss_pct> [runs]]\n"
+    "  Example: rak-frag test 2000 50 30 10\n\n",
+    prvRakFragCommand
+};
+
+/* Command: rak-classc - class C downlinks to USB */
+static void prvRakClassCCommand(ConsoleIO_t * const pxConsoleIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[])
+{
+    RAK3172_Status_t xStatus = RAK3172_OK;
+    
+    if(ulArgc >= 2 && strcmp(ppcArgv[1], "start") == 0)
+    {
+        xStatus = RAK3172_ClassCStart();
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "stop") == 0)
+    {
+        xStatus = RAK3172_ClassCStop();
+    }
+    else if(ulArgc >= 2 && strcmp(ppcArgv[1], "clear") == 0)
+    {
+        RAK3172_ClassCClearStats();
+    }
+    else if(ulArgc >= 3 && strcmp(ppcArgv[1], "inject") == 0)
+    {
+        /* Downlinks as the module would report them, through the UART ring */
+        RAK3172_Dev_t *dev = RAK3172_GetDev(0);
+        uint32_t ulCount = (uint32_t)atoi(ppcArgv[2]);
+        char pcLine[64];
+        
+        for(uint32_t i = 0; i < ulCount; i++)
+        {
+            int len = snprintf(pcLine, sizeof(pcLine), "+EVT:RX_C:-%u:%u:UNICAST:2:%08lX\r\n",
+                               (unsigned int)(40 + i % 60), (unsigned int)(i % 10), (unsigned long)i);
+            RAK3172_DevInjectRx(dev, pcLine, (size_t)len);
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+    }
+    else if(ulArgc != 1)
+    {
+        pxConsoleIO->print("Usage: rak-classc [start | stop | clear | inject <count>]\n");
+        return;
+    }
+    
+    if(xStatus != RAK3172_OK)
+    {
+        snprintf(pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                "ERROR: %s\n", RAK3172_StatusString(xStatus));
+        pxConsoleIO->print(pcCliScratchBuffer);
+        return;
+    }
+    
+    if(ulArgc > 1 && strcmp(ppcArgv[1], "inject") != 0)
+    {
+        pxConsoleIO->print("OK\n");
+        return;
+    }
+    
+    RAK3172_ClassCStats_t xStats;
+    char pcBuffer[512];
+    
+    RAK3172_GetClassCStats(&xStats);
+    
+    int len = snprintf(pcBuffer, sizeof(pcBuffer),
+                       "\nRAK3172 class C (%s):\n"
+                       "  Downlinks to USB: %10lu\n"
+                       "  Dropped:          %10lu\n"
+                       "  Written:          %10lu\n"
+                       "  Stack free:       %10lu words\n"
+                       "  Last byte to USB write: avg %lu us, max %lu us\n",
+                       xStats.active ? "on" : "off",
+                       (unsigned long)xStats.downlinks,
+                       (unsigned long)xStats.dropped,
+                       (unsigned long)xStats.written,
+                       (unsigned long)xStats.stackFreeWords,
+                       (unsigned long)(xStats.written ? xStats.totalUs / xStats.written : 0),
+                       (unsigned long)xStats.maxUs);
+    
+    for(int i = 0; i < RAK3172_CLASSC_HIST_BUCKETS && len < (int)sizeof(pcBuffer); i++)
+    {
+        if(xStats.histogram[i] == 0)
+            continue;
+        
+        if(i == RAK3172_CLASSC_HIST_BUCKETS - 1)
+            len += snprintf(&pcBuffer[len], sizeof(pcBuffer) - len, "    >= %6lu us: %lu\n",
+                            (unsigned long)(1ul << (i - 1)), (unsigned long)xStats.histogram[i]);
+        else
+            len += snprintf(&pcBuffer[len], sizeof(pcBuffer) - len, "    < %7lu us: %lu\n",
+                            (unsigned long)(1ul << i), (unsigned long)xStats.histogram[i]);
+    }
+    
+    if(len < (int)sizeof(pcBuffer) - 1)
+        strcat(pcBuffer, "\n");
+    pxConsoleIO->print(pcBuffer);
+}
+
+const CLI_Command_Definition_t xCommandDef_rakClassC =
+{
+    "rak-classc",
+    "rak-classc:\n"
+    "  Switch the module to class C and push downlinks straight to USB as\n"
+    "  +DL:<us>:<window>:<port>:<rssi>:<snr>:<hex>, back to class A, or show the\n"
+    "  last UART byte to USB write latency histogram. inject feeds simulated\n"
+    "  class C downlinks through the UART ring\n"
+    "  Usage: rak-classc [start | stop | clear | inject <count>]\n\n",
+    prvRakClassCCommand
+};
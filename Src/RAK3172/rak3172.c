@@ -1,4 +1,17 @@
 #include "rak3172.h"
+#include "rak3172_at.h"
+#include "rak3172_pool.h"
+#include "rak3172_airtime.h"
+#include "rak3172_region.h"
+#include "rak3172_rx.h"
+#include "rak3172_classc.h"
+#include "rak3172_config.h"
+#include "rak3172_confirm.h"
+#include "rak3172_join.h"
+#include "rak3172_p2p.h"
+#include "rak3172_sched.h"
+#include "rak3172_timeout.h"
+#include "rak3172_tx.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
@@ -8,108 +21,356 @@
 #include "hardware/gpio.h"
 #include "pico/stdlib.h"
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 
-/* Internal state */
-static QueueHandle_t xRxQueue = NULL;
-static QueueHandle_t xEventQueue = NULL;
-static SemaphoreHandle_t xUartMutex = NULL;
-static TaskHandle_t xRAK3172TaskHandle = NULL;
+/* Queued command. cmd (or payload for an AT+SEND request, cmd == NULL)
+ * must stay valid until the callback has run. A non-zero baud switches the
+ * host UART once the command succeeds, or right away when there is neither
+ * cmd nor payload. */
+typedef struct {
+    const char *cmd;
+    const uint8_t *payload;
+    uint16_t payloadLen;
+    uint8_t port;
+    RAK3172_CmdCallback_t callback;
+    void *ctx;
+    uint32_t timeout_ms;
+    uint32_t baud;
+    TickType_t submitTick;
+    bool urgent;                    /* Never held for receive windows */
+    bool held;                      /* Was held for receive windows */
+    bool confirmed;                 /* AT+SEND type, AT+CFM is switched to it first */
+} RAK3172_Request_t;
+
+/* Command currently on the wire, only touched by Task_RAK3172 */
+typedef struct {
+    RAK3172_Request_t req;
+    TickType_t startTick;
+    TickType_t deadline;
+    uint32_t startUs;
+    uint32_t wireMs;                /* Time to clock the line out at the current rate */
+    RAK3172_TmoClass_t tmoClass;
+    size_t responseIdx;
+    bool active;
+    bool onWire;                    /* Sent, the reply latency is meaningful */
+} RAK3172_ActiveCmd_t;
+
+/* State of one module */
+struct RAK3172_Dev {
+    RAK3172_DevConfig_t config;
+    uint8_t index;
+    bool open;
+    
+    QueueHandle_t eventQueue;
+    QueueHandle_t cmdQueue;
+    TaskHandle_t task;
+    SemaphoreHandle_t readySem;             /* Boot banner seen, given by the line parser */
+    
+    RAK3172_ActiveCmd_t activeCmd;
+    char response[RAK3172_RX_BUFFER_SIZE];
+    
+    /* Transmit path, DMA when a channel is available */
+    const RAK3172_TxPort_t *txPort;
+    RAK3172_TxChannel_t txChannel;
+    uint8_t txBuffer[RAK3172_TX_BUFFER_SIZE];
+    RAK3172_CmdStats_t cmdStats;
+    
+    RAK3172_UrcParser_t urcParser;
+    RAK3172_RxData_t rxScratch;             /* Used when the pool is exhausted */
+    
+    /* Uplink data rate, last value set or read back */
+    volatile uint8_t dataRate;
+    volatile bool joined;                   /* Last join URC was +EVT:JOINED */
+    
+    RAK3172_RxRing_t rxRing;                /* Filled by the UART IRQ, drained by the task */
+    volatile uint32_t lineCount;            /* Line terminators stored in the ring */
+    volatile uint64_t lineUs[RAK3172_LINE_STAMPS];  /* time_us_64() of the terminator, by line number */
+    uint32_t linesParsed;                   /* Task only */
+    uint64_t curLineUs;                     /* Stamp of the line being processed */
+    volatile RAK3172_UartStats_t uartStats;
+    
+    /* Link rate, negotiated by the startup task */
+    RAK3172_LinkInfo_t linkInfo;
+    bool discardLine;                       /* Partial line received at the old rate */
+    volatile TickType_t lastRxTick;         /* Last complete line from the module */
+    volatile bool simHang;                  /* Fault injection: ignore the module until reset */
+    volatile bool simModule;                /* Commands answered with OK by the driver, nothing sent */
+    volatile bool resetPending;             /* Hardware reset done, the task forgets the module state */
+    
+    /* Class A receive windows of the last uplink, Task_RAK3172 only */
+    bool rxWinActive;
+    TickType_t rxWinTxEnd;                  /* Estimated end of the transmission */
+    TickType_t rxWinClose;
+    RAK3172_Request_t held[RAK3172_RXWIN_MAX_HELD];
+    uint8_t heldCount;
+    RAK3172_Request_t deferred;             /* Held list full, follows the held ones */
+    bool deferredPending;
+    
+    /* Uplink type, Task_RAK3172 only */
+    int8_t cfm;                             /* AT+CFM of the module, -1 unknown */
+    RAK3172_Request_t cfmSend;              /* Uplink waiting for its AT+CFM switch */
+    bool cfmSendPending;
+};
+
+static RAK3172_Dev_t xDevices[RAK3172_MAX_DEVICES];
+static RAK3172_Dev_t * const pxPrimary = &xDevices[0];
+static RAK3172_Dev_t *pxUartDevs[2] = {0};   /* By UART index, for the IRQ */
+
+static const RAK3172_DevConfig_t xPrimaryConfig = {
+    .name = "RAK0",
+    .uartIndex = RAK3172_UART_INDEX,
+    .txPin = RAK3172_TX_PIN,
+    .rxPin = RAK3172_RX_PIN,
+    .rstPin = RAK3172_RST_PIN,
+    .txPort = NULL,
+};
+
 static RAK3172_RxCallback_t pxRxCallback = NULL;
 
-/* RX Buffer */
-static char rxBuffer[RAK3172_RX_BUFFER_SIZE];
-static volatile uint16_t rxIndex = 0;
+/* Downlink dispatch by fPort, pxRxCallback catches everything else.
+ * Shared by all modules. */
+typedef struct {
+    uint8_t port;
+    RAK3172_RxCallback_t callback;
+} RAK3172_PortHandler_t;
+
+static RAK3172_PortHandler_t xPortHandlers[RAK3172_MAX_PORT_HANDLERS] = {0};
+
+/* Region, last value set or read back from the primary module */
+static volatile RAK3172_Region_t xRegion = RAK3172_DEFAULT_REGION;
 
-/* UART IRQ Handler */
-static void rak3172_uart_irq_handler(void)
+static const uint32_t ulBaudCandidates[] = RAK3172_BAUD_CANDIDATES;
+
+/* UART IRQ, shared body of both handlers */
+static void prvUartIrq(RAK3172_Dev_t *dev)
 {
-    static uint32_t irqCount = 0;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    
-    irqCount++;
-    
-    // Debug : afficher chaque 10ème appel
-    if((irqCount % 10) == 0)
+    bool xLineComplete = false;
+    uart_inst_t *uart = uart_get_instance(dev->config.uartIndex);
+    uart_hw_t *pxUartHw = uart_get_hw(uart);
+    uint32_t head = dev->rxRing.head;
+
+    while(uart_is_readable(uart))
+    {
+        uint32_t dr = pxUartHw->dr;
+        uint8_t c = (uint8_t)dr;
+
+        if(dr & UART_UARTDR_OE_BITS)
+        {
+            dev->uartStats.hwOverruns++;
+        }
+
+        uint32_t fill = RAK3172_RxRingPush(&dev->rxRing, &head, c);
+        if(fill)
+        {
+            dev->uartStats.rxBytes++;
+            
+            if(c == '\n')
+            {
+                dev->lineUs[dev->lineCount & (RAK3172_LINE_STAMPS - 1)] = time_us_64();
+                dev->lineCount++;
+            }
+
+            if(fill > dev->uartStats.ringHighWater)
+            {
+                dev->uartStats.ringHighWater = fill;
+            }
+        }
+        else
+        {
+            dev->uartStats.ringDrops++;
+        }
+
+        if(c == '\n')
+        {
+            dev->uartStats.rxLines++;
+            xLineComplete = true;
+        }
+    }
+
+    /* Publish the new bytes before waking the consumer */
+    dev->rxRing.head = head;
+
+    /* Only wake the parser once a full line is available */
+    if(xLineComplete && dev->task)
     {
-        RAK_DEBUG("[IRQ] Called %lu times\n", irqCount);
+        vTaskNotifyGiveFromISR(dev->task, &xHigherPriorityTaskWoken);
     }
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* UART IRQ Handlers */
+static void rak3172_uart0_irq_handler(void)
+{
+    if(pxUartDevs[0])
+        prvUartIrq(pxUartDevs[0]);
+}
+
+static void rak3172_uart1_irq_handler(void)
+{
+    if(pxUartDevs[1])
+        prvUartIrq(pxUartDevs[1]);
+}
+
+/* Switch the host side of the link. Only called by Task_RAK3172 while the
+ * TX path is idle, so no byte is sent at the wrong rate. */
+static void prvSetHostBaud(RAK3172_Dev_t *dev, uint32_t baud)
+{
+    uart_inst_t *uart = uart_get_instance(dev->config.uartIndex);
+    
+    uart_tx_wait_blocking(uart);
+    uint32_t actual = uart_set_baudrate(uart, baud);
+    
+    taskENTER_CRITICAL();
+    dev->linkInfo.baud = actual;
+    taskEXIT_CRITICAL();
+    
+    dev->discardLine = true;
+    RAK_DEBUG("UART%u now at %lu baud\n", dev->config.uartIndex, actual);
+}
+
+/* DMA TX complete: wake the task so it can start the next command */
+static void prvTxDoneFromISR(void *ctx)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    RAK3172_Dev_t *dev = (RAK3172_Dev_t *)ctx;
     
-    while(uart_is_readable(RAK3172_UART_ID))
+    if(dev->task)
     {
-        char c = uart_getc(RAK3172_UART_ID);
-        
-        // Debug : afficher chaque caractère reçu
-        RAK_DEBUG("[IRQ] RX: 0x%02X ('%c')\n", c, (c >= 32 && c < 127) ? c : '.');
-        
-        // Envoyer à la queue
-        xQueueSendFromISR(xRxQueue, &c, &xHigherPriorityTaskWoken);
+        vTaskNotifyGiveFromISR(dev->task, &xHigherPriorityTaskWoken);
     }
     
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
-/* Initialize RAK3172 driver */
-BaseType_t RAK3172_Init(void)
+static void prvTaskRAK3172Startup(void *pvParameters);
+
+/* Bring up one module: queues, reset pin, UART, TX path and its tasks.
+ * The module is held in reset until its startup task runs. */
+RAK3172_Dev_t *RAK3172_DevOpen(const RAK3172_DevConfig_t *config)
 {
-    printf("Initializing RAK3172...\n");
+    RAK3172_Dev_t *dev = NULL;
+    char taskName[configMAX_TASK_NAME_LEN];
+    
+    if(!config || config->uartIndex > 1 || pxUartDevs[config->uartIndex])
+        return NULL;
+    
+    for(int i = 0; i < RAK3172_MAX_DEVICES && !dev; i++)
+    {
+        if(!xDevices[i].open)
+            dev = &xDevices[i];
+    }
+    if(!dev)
+        return NULL;
+    
+    memset(dev, 0, sizeof(*dev));
+    dev->config = *config;
+    dev->index = (uint8_t)(dev - xDevices);
+    dev->cfm = -1;
     
     /* Create queues and mutex */
-    xRxQueue = xQueueCreate(RAK3172_RX_BUFFER_SIZE, sizeof(char));
-    xEventQueue = xQueueCreate(10, sizeof(RAK3172_EventData_t));
-    xUartMutex = xSemaphoreCreateMutex();
+    dev->eventQueue = xQueueCreate(RAK3172_EVENT_QUEUE_LEN, sizeof(RAK3172_EventData_t));
+    dev->cmdQueue = xQueueCreate(RAK3172_CMD_QUEUE_LEN, sizeof(RAK3172_Request_t));
+    dev->readySem = xSemaphoreCreateBinary();
     
-    if(!xRxQueue || !xEventQueue || !xUartMutex)
+    if(!dev->eventQueue || !dev->cmdQueue || !dev->readySem)
     {
-        printf("ERROR: Failed to create RAK3172 resources\n");
-        return pdFAIL;
+        printf("ERROR: Failed to create %s resources\n", config->name);
+        return NULL;
     }
     
     /* Configure RST pin - TRÈS IMPORTANT */
-    printf("Configuring RST pin (GP%d)...\n", RAK3172_RST_PIN);
-    gpio_init(RAK3172_RST_PIN);
-    gpio_set_dir(RAK3172_RST_PIN, GPIO_OUT);
-
-    /* Initialize UART0 */
-    printf("Initializing UART0 for RAK3172...\n");
-    uart_init(RAK3172_UART_ID, RAK3172_BAUD_RATE);
-    gpio_set_function(RAK3172_TX_PIN, GPIO_FUNC_UART);
-    gpio_set_function(RAK3172_RX_PIN, GPIO_FUNC_UART);
+    printf("Configuring %s RST pin (GP%d)...\n", config->name, config->rstPin);
+    gpio_init(config->rstPin);
+    gpio_set_dir(config->rstPin, GPIO_OUT);
     
-    /* Configure UART format (8N1) */
-    uart_set_format(RAK3172_UART_ID, 8, 1, UART_PARITY_NONE);
-    uart_set_fifo_enabled(RAK3172_UART_ID, true);
+    /* Hold the module in reset, the startup task releases it */
+    gpio_put(config->rstPin, 0);
+
+    /* Initialize the UART */
+    uart_inst_t *uart = uart_get_instance(config->uartIndex);
     
-    printf("UART0 configured: %d baud, 8N1\n", RAK3172_BAUD_RATE);
+    printf("Initializing UART%u for %s...\n", config->uartIndex, config->name);
+    uart_init(uart, RAK3172_BAUD_RATE);
+    gpio_set_function(config->txPin, GPIO_FUNC_UART);
+    gpio_set_function(config->rxPin, GPIO_FUNC_UART);
     
-    /* NE PAS configurer l'IRQ - utiliser polling */
-    printf("Using polling mode (no IRQ)\n");
-
-    printf("Performing hardware reset of RAK3172...\n");
+    /* Configure UART format (8N1) */
+    uart_set_format(uart, 8, 1, UART_PARITY_NONE);
+    uart_set_fifo_enabled(uart, true);
     
-    gpio_put(RAK3172_RST_PIN, 0);  // Assert reset
-    sleep_ms(100);
+    printf("UART%u configured: %d baud, 8N1\n", config->uartIndex, RAK3172_BAUD_RATE);
     
-    gpio_put(RAK3172_RST_PIN, 1);  // Release reset
-    sleep_ms(500);
+    /* Transmit through DMA, fall back to blocking writes */
+    dev->txChannel.uartIndex = config->uartIndex;
+    dev->txChannel.done = prvTxDoneFromISR;
+    dev->txChannel.ctx = dev;
     
-    /* Clear startup messages */
-    while(uart_is_readable(RAK3172_UART_ID))
+    if(config->txPort)
+    {
+        dev->txPort = config->txPort;
+        dev->txPort->init(&dev->txChannel);
+    }
+    else if(xRak3172DmaTx.init(&dev->txChannel))
+    {
+        dev->txPort = &xRak3172DmaTx;
+        printf("UART%u TX using DMA\n", config->uartIndex);
+    }
+    else
     {
-        uart_getc(RAK3172_UART_ID);
+        dev->txPort = &xRak3172BlockingTx;
+        dev->txPort->init(&dev->txChannel);
+        printf("WARNING: No DMA channel, UART%u TX blocking\n", config->uartIndex);
     }
     
-    printf("Reset complete\n");
+    dev->linkInfo.baud = RAK3172_BAUD_RATE;
+    dev->lastRxTick = xTaskGetTickCount();
+    dev->open = true;
     
     /* Create RAK3172 task */
-    BaseType_t xResult = xTaskCreate(Task_RAK3172, "RAK3172", 512, NULL, 2, &xRAK3172TaskHandle);
+    BaseType_t xResult = xTaskCreate(Task_RAK3172, config->name, 512, dev, 2, &dev->task);
     if(xResult != pdPASS)
     {
-        printf("ERROR: Failed to create RAK3172 task\n");
-        return pdFAIL;
+        printf("ERROR: Failed to create %s task\n", config->name);
+        return NULL;
+    }
+    
+    /* Module boot and link bring-up need blocking commands, they cannot
+     * run in Task_RAK3172. The rest of the system starts meanwhile. */
+    snprintf(taskName, sizeof(taskName), "%sBoot", config->name);
+    xResult = xTaskCreate(prvTaskRAK3172Startup, taskName, 512, dev, 2, NULL);
+    if(xResult != pdPASS)
+    {
+        printf("ERROR: Failed to create %s startup task\n", config->name);
+        return NULL;
     }
     
-    printf("RAK3172 initialized successfully on UART0 (GP0=TX, GP1=RX)\n");
+    /* Enable RX interrupts (RX FIFO level + RX timeout) */
+    pxUartDevs[config->uartIndex] = dev;
+    int uartIrq = config->uartIndex ? UART1_IRQ : UART0_IRQ;
+    irq_set_exclusive_handler(uartIrq, config->uartIndex ? rak3172_uart1_irq_handler : rak3172_uart0_irq_handler);
+    irq_set_enabled(uartIrq, true);
+    uart_set_irq_enables(uart, true, false);
+    
+    printf("%s initialized on UART%u (GP%d=TX, GP%d=RX)\n",
+           config->name, config->uartIndex, config->txPin, config->rxPin);
+    
+    return dev;
+}
+
+/* Initialize RAK3172 driver and the primary module */
+BaseType_t RAK3172_Init(void)
+{
+    printf("Initializing RAK3172...\n");
+    
+    RAK3172_PoolInit();
+    RAK3172_ConfigInit();
+    RAK3172_JoinInit();
+    
+    if(!RAK3172_DevOpen(&xPrimaryConfig))
+        return pdFAIL;
     
     /* Attendre un peu puis tester la communication */
     //vTaskDelay(pdMS_TO_TICKS(1000));
@@ -138,326 +399,1609 @@ BaseType_t RAK3172_Init(void)
     return pdPASS;
 }
 
-/* RAK3172 Task - Polling mode */
-void Task_RAK3172(void *pvParameters)
+/* Append a data line to the active command response */
+static void prvAppendResponse(RAK3172_Dev_t *dev, const char *line, size_t len)
 {
-    char lineBuffer[RAK3172_RX_BUFFER_SIZE];
-    uint16_t lineIdx = 0;
+    size_t room = sizeof(dev->response) - dev->activeCmd.responseIdx - 1;
     
-    printf("RAK3172 task started (polling mode)\n");
+    if(room == 0)
+        return;
     
-    vTaskDelay(pdMS_TO_TICKS(500));
+    /* Keep the line terminator so multi-line replies stay readable */
+    if(len + 1 > room)
+        len = room - 1;
     
-    while(1)
+    memcpy(&dev->response[dev->activeCmd.responseIdx], line, len);
+    dev->activeCmd.responseIdx += len;
+    dev->response[dev->activeCmd.responseIdx++] = '\n';
+    dev->response[dev->activeCmd.responseIdx] = '\0';
+}
+
+/* The uplink ended at txEnd: RX1 and RX2 follow, the module answers
+ * nothing but urgent commands until RX2 is over */
+static void prvRxWindowsArm(RAK3172_Dev_t *dev, TickType_t txEnd)
+{
+    dev->rxWinActive = true;
+    dev->rxWinTxEnd = txEnd;
+    dev->rxWinClose = txEnd + pdMS_TO_TICKS(RAK3172_RXWIN_RX2_DELAY_MS + RAK3172_RXWIN_LEN_MS);
+}
+
+static bool prvRxWindowsOpen(RAK3172_Dev_t *dev)
+{
+    if(dev->rxWinActive && (int32_t)(xTaskGetTickCount() - dev->rxWinClose) >= 0)
+        dev->rxWinActive = false;
+    
+    return dev->rxWinActive;
+}
+
+/* Queries, settings and uplinks would get AT_BUSY_ERROR during the
+ * windows; pings, resets and host-only requests go through */
+static bool prvHoldable(const RAK3172_Request_t *req)
+{
+    if(req->urgent || (!req->cmd && !req->payload))
+        return false;
+    
+    RAK3172_TmoClass_t cls = RAK3172_TimeoutClassify(req->cmd);
+    return cls != RAK3172_TMO_PING && cls != RAK3172_TMO_OTHER;
+}
+
+/* Finish the active command and report its result */
+static void prvCompleteCommand(RAK3172_Dev_t *dev, RAK3172_Status_t status)
+{
+    TickType_t now = xTaskGetTickCount();
+    RAK3172_Request_t req = dev->activeCmd.req;
+    
+    dev->activeCmd.active = false;
+    
+    dev->cmdStats.completed++;
+    dev->cmdStats.totalExecMs += pdTICKS_TO_MS(now - dev->activeCmd.startTick);
+    if(status == RAK3172_ERR_TIMEOUT)
+        dev->cmdStats.timeouts++;
+    if(status == RAK3172_ERR_BUSY)
+        dev->cmdStats.busy++;
+    if(req.held)
     {
-        /* Poll UART for data */
-        while(uart_is_readable(RAK3172_UART_ID))
-        {
-            char c = uart_getc(RAK3172_UART_ID);
-            
-            /* Send to queue for RAK3172_SendCommand */
-            xQueueSend(xRxQueue, &c, 0);
-            
-            /* Also process for events */
-            if(c == '\n')
-            {
-                lineBuffer[lineIdx] = '\0';
-                
-                /* Process line if it's an event */
-                if(strstr(lineBuffer, "+EVT:RXP2P"))
-                {
-                    RAK_DEBUG("LoRa RX: %s\n", lineBuffer);
-                    
-                    if(pxRxCallback)
-                    {
-                        RAK3172_RxData_t rxData = {0};
-                        pxRxCallback(&rxData);
-                    }
-                }
-                else if(strstr(lineBuffer, "+EVT:"))
-                {
-                    RAK_DEBUG("RAK3172 Event: %s\n", lineBuffer);
-                }
-                
-                lineIdx = 0;
-            }
-            else if(c != '\r' && lineIdx < RAK3172_RX_BUFFER_SIZE - 1)
-            {
-                lineBuffer[lineIdx++] = c;
-            }
-        }
+        uint32_t latencyMs = pdTICKS_TO_MS(now - req.submitTick);
+        
+        dev->cmdStats.rxWinHeldMs += latencyMs;
+        if(latencyMs > dev->cmdStats.rxWinHeldMaxMs)
+            dev->cmdStats.rxWinHeldMaxMs = latencyMs;
+    }
+    
+    /* Feed the adaptive deadline of the command class */
+    if(dev->activeCmd.onWire)
+    {
+        uint32_t latencyMs = (time_us_32() - dev->activeCmd.startUs) / 1000;
+        
+        if(status == RAK3172_ERR_TIMEOUT)
+            RAK3172_TimeoutExpired(dev->activeCmd.tmoClass);
+        else
+            RAK3172_TimeoutSample(dev->activeCmd.tmoClass,
+                                  latencyMs > dev->activeCmd.wireMs ? latencyMs - dev->activeCmd.wireMs : 0);
+    }
+    
+    /* The module answers at the new rate from now on */
+    if(status == RAK3172_OK && req.baud)
+        prvSetHostBaud(dev, req.baud);
+    
+    /* Uplink type now set on the module, whoever asked for it */
+    if(req.cmd && strncmp(req.cmd, "AT+CFM=", 7) == 0 && (req.cmd[7] == '0' || req.cmd[7] == '1') && !req.cmd[8])
+        dev->cfm = status == RAK3172_OK ? req.cmd[7] - '0' : -1;
+    
+    /* Uplink on the air, its sub-band is now off and the receive windows follow */
+    if(status == RAK3172_OK && !req.cmd && req.payload)
+    {
+        uint32_t airtimeUs = RAK3172_UplinkAirtimeUs(dev->dataRate, req.payloadLen);
         
-        /* Yield to other tasks */
-        vTaskDelay(pdMS_TO_TICKS(10));
+        RAK3172_DevDutyCycleCharge(dev, airtimeUs);
+        prvRxWindowsArm(dev, now + pdMS_TO_TICKS(airtimeUs / 1000));
+        dev->cmdStats.rxWinCycles++;
     }
+    
+    RAK_DEBUG("[DEBUG] %s -> %s\n", req.cmd ? req.cmd : "AT+SEND", RAK3172_StatusString(status));
+    
+    if(req.callback)
+        req.callback(status, dev->response, req.ctx);
 }
 
-/* Hardware reset of RAK3172 */
-BaseType_t RAK3172_HardwareReset(void)
+/* Build the command line in the TX buffer, returns its length or 0 if it
+ * does not fit. AT+SEND payloads are hex-encoded in place. */
+static size_t prvBuildCommand(RAK3172_Dev_t *dev, const RAK3172_Request_t *req)
 {
-    printf("Performing hardware reset of RAK3172...\n");
-    
-    gpio_put(RAK3172_RST_PIN, 0);  // Assert reset
-    vTaskDelay(pdMS_TO_TICKS(100));
-    
-    gpio_put(RAK3172_RST_PIN, 1);  // Release reset
-    vTaskDelay(pdMS_TO_TICKS(500));
+    size_t len = 0;
     
-    /* Clear startup messages */
-    while(uart_is_readable(RAK3172_UART_ID))
+    if(req->cmd)
     {
-        uart_getc(RAK3172_UART_ID);
+        len = strlen(req->cmd);
+        if(len + 2 > sizeof(dev->txBuffer))
+            return 0;
+        memcpy(dev->txBuffer, req->cmd, len);
+    }
+    else
+    {
+        uint8_t port = req->port;
+        
+        memcpy(dev->txBuffer, "AT+SEND=", 8);
+        len = 8;
+        if(port >= 100)
+            dev->txBuffer[len++] = '0' + port / 100;
+        if(port >= 10)
+            dev->txBuffer[len++] = '0' + (port / 10) % 10;
+        dev->txBuffer[len++] = '0' + port % 10;
+        dev->txBuffer[len++] = ':';
+        
+        RAK3172_HexEncode(req->payload, req->payloadLen, (char *)&dev->txBuffer[len]);
+        len += 2 * req->payloadLen;
     }
     
-    RAK_DEBUG("Reset complete\n");
+    dev->txBuffer[len++] = '\r';
+    dev->txBuffer[len++] = '\n';
     
-    return pdPASS;
+    return len;
 }
 
-/* Send AT command and wait for response */
-BaseType_t RAK3172_SendCommand(const char *cmd, char *response, uint32_t timeout_ms)
+/* Next request to run. While the receive windows are open, holdable
+ * requests move aside in order and urgent ones overtake them; once the
+ * windows close the held ones run first. The queue is always scanned to
+ * the end, nothing goes back in it. */
+static bool prvNextRequest(RAK3172_Dev_t *dev, RAK3172_Request_t *req)
 {
-    if(!cmd)
-        return pdFAIL;
+    bool open = prvRxWindowsOpen(dev);
     
-    RAK_DEBUG("\n[DEBUG] === RAK3172_SendCommand ===\n");
-    RAK_DEBUG("[DEBUG] Command: %s\n", cmd);
-    RAK_DEBUG("[DEBUG] Timeout: %lu ms\n", timeout_ms);
+    /* Its AT+CFM switch just went through */
+    if(dev->cfmSendPending)
+    {
+        *req = dev->cfmSend;
+        dev->cfmSendPending = false;
+        return true;
+    }
     
-    /* Lock UART */
-    if(xSemaphoreTake(xUartMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
+    if(!open && dev->heldCount)
     {
-        RAK_DEBUG("[DEBUG] ERROR: Failed to acquire mutex\n");
-        return pdFAIL;
+        *req = dev->held[0];
+        dev->heldCount--;
+        memmove(&dev->held[0], &dev->held[1], dev->heldCount * sizeof(dev->held[0]));
+        
+        /* Only pending with the list full, there is room now */
+        if(dev->deferredPending)
+        {
+            dev->held[dev->heldCount++] = dev->deferred;
+            dev->deferredPending = false;
+        }
+        return true;
+    }
+    
+    while(xQueueReceive(dev->cmdQueue, req, 0) == pdTRUE)
+    {
+        if(!open || !prvHoldable(req))
+            return true;
+        
+        /* Nowhere left to put it, it runs and may meet a busy module */
+        if(dev->heldCount >= RAK3172_RXWIN_MAX_HELD && dev->deferredPending)
+        {
+            dev->cmdStats.rxWinOverflow++;
+            return true;
+        }
+        
+        req->held = true;
+        dev->cmdStats.rxWinHeld++;
+        
+        /* The last one waits outside the queue, urgent ones behind it
+         * still get through */
+        if(dev->heldCount < RAK3172_RXWIN_MAX_HELD)
+        {
+            dev->held[dev->heldCount++] = *req;
+        }
+        else
+        {
+            dev->deferred = *req;
+            dev->deferredPending = true;
+        }
     }
     
-    RAK_DEBUG("[DEBUG] Mutex acquired\n");
+    return false;
+}
+
+/* AT+CFM switch ahead of an uplink done. On failure the uplink would go
+ * out with the wrong type, it fails instead. */
+static void prvCfmSwitched(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    RAK3172_Dev_t *dev = (RAK3172_Dev_t *)ctx;
+    
+    if(status == RAK3172_OK || !dev->cfmSendPending)
+        return;
+    
+    dev->cfmSendPending = false;
+    if(dev->cfmSend.callback)
+        dev->cfmSend.callback(status, response, dev->cfmSend.ctx);
+}
+
+/* Put the next queued command on the wire. Transmission runs in the
+ * background (DMA), the reply is collected by the line parser. */
+static void prvStartNextCommand(RAK3172_Dev_t *dev)
+{
+    RAK3172_Request_t req;
+    
+    /* Previous command still leaving the DMA buffer */
+    if(dev->txPort->busy(&dev->txChannel))
+        return;
+    
+    if(!prvNextRequest(dev, &req))
+        return;
     
-    /* Clear RX queue */
-    UBaseType_t itemsCleared = 0;
-    char dummyChar;
-    while(xQueueReceive(xRxQueue, &dummyChar, 0) == pdTRUE)
+    /* The module type is global: an uplink of the other type switches it
+     * first and runs right after, nothing else goes in between */
+    if(!req.cmd && req.payload && dev->cfm != (int8_t)req.confirmed && RAK3172_DevDutyCycleWaitMs(dev) == 0)
     {
-        itemsCleared++;
+        dev->cfmSend = req;
+        dev->cfmSendPending = true;
+        dev->cmdStats.cfmSwitches++;
+        
+        req = (RAK3172_Request_t){
+            .cmd = req.confirmed ? "AT+CFM=1" : "AT+CFM=0",
+            .callback = prvCfmSwitched,
+            .ctx = dev,
+            .timeout_ms = RAK3172_CFM_SWITCH_TIMEOUT_MS,
+            .submitTick = req.submitTick,
+            .urgent = true,
+        };
     }
-    if(itemsCleared > 0)
+    
+    dev->activeCmd.req = req;
+    dev->activeCmd.startTick = xTaskGetTickCount();
+    dev->activeCmd.startUs = time_us_32();
+    dev->activeCmd.responseIdx = 0;
+    dev->activeCmd.active = true;
+    dev->activeCmd.onWire = false;
+    dev->response[0] = '\0';
+    
+    dev->cmdStats.totalWaitMs += pdTICKS_TO_MS(dev->activeCmd.startTick - req.submitTick);
+    
+    /* Host-only rate change, nothing to send */
+    if(!req.cmd && !req.payload)
     {
-        RAK_DEBUG("[DEBUG] Cleared %u items from RX queue\n", itemsCleared);
+        prvCompleteCommand(dev, req.baud ? RAK3172_OK : RAK3172_ERR_INVALID);
+        return;
     }
     
-    /* Check if UART is writable */
-    if(!uart_is_writable(RAK3172_UART_ID))
+    /* The module would refuse it, save the round trip */
+    if(!req.cmd && RAK3172_DevDutyCycleWaitMs(dev) > 0)
     {
-        RAK_DEBUG("[DEBUG] WARNING: UART not writable!\n");
+        prvCompleteCommand(dev, RAK3172_ERR_DUTY_CYCLE);
+        return;
     }
     
-    /* Send command character by character for debug */
-    RAK_DEBUG("[DEBUG] Sending bytes: ");
-    uart_puts(RAK3172_UART_ID, cmd);
-    for(size_t i = 0; cmd[i] != '\0'; i++)
+    size_t len = prvBuildCommand(dev, &req);
+    if(len == 0 || (!dev->simModule && !dev->txPort->write(&dev->txChannel, dev->txBuffer, len)))
     {
-        RAK_DEBUG("0x%02X ", (uint8_t)cmd[i]);
+        prvCompleteCommand(dev, RAK3172_ERR_INVALID);
+        return;
     }
-    uart_puts(RAK3172_UART_ID, "\r\n");
-    RAK_DEBUG("0x0D 0x0A\n");
     
-    /* Wait for data to be sent */
-    uart_tx_wait_blocking(RAK3172_UART_ID);
-    RAK_DEBUG("[DEBUG] Data sent successfully\n");
+    /* Learned deadline of the class, plus the time the line takes on the
+     * wire; the caller's timeout stays the upper bound */
+    uint32_t baud = dev->linkInfo.baud ? dev->linkInfo.baud : RAK3172_BAUD_RATE;
+    uint32_t timeout;
     
-    /* Wait for response */
-    char rxChar;
-    uint16_t rxIdx = 0;
-    TickType_t startTime = xTaskGetTickCount();
-    bool responseComplete = false;
-    uint32_t charsReceived = 0;
+    dev->activeCmd.tmoClass = RAK3172_TimeoutClassify(req.cmd);
+    dev->activeCmd.wireMs = (uint32_t)(len * 10 * 1000 / baud) + 1;
+    timeout = dev->activeCmd.wireMs + RAK3172_TimeoutGet(dev->activeCmd.tmoClass, req.timeout_ms);
+    if(timeout > req.timeout_ms)
+        timeout = req.timeout_ms;
+    dev->activeCmd.deadline = dev->activeCmd.startTick + pdMS_TO_TICKS(timeout);
+    dev->activeCmd.onWire = true;
     
-    if(response)
-        response[0] = '\0';
+    /* Simulated module: the reply is parsed on the next pass of the task */
+    if(dev->simModule)
+    {
+        RAK3172_DevInjectRx(dev, "OK\r\n", 4);
+        return;
+    }
     
-    RAK_DEBUG("[DEBUG] Waiting for response...\n");
+    dev->uartStats.txBytes += len;
+    if(dev->txPort == &xRak3172DmaTx)
+        dev->uartStats.txDma++;
+}
+
+/* Call the handler registered for this fPort, or the catch-all callback */
+static void prvDispatchDownlink(const RAK3172_RxData_t *rx)
+{
+    RAK3172_RxCallback_t callback = pxRxCallback;
     
-    while(!responseComplete && (xTaskGetTickCount() - startTime) < pdMS_TO_TICKS(timeout_ms))
+    if(rx->window != RAK3172_RX_WINDOW_P2P)
     {
-        if(xQueueReceive(xRxQueue, &rxChar, pdMS_TO_TICKS(100)) == pdTRUE)
+        for(int i = 0; i < RAK3172_MAX_PORT_HANDLERS; i++)
         {
-            charsReceived++;
-            
-            RAK_DEBUG("[DEBUG] RX char %u: 0x%02X ('%c')\n", charsReceived, (uint8_t)rxChar, 
-                   (rxChar >= 32 && rxChar < 127) ? rxChar : '.');
-            
-            if(response && rxIdx < RAK3172_RX_BUFFER_SIZE - 1)
+            if(xPortHandlers[i].callback && xPortHandlers[i].port == rx->port)
             {
-                response[rxIdx++] = rxChar;
-                response[rxIdx] = '\0';
-                
-                /* Check for complete response (ends with OK or ERROR) */
-                if(strstr(response, "OK\r\n") || strstr(response, "ERROR"))
-                {
-                    responseComplete = true;
-                    RAK_DEBUG("[DEBUG] Response complete detected\n");
-                }
+                callback = xPortHandlers[i].callback;
+                break;
             }
         }
-        
-        // Afficher un point toutes les 500ms pour montrer qu'on attend
-        static TickType_t lastDot = 0;
-        if((xTaskGetTickCount() - lastDot) > pdMS_TO_TICKS(500))
-        {
-            printf(".");
-            lastDot = xTaskGetTickCount();
-        }
     }
     
-    RAK_DEBUG("\n[DEBUG] Chars received: %u\n", charsReceived);
+    if(callback)
+        callback(rx);
+}
+
+/* Decode an unsolicited +EVT: line and publish it.
+ * Downlinks are decoded straight into a pool block which travels with the
+ * event descriptor, nothing is copied afterwards. */
+static void prvHandleUrc(RAK3172_Dev_t *dev, const char *line, size_t len)
+{
+    RAK3172_EventData_t xEvent = { .type = RAK3172_EVENT_NONE, .length = 0, .handle = RAK3172_POOL_NONE };
+    RAK3172_RxData_t *pxRx = &dev->rxScratch;
+    RAK3172_PoolHandle_t handle = RAK3172_POOL_NONE;
     
-    if(response && strlen(response) > 0)
+    /* Only downlinks need a block */
+    if(strncmp(line, "+EVT:RX", 7) == 0 || dev->urcParser.pending != RAK3172_URC_UNKNOWN)
     {
-        RAK_DEBUG("[DEBUG] Full response:\n%s\n", response);
+        handle = RAK3172_PoolAlloc();
+        if(handle != RAK3172_POOL_NONE)
+            pxRx = (RAK3172_RxData_t *)RAK3172_PoolGet(handle);
     }
-    else
+    
+    RAK3172_UrcType_t urc = RAK3172_ParseUrc(&dev->urcParser, line, len, pxRx);
+    
+    switch(urc)
     {
-        RAK_DEBUG("[DEBUG] No response received\n");
+        case RAK3172_URC_JOINED:
+            xEvent.type = RAK3172_EVENT_JOIN_SUCCESS;
+            dev->joined = true;
+            if(dev == pxPrimary)
+                RAK3172_JoinHandleUrc(true);
+            break;
+        case RAK3172_URC_JOIN_FAILED:
+            xEvent.type = RAK3172_EVENT_JOIN_FAILED;
+            dev->joined = false;
+            if(dev == pxPrimary)
+                RAK3172_JoinHandleUrc(false);
+            break;
+        case RAK3172_URC_TX_DONE:
+            xEvent.type = RAK3172_EVENT_TX_DONE;
+            /* Before RX1 could open it marks the real end of the
+             * transmission, later it comes after the windows */
+            if(dev->rxWinActive)
+            {
+                TickType_t now = xTaskGetTickCount();
+                
+                if((int32_t)(now - (dev->rxWinTxEnd + pdMS_TO_TICKS(RAK3172_RXWIN_RX1_DELAY_MS))) < 0)
+                    prvRxWindowsArm(dev, now);
+                else
+                    dev->rxWinActive = false;
+            }
+            break;
+        case RAK3172_URC_TX_P2P_DONE:
+            if(dev == pxPrimary)
+                RAK3172_P2pHandleTxDone();
+            break;
+        case RAK3172_URC_SEND_CONFIRMED_OK:
+            dev->rxWinActive = false;
+            xEvent.type = RAK3172_EVENT_TX_SUCCESS;
+            if(dev == pxPrimary)
+                RAK3172_ConfirmHandleUrc(true);
+            break;
+        case RAK3172_URC_SEND_CONFIRMED_FAILED:
+            dev->rxWinActive = false;
+            xEvent.type = RAK3172_EVENT_TX_FAILED;
+            if(dev == pxPrimary)
+                RAK3172_ConfirmHandleUrc(false);
+            break;
+        case RAK3172_URC_RX:
+        case RAK3172_URC_RX_P2P:
+            xEvent.type = (urc == RAK3172_URC_RX) ? RAK3172_EVENT_RX_DATA : RAK3172_EVENT_RX_P2P;
+            /* A downlink ends the windows of its uplink */
+            if(urc == RAK3172_URC_RX)
+                dev->rxWinActive = false;
+            /* Class C: straight to USB before anything else */
+            if(urc == RAK3172_URC_RX && dev == pxPrimary)
+                RAK3172_ClassCHandleRx(pxRx, dev->curLineUs);
+            if(urc == RAK3172_URC_RX_P2P && dev == pxPrimary)
+                RAK3172_P2pHandleRx(pxRx);
+            prvDispatchDownlink(pxRx);
+            if(handle != RAK3172_POOL_NONE)
+            {
+                xEvent.handle = handle;
+                xEvent.length = pxRx->length;
+                handle = RAK3172_POOL_NONE;
+            }
+            break;
+        case RAK3172_URC_PARTIAL:
+            break;
+        case RAK3172_URC_UNKNOWN:
+        default:
+            RAK_DEBUG("RAK3172 Event: %s\n", line);
+            break;
     }
     
-    /* Unlock UART */
-    xSemaphoreGive(xUartMutex);
+    /* Block not handed over to an event */
+    RAK3172_PoolFree(handle);
     
-    RAK_DEBUG("[DEBUG] === End of RAK3172_SendCommand ===\n\n");
+    if(xEvent.type == RAK3172_EVENT_NONE)
+        return;
     
-    return responseComplete ? pdPASS : pdFAIL;
+    if(xQueueSend(dev->eventQueue, &xEvent, 0) != pdTRUE)
+    {
+        RAK3172_PoolFree(xEvent.handle);
+        dev->cmdStats.eventDrops++;
+        RAK_DEBUG("Event queue full, dropped: %s\n", line);
+    }
 }
 
-/* Get firmware version */
-BaseType_t RAK3172_GetVersion(char *version, size_t max_len)
+/* Handle one complete line from the module */
+static void prvProcessLine(RAK3172_Dev_t *dev, const char *line, size_t len)
 {
-    char response[128];
+    RAK3172_Status_t status = RAK3172_OK;
+    bool pending = dev->activeCmd.active;
+    RAK3172_LineType_t type = RAK3172_ClassifyLine(line, len,
+                                                   pending ? dev->activeCmd.req.cmd : NULL,
+                                                   &status);
     
-    if(RAK3172_SendCommand("AT+VER=?", response, 2000) == pdPASS)
+    switch(type)
     {
-        /* Parse response: AT+VER=X.X.X */
-        char *ver = strstr(response, "AT+VER=");
-        if(ver)
-        {
-            ver += 7; // Skip "AT+VER="
-            char *end = strchr(ver, '\r');
-            if(end)
+        case RAK3172_LINE_URC:
+            /* Never part of a command reply, even when one is pending */
+            prvHandleUrc(dev, line, len);
+            break;
+        
+        case RAK3172_LINE_DATA:
+            if(len >= sizeof(RAK3172_BOOT_BANNER) - 1 &&
+               strncmp(line, RAK3172_BOOT_BANNER, sizeof(RAK3172_BOOT_BANNER) - 1) == 0)
             {
-                size_t len = end - ver;
-                if(len < max_len)
-                {
-                    strncpy(version, ver, len);
-                    version[len] = '\0';
-                    return pdPASS;
-                }
+                /* A saved AT+CFM may differ from what we last set */
+                dev->cfm = -1;
+                xSemaphoreGive(dev->readySem);
             }
-        }
+            
+            if(pending)
+            {
+                prvAppendResponse(dev, line, len);
+            }
+            else
+            {
+                RAK_DEBUG("Unsolicited: %s\n", line);
+            }
+            break;
+        
+        case RAK3172_LINE_OK:
+        case RAK3172_LINE_ERROR:
+            if(pending)
+            {
+                prvCompleteCommand(dev, status);
+            }
+            break;
+        
+        case RAK3172_LINE_ECHO:
+        case RAK3172_LINE_EMPTY:
+        default:
+            break;
     }
-    
-    return pdFAIL;
 }
 
-/* Join LoRaWAN network */
-BaseType_t RAK3172_Join(uint32_t timeout_ms)
+/* One line out of the RX ring, runs in Task_RAK3172 */
+static void prvRxLine(void *ctx, char *line, size_t length)
 {
-    char response[256];
+    RAK3172_Dev_t *dev = (RAK3172_Dev_t *)ctx;
     
-    if(RAK3172_SendCommand("AT+JOIN=1:0:10:8", response, timeout_ms) == pdPASS)
+    dev->curLineUs = dev->lineUs[dev->linesParsed++ & (RAK3172_LINE_STAMPS - 1)];
+    if(!dev->simHang)
     {
-        if(strstr(response, "+EVT:JOINED"))
-        {
-            return pdPASS;
-        }
+        dev->lastRxTick = xTaskGetTickCount();
+        prvProcessLine(dev, line, length);
     }
-    
-    return pdFAIL;
 }
 
-/* Send confirmed data */
-BaseType_t RAK3172_SendData(uint8_t port, const uint8_t *data, uint16_t length)
+/* RAK3172 Task - owns the UART: runs queued commands one at a time and
+ * parses every line the IRQ hands over */
+void Task_RAK3172(void *pvParameters)
 {
-    if(!data || length == 0 || length > RAK3172_MAX_PAYLOAD)
-        return pdFAIL;
+    RAK3172_Dev_t *dev = (RAK3172_Dev_t *)pvParameters;
+    RAK3172_RxLine_t xLine = { .length = 0 };
     
-    char cmd[600];
-    char hexData[RAK3172_MAX_PAYLOAD * 2 + 1];
+    printf("%s task started (IRQ mode)\n", dev->config.name);
     
-    /* Convert data to hex string */
-    for(uint16_t i = 0; i < length; i++)
+    while(1)
     {
-        sprintf(&hexData[i * 2], "%02X", data[i]);
+        TickType_t xWait = portMAX_DELAY;
+        
+        /* No receive windows after a reset, and AT+CFM is unknown */
+        if(dev->resetPending)
+        {
+            dev->resetPending = false;
+            dev->rxWinActive = false;
+            dev->cfm = -1;
+        }
+        
+        if(!dev->activeCmd.active)
+        {
+            prvStartNextCommand(dev);
+        }
+        
+        if(dev->activeCmd.active)
+        {
+            TickType_t now = xTaskGetTickCount();
+            xWait = ((int32_t)(dev->activeCmd.deadline - now) > 0) ? (dev->activeCmd.deadline - now) : 0;
+        }
+        else if(dev->heldCount)
+        {
+            /* Wake up when the receive windows close */
+            TickType_t now = xTaskGetTickCount();
+            xWait = ((int32_t)(dev->rxWinClose - now) > 0) ? (dev->rxWinClose - now) : 0;
+        }
+        
+        /* Sleep until a line terminator arrives, a command is submitted or the deadline expires */
+        ulTaskNotifyTake(pdTRUE, xWait);
+        
+        if(dev->discardLine)
+        {
+            dev->discardLine = false;
+            xLine.length = 0;
+        }
+        
+        RAK3172_RxSplit(&dev->rxRing, &xLine, prvRxLine, dev);
+        
+        /* Ring drained: line numbers agree again, even after ring drops */
+        taskENTER_CRITICAL();
+        if(RAK3172_RxRingEmpty(&dev->rxRing))
+            dev->linesParsed = dev->lineCount;
+        taskEXIT_CRITICAL();
+        
+        if(dev->activeCmd.active && (int32_t)(xTaskGetTickCount() - dev->activeCmd.deadline) >= 0)
+        {
+            prvCompleteCommand(dev, RAK3172_ERR_TIMEOUT);
+        }
     }
-    hexData[length * 2] = '\0';
-    
-    /* Build command */
-    snprintf(cmd, sizeof(cmd), "AT+SEND=%d:%s", port, hexData);
-    
-    char response[256];
-    return RAK3172_SendCommand(cmd, response, 30000);
 }
 
-/* Send unconfirmed data */
-BaseType_t RAK3172_SendDataUnconfirmed(uint8_t port, const uint8_t *data, uint16_t length)
+/* Put a request on the command queue and wake the RAK3172 task */
+static RAK3172_Status_t prvSubmit(RAK3172_Dev_t *dev, RAK3172_Request_t *req)
 {
-    if(!data || length == 0 || length > RAK3172_MAX_PAYLOAD)
-        return pdFAIL;
+    if(!dev->cmdQueue)
+        return RAK3172_ERR_INVALID;
     
-    char cmd[600];
-    char hexData[RAK3172_MAX_PAYLOAD * 2 + 1];
+    req->submitTick = xTaskGetTickCount();
     
-    /* Convert data to hex string */
-    for(uint16_t i = 0; i < length; i++)
+    if(xQueueSend(dev->cmdQueue, req, 0) != pdTRUE)
     {
-        sprintf(&hexData[i * 2], "%02X", data[i]);
+        taskENTER_CRITICAL();
+        dev->cmdStats.queueFull++;
+        taskEXIT_CRITICAL();
+        return RAK3172_ERR_QUEUE_FULL;
     }
-    hexData[length * 2] = '\0';
     
-    /* Build command */
-    snprintf(cmd, sizeof(cmd), "AT+SEND=%d:%s", port, hexData);
+    UBaseType_t depth = uxQueueMessagesWaiting(dev->cmdQueue);
+    
+    taskENTER_CRITICAL();
+    dev->cmdStats.submitted++;
+    if(depth > dev->cmdStats.queueHighWater)
+        dev->cmdStats.queueHighWater = depth;
+    taskEXIT_CRITICAL();
+    
+    xTaskNotifyGive(dev->task);
     
-    char response[256];
-    return RAK3172_SendCommand(cmd, response, 10000);
+    return RAK3172_OK;
 }
 
-/* Set DevEUI */
-BaseType_t RAK3172_SetDevEUI(const char *deveui)
+/* Queue an AT command without waiting for it.
+ * The callback (optional) runs in the RAK3172 task once the final result
+ * code or the timeout is reached. cmd must stay valid until then. */
+RAK3172_Status_t RAK3172_DevSubmitCommand(RAK3172_Dev_t *dev, const char *cmd,
+                                          RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
 {
-    char cmd[64];
-    snprintf(cmd, sizeof(cmd), "AT+DEVEUI=%s", deveui);
-    char response[128];
-    return RAK3172_SendCommand(cmd, response, 2000);
+    if(!dev || !cmd)
+        return RAK3172_ERR_INVALID;
+    
+    RAK3172_Request_t req = {
+        .cmd = cmd,
+        .callback = callback,
+        .ctx = ctx,
+        .timeout_ms = timeout_ms,
+    };
+    
+    return prvSubmit(dev, &req);
 }
 
-/* Set AppEUI */
-BaseType_t RAK3172_SetAppEUI(const char *appeui)
+RAK3172_Status_t RAK3172_SubmitCommand(const char *cmd, RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
 {
-    char cmd[64];
-    snprintf(cmd, sizeof(cmd), "AT+APPEUI=%s", appeui);
-    char response[128];
-    return RAK3172_SendCommand(cmd, response, 2000);
+    return RAK3172_DevSubmitCommand(pxPrimary, cmd, callback, ctx, timeout_ms);
+}
+
+/* Largest payload at the module's current data rate */
+static uint8_t prvMaxPayload(const RAK3172_Dev_t *dev)
+{
+    const RAK3172_DataRate_t *pxDr = RAK3172_GetDataRateInfo(dev->dataRate);
+    
+    return pxDr ? pxDr->maxPayload : 0;
+}
+
+/* Queue an uplink without waiting for it. The AT+SEND line is encoded
+ * while it is written to the UART, data must stay valid until the
+ * callback has run. */
+RAK3172_Status_t RAK3172_DevSubmitSend(RAK3172_Dev_t *dev, uint8_t port, const uint8_t *data, uint16_t length,
+                                       RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    if(!dev || !data || length == 0 || length > RAK3172_MAX_PAYLOAD)
+        return RAK3172_ERR_INVALID;
+    
+    /* Would fail on the module after a full round trip */
+    if(length > prvMaxPayload(dev))
+        return RAK3172_ERR_PAYLOAD_SIZE;
+    
+    RAK3172_Request_t req = {
+        .cmd = NULL,
+        .payload = data,
+        .payloadLen = length,
+        .port = port,
+        .callback = callback,
+        .ctx = ctx,
+        .timeout_ms = timeout_ms,
+    };
+    
+    return prvSubmit(dev, &req);
+}
+
+RAK3172_Status_t RAK3172_SubmitSend(uint8_t port, const uint8_t *data, uint16_t length,
+                                    RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    return RAK3172_DevSubmitSend(pxPrimary, port, data, length, callback, ctx, timeout_ms);
+}
+
+/* Context of a blocking command, lives on the caller's stack */
+typedef struct {
+    TaskHandle_t waiter;
+    char *response;
+    size_t responseLen;
+    RAK3172_Status_t status;
+} RAK3172_SyncCtx_t;
+
+static void prvSyncCallback(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    RAK3172_SyncCtx_t *pxSync = (RAK3172_SyncCtx_t *)ctx;
+    
+    if(pxSync->response && pxSync->responseLen > 0)
+    {
+        strncpy(pxSync->response, response, pxSync->responseLen - 1);
+        pxSync->response[pxSync->responseLen - 1] = '\0';
+    }
+    
+    pxSync->status = status;
+    xTaskNotifyGiveIndexed(pxSync->waiter, RAK3172_NOTIFY_INDEX);
+}
+
+/* Submit a request and block until the RAK3172 task completes it */
+static RAK3172_Status_t prvSubmitAndWait(RAK3172_Dev_t *dev, RAK3172_Request_t *req, char *response, size_t response_len)
+{
+    /* The RAK3172 task would wait for itself */
+    if(xTaskGetCurrentTaskHandle() == dev->task)
+        return RAK3172_ERR_INVALID;
+    
+    RAK3172_SyncCtx_t xSync = {
+        .waiter = xTaskGetCurrentTaskHandle(),
+        .response = response,
+        .responseLen = response ? response_len : 0,
+        .status = RAK3172_ERR_TIMEOUT,
+    };
+    
+    if(response && response_len > 0)
+        response[0] = '\0';
+    
+    req->callback = prvSyncCallback;
+    req->ctx = &xSync;
+    
+    xTaskNotifyStateClearIndexed(NULL, RAK3172_NOTIFY_INDEX);
+    
+    RAK3172_Status_t status = prvSubmit(dev, req);
+    if(status != RAK3172_OK)
+        return status;
+    
+    /* The RAK3172 task always completes the command, at the latest on its deadline */
+    ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+    
+    return xSync.status;
+}
+
+/* Send AT command and wait for its final result code.
+ * Data lines of the reply are copied to response, one per line. */
+RAK3172_Status_t RAK3172_DevSendCommand(RAK3172_Dev_t *dev, const char *cmd, char *response,
+                                        size_t response_len, uint32_t timeout_ms)
+{
+    if(!dev || !cmd)
+        return RAK3172_ERR_INVALID;
+    
+    RAK3172_Request_t req = {
+        .cmd = cmd,
+        .timeout_ms = timeout_ms,
+    };
+    
+    return prvSubmitAndWait(dev, &req, response, response_len);
+}
+
+RAK3172_Status_t RAK3172_SendCommand(const char *cmd, char *response, size_t response_len, uint32_t timeout_ms)
+{
+    return RAK3172_DevSendCommand(pxPrimary, cmd, response, response_len, timeout_ms);
+}
+
+/* As RAK3172_SendCommand(), but never held back for receive windows */
+RAK3172_Status_t RAK3172_SendCommandUrgent(const char *cmd, char *response, size_t response_len, uint32_t timeout_ms)
+{
+    if(!cmd)
+        return RAK3172_ERR_INVALID;
+    
+    RAK3172_Request_t req = {
+        .cmd = cmd,
+        .timeout_ms = timeout_ms,
+        .urgent = true,
+    };
+    
+    return prvSubmitAndWait(pxPrimary, &req, response, response_len);
+}
+
+/* Transaction in progress, lives on the caller's stack */
+typedef struct {
+    RAK3172_TxnItem_t *items;
+    size_t count;
+    size_t idx;                 /* Step on the wire */
+    bool rollback;
+    bool undoing;
+    uint32_t timeout_ms;
+    RAK3172_Status_t status;    /* First failure */
+    TaskHandle_t waiter;
+} RAK3172_Txn_t;
+
+static void prvTxnCallback(RAK3172_Status_t status, const char *response, void *ctx);
+
+/* Queue the next command of the transaction (forward step or undo),
+ * returns false when there is nothing left to run */
+static bool prvTxnNext(RAK3172_Txn_t *pxTxn)
+{
+    while(1)
+    {
+        const char *cmd;
+        
+        if(!pxTxn->undoing)
+        {
+            if(pxTxn->idx >= pxTxn->count)
+                return false;
+            cmd = pxTxn->items[pxTxn->idx].cmd;
+        }
+        else
+        {
+            /* Undo the steps that succeeded, newest first */
+            if(pxTxn->idx == 0)
+                return false;
+            pxTxn->idx--;
+            cmd = pxTxn->items[pxTxn->idx].undo;
+            if(!cmd)
+                continue;
+        }
+        
+        RAK3172_Request_t req = {
+            .cmd = cmd,
+            .callback = prvTxnCallback,
+            .ctx = pxTxn,
+            .timeout_ms = pxTxn->timeout_ms,
+        };
+        
+        RAK3172_Status_t status = prvSubmit(pxPrimary, &req);
+        if(status == RAK3172_OK)
+            return true;
+        
+        /* Queue full: a failed forward step, or an undo we have to skip */
+        if(!pxTxn->undoing)
+        {
+            pxTxn->items[pxTxn->idx].status = status;
+            pxTxn->status = status;
+            if(!pxTxn->rollback)
+                return false;
+            pxTxn->undoing = true;
+        }
+    }
+}
+
+/* Step result, runs in the RAK3172 task and queues the next step at once */
+static void prvTxnCallback(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    RAK3172_Txn_t *pxTxn = (RAK3172_Txn_t *)ctx;
+    
+    if(!pxTxn->undoing)
+    {
+        pxTxn->items[pxTxn->idx].status = status;
+        
+        if(status == RAK3172_OK)
+        {
+            pxTxn->idx++;
+        }
+        else
+        {
+            pxTxn->status = status;
+            if(!pxTxn->rollback)
+            {
+                xTaskNotifyGiveIndexed(pxTxn->waiter, RAK3172_NOTIFY_INDEX);
+                return;
+            }
+            pxTxn->undoing = true;
+        }
+    }
+    
+    if(!prvTxnNext(pxTxn))
+        xTaskNotifyGiveIndexed(pxTxn->waiter, RAK3172_NOTIFY_INDEX);
+}
+
+/* Run a list of commands back to back. Each step is queued by the RAK3172
+ * task as soon as the previous reply is in, without waking the caller.
+ * The first failure stops the transaction; with rollback the undo
+ * commands of the steps already done run in reverse order. */
+RAK3172_Status_t RAK3172_RunTransaction(RAK3172_TxnItem_t *items, size_t count, bool rollback,
+                                        uint32_t timeout_ms, uint32_t *elapsed_ms)
+{
+    uint32_t start = time_us_32();
+    
+    if(!items || count == 0)
+        return RAK3172_ERR_INVALID;
+    
+    /* The RAK3172 task would wait for itself */
+    if(xTaskGetCurrentTaskHandle() == pxPrimary->task)
+        return RAK3172_ERR_INVALID;
+    
+    for(size_t i = 0; i < count; i++)
+        items[i].status = RAK3172_ERR_ABORTED;
+    
+    RAK3172_Txn_t xTxn = {
+        .items = items,
+        .count = count,
+        .idx = 0,
+        .rollback = rollback,
+        .undoing = false,
+        .timeout_ms = timeout_ms,
+        .status = RAK3172_OK,
+        .waiter = xTaskGetCurrentTaskHandle(),
+    };
+    
+    xTaskNotifyStateClearIndexed(NULL, RAK3172_NOTIFY_INDEX);
+    
+    /* Every step completes, at the latest on its deadline */
+    if(prvTxnNext(&xTxn))
+        ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+    
+    if(elapsed_ms)
+        *elapsed_ms = (time_us_32() - start) / 1000;
+    
+    return xTxn.status;
+}
+
+/* Get firmware version, from the configuration shadow once known */
+RAK3172_Status_t RAK3172_GetVersion(char *version, size_t max_len)
+{
+    return RAK3172_ConfigGet(RAK3172_CFG_VERSION, version, max_len);
+}
+
+/* Blocking uplink, the payload is streamed from data without any copy */
+static RAK3172_Status_t prvSendBlocking(RAK3172_Dev_t *dev, uint8_t port, const uint8_t *data, uint16_t length,
+                                        bool confirmed, uint32_t timeout_ms)
+{
+    if(!data || length == 0 || length > RAK3172_MAX_PAYLOAD)
+        return RAK3172_ERR_INVALID;
+    
+    if(length > prvMaxPayload(dev))
+        return RAK3172_ERR_PAYLOAD_SIZE;
+    
+    RAK3172_Request_t req = {
+        .cmd = NULL,
+        .payload = data,
+        .payloadLen = length,
+        .port = port,
+        .timeout_ms = timeout_ms,
+        .confirmed = confirmed,
+    };
+    
+    return prvSubmitAndWait(dev, &req, NULL, 0);
+}
+
+/* Send unconfirmed data */
+RAK3172_Status_t RAK3172_SendDataUnconfirmed(uint8_t port, const uint8_t *data, uint16_t length)
+{
+    return prvSendBlocking(pxPrimary, port, data, length, false, 10000);
+}
+
+/* One confirmed AT+SEND, returns once the module accepted it. The ack
+ * comes later as +EVT:SEND_CONFIRMED_OK/FAILED; RAK3172_SendData() does
+ * the waiting and retransmissions. */
+RAK3172_Status_t RAK3172_SendConfirmedOnce(uint8_t port, const uint8_t *data, uint16_t length)
+{
+    return prvSendBlocking(pxPrimary, port, data, length, true, 10000);
+}
+
+/* Set DevEUI */
+RAK3172_Status_t RAK3172_SetDevEUI(const char *deveui)
+{
+    return RAK3172_ConfigSet(RAK3172_CFG_DEVEUI, deveui);
+}
+
+/* Set AppEUI */
+RAK3172_Status_t RAK3172_SetAppEUI(const char *appeui)
+{
+    return RAK3172_ConfigSet(RAK3172_CFG_APPEUI, appeui);
 }
 
 /* Set AppKey */
-BaseType_t RAK3172_SetAppKey(const char *appkey)
+RAK3172_Status_t RAK3172_SetAppKey(const char *appkey)
+{
+    return RAK3172_ConfigSet(RAK3172_CFG_APPKEY, appkey);
+}
+
+/* Set region, by name ("EU868") or AT+BAND code ("4") */
+RAK3172_Status_t RAK3172_SetRegion(const char *region)
+{
+    RAK3172_Region_t xNew;
+    char code[4];
+    
+    if(!RAK3172_FindRegion(region, &xNew))
+        return RAK3172_ERR_INVALID;
+    
+    snprintf(code, sizeof(code), "%u", RAK3172_GetRegionInfo(xNew)->bandCode);
+    
+    /* The shadow calls RAK3172_RegionRefresh() once it is written */
+    return RAK3172_ConfigSet(RAK3172_CFG_BAND, code);
+}
+
+/* Region used for payload limits, airtime and duty cycle */
+RAK3172_Region_t RAK3172_GetRegion(void)
+{
+    return xRegion;
+}
+
+/* Numeric setting, from the configuration shadow when known */
+static RAK3172_Status_t prvReadNumber(RAK3172_ConfigItem_t item, uint32_t *value)
+{
+    char pcValue[RAK3172_CFG_VALUE_LEN];
+    
+    RAK3172_Status_t status = RAK3172_ConfigGet(item, pcValue, sizeof(pcValue));
+    if(status != RAK3172_OK)
+        return status;
+    
+    if(pcValue[0] < '0' || pcValue[0] > '9')
+        return RAK3172_ERR_ERROR;
+    
+    *value = strtoul(pcValue, NULL, 10);
+    return RAK3172_OK;
+}
+
+/* Pick up the region the module uses */
+static RAK3172_Status_t prvReadRegion(void)
+{
+    uint32_t code;
+    RAK3172_Region_t xNew;
+    
+    RAK3172_Status_t status = prvReadNumber(RAK3172_CFG_BAND, &code);
+    if(status != RAK3172_OK)
+        return status;
+    
+    /* Band without a table (EU433, CN470...): keep the previous limits */
+    if(!RAK3172_FindRegionByCode((uint8_t)code, &xNew))
+    {
+        printf("WARNING: RAK3172 band %lu not in the region table\n", (unsigned long)code);
+        return RAK3172_ERR_MODE;
+    }
+    
+    xRegion = xNew;
+    return RAK3172_OK;
+}
+
+/* AT+BAND written, by RAK3172_SetRegion() or a configuration commit:
+ * follow it with the region tables and pick up the data rate the module
+ * reset with the band */
+void RAK3172_RegionRefresh(void)
+{
+    if(prvReadRegion() != RAK3172_OK)
+        return;
+    
+    if(RAK3172_ReadDataRate() != RAK3172_OK)
+        pxPrimary->dataRate = RAK3172_GetRegionInfo(xRegion)->defaultDr;
+}
+
+/* Pick up the data rate the module uses (ADR may have changed it).
+ * Only the primary module has a configuration shadow, the others are
+ * asked directly. */
+RAK3172_Status_t RAK3172_DevReadDataRate(RAK3172_Dev_t *dev)
 {
-    char cmd[80];
-    snprintf(cmd, sizeof(cmd), "AT+APPKEY=%s", appkey);
-    char response[128];
-    return RAK3172_SendCommand(cmd, response, 2000);
+    uint32_t dr;
+    RAK3172_Status_t status;
+    
+    if(!dev)
+        return RAK3172_ERR_INVALID;
+    
+    if(dev == pxPrimary)
+    {
+        /* Always ask the module, the shadow may be behind ADR */
+        RAK3172_ConfigInvalidate(RAK3172_CFG_DR);
+        status = prvReadNumber(RAK3172_CFG_DR, &dr);
+    }
+    else
+    {
+        char pcResponse[RAK3172_CFG_VALUE_LEN];
+        
+        /* Reply "AT+DR=<n>", a bare "<n>" is accepted too */
+        status = RAK3172_DevSendCommand(dev, "AT+DR=?", pcResponse, sizeof(pcResponse), RAK3172_PING_TIMEOUT_MS);
+        
+        char *pcValue = strchr(pcResponse, '=');
+        pcValue = pcValue ? pcValue + 1 : pcResponse;
+        
+        if(status == RAK3172_OK && (pcValue[0] < '0' || pcValue[0] > '9'))
+            status = RAK3172_ERR_ERROR;
+        dr = strtoul(pcValue, NULL, 10);
+    }
+    
+    if(status != RAK3172_OK)
+        return status;
+    
+    dev->dataRate = (uint8_t)dr;
+    return RAK3172_OK;
+}
+
+RAK3172_Status_t RAK3172_ReadDataRate(void)
+{
+    return RAK3172_DevReadDataRate(pxPrimary);
+}
+
+/* Set uplink data rate */
+RAK3172_Status_t RAK3172_SetDataRate(uint8_t dr)
+{
+    char value[4];
+    
+    if(!RAK3172_GetDataRateInfo(dr))
+        return RAK3172_ERR_INVALID;
+    
+    snprintf(value, sizeof(value), "%u", dr);
+    
+    RAK3172_Status_t status = RAK3172_ConfigSet(RAK3172_CFG_DR, value);
+    if(status == RAK3172_OK)
+        pxPrimary->dataRate = dr;
+    
+    return status;
+}
+
+/* Uplink data rate used for payload limits and airtime */
+uint8_t RAK3172_DevGetDataRate(const RAK3172_Dev_t *dev)
+{
+    return dev ? dev->dataRate : 0;
 }
 
-/* Set region */
-BaseType_t RAK3172_SetRegion(const char *region)
+uint8_t RAK3172_GetDataRate(void)
 {
-    char cmd[32];
-    snprintf(cmd, sizeof(cmd), "AT+BAND=%s", region);
-    char response[128];
-    return RAK3172_SendCommand(cmd, response, 2000);
+    return pxPrimary->dataRate;
 }
 
-/* Register RX callback */
+/* Register RX callback, receives downlinks without a port handler and P2P packets */
 BaseType_t RAK3172_RegisterRxCallback(RAK3172_RxCallback_t callback)
 {
     pxRxCallback = callback;
     return pdPASS;
 }
+
+/* Register a downlink handler for one fPort, NULL callback removes it */
+BaseType_t RAK3172_RegisterPortHandler(uint8_t port, RAK3172_RxCallback_t callback)
+{
+    BaseType_t xResult = pdFAIL;
+    int freeSlot = -1;
+    
+    taskENTER_CRITICAL();
+    for(int i = 0; i < RAK3172_MAX_PORT_HANDLERS; i++)
+    {
+        if(xPortHandlers[i].callback && xPortHandlers[i].port == port)
+        {
+            xPortHandlers[i].callback = callback;
+            xResult = pdPASS;
+            break;
+        }
+        if(!xPortHandlers[i].callback && freeSlot < 0)
+            freeSlot = i;
+    }
+    if(xResult != pdPASS && callback && freeSlot >= 0)
+    {
+        xPortHandlers[freeSlot].port = port;
+        xPortHandlers[freeSlot].callback = callback;
+        xResult = pdPASS;
+    }
+    taskEXIT_CRITICAL();
+    
+    return (xResult == pdPASS || !callback) ? pdPASS : pdFAIL;
+}
+
+/* Publish an event without payload, for the driver's own state machines */
+BaseType_t RAK3172_PostEvent(RAK3172_Event_t type)
+{
+    RAK3172_Dev_t *dev = pxPrimary;
+    RAK3172_EventData_t xEvent = {
+        .type = type,
+        .length = 0,
+        .handle = RAK3172_POOL_NONE
+    };
+    
+    if(!dev->eventQueue)
+        return pdFAIL;
+    
+    if(xQueueSend(dev->eventQueue, &xEvent, 0) != pdTRUE)
+    {
+        taskENTER_CRITICAL();
+        dev->cmdStats.eventDrops++;
+        taskEXIT_CRITICAL();
+        return pdFAIL;
+    }
+    
+    return pdPASS;
+}
+
+/* Wait for the next decoded event (join, TX result, downlink) */
+BaseType_t RAK3172_DevWaitEvent(RAK3172_Dev_t *dev, RAK3172_EventData_t *event, uint32_t timeout_ms)
+{
+    if(!dev || !event || !dev->eventQueue)
+        return pdFAIL;
+    
+    return xQueueReceive(dev->eventQueue, event, pdMS_TO_TICKS(timeout_ms));
+}
+
+BaseType_t RAK3172_WaitEvent(RAK3172_EventData_t *event, uint32_t timeout_ms)
+{
+    return RAK3172_DevWaitEvent(pxPrimary, event, timeout_ms);
+}
+
+/* Downlink carried by an event, NULL for events without payload */
+const RAK3172_RxData_t *RAK3172_EventRxData(const RAK3172_EventData_t *event)
+{
+    if(!event)
+        return NULL;
+    
+    return (const RAK3172_RxData_t *)RAK3172_PoolGet(event->handle);
+}
+
+/* Give the event payload block back to the pool */
+void RAK3172_ReleaseEvent(RAK3172_EventData_t *event)
+{
+    if(!event)
+        return;
+    
+    RAK3172_PoolFree(event->handle);
+    event->handle = RAK3172_POOL_NONE;
+    event->length = 0;
+}
+
+/* Get UART receive statistics */
+void RAK3172_DevGetUartStats(const RAK3172_Dev_t *dev, RAK3172_UartStats_t *stats)
+{
+    if(!dev || !stats)
+        return;
+    
+    taskENTER_CRITICAL();
+    *stats = *(const RAK3172_UartStats_t *)&dev->uartStats;
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_GetUartStats(RAK3172_UartStats_t *stats)
+{
+    RAK3172_DevGetUartStats(pxPrimary, stats);
+}
+
+/* Human readable status */
+const char *RAK3172_StatusString(RAK3172_Status_t status)
+{
+    switch(status)
+    {
+        case RAK3172_OK:             return "OK";
+        case RAK3172_ERR_ERROR:      return "ERROR";
+        case RAK3172_ERR_PARAM:      return "AT_PARAM_ERROR";
+        case RAK3172_ERR_BUSY:       return "AT_BUSY_ERROR";
+        case RAK3172_ERR_OVERFLOW:   return "AT_TEST_PARAM_OVERFLOW";
+        case RAK3172_ERR_NO_CLASSB:  return "AT_NO_CLASSB_ENABLE";
+        case RAK3172_ERR_NO_NETWORK: return "AT_NO_NETWORK_JOINED";
+        case RAK3172_ERR_RX:         return "AT_RX_ERROR";
+        case RAK3172_ERR_MODE:       return "AT_MODE_NO_SUPPORT";
+        case RAK3172_ERR_TIMEOUT:    return "TIMEOUT";
+        case RAK3172_ERR_QUEUE_FULL: return "QUEUE_FULL";
+        case RAK3172_ERR_INVALID:    return "INVALID_ARGUMENT";
+        case RAK3172_ERR_DUTY_CYCLE: return "DUTY_CYCLE";
+        case RAK3172_ERR_PAYLOAD_SIZE: return "PAYLOAD_TOO_LONG";
+        case RAK3172_ERR_ABORTED:    return "NOT_RUN";
+        case RAK3172_ERR_NO_ACK:     return "NO_ACK";
+        default:                     return "UNKNOWN";
+    }
+}
+
+/* Get command engine statistics */
+void RAK3172_DevGetCmdStats(const RAK3172_Dev_t *dev, RAK3172_CmdStats_t *stats)
+{
+    if(!dev || !stats)
+        return;
+    
+    taskENTER_CRITICAL();
+    *stats = dev->cmdStats;
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_GetCmdStats(RAK3172_CmdStats_t *stats)
+{
+    RAK3172_DevGetCmdStats(pxPrimary, stats);
+}
+
+/* Send AT and measure the round trip seen by a client task */
+RAK3172_Status_t RAK3172_DevPing(RAK3172_Dev_t *dev, uint32_t *rtt_us)
+{
+    uint32_t start = time_us_32();
+    RAK3172_Status_t status = RAK3172_DevSendCommand(dev, "AT", NULL, 0, RAK3172_PING_TIMEOUT_MS);
+    
+    if(rtt_us)
+        *rtt_us = time_us_32() - start;
+    
+    return status;
+}
+
+RAK3172_Status_t RAK3172_Ping(uint32_t *rtt_us)
+{
+    return RAK3172_DevPing(pxPrimary, rtt_us);
+}
+
+/* Get UART link state */
+void RAK3172_DevGetLinkInfo(const RAK3172_Dev_t *dev, RAK3172_LinkInfo_t *info)
+{
+    if(!dev || !info)
+        return;
+    
+    taskENTER_CRITICAL();
+    *info = dev->linkInfo;
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_GetLinkInfo(RAK3172_LinkInfo_t *info)
+{
+    RAK3172_DevGetLinkInfo(pxPrimary, info);
+}
+
+/* Opened module by index, NULL if there is none */
+RAK3172_Dev_t *RAK3172_GetDev(uint8_t index)
+{
+    if(index >= RAK3172_MAX_DEVICES || !xDevices[index].open)
+        return NULL;
+    
+    return &xDevices[index];
+}
+
+uint8_t RAK3172_DevIndex(const RAK3172_Dev_t *dev)
+{
+    return dev->index;
+}
+
+const char *RAK3172_DevName(const RAK3172_Dev_t *dev)
+{
+    return dev->config.name;
+}
+
+/* Time since the module last sent a line */
+uint32_t RAK3172_DevRxIdleMs(const RAK3172_Dev_t *dev)
+{
+    return dev ? pdTICKS_TO_MS(xTaskGetTickCount() - dev->lastRxTick) : 0;
+}
+
+/* Nothing on the wire, queued, held or expected from receive windows,
+ * and no line for idle_ms. A snapshot: the module may still send a URC
+ * of its own (Class C, P2P) right after. */
+bool RAK3172_DevIsQuiet(const RAK3172_Dev_t *dev, uint32_t idle_ms)
+{
+    if(!dev || !dev->open)
+        return true;
+    
+    return !dev->activeCmd.active && !dev->rxWinActive && dev->heldCount == 0 &&
+           uxQueueMessagesWaiting(dev->cmdQueue) == 0 && RAK3172_DevRxIdleMs(dev) >= idle_ms;
+}
+
+/* Make the driver deaf to the module, as if it had wedged, until the
+ * next hardware reset. Used to exercise the health monitor. */
+void RAK3172_DevSimulateHang(RAK3172_Dev_t *dev, bool hang)
+{
+    if(dev)
+        dev->simHang = hang;
+}
+
+/* Answer every command with OK instead of sending it, to measure the
+ * command engine without the module. Unsolicited lines still arrive. */
+void RAK3172_DevSimulateModule(RAK3172_Dev_t *dev, bool on)
+{
+    if(dev)
+        dev->simModule = on;
+}
+
+/* Feed bytes to the driver as if the module had sent them, for a
+ * simulated module. Shares the RX ring with the UART IRQ. */
+size_t RAK3172_DevInjectRx(RAK3172_Dev_t *dev, const char *data, size_t len)
+{
+    size_t count = 0;
+    bool xLineComplete = false;
+    
+    if(!dev || !data)
+        return 0;
+    
+    taskENTER_CRITICAL();
+    uint32_t head = dev->rxRing.head;
+    while(count < len && RAK3172_RxRingPush(&dev->rxRing, &head, (uint8_t)data[count]))
+    {
+        if(data[count++] == '\n')
+        {
+            dev->lineUs[dev->lineCount & (RAK3172_LINE_STAMPS - 1)] = time_us_64();
+            dev->lineCount++;
+            dev->uartStats.rxLines++;
+            xLineComplete = true;
+        }
+    }
+    dev->uartStats.rxBytes += count;
+    dev->uartStats.ringDrops += len - count;
+    dev->rxRing.head = head;
+    taskEXIT_CRITICAL();
+    
+    if(xLineComplete && dev->task)
+        xTaskNotifyGive(dev->task);
+    
+    return count;
+}
+
+/* Last join result reported by the module */
+bool RAK3172_DevIsJoined(const RAK3172_Dev_t *dev)
+{
+    return dev && dev->joined;
+}
+
+bool RAK3172_IsJoined(void)
+{
+    return RAK3172_DevIsJoined(pxPrimary);
+}
+
+/* Change the link rate. With cmd the module is asked first and the host
+ * follows on OK, without it only the host side moves. Queued like any
+ * other command so nothing in flight is cut in half. */
+static RAK3172_Status_t prvSetLinkBaud(RAK3172_Dev_t *dev, const char *cmd, uint32_t baud)
+{
+    RAK3172_Request_t req = {
+        .cmd = cmd,
+        .baud = baud,
+        .timeout_ms = RAK3172_PING_TIMEOUT_MS,
+    };
+    
+    return prvSubmitAndWait(dev, &req, NULL, 0);
+}
+
+/* Average AT round trip over count pings, 0 if any of them fails */
+static uint32_t prvPingAverage(RAK3172_Dev_t *dev, uint32_t count)
+{
+    uint32_t total = 0;
+    
+    for(uint32_t i = 0; i < count; i++)
+    {
+        uint32_t rtt;
+        
+        if(RAK3172_DevPing(dev, &rtt) != RAK3172_OK)
+            return 0;
+        total += rtt;
+    }
+    
+    return total / count;
+}
+
+/* Find the rate the module currently uses. It keeps AT+BAUD across resets,
+ * so a previous upgrade is found here on the next boot. The first ping
+ * after a switch may carry noise from the old rate, hence two tries. */
+static uint32_t prvProbeLink(RAK3172_Dev_t *dev)
+{
+    uint32_t rates[2 + sizeof(ulBaudCandidates) / sizeof(ulBaudCandidates[0])];
+    
+    /* Current host rate first, it is right unless the module was reset to another one */
+    taskENTER_CRITICAL();
+    rates[0] = dev->linkInfo.baud;
+    taskEXIT_CRITICAL();
+    rates[1] = RAK3172_BAUD_RATE;
+    memcpy(&rates[2], ulBaudCandidates, sizeof(ulBaudCandidates));
+    
+    for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        uint32_t rate = rates[i];
+        
+        if(i > 0 && rate == rates[0])
+            continue;
+        
+        if(prvSetLinkBaud(dev, NULL, rate) != RAK3172_OK)
+            return 0;
+        
+        if(RAK3172_DevPing(dev, NULL) == RAK3172_OK || RAK3172_DevPing(dev, NULL) == RAK3172_OK)
+            return rate;
+    }
+    
+    return 0;
+}
+
+/* Bring the link up at the fastest rate both sides agree on */
+static void prvNegotiateBaud(RAK3172_Dev_t *dev)
+{
+    uint32_t current = prvProbeLink(dev);
+    
+    if(current == 0)
+    {
+        printf("WARNING: No response from %s, UART%u left at %d baud\n",
+               dev->config.name, dev->config.uartIndex, RAK3172_BAUD_RATE);
+        prvSetLinkBaud(dev, NULL, RAK3172_BAUD_RATE);
+        return;
+    }
+    
+    /* Reference at the default rate, unknown if a previous boot already upgraded */
+    uint32_t rttBefore = (current == RAK3172_BAUD_RATE) ? prvPingAverage(dev, RAK3172_BENCH_PINGS) : 0;
+    
+#if RAK3172_BAUD_UPGRADE
+    /* Candidates are sorted, fastest first */
+    for(size_t i = 0; i < sizeof(ulBaudCandidates) / sizeof(ulBaudCandidates[0]); i++)
+    {
+        uint32_t baud = ulBaudCandidates[i];
+        char cmd[24];
+        
+        if(baud <= current)
+            break;
+        
+        snprintf(cmd, sizeof(cmd), "AT+BAUD=%lu", (unsigned long)baud);
+        
+        /* Rate refused, the host did not move */
+        if(prvSetLinkBaud(dev, cmd, baud) != RAK3172_OK)
+            continue;
+        
+        if(RAK3172_DevPing(dev, NULL) == RAK3172_OK || RAK3172_DevPing(dev, NULL) == RAK3172_OK)
+        {
+            current = baud;
+            break;
+        }
+        
+        /* The module did not follow, find out where it went */
+        current = prvProbeLink(dev);
+        if(current == 0 || current == baud)
+            break;
+    }
+    
+    if(current == 0)
+    {
+        printf("WARNING: %s lost during baud negotiation\n", dev->config.name);
+        prvSetLinkBaud(dev, NULL, RAK3172_BAUD_RATE);
+        return;
+    }
+#endif
+    
+    uint32_t rttAfter = prvPingAverage(dev, RAK3172_BENCH_PINGS);
+    
+    taskENTER_CRITICAL();
+    dev->linkInfo.upgraded = (current > RAK3172_BAUD_RATE);
+    dev->linkInfo.rttBeforeUs = rttBefore;
+    dev->linkInfo.rttAfterUs = rttAfter;
+    taskEXIT_CRITICAL();
+    
+    printf("%s link: %lu baud, AT round trip %lu us\n", dev->config.name,
+           (unsigned long)current, (unsigned long)rttAfter);
+}
+
+/* Release RST and wait until the module is ready: its boot banner or the
+ * first AT it answers, whichever comes first. Records the boot metrics. */
+static bool prvBootModule(RAK3172_Dev_t *dev)
+{
+    bool bannerSeen = false;
+    bool ready = false;
+    uint32_t readyMs = 0;
+    uint32_t firstCmdMs = 0;
+    
+    xSemaphoreTake(dev->readySem, 0);
+    
+    uint32_t start = time_us_32();
+    gpio_put(dev->config.rstPin, 1);  // Release reset
+    
+    while(!ready && (time_us_32() - start) / 1000 < RAK3172_BOOT_TIMEOUT_MS)
+    {
+        if(xSemaphoreTake(dev->readySem, pdMS_TO_TICKS(RAK3172_BOOT_POLL_MS)) == pdTRUE)
+        {
+            bannerSeen = true;
+            readyMs = (time_us_32() - start) / 1000;
+            break;
+        }
+        
+        /* No banner yet (or printed at another rate), try talking to it */
+        if(RAK3172_DevPing(dev, NULL) == RAK3172_OK)
+        {
+            ready = true;
+            readyMs = firstCmdMs = (time_us_32() - start) / 1000;
+        }
+    }
+    
+    if(bannerSeen && RAK3172_DevPing(dev, NULL) == RAK3172_OK)
+    {
+        ready = true;
+        firstCmdMs = (time_us_32() - start) / 1000;
+    }
+    
+    taskENTER_CRITICAL();
+    dev->linkInfo.bannerSeen = bannerSeen;
+    dev->linkInfo.bootMs = readyMs;
+    dev->linkInfo.firstCmdMs = firstCmdMs;
+    taskEXIT_CRITICAL();
+    
+    if(ready)
+    {
+        printf("%s ready after %lu ms (%s), first command OK after %lu ms\n", dev->config.name,
+               (unsigned long)readyMs, bannerSeen ? "banner" : "AT", (unsigned long)firstCmdMs);
+    }
+    else
+    {
+        printf("WARNING: %s not ready after %d ms\n", dev->config.name, RAK3172_BOOT_TIMEOUT_MS);
+    }
+    
+    return ready;
+}
+
+/* Pick up the region and data rate the module was left configured for.
+ * The region is shared, only the primary module defines it. */
+static void prvReadRadioConfig(RAK3172_Dev_t *dev)
+{
+    if(dev != pxPrimary || prvReadRegion() == RAK3172_OK)
+        RAK3172_DevReadDataRate(dev);
+}
+
+/* One-shot startup task, one per module */
+static void prvTaskRAK3172Startup(void *pvParameters)
+{
+    RAK3172_Dev_t *dev = (RAK3172_Dev_t *)pvParameters;
+    
+    printf("Releasing %s reset...\n", dev->config.name);
+    
+    prvBootModule(dev);
+    prvNegotiateBaud(dev);
+    
+    /* Payload limits follow whatever the module was left configured for */
+    prvReadRadioConfig(dev);
+    
+    printf("%s region %s, DR%u, max payload %u bytes\n", dev->config.name,
+           RAK3172_GetRegionInfo(xRegion)->name, dev->dataRate, prvMaxPayload(dev));
+    
+    vTaskDelete(NULL);
+}
+
+/* Hardware reset of one module, returns as soon as it is ready again */
+BaseType_t RAK3172_DevHardwareReset(RAK3172_Dev_t *dev)
+{
+    /* Would wait for its own pings */
+    if(!dev || xTaskGetCurrentTaskHandle() == dev->task)
+        return pdFAIL;
+    
+    printf("Performing hardware reset of %s...\n", dev->config.name);
+    
+    /* Settings not saved by the module are gone, re-read everything */
+    if(dev == pxPrimary)
+    {
+        RAK3172_ConfigInvalidateAll();
+        RAK3172_JoinReset();
+    }
+    dev->joined = false;
+    dev->simHang = false;
+    
+    /* Receive window state belongs to the driver task */
+    dev->resetPending = true;
+    if(dev->task)
+        xTaskNotifyGive(dev->task);
+    
+    gpio_put(dev->config.rstPin, 0);  // Assert reset
+    vTaskDelay(pdMS_TO_TICKS(RAK3172_RESET_PULSE_MS));
+    
+    if(!prvBootModule(dev))
+    {
+        /* Silent at the current rate: the module may have come back at another one */
+        prvNegotiateBaud(dev);
+        
+        if(RAK3172_DevPing(dev, NULL) != RAK3172_OK)
+            return pdFAIL;
+    }
+    
+    prvReadRadioConfig(dev);
+    
+    return pdPASS;
+}
+
+BaseType_t RAK3172_HardwareReset(void)
+{
+    return RAK3172_DevHardwareReset(pxPrimary);
+}
@@ -0,0 +1,35 @@
+#include "rak3172_airtime.h"
+
+#define RAK3172_PREAMBLE_SYMBOLS    8
+#define RAK3172_FSK_US_PER_BYTE     160     /* 8 bits at 50 kbps */
+#define RAK3172_FSK_FRAME_BYTES     11      /* Preamble 5, sync 3, length 1, CRC 2 */
+
+/* Time on air of a PHY payload (Semtech AN1200.13), explicit header and
+ * CRC as used by LoRaWAN uplinks. Integer only, exact for 125/250/500 kHz. */
+uint32_t RAK3172_TimeOnAirUs(const RAK3172_DataRate_t *drInfo, uint16_t phyLen)
+{
+    if(!drInfo)
+        return 0;
+
+    if(drInfo->sf == 0)
+        return (RAK3172_FSK_FRAME_BYTES + phyLen) * RAK3172_FSK_US_PER_BYTE;
+
+    int32_t sf = drInfo->sf;
+    uint32_t symbolUs = ((uint32_t)1000 << sf) / drInfo->bw_khz;
+    int32_t de = (sf >= 11 && drInfo->bw_khz == 125) ? 1 : 0;
+
+    /* 8*PL - 4*SF + 28 + 16*CRC - 20*H, rounded up in units of 4*(SF - 2*DE) */
+    int32_t num = 8 * (int32_t)phyLen - 4 * sf + 28 + 16;
+    int32_t den = 4 * (sf - 2 * de);
+    int32_t blocks = (num > 0) ? (num + den - 1) / den : 0;
+    uint32_t payloadSymbols = 8 + blocks * (drInfo->cr + 4);
+
+    /* Preamble lasts n + 4.25 symbols */
+    return (RAK3172_PREAMBLE_SYMBOLS * 4 + 17) * symbolUs / 4 + payloadSymbols * symbolUs;
+}
+
+/* Time on air of an uplink carrying payloadLen bytes at data rate dr */
+uint32_t RAK3172_UplinkAirtimeUs(uint8_t dr, uint16_t payloadLen)
+{
+    return RAK3172_TimeOnAirUs(RAK3172_GetDataRateInfo(dr), RAK3172_LORAWAN_OVERHEAD + payloadLen);
+}
@@ -0,0 +1,341 @@
+#include "rak3172_at.h"
+#include <string.h>
+
+/* Final result codes reported by RUI3 firmware */
+typedef struct {
+    const char *code;
+    RAK3172_Status_t status;
+} RAK3172_ResultCode_t;
+
+static const RAK3172_ResultCode_t xResultCodes[] = {
+    { "AT_ERROR",                RAK3172_ERR_ERROR      },
+    { "AT_PARAM_ERROR",          RAK3172_ERR_PARAM      },
+    { "AT_BUSY_ERROR",           RAK3172_ERR_BUSY       },
+    { "AT_TEST_PARAM_OVERFLOW",  RAK3172_ERR_OVERFLOW   },
+    { "AT_NO_CLASSB_ENABLE",     RAK3172_ERR_NO_CLASSB  },
+    { "AT_NO_NETWORK_JOINED",    RAK3172_ERR_NO_NETWORK },
+    { "AT_RX_ERROR",             RAK3172_ERR_RX         },
+    { "AT_MODE_NO_SUPPORT",      RAK3172_ERR_MODE       },
+};
+
+static bool prvLineEquals(const char *line, size_t len, const char *str)
+{
+    return (strncmp(line, str, len) == 0) && (str[len] == '\0');
+}
+
+/* Classify a line in a single pass, dispatching on the first character */
+RAK3172_LineType_t RAK3172_ClassifyLine(const char *line, size_t len,
+                                        const char *cmd,
+                                        RAK3172_Status_t *status)
+{
+    if(len == 0)
+        return RAK3172_LINE_EMPTY;
+
+    switch(line[0])
+    {
+        case 'O':
+            if(len == 2 && line[1] == 'K')
+                return RAK3172_LINE_OK;
+            break;
+
+        case '+':
+            if(len > 5 && strncmp(line, "+EVT:", 5) == 0)
+                return RAK3172_LINE_URC;
+            break;
+
+        case 'E':
+            if(prvLineEquals(line, len, "ERROR"))
+            {
+                if(status)
+                    *status = RAK3172_ERR_ERROR;
+                return RAK3172_LINE_ERROR;
+            }
+            break;
+
+        case 'A':
+            if(len > 3 && line[1] == 'T' && line[2] == '_')
+            {
+                for(size_t i = 0; i < sizeof(xResultCodes) / sizeof(xResultCodes[0]); i++)
+                {
+                    if(prvLineEquals(line, len, xResultCodes[i].code))
+                    {
+                        if(status)
+                            *status = xResultCodes[i].status;
+                        return RAK3172_LINE_ERROR;
+                    }
+                }
+
+                /* Unknown AT_xxx_ERROR code from a newer firmware */
+                if(len > 9 && strncmp(&line[len - 6], "_ERROR", 6) == 0)
+                {
+                    if(status)
+                        *status = RAK3172_ERR_ERROR;
+                    return RAK3172_LINE_ERROR;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if(cmd && prvLineEquals(line, len, cmd))
+        return RAK3172_LINE_ECHO;
+
+    return RAK3172_LINE_DATA;
+}
+
+/* Fixed-format event lines */
+typedef struct {
+    const char *prefix;
+    RAK3172_UrcType_t type;
+} RAK3172_UrcPrefix_t;
+
+static const RAK3172_UrcPrefix_t xUrcPrefixes[] = {
+    { "JOINED",                RAK3172_URC_JOINED                },
+    { "JOIN_FAILED",           RAK3172_URC_JOIN_FAILED           },
+    { "JOIN FAILED",           RAK3172_URC_JOIN_FAILED           },
+    { "SEND_CONFIRMED_OK",     RAK3172_URC_SEND_CONFIRMED_OK     },
+    { "SEND_CONFIRMED_FAILED", RAK3172_URC_SEND_CONFIRMED_FAILED },
+    { "TX_DONE",               RAK3172_URC_TX_DONE               },
+    { "TXP2P DONE",            RAK3172_URC_TX_P2P_DONE           },
+};
+
+static bool prvStartsWith(const char *p, const char *end, const char *prefix)
+{
+    size_t n = strlen(prefix);
+    return ((size_t)(end - p) >= n) && (strncmp(p, prefix, n) == 0);
+}
+
+/* Parse a signed decimal number, skipping leading blanks */
+static bool prvParseInt(const char **pp, const char *end, int32_t *value)
+{
+    const char *p = *pp;
+    bool negative = false;
+    int32_t v = 0;
+
+    while(p < end && *p == ' ')
+        p++;
+
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    if(p >= end || *p < '0' || *p > '9')
+        return false;
+
+    while(p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+
+    *value = negative ? -v : v;
+    *pp = p;
+    return true;
+}
+
+/* Hex digit value + 1, 0 for anything that is not a hex digit */
+static const uint8_t ucHexValue[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,
+    ['5'] = 6,  ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+const char cRak3172HexDigits[16] = "0123456789ABCDEF";
+
+/* Encode len bytes as 2 * len upper case hex digits, no terminator */
+void RAK3172_HexEncode(const uint8_t *data, size_t len, char *out)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        uint8_t b = data[i];
+        out[2 * i]     = cRak3172HexDigits[b >> 4];
+        out[2 * i + 1] = cRak3172HexDigits[b & 0x0F];
+    }
+}
+
+/* Decode hex_len digits into out, returns the byte count or -1 when the
+ * input is odd, too long or contains a non hex digit */
+int32_t RAK3172_HexDecode(const char *hex, size_t hex_len, uint8_t *out, size_t max_len)
+{
+    if((hex_len & 1) || hex_len / 2 > max_len)
+        return -1;
+
+    for(size_t i = 0; i < hex_len / 2; i++)
+    {
+        uint8_t hi = ucHexValue[(uint8_t)hex[2 * i]];
+        uint8_t lo = ucHexValue[(uint8_t)hex[2 * i + 1]];
+        if(hi == 0 || lo == 0)
+            return -1;
+        out[i] = (uint8_t)(((hi - 1) << 4) | (lo - 1));
+    }
+
+    return (int32_t)(hex_len / 2);
+}
+
+/* Hex-decode [p, end) into rx->data */
+static bool prvDecodePayload(const char *p, const char *end, RAK3172_RxData_t *rx)
+{
+    int32_t n = RAK3172_HexDecode(p, (size_t)(end - p), rx->data, sizeof(rx->data));
+
+    if(n < 0)
+        return false;
+
+    rx->length = (uint16_t)n;
+    return true;
+}
+
+/* "<rssi>:<snr>" (v4) or ", RSSI <rssi>, SNR <snr>" (v3) */
+static bool prvParseRadio(const char **pp, const char *end, int32_t *rssi, int32_t *snr, bool *legacy)
+{
+    const char *p = *pp;
+
+    if(p < end && *p == ':')
+    {
+        p++;
+        if(!prvParseInt(&p, end, rssi) || p >= end || *p++ != ':' || !prvParseInt(&p, end, snr))
+            return false;
+        *legacy = false;
+    }
+    else
+    {
+        while(p < end && (*p == ',' || *p == ' ')) p++;
+        if(!prvStartsWith(p, end, "RSSI")) return false;
+        p += 4;
+        if(!prvParseInt(&p, end, rssi)) return false;
+        while(p < end && (*p == ',' || *p == ' ')) p++;
+        if(!prvStartsWith(p, end, "SNR")) return false;
+        p += 3;
+        if(!prvParseInt(&p, end, snr)) return false;
+        *legacy = true;
+    }
+
+    *pp = p;
+    return true;
+}
+
+/* Decode one +EVT: line */
+RAK3172_UrcType_t RAK3172_ParseUrc(RAK3172_UrcParser_t *parser,
+                                   const char *line, size_t len,
+                                   RAK3172_RxData_t *rx)
+{
+    const char *end = line + len;
+    const char *p = line + 5;   /* Skip "+EVT:" */
+    int32_t rssi, snr, port;
+    bool legacy;
+
+    if(len < 5 || strncmp(line, "+EVT:", 5) != 0)
+        return RAK3172_URC_UNKNOWN;
+
+    /* LoRaWAN downlink: RX_1 / RX_2 / RX_B / RX_C */
+    if(prvStartsWith(p, end, "RX_") && (end - p) > 3)
+    {
+        RAK3172_RxWindow_t window;
+        switch(p[3])
+        {
+            case '1': window = RAK3172_RX_WINDOW_1; break;
+            case '2': window = RAK3172_RX_WINDOW_2; break;
+            case 'B': window = RAK3172_RX_WINDOW_B; break;
+            case 'C': window = RAK3172_RX_WINDOW_C; break;
+            default:  return RAK3172_URC_UNKNOWN;
+        }
+        p += 4;
+
+        if(!prvParseRadio(&p, end, &rssi, &snr, &legacy))
+            return RAK3172_URC_UNKNOWN;
+
+        parser->window = window;
+        parser->rssi = (int16_t)rssi;
+        parser->snr = (int8_t)snr;
+        parser->multicast = false;
+
+        if(legacy)
+        {
+            parser->pending = RAK3172_URC_RX;
+            return RAK3172_URC_PARTIAL;
+        }
+
+        /* :UNICAST|MULTICAST:<port>:<hex> */
+        if(p >= end || *p++ != ':')
+            return RAK3172_URC_UNKNOWN;
+        parser->multicast = prvStartsWith(p, end, "MULTICAST");
+        while(p < end && *p != ':') p++;
+        if(p >= end || *p++ != ':' || !prvParseInt(&p, end, &port))
+            return RAK3172_URC_UNKNOWN;
+        if(p < end && *p == ':')
+            p++;
+
+        rx->port = (uint8_t)port;
+        rx->rssi = parser->rssi;
+        rx->snr = parser->snr;
+        rx->window = parser->window;
+        rx->multicast = parser->multicast;
+        parser->pending = RAK3172_URC_UNKNOWN;
+        return prvDecodePayload(p, end, rx) ? RAK3172_URC_RX : RAK3172_URC_UNKNOWN;
+    }
+
+    /* LoRa P2P packet */
+    if(prvStartsWith(p, end, "RXP2P"))
+    {
+        p += 5;
+        if(!prvParseRadio(&p, end, &rssi, &snr, &legacy))
+            return RAK3172_URC_UNKNOWN;
+
+        parser->rssi = (int16_t)rssi;
+        parser->snr = (int8_t)snr;
+
+        if(legacy)
+        {
+            parser->pending = RAK3172_URC_RX_P2P;
+            return RAK3172_URC_PARTIAL;
+        }
+
+        if(p < end && *p == ':')
+            p++;
+
+        rx->port = 0;
+        rx->rssi = parser->rssi;
+        rx->snr = parser->snr;
+        rx->window = RAK3172_RX_WINDOW_P2P;
+        rx->multicast = false;
+        parser->pending = RAK3172_URC_UNKNOWN;
+        return prvDecodePayload(p, end, rx) ? RAK3172_URC_RX_P2P : RAK3172_URC_UNKNOWN;
+    }
+
+    for(size_t i = 0; i < sizeof(xUrcPrefixes) / sizeof(xUrcPrefixes[0]); i++)
+    {
+        if(prvStartsWith(p, end, xUrcPrefixes[i].prefix))
+            return xUrcPrefixes[i].type;
+    }
+
+    /* Continuation lines of a v3 multi-line downlink */
+    if(parser->pending == RAK3172_URC_RX)
+    {
+        if(prvStartsWith(p, end, "UNICAST") || prvStartsWith(p, end, "MULTICAST"))
+        {
+            parser->multicast = (*p == 'M');
+            return RAK3172_URC_PARTIAL;
+        }
+
+        if(prvParseInt(&p, end, &port) && p < end && *p == ':')
+        {
+            rx->port = (uint8_t)port;
+            rx->rssi = parser->rssi;
+            rx->snr = parser->snr;
+            rx->window = parser->window;
+            rx->multicast = parser->multicast;
+            parser->pending = RAK3172_URC_UNKNOWN;
+            return prvDecodePayload(p + 1, end, rx) ? RAK3172_URC_RX : RAK3172_URC_UNKNOWN;
+        }
+    }
+    else if(parser->pending == RAK3172_URC_RX_P2P)
+    {
+        rx->port = 0;
+        rx->rssi = parser->rssi;
+        rx->snr = parser->snr;
+        rx->window = RAK3172_RX_WINDOW_P2P;
+        rx->multicast = false;
+        parser->pending = RAK3172_URC_UNKNOWN;
+        return prvDecodePayload(p, end, rx) ? RAK3172_URC_RX_P2P : RAK3172_URC_UNKNOWN;
+    }
+
+    return RAK3172_URC_UNKNOWN;
+}
\ No newline at end of file
@@ -0,0 +1,357 @@
+#include "rak3172_batch.h"
+#include "rak3172_airtime.h"
+#include "rak3172_sched.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
+#include <string.h>
+
+typedef enum {
+    RAK3172_FLUSH_SIZE,
+    RAK3172_FLUSH_AGE,
+    RAK3172_FLUSH_EXPLICIT,
+} RAK3172_FlushReason_t;
+
+/* One frame being filled or on the air. It is sent in chunks sized to
+ * the data rate at send time, so a data rate drop after the records were
+ * packed splits the frame instead of getting it refused. */
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint16_t length;
+    uint16_t records;
+    uint16_t offset;            /* Records before this are done with */
+    uint16_t chunkEnd;          /* Chunk on the air: [offset, chunkEnd) */
+    uint16_t chunkRecords;
+    uint8_t retries;            /* Of the current chunk */
+} RAK3172_BatchFrame_t;
+
+static RAK3172_BatchFrame_t xFrames[2];
+static uint8_t ucFillIdx = 0;
+static bool xInFlight = false;          /* The other frame is queued or on the air */
+static bool xFlushPending = false;      /* Fill frame to send once the other completes */
+static RAK3172_FlushReason_t xPendingReason;
+
+static SemaphoreHandle_t xBatchMutex = NULL;
+static TimerHandle_t xAgeTimer = NULL;
+static TimerHandle_t xRetryTimer = NULL;
+static RAK3172_BatchStats_t xBatchStats = {0};
+
+static void prvSubmitFrameLocked(RAK3172_FlushReason_t reason);
+static void prvFrameDone(RAK3172_Status_t status, const char *response, void *ctx);
+
+static uint8_t prvMaxPayload(void)
+{
+    const RAK3172_DataRate_t *pxDr = RAK3172_GetDataRateInfo(RAK3172_GetDataRate());
+
+    return pxDr ? pxDr->maxPayload : 0;
+}
+
+/* The in-flight frame is done with, start the fill frame if it is due.
+ * Called with the mutex held. */
+static void prvFrameCompleteLocked(void)
+{
+    xInFlight = false;
+
+    if(xFlushPending)
+    {
+        xFlushPending = false;
+        prvSubmitFrameLocked(xPendingReason);
+    }
+}
+
+/* Submit as many records of the in-flight frame as fit one uplink at the
+ * current data rate. A record that does not fit on its own any more is
+ * dropped, so is a chunk the driver refuses for any reason but a full
+ * command queue. Called with the mutex held. */
+static void prvSendChunkLocked(void)
+{
+    RAK3172_BatchFrame_t *pxFrame = &xFrames[ucFillIdx ^ 1];
+    uint8_t max = prvMaxPayload();
+
+    for(;;)
+    {
+        if(pxFrame->offset >= pxFrame->length)
+        {
+            prvFrameCompleteLocked();
+            return;
+        }
+
+        uint16_t end = pxFrame->offset;
+        uint16_t records = 0;
+
+        while(end < pxFrame->length && end + 1 + pxFrame->data[end] - pxFrame->offset <= max)
+        {
+            end += 1 + pxFrame->data[end];
+            records++;
+        }
+
+        if(records == 0)
+        {
+            pxFrame->offset += 1 + pxFrame->data[pxFrame->offset];
+            xBatchStats.recordsLost++;
+            continue;
+        }
+
+        pxFrame->chunkEnd = end;
+        pxFrame->chunkRecords = records;
+
+        RAK3172_Status_t status = RAK3172_SubmitSend(RAK3172_BATCH_PORT, &pxFrame->data[pxFrame->offset],
+                                                     end - pxFrame->offset, prvFrameDone, NULL,
+                                                     RAK3172_BATCH_SEND_TIMEOUT_MS);
+        if(status == RAK3172_OK)
+            return;
+
+        if(status == RAK3172_ERR_QUEUE_FULL)
+        {
+            /* Command queue full, try again later */
+            xTimerChangePeriod(xRetryTimer, pdMS_TO_TICKS(RAK3172_BATCH_RETRY_MS), 0);
+            return;
+        }
+
+        /* Refused for good, the next chunk may still go */
+        xBatchStats.sendErrors++;
+        xBatchStats.recordsLost += records;
+        pxFrame->offset = end;
+        pxFrame->retries = 0;
+    }
+}
+
+/* Chunk result, runs in the RAK3172 task */
+static void prvFrameDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    (void)response;
+    (void)ctx;
+
+    xSemaphoreTake(xBatchMutex, portMAX_DELAY);
+
+    RAK3172_BatchFrame_t *pxFrame = &xFrames[ucFillIdx ^ 1];
+    uint32_t retryMs = 0;
+
+    switch(status)
+    {
+        case RAK3172_OK:
+        {
+            uint8_t dr = RAK3172_GetDataRate();
+            uint16_t length = pxFrame->chunkEnd - pxFrame->offset;
+            uint32_t airtimeUs = RAK3172_UplinkAirtimeUs(dr, length);
+            uint32_t soloAirtimeUs = 0;
+
+            for(uint16_t i = pxFrame->offset; i < pxFrame->chunkEnd; i += 1 + pxFrame->data[i])
+                soloAirtimeUs += RAK3172_UplinkAirtimeUs(dr, pxFrame->data[i]);
+
+            xBatchStats.frames++;
+            xBatchStats.bytes += length;
+            xBatchStats.airtimeMs += airtimeUs / 1000;
+            if(soloAirtimeUs > airtimeUs)
+                xBatchStats.airtimeSavedMs += (soloAirtimeUs - airtimeUs) / 1000;
+            break;
+        }
+
+        case RAK3172_ERR_DUTY_CYCLE:
+            /* Another sender used the band meanwhile */
+            retryMs = RAK3172_DutyCycleWaitMs();
+            if(retryMs == 0)
+                retryMs = 1;
+            break;
+
+        case RAK3172_ERR_BUSY:
+            retryMs = RAK3172_BATCH_RETRY_MS;
+            break;
+
+        case RAK3172_ERR_PAYLOAD_SIZE:
+            /* Data rate dropped after the chunk was cut, cut it again */
+            retryMs = 1;
+            break;
+
+        default:
+            break;
+    }
+
+    if(retryMs > 0 && pxFrame->retries < RAK3172_BATCH_MAX_RETRIES)
+    {
+        pxFrame->retries++;
+        xBatchStats.retries++;
+        xTimerChangePeriod(xRetryTimer, pdMS_TO_TICKS(retryMs) ? pdMS_TO_TICKS(retryMs) : 1, 0);
+        xSemaphoreGive(xBatchMutex);
+        return;
+    }
+
+    if(status != RAK3172_OK)
+    {
+        xBatchStats.sendErrors++;
+        xBatchStats.recordsLost += pxFrame->chunkRecords;
+    }
+
+    pxFrame->offset = pxFrame->chunkEnd;
+    pxFrame->retries = 0;
+    prvSendChunkLocked();
+
+    xSemaphoreGive(xBatchMutex);
+}
+
+/* Make the fill frame the in-flight one and switch buffers.
+ * Called with the mutex held. */
+static void prvSubmitFrameLocked(RAK3172_FlushReason_t reason)
+{
+    RAK3172_BatchFrame_t *pxFrame = &xFrames[ucFillIdx];
+
+    if(pxFrame->length == 0)
+        return;
+
+    if(xInFlight)
+    {
+        xFlushPending = true;
+        xPendingReason = reason;
+        return;
+    }
+
+    switch(reason)
+    {
+        case RAK3172_FLUSH_SIZE:     xBatchStats.flushSize++;     break;
+        case RAK3172_FLUSH_AGE:      xBatchStats.flushAge++;      break;
+        case RAK3172_FLUSH_EXPLICIT: xBatchStats.flushExplicit++; break;
+    }
+
+    pxFrame->offset = 0;
+    pxFrame->retries = 0;
+
+    xInFlight = true;
+    ucFillIdx ^= 1;
+    xFrames[ucFillIdx].length = 0;
+    xFrames[ucFillIdx].records = 0;
+
+    xTimerStop(xAgeTimer, 0);
+
+    prvSendChunkLocked();
+}
+
+/* Oldest record reached its deadline, runs in the timer task. The mutex
+ * holder may be waiting on a timer command itself, so never block here:
+ * fire again shortly instead. */
+static void prvAgeTimerCallback(TimerHandle_t xTimer)
+{
+    if(xSemaphoreTake(xBatchMutex, 0) != pdTRUE)
+    {
+        xTimerChangePeriod(xTimer, pdMS_TO_TICKS(RAK3172_BATCH_LOCK_RETRY_MS), 0);
+        return;
+    }
+
+    prvSubmitFrameLocked(RAK3172_FLUSH_AGE);
+    xSemaphoreGive(xBatchMutex);
+}
+
+/* Send the in-flight chunk again, runs in the timer task. Never blocks
+ * the timer task on the mutex, tries again shortly instead. */
+static void prvRetryTimerCallback(TimerHandle_t xTimer)
+{
+    if(xSemaphoreTake(xBatchMutex, 0) != pdTRUE)
+    {
+        xTimerChangePeriod(xTimer, pdMS_TO_TICKS(RAK3172_BATCH_LOCK_RETRY_MS), 0);
+        return;
+    }
+
+    if(xInFlight)
+        prvSendChunkLocked();
+
+    xSemaphoreGive(xBatchMutex);
+}
+
+/* Create the batching resources, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_BatchInit(void)
+{
+    if(xBatchMutex)
+        return RAK3172_OK;
+
+    xBatchMutex = xSemaphoreCreateMutex();
+    xAgeTimer = xTimerCreate("RAKBatch", pdMS_TO_TICKS(RAK3172_BATCH_MAX_AGE_MS), pdFALSE, NULL, prvAgeTimerCallback);
+    xRetryTimer = xTimerCreate("RAKBatchRetry", 1, pdFALSE, NULL, prvRetryTimerCallback);
+
+    if(!xBatchMutex || !xAgeTimer || !xRetryTimer)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Append one record. A full frame is sent first; RAK3172_ERR_BUSY when it
+ * cannot be because the previous frame is still on the air. */
+RAK3172_Status_t RAK3172_BatchAdd(const uint8_t *record, uint8_t length)
+{
+    if(!xBatchMutex || !record || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    uint8_t max = prvMaxPayload();
+    RAK3172_Status_t status = RAK3172_OK;
+
+    if(length + 1 > max)
+    {
+        taskENTER_CRITICAL();
+        xBatchStats.rejected++;
+        taskEXIT_CRITICAL();
+        return RAK3172_ERR_PAYLOAD_SIZE;
+    }
+
+    xSemaphoreTake(xBatchMutex, portMAX_DELAY);
+
+    RAK3172_BatchFrame_t *pxFrame = &xFrames[ucFillIdx];
+
+    /* No room left at the current data rate */
+    if(pxFrame->length > 0 && pxFrame->length + 1 + length > max)
+    {
+        if(xInFlight)
+            status = RAK3172_ERR_BUSY;
+        else
+            prvSubmitFrameLocked(RAK3172_FLUSH_SIZE);
+
+        pxFrame = &xFrames[ucFillIdx];
+    }
+
+    if(status == RAK3172_OK)
+    {
+        if(pxFrame->length == 0)
+            xTimerChangePeriod(xAgeTimer, pdMS_TO_TICKS(RAK3172_BATCH_MAX_AGE_MS), 0);
+
+        pxFrame->data[pxFrame->length++] = length;
+        memcpy(&pxFrame->data[pxFrame->length], record, length);
+        pxFrame->length += length;
+        pxFrame->records++;
+
+        xBatchStats.records++;
+
+        /* Not even a 1-byte record fits anymore */
+        if(pxFrame->length + 2 > max)
+            prvSubmitFrameLocked(RAK3172_FLUSH_SIZE);
+    }
+    else
+    {
+        xBatchStats.rejected++;
+    }
+
+    xSemaphoreGive(xBatchMutex);
+
+    return status;
+}
+
+/* Send whatever is buffered now */
+RAK3172_Status_t RAK3172_BatchFlush(void)
+{
+    if(!xBatchMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xBatchMutex, portMAX_DELAY);
+    prvSubmitFrameLocked(RAK3172_FLUSH_EXPLICIT);
+    xSemaphoreGive(xBatchMutex);
+
+    return RAK3172_OK;
+}
+
+/* Get batching statistics */
+void RAK3172_GetBatchStats(RAK3172_BatchStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xBatchStats;
+    taskEXIT_CRITICAL();
+}
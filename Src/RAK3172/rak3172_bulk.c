@@ -0,0 +1,529 @@
+#include "rak3172_bulk.h"
+#include "rak3172_p2p.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BULK_DATA           0xB1
+#define BULK_ACK            0xB2
+#define BULK_DATA_ACK_REQ   0xB3
+
+#define BULK_HEADER_LEN     6
+#define BULK_ACK_LEN        8
+#define BULK_MAP_BITS       32
+#define BULK_MAP_BYTES      (RAK3172_BULK_MAX_FRAGMENTS / 8)
+
+/* One frame in the in-memory channel */
+typedef struct {
+    uint8_t length;
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+} BulkFrame_t;
+
+/* One end of the in-memory channel */
+typedef struct {
+    QueueHandle_t rx;
+    QueueHandle_t peer;
+    uint8_t lossPct;
+} BulkLoopEnd_t;
+
+static QueueHandle_t xLoopQueue[2] = {NULL, NULL};
+static BulkLoopEnd_t xLoopEnd[2];
+static RAK3172_BulkLink_t xLoopLink[2];
+
+/* Self test state, one run at a time */
+static uint8_t ucTestSrc[RAK3172_BULK_SELFTEST_MAX];
+static uint8_t ucTestDst[RAK3172_BULK_SELFTEST_MAX];
+static TaskHandle_t xTestWaiter = NULL;
+static RAK3172_BulkStats_t xTestRxStats;
+static RAK3172_Status_t xTestRxStatus;
+static size_t xTestRxLength;
+
+static inline bool prvTestBit(const uint8_t *map, uint16_t bit)
+{
+    return (map[bit >> 3] & (1u << (bit & 7))) != 0;
+}
+
+static inline void prvSetBit(uint8_t *map, uint16_t bit)
+{
+    map[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+}
+
+static inline void prvPut16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static inline uint16_t prvGet16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t prvElapsedMs(TickType_t start)
+{
+    uint32_t ms = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+    return ms ? ms : 1;
+}
+
+static void prvFinish(RAK3172_BulkStats_t *stats, TickType_t start)
+{
+    stats->elapsedMs = prvElapsedMs(start);
+    stats->bytesPerSec = (uint32_t)(((uint64_t)stats->bytes * 1000) / stats->elapsedMs);
+}
+
+static uint32_t prvAirtimeMs(const RAK3172_BulkLink_t *link, uint8_t length)
+{
+    return link->airtimeMs ? link->airtimeMs(link->ctx, length) : 0;
+}
+
+/* Receiver silence before it ACKs on its own: the next fragment of a
+ * burst is at most one full frame's airtime away */
+static uint32_t prvAckDelayMs(const RAK3172_BulkLink_t *link)
+{
+    return prvAirtimeMs(link, BULK_HEADER_LEN + RAK3172_BULK_CHUNK) + RAK3172_BULK_ACK_DELAY_MS;
+}
+
+/* Sender wait after a burst: the receiver may hold the ACK for its
+ * delay when the last fragment was lost, then the ACK is on air */
+static uint32_t prvAckTimeoutMs(const RAK3172_BulkLink_t *link)
+{
+    return prvAckDelayMs(link) + prvAirtimeMs(link, BULK_ACK_LEN) + RAK3172_BULK_ACK_TIMEOUT_MS;
+}
+
+/* Wait for an ACK of this session, other frames are dropped */
+static bool prvWaitAck(const RAK3172_BulkLink_t *link, uint8_t session,
+                       uint16_t *base, uint32_t *bitmap, RAK3172_BulkStats_t *stats)
+{
+    uint8_t frame[RAK3172_MAX_PAYLOAD];
+    uint8_t length;
+    uint32_t timeout = prvAckTimeoutMs(link);
+    TickType_t start = xTaskGetTickCount();
+
+    for(;;)
+    {
+        uint32_t waited = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+        if(waited >= timeout)
+            return false;
+
+        if(!link->recv(link->ctx, frame, &length, timeout - waited))
+            return false;
+
+        stats->framesReceived++;
+
+        if(length < BULK_ACK_LEN || frame[0] != BULK_ACK || frame[1] != session)
+            continue;
+
+        *base = prvGet16(&frame[2]);
+        *bitmap = (uint32_t)frame[4] | ((uint32_t)frame[5] << 8) |
+                  ((uint32_t)frame[6] << 16) | ((uint32_t)frame[7] << 24);
+        return true;
+    }
+}
+
+/* Send a blob, returns once the receiver holds every fragment */
+RAK3172_Status_t RAK3172_BulkSend(const RAK3172_BulkLink_t *link, uint8_t session,
+                                  const uint8_t *data, size_t length, RAK3172_BulkStats_t *stats)
+{
+    uint8_t frame[BULK_HEADER_LEN + RAK3172_BULK_CHUNK];
+    uint8_t acked[BULK_MAP_BYTES] = {0};
+    uint8_t sent[BULK_MAP_BYTES] = {0};
+    uint16_t burst[RAK3172_BULK_WINDOW_MAX];
+    RAK3172_BulkStats_t xStats = {0};
+    RAK3172_Status_t status = RAK3172_OK;
+
+    if(!link || !data || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    size_t fragments = (length + RAK3172_BULK_CHUNK - 1) / RAK3172_BULK_CHUNK;
+    if(fragments > RAK3172_BULK_MAX_FRAGMENTS)
+        return RAK3172_ERR_PAYLOAD_SIZE;
+
+    uint16_t total = (uint16_t)fragments;
+    uint16_t base = 0;
+    uint8_t window = RAK3172_BULK_WINDOW_INIT;
+    uint32_t timeouts = 0;
+    TickType_t start = xTaskGetTickCount();
+
+    xStats.bytes = (uint32_t)length;
+    xStats.fragments = total;
+    xStats.windowMin = window;
+    xStats.windowMax = window;
+
+    while(base < total)
+    {
+        /* Unacknowledged fragments the ACK bitmap can still report */
+        uint8_t count = 0;
+        for(uint32_t seq = base; seq < total && seq <= (uint32_t)base + BULK_MAP_BITS && count < window; seq++)
+        {
+            if(!prvTestBit(acked, (uint16_t)seq))
+                burst[count++] = (uint16_t)seq;
+        }
+
+        for(uint8_t i = 0; i < count && status == RAK3172_OK; i++)
+        {
+            uint16_t seq = burst[i];
+            size_t offset = (size_t)seq * RAK3172_BULK_CHUNK;
+            size_t chunk = length - offset;
+            if(chunk > RAK3172_BULK_CHUNK)
+                chunk = RAK3172_BULK_CHUNK;
+
+            frame[0] = (i == count - 1) ? BULK_DATA_ACK_REQ : BULK_DATA;
+            frame[1] = session;
+            prvPut16(&frame[2], seq);
+            prvPut16(&frame[4], total);
+            memcpy(&frame[BULK_HEADER_LEN], &data[offset], chunk);
+
+            status = link->send(link->ctx, frame, (uint8_t)(BULK_HEADER_LEN + chunk));
+
+            xStats.framesSent++;
+            if(prvTestBit(sent, seq))
+                xStats.retransmissions++;
+            prvSetBit(sent, seq);
+        }
+
+        if(status != RAK3172_OK)
+            break;
+
+        uint16_t ackBase;
+        uint32_t bitmap;
+        if(!prvWaitAck(link, session, &ackBase, &bitmap, &xStats))
+        {
+            /* Burst or ACK lost entirely, probe again with one fragment */
+            xStats.timeouts++;
+            window = 1;
+            xStats.windowMin = 1;
+            if(++timeouts >= RAK3172_BULK_MAX_TIMEOUTS)
+            {
+                status = RAK3172_ERR_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+
+        timeouts = 0;
+
+        for(uint16_t seq = base; seq < ackBase && seq < total; seq++)
+            prvSetBit(acked, seq);
+        for(uint32_t i = 0; i < BULK_MAP_BITS; i++)
+        {
+            uint32_t seq = (uint32_t)ackBase + 1 + i;
+            if((bitmap & (1ul << i)) && seq < total)
+                prvSetBit(acked, (uint16_t)seq);
+        }
+
+        uint8_t lost = 0;
+        for(uint8_t i = 0; i < count; i++)
+        {
+            if(!prvTestBit(acked, burst[i]))
+                lost++;
+        }
+
+        /* Additive increase, multiplicative decrease */
+        if(lost == 0 && window < RAK3172_BULK_WINDOW_MAX)
+            window++;
+        else if(lost)
+            window = (window > 1) ? window / 2 : 1;
+
+        if(window < xStats.windowMin)
+            xStats.windowMin = window;
+        if(window > xStats.windowMax)
+            xStats.windowMax = window;
+
+        while(base < total && prvTestBit(acked, base))
+            base++;
+    }
+
+    xStats.window = window;
+    prvFinish(&xStats, start);
+
+    if(stats)
+        *stats = xStats;
+
+    return status;
+}
+
+static RAK3172_Status_t prvSendAck(const RAK3172_BulkLink_t *link, uint8_t session,
+                                   const uint8_t *received, uint16_t base, uint16_t total)
+{
+    uint8_t frame[BULK_ACK_LEN];
+    uint32_t bitmap = 0;
+
+    for(uint32_t i = 0; i < BULK_MAP_BITS; i++)
+    {
+        uint32_t seq = (uint32_t)base + 1 + i;
+        if(seq < total && prvTestBit(received, (uint16_t)seq))
+            bitmap |= 1ul << i;
+    }
+
+    frame[0] = BULK_ACK;
+    frame[1] = session;
+    prvPut16(&frame[2], base);
+    frame[4] = (uint8_t)bitmap;
+    frame[5] = (uint8_t)(bitmap >> 8);
+    frame[6] = (uint8_t)(bitmap >> 16);
+    frame[7] = (uint8_t)(bitmap >> 24);
+
+    return link->send(link->ctx, frame, sizeof(frame));
+}
+
+/* Receive one blob into buffer. The session and fragment count come from
+ * the first fragment; timeout_ms bounds the wait for it and any later
+ * silence. After the last fragment, retransmissions are answered until
+ * RAK3172_BULK_LINGER_MS past the sender ACK timeout in case the final
+ * ACK was lost. */
+RAK3172_Status_t RAK3172_BulkReceive(const RAK3172_BulkLink_t *link, uint8_t *buffer, size_t max_len,
+                                     size_t *length, uint32_t timeout_ms, RAK3172_BulkStats_t *stats)
+{
+    uint8_t frame[RAK3172_MAX_PAYLOAD];
+    uint8_t received[BULK_MAP_BYTES] = {0};
+    RAK3172_BulkStats_t xStats = {0};
+    RAK3172_Status_t status = RAK3172_OK;
+    uint8_t session = 0;
+    uint16_t total = 0;
+    uint16_t base = 0;
+    uint16_t count = 0;
+    size_t lastLength = 0;
+    bool pending = false;
+    bool complete = false;
+    TickType_t start = xTaskGetTickCount();
+
+    if(!link || !buffer || !length)
+        return RAK3172_ERR_INVALID;
+
+    uint32_t ackDelay = prvAckDelayMs(link);
+    uint32_t linger = prvAckTimeoutMs(link) + RAK3172_BULK_LINGER_MS;
+
+    for(;;)
+    {
+        uint8_t frameLength;
+        uint32_t wait = pending ? ackDelay :
+                        (complete ? linger : timeout_ms);
+
+        if(!link->recv(link->ctx, frame, &frameLength, wait))
+        {
+            if(pending)
+            {
+                /* The fragment asking for an ACK was lost */
+                prvSendAck(link, session, received, base, total);
+                xStats.framesSent++;
+                pending = false;
+                continue;
+            }
+            if(!complete)
+                status = RAK3172_ERR_TIMEOUT;
+            break;
+        }
+
+        xStats.framesReceived++;
+
+        if(frameLength < BULK_HEADER_LEN || (frame[0] != BULK_DATA && frame[0] != BULK_DATA_ACK_REQ))
+            continue;
+
+        uint16_t seq = prvGet16(&frame[2]);
+        uint16_t frameTotal = prvGet16(&frame[4]);
+        size_t chunk = frameLength - BULK_HEADER_LEN;
+
+        if(total == 0)
+        {
+            if(frameTotal == 0 || frameTotal > RAK3172_BULK_MAX_FRAGMENTS)
+                continue;
+            if((size_t)(frameTotal - 1) * RAK3172_BULK_CHUNK >= max_len)
+            {
+                status = RAK3172_ERR_PAYLOAD_SIZE;
+                break;
+            }
+            session = frame[1];
+            total = frameTotal;
+            start = xTaskGetTickCount();
+        }
+
+        if(frame[1] != session || frameTotal != total || seq >= total ||
+           chunk == 0 || chunk > RAK3172_BULK_CHUNK ||
+           (seq < total - 1 && chunk != RAK3172_BULK_CHUNK))
+            continue;
+
+        if(prvTestBit(received, seq))
+        {
+            xStats.duplicates++;
+        }
+        else
+        {
+            size_t offset = (size_t)seq * RAK3172_BULK_CHUNK;
+            if(offset + chunk > max_len)
+            {
+                status = RAK3172_ERR_PAYLOAD_SIZE;
+                break;
+            }
+
+            /* In place, no reassembly copy */
+            memcpy(&buffer[offset], &frame[BULK_HEADER_LEN], chunk);
+            prvSetBit(received, seq);
+            count++;
+
+            if(seq == total - 1)
+                lastLength = chunk;
+            while(base < total && prvTestBit(received, base))
+                base++;
+        }
+
+        if(count == total && !complete)
+        {
+            complete = true;
+            xStats.bytes = (uint32_t)((size_t)(total - 1) * RAK3172_BULK_CHUNK + lastLength);
+            xStats.fragments = total;
+            prvFinish(&xStats, start);
+        }
+
+        if(frame[0] == BULK_DATA_ACK_REQ || complete)
+        {
+            prvSendAck(link, session, received, base, total);
+            xStats.framesSent++;
+            pending = false;
+        }
+        else
+        {
+            pending = true;
+        }
+    }
+
+    *length = complete ? xStats.bytes : 0;
+
+    if(stats)
+        *stats = xStats;
+
+    return status;
+}
+
+/* P2P link */
+static RAK3172_Status_t prvP2pSend(void *ctx, const uint8_t *data, uint8_t length)
+{
+    (void)ctx;
+    return RAK3172_P2pSend(data, length);
+}
+
+static uint32_t prvP2pAirtimeMs(void *ctx, uint8_t length)
+{
+    (void)ctx;
+    return (RAK3172_P2pAirtimeUs(length) + 999) / 1000;
+}
+
+static BaseType_t prvP2pRecv(void *ctx, uint8_t *data, uint8_t *length, uint32_t timeout_ms)
+{
+    RAK3172_P2pPacket_t xPacket;
+
+    (void)ctx;
+
+    if(RAK3172_P2pRead(&xPacket, timeout_ms) != pdPASS)
+        return pdFAIL;
+
+    memcpy(data, xPacket.data, xPacket.length);
+    *length = xPacket.length;
+    return pdPASS;
+}
+
+const RAK3172_BulkLink_t xRak3172BulkP2p = {
+    .send = prvP2pSend,
+    .recv = prvP2pRecv,
+    .airtimeMs = prvP2pAirtimeMs,
+    .ctx = NULL
+};
+
+/* In-memory link, drops lossPct % of the frames */
+static RAK3172_Status_t prvLoopSend(void *ctx, const uint8_t *data, uint8_t length)
+{
+    BulkLoopEnd_t *pxEnd = ctx;
+    BulkFrame_t xFrame;
+
+    if((uint32_t)(rand() % 100) < pxEnd->lossPct)
+        return RAK3172_OK;
+
+    xFrame.length = length;
+    memcpy(xFrame.data, data, length);
+
+    /* A full channel loses the frame like the air would */
+    xQueueSend(pxEnd->peer, &xFrame, 0);
+    return RAK3172_OK;
+}
+
+static BaseType_t prvLoopRecv(void *ctx, uint8_t *data, uint8_t *length, uint32_t timeout_ms)
+{
+    BulkLoopEnd_t *pxEnd = ctx;
+    BulkFrame_t xFrame;
+
+    if(xQueueReceive(pxEnd->rx, &xFrame, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+        return pdFAIL;
+
+    memcpy(data, xFrame.data, xFrame.length);
+    *length = xFrame.length;
+    return pdPASS;
+}
+
+static void prvSelfTestRxTask(void *pvParameters)
+{
+    (void)pvParameters;
+
+    xTestRxStatus = RAK3172_BulkReceive(&xLoopLink[1], ucTestDst, sizeof(ucTestDst),
+                                        &xTestRxLength, RAK3172_BULK_ACK_TIMEOUT_MS * RAK3172_BULK_MAX_TIMEOUTS,
+                                        &xTestRxStats);
+
+    xTaskNotifyGiveIndexed(xTestWaiter, RAK3172_NOTIFY_INDEX);
+    vTaskDelete(NULL);
+}
+
+RAK3172_Status_t RAK3172_BulkSelfTest(size_t length, uint8_t loss_pct,
+                                      RAK3172_BulkStats_t *tx, RAK3172_BulkStats_t *rx)
+{
+    if(length == 0 || length > RAK3172_BULK_SELFTEST_MAX || loss_pct >= 100)
+        return RAK3172_ERR_INVALID;
+
+    if(!xLoopQueue[0])
+    {
+        xLoopQueue[0] = xQueueCreate(RAK3172_P2P_RING_LEN, sizeof(BulkFrame_t));
+        xLoopQueue[1] = xQueueCreate(RAK3172_P2P_RING_LEN, sizeof(BulkFrame_t));
+        if(!xLoopQueue[0] || !xLoopQueue[1])
+            return RAK3172_ERR_INVALID;
+    }
+
+    xQueueReset(xLoopQueue[0]);
+    xQueueReset(xLoopQueue[1]);
+
+    for(int i = 0; i < 2; i++)
+    {
+        xLoopEnd[i].rx = xLoopQueue[i];
+        xLoopEnd[i].peer = xLoopQueue[i ^ 1];
+        xLoopEnd[i].lossPct = loss_pct;
+        xLoopLink[i].send = prvLoopSend;
+        xLoopLink[i].recv = prvLoopRecv;
+        xLoopLink[i].ctx = &xLoopEnd[i];
+    }
+
+    for(size_t i = 0; i < length; i++)
+        ucTestSrc[i] = (uint8_t)rand();
+    memset(ucTestDst, 0, sizeof(ucTestDst));
+
+    xTestWaiter = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, 0);
+
+    if(xTaskCreate(prvSelfTestRxTask, "RAKBulkRx", 512, NULL,
+                   uxTaskPriorityGet(NULL), NULL) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    RAK3172_Status_t status = RAK3172_BulkSend(&xLoopLink[0], 1, ucTestSrc, length, tx);
+
+    /* The receiver lingers for lost final ACKs before it returns */
+    ulTaskNotifyTakeIndexed(RAK3172_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+
+    if(rx)
+        *rx = xTestRxStats;
+
+    if(status != RAK3172_OK)
+        return status;
+    if(xTestRxStatus != RAK3172_OK)
+        return xTestRxStatus;
+    if(xTestRxLength != length || memcmp(ucTestSrc, ucTestDst, length) != 0)
+        return RAK3172_ERR_ERROR;
+
+    return RAK3172_OK;
+}
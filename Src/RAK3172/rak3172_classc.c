@@ -0,0 +1,149 @@
+#include "rak3172_classc.h"
+#include "rak3172_at.h"
+#include "rak3172_config.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "message_buffer.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Message: time_us_64() of the URC, then the line */
+#define CLASSC_LINE_LEN     (sizeof(uint64_t) + 48 + 2 * RAK3172_MAX_PAYLOAD)
+
+static const char pcWindowNames[] = "12BCP";
+
+static MessageBufferHandle_t xUsbBuffer = NULL;
+static TaskHandle_t xUsbTask = NULL;
+static volatile bool xActive = false;
+static RAK3172_ClassCStats_t xClassCStats = {0};
+
+static char pcLine[CLASSC_LINE_LEN];        /* RAK3172 task only */
+static char pcUsbLine[CLASSC_LINE_LEN];     /* USB task only */
+
+static uint8_t prvBucket(uint32_t us)
+{
+    uint8_t bucket = 0;
+
+    while(us && bucket < RAK3172_CLASSC_HIST_BUCKETS - 1)
+    {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Writes the lines as they come, no polling */
+static void prvUsbTask(void *pvParameters)
+{
+    (void)pvParameters;
+
+    while(1)
+    {
+        size_t len = xMessageBufferReceive(xUsbBuffer, pcUsbLine, sizeof(pcUsbLine), portMAX_DELAY);
+        uint64_t lineUs;
+
+        if(len <= sizeof(lineUs))
+            continue;
+        memcpy(&lineUs, pcUsbLine, sizeof(lineUs));
+
+        /* One call, stdio holds its lock for the whole line and CLI
+         * output can't land in the middle of it */
+        stdio_put_string(&pcUsbLine[sizeof(lineUs)], (int)(len - sizeof(lineUs)), false, false);
+        stdio_flush();
+
+        uint64_t latencyUs = time_us_64() - lineUs;
+        uint32_t us = (latencyUs > UINT32_MAX) ? UINT32_MAX : (uint32_t)latencyUs;
+
+        taskENTER_CRITICAL();
+        xClassCStats.written++;
+        xClassCStats.totalUs += us;
+        if(us > xClassCStats.maxUs)
+            xClassCStats.maxUs = us;
+        xClassCStats.histogram[prvBucket(us)]++;
+        taskEXIT_CRITICAL();
+    }
+}
+
+/* Create the USB buffer and task, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_ClassCInit(void)
+{
+    if(xUsbBuffer)
+        return RAK3172_OK;
+
+    xUsbBuffer = xMessageBufferCreate(RAK3172_CLASSC_BUFFER_SIZE);
+    if(!xUsbBuffer)
+        return RAK3172_ERR_INVALID;
+
+    if(xTaskCreate(prvUsbTask, "RAKUsb", RAK3172_CLASSC_STACK_WORDS, NULL, RAK3172_CLASSC_TASK_PRIORITY, &xUsbTask) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Switch the module to class C and push downlinks to USB. The network
+ * must know the device as class C as well. */
+RAK3172_Status_t RAK3172_ClassCStart(void)
+{
+    if(!xUsbBuffer)
+        return RAK3172_ERR_INVALID;
+
+    RAK3172_Status_t status = RAK3172_ConfigSet(RAK3172_CFG_CLASS, "C");
+
+    xActive = (status == RAK3172_OK);
+    return status;
+}
+
+/* Back to class A, downlinks only go through the event queue */
+RAK3172_Status_t RAK3172_ClassCStop(void)
+{
+    xActive = false;
+    return RAK3172_ConfigSet(RAK3172_CFG_CLASS, "A");
+}
+
+/* Runs in the RAK3172 task, before the downlink is dispatched */
+void RAK3172_ClassCHandleRx(const RAK3172_RxData_t *rx, uint64_t lineUs)
+{
+    if(!xActive || !xUsbBuffer)
+        return;
+
+    memcpy(pcLine, &lineUs, sizeof(lineUs));
+
+    int len = sizeof(lineUs);
+    len += snprintf(&pcLine[len], sizeof(pcLine) - len, "+DL:%llu:%c:%u:%d:%d:",
+                    (unsigned long long)lineUs, pcWindowNames[rx->window],
+                    rx->port, rx->rssi, rx->snr);
+    RAK3172_HexEncode(rx->data, rx->length, &pcLine[len]);
+    len += 2 * rx->length;
+    pcLine[len++] = '\r';
+    pcLine[len++] = '\n';
+
+    bool sent = xMessageBufferSend(xUsbBuffer, pcLine, (size_t)len, 0) == (size_t)len;
+
+    taskENTER_CRITICAL();
+    if(sent)
+        xClassCStats.downlinks++;
+    else
+        xClassCStats.dropped++;
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_ClassCClearStats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&xClassCStats, 0, sizeof(xClassCStats));
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_GetClassCStats(RAK3172_ClassCStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xClassCStats;
+    stats->active = xActive;
+    taskEXIT_CRITICAL();
+
+    stats->stackFreeWords = xUsbTask ? uxTaskGetStackHighWaterMark(xUsbTask) : 0;
+}
@@ -0,0 +1,341 @@
+#include "rak3172_config.h"
+#include "rak3172_region.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+typedef struct {
+    char value[RAK3172_CFG_VALUE_LEN];      /* Value held by the module */
+    char staged[RAK3172_CFG_VALUE_LEN];     /* Value to write on commit */
+    bool valid;
+    bool dirty;
+} RAK3172_ConfigEntry_t;
+
+/* AT command names, indexed by RAK3172_ConfigItem_t */
+static const char * const pcConfigNames[RAK3172_CFG_COUNT] = {
+    [RAK3172_CFG_DEVEUI]  = "DEVEUI",
+    [RAK3172_CFG_APPEUI]  = "APPEUI",
+    [RAK3172_CFG_APPKEY]  = "APPKEY",
+    [RAK3172_CFG_BAND]    = "BAND",
+    [RAK3172_CFG_DR]      = "DR",
+    [RAK3172_CFG_ADR]     = "ADR",
+    [RAK3172_CFG_CLASS]   = "CLASS",
+    [RAK3172_CFG_TXPOWER] = "TXP",
+    [RAK3172_CFG_CONFIRM] = "CFM",
+    [RAK3172_CFG_VERSION] = "VER",
+};
+
+static RAK3172_ConfigEntry_t xConfig[RAK3172_CFG_COUNT];
+static SemaphoreHandle_t xConfigMutex = NULL;
+static RAK3172_ConfigStats_t xConfigStats = {0};
+
+/* Create the shadow lock, called by RAK3172_Init() */
+RAK3172_Status_t RAK3172_ConfigInit(void)
+{
+    if(!xConfigMutex)
+        xConfigMutex = xSemaphoreCreateMutex();
+
+    return xConfigMutex ? RAK3172_OK : RAK3172_ERR_INVALID;
+}
+
+/* AT name of a setting */
+const char *RAK3172_ConfigName(RAK3172_ConfigItem_t item)
+{
+    return ((unsigned)item < RAK3172_CFG_COUNT) ? pcConfigNames[item] : "?";
+}
+
+/* Shadow value usable. The driver switches AT+CFM per uplink, that one
+ * is never trusted. */
+static bool prvKnown(RAK3172_ConfigItem_t item)
+{
+    return xConfig[item].valid && item != RAK3172_CFG_CONFIRM;
+}
+
+/* Fetch a value from the module, reply "AT+<NAME>=<value>" */
+static RAK3172_Status_t prvReadLocked(RAK3172_ConfigItem_t item)
+{
+    char cmd[24];
+    char response[96];
+
+    snprintf(cmd, sizeof(cmd), "AT+%s=?", pcConfigNames[item]);
+
+    RAK3172_Status_t status = RAK3172_SendCommand(cmd, response, sizeof(response), 2000);
+    if(status != RAK3172_OK)
+        return status;
+
+    char *pcValue = strchr(response, '=');
+    pcValue = pcValue ? pcValue + 1 : response;
+
+    size_t len = strcspn(pcValue, "\r\n");
+    if(len == 0)
+        return RAK3172_ERR_ERROR;
+    if(len >= RAK3172_CFG_VALUE_LEN)
+        len = RAK3172_CFG_VALUE_LEN - 1;
+
+    memcpy(xConfig[item].value, pcValue, len);
+    xConfig[item].value[len] = '\0';
+    xConfig[item].valid = true;
+
+    return RAK3172_OK;
+}
+
+/* Push a staged value to the module */
+static RAK3172_Status_t prvWriteLocked(RAK3172_ConfigItem_t item)
+{
+    RAK3172_ConfigEntry_t *pxEntry = &xConfig[item];
+    char cmd[24 + RAK3172_CFG_VALUE_LEN];
+
+    snprintf(cmd, sizeof(cmd), "AT+%s=%s", pcConfigNames[item], pxEntry->staged);
+
+    RAK3172_Status_t status = RAK3172_SendCommand(cmd, NULL, 0, 2000);
+    if(status != RAK3172_OK)
+        return status;
+
+    strcpy(pxEntry->value, pxEntry->staged);
+    pxEntry->valid = true;
+    pxEntry->dirty = false;
+    xConfigStats.writes++;
+
+    return RAK3172_OK;
+}
+
+/* Read a setting, from the shadow when known */
+RAK3172_Status_t RAK3172_ConfigGet(RAK3172_ConfigItem_t item, char *value, size_t max_len)
+{
+    RAK3172_Status_t status = RAK3172_OK;
+
+    if((unsigned)item >= RAK3172_CFG_COUNT || !value || max_len == 0 || !xConfigMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+
+    if(prvKnown(item))
+    {
+        xConfigStats.hits++;
+    }
+    else
+    {
+        xConfigStats.misses++;
+        status = prvReadLocked(item);
+    }
+
+    if(status == RAK3172_OK)
+    {
+        if(strlen(xConfig[item].value) < max_len)
+            strcpy(value, xConfig[item].value);
+        else
+            status = RAK3172_ERR_INVALID;
+    }
+
+    xSemaphoreGive(xConfigMutex);
+
+    return status;
+}
+
+/* Stage a new value, nothing is sent until RAK3172_ConfigCommit() */
+RAK3172_Status_t RAK3172_ConfigStage(RAK3172_ConfigItem_t item, const char *value)
+{
+    if((unsigned)item >= RAK3172_CFG_COUNT || item == RAK3172_CFG_VERSION || !value || !xConfigMutex)
+        return RAK3172_ERR_INVALID;
+
+    if(strlen(value) >= RAK3172_CFG_VALUE_LEN)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+
+    RAK3172_ConfigEntry_t *pxEntry = &xConfig[item];
+
+    /* Hex values come back in either case */
+    if(prvKnown(item) && strcasecmp(pxEntry->value, value) == 0)
+    {
+        pxEntry->dirty = false;
+        xConfigStats.skipped++;
+    }
+    else
+    {
+        strcpy(pxEntry->staged, value);
+        pxEntry->dirty = true;
+    }
+
+    xSemaphoreGive(xConfigMutex);
+
+    return RAK3172_OK;
+}
+
+/* Command buffers of a commit, used under the mutex */
+static char pcCommitCmd[RAK3172_CFG_COUNT][24 + RAK3172_CFG_VALUE_LEN];
+static char pcCommitUndo[RAK3172_CFG_COUNT][24 + RAK3172_CFG_VALUE_LEN];
+
+/* Write every dirty setting in one transaction. The first error stops it
+ * and restores the values already written when they are known. itemStatus
+ * (optional, RAK3172_CFG_COUNT entries) gets the result per setting,
+ * RAK3172_OK for the ones that were clean. */
+RAK3172_Status_t RAK3172_ConfigCommit(RAK3172_Status_t *itemStatus, uint32_t *elapsed_ms)
+{
+    RAK3172_TxnItem_t xItems[RAK3172_CFG_COUNT];
+    RAK3172_ConfigItem_t xItemCfg[RAK3172_CFG_COUNT];
+    RAK3172_Status_t status = RAK3172_OK;
+    size_t count = 0;
+    bool bandWritten = false;
+
+    if(!xConfigMutex)
+        return RAK3172_ERR_INVALID;
+
+    if(itemStatus)
+    {
+        for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+            itemStatus[i] = RAK3172_OK;
+    }
+    if(elapsed_ms)
+        *elapsed_ms = 0;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+
+    for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+    {
+        RAK3172_ConfigEntry_t *pxEntry = &xConfig[i];
+
+        if(!pxEntry->dirty)
+            continue;
+
+        snprintf(pcCommitCmd[count], sizeof(pcCommitCmd[count]), "AT+%s=%s", pcConfigNames[i], pxEntry->staged);
+        xItems[count].cmd = pcCommitCmd[count];
+        xItems[count].undo = NULL;
+
+        if(prvKnown((RAK3172_ConfigItem_t)i))
+        {
+            snprintf(pcCommitUndo[count], sizeof(pcCommitUndo[count]), "AT+%s=%s", pcConfigNames[i], pxEntry->value);
+            xItems[count].undo = pcCommitUndo[count];
+        }
+
+        xItemCfg[count++] = (RAK3172_ConfigItem_t)i;
+    }
+
+    if(count > 0)
+    {
+        status = RAK3172_RunTransaction(xItems, count, true, 2000, elapsed_ms);
+
+        for(size_t n = 0; n < count; n++)
+        {
+            RAK3172_ConfigEntry_t *pxEntry = &xConfig[xItemCfg[n]];
+
+            if(itemStatus)
+                itemStatus[xItemCfg[n]] = xItems[n].status;
+
+            /* Even rolled back, the module may have reset its data rate */
+            if(xItemCfg[n] == RAK3172_CFG_BAND && xItems[n].status == RAK3172_OK)
+                bandWritten = true;
+
+            if(status == RAK3172_OK)
+            {
+                strcpy(pxEntry->value, pxEntry->staged);
+                pxEntry->valid = true;
+                pxEntry->dirty = false;
+                xConfigStats.writes++;
+            }
+            else if(xItems[n].status == RAK3172_OK && !xItems[n].undo)
+            {
+                /* Written but could not be restored: the module holds the new value */
+                strcpy(pxEntry->value, pxEntry->staged);
+                pxEntry->valid = true;
+                xConfigStats.writes++;
+            }
+        }
+    }
+
+    xSemaphoreGive(xConfigMutex);
+
+    /* Reads the shadow, outside the lock */
+    if(bandWritten)
+        RAK3172_RegionRefresh();
+
+    return status;
+}
+
+/* Write-through set, skipped when the module already holds the value */
+RAK3172_Status_t RAK3172_ConfigSet(RAK3172_ConfigItem_t item, const char *value)
+{
+    bool written = false;
+
+    RAK3172_Status_t status = RAK3172_ConfigStage(item, value);
+    if(status != RAK3172_OK)
+        return status;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+    if(xConfig[item].dirty)
+    {
+        status = prvWriteLocked(item);
+        written = (status == RAK3172_OK);
+    }
+    xSemaphoreGive(xConfigMutex);
+
+    if(written && item == RAK3172_CFG_BAND)
+        RAK3172_RegionRefresh();
+
+    return status;
+}
+
+/* Forget one value, the next read goes to the module */
+void RAK3172_ConfigInvalidate(RAK3172_ConfigItem_t item)
+{
+    if((unsigned)item >= RAK3172_CFG_COUNT || !xConfigMutex)
+        return;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+    xConfig[item].valid = false;
+    xSemaphoreGive(xConfigMutex);
+}
+
+/* Forget everything, staged values included */
+void RAK3172_ConfigInvalidateAll(void)
+{
+    if(!xConfigMutex)
+        return;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+    for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+    {
+        xConfig[i].valid = false;
+        xConfig[i].dirty = false;
+    }
+    xConfigStats.invalidations++;
+    xSemaphoreGive(xConfigMutex);
+}
+
+/* Shadow content without touching the UART, false if unknown */
+bool RAK3172_ConfigPeek(RAK3172_ConfigItem_t item, char *value, size_t max_len, bool *dirty)
+{
+    bool valid;
+
+    if((unsigned)item >= RAK3172_CFG_COUNT || !value || max_len == 0 || !xConfigMutex)
+        return false;
+
+    xSemaphoreTake(xConfigMutex, portMAX_DELAY);
+
+    valid = prvKnown(item);
+    if(valid)
+    {
+        strncpy(value, xConfig[item].value, max_len - 1);
+        value[max_len - 1] = '\0';
+    }
+    if(dirty)
+        *dirty = xConfig[item].dirty;
+
+    xSemaphoreGive(xConfigMutex);
+
+    return valid;
+}
+
+/* Get shadow statistics */
+void RAK3172_GetConfigStats(RAK3172_ConfigStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xConfigStats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,377 @@
+#include "rak3172_confirm.h"
+#include "rak3172_airtime.h"
+#include "rak3172_sched.h"
+#include "rak3172_timeout.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include <string.h>
+
+/* Queued uplink */
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint8_t length;
+    uint8_t port;
+    uint32_t seq;
+    RAK3172_CfmCallback_t callback;
+    void *ctx;
+} RAK3172_CfmMsg_t;
+
+const uint32_t RAK3172_CfmHistEdgesMs[RAK3172_CFM_HIST_BINS - 1] = {
+    1000, 1500, 2000, 2500, 3000, 4000, 6000
+};
+
+static QueueHandle_t xCfmQueue = NULL;
+static QueueHandle_t xAckQueue = NULL;      /* Ack URC of the outstanding uplink */
+static TaskHandle_t xCfmTaskHandle = NULL;
+static RAK3172_CfmMsg_t xCurrent;           /* Owned by the manager task */
+
+static uint32_t ulNextSeq = 1;
+static uint32_t ulOutstandingSeq = 0;       /* 0 when nothing waits for an ack */
+static uint32_t ulBudgetMs = RAK3172_CFM_AIRTIME_BUDGET_MS;
+
+/* Recent confirmed outcomes, bit set = acked, newest in bit 0 */
+static uint32_t ulOutcomes = 0;
+static uint8_t ucOutcomeCount = 0;
+static uint8_t ucSinceProbe = 0;
+
+static RAK3172_CfmStats_t xCfmStats = {0};
+
+static uint8_t prvRatioPct(void)
+{
+    uint8_t acked = 0;
+
+    for(uint8_t i = 0; i < ucOutcomeCount; i++)
+        acked += (ulOutcomes >> i) & 1;
+
+    return ucOutcomeCount ? (uint8_t)(acked * 100 / ucOutcomeCount) : 100;
+}
+
+/* Poor link: enough recent confirmed uplinks, too few acked */
+static bool prvFallenBack(void)
+{
+    return ucOutcomeCount >= 4 && prvRatioPct() < RAK3172_CFM_MIN_RATIO_PCT;
+}
+
+static void prvRecordOutcome(bool acked)
+{
+    ulOutcomes = (ulOutcomes << 1) | (acked ? 1 : 0);
+    if(ucOutcomeCount < RAK3172_CFM_WINDOW)
+        ucOutcomeCount++;
+}
+
+static void prvRecordLatency(uint32_t ms)
+{
+    uint8_t bin = 0;
+
+    while(bin < RAK3172_CFM_HIST_BINS - 1 && ms >= RAK3172_CfmHistEdgesMs[bin])
+        bin++;
+
+    taskENTER_CRITICAL();
+    xCfmStats.ackHist[bin]++;
+    taskEXIT_CRITICAL();
+}
+
+static void prvCount(uint32_t *counter, uint32_t n)
+{
+    taskENTER_CRITICAL();
+    *counter += n;
+    taskEXIT_CRITICAL();
+}
+
+/* One AT+SEND of the given type, the driver switches AT+CFM for this
+ * uplink only. Waits out the duty cycle and a busy module, a few times at
+ * most. */
+static RAK3172_Status_t prvSendOnce(const RAK3172_CfmMsg_t *pxMsg, bool confirmed)
+{
+    RAK3172_Status_t status = RAK3172_ERR_INVALID;
+
+    for(int tries = 0; tries < RAK3172_CFM_MAX_ATTEMPTS; tries++)
+    {
+        uint32_t waitMs = RAK3172_DutyCycleWaitMs();
+        if(waitMs)
+            vTaskDelay(pdMS_TO_TICKS(waitMs));
+
+        if(confirmed)
+        {
+            xQueueReset(xAckQueue);
+            taskENTER_CRITICAL();
+            ulOutstandingSeq = pxMsg->seq;
+            taskEXIT_CRITICAL();
+        }
+
+        if(confirmed)
+            status = RAK3172_SendConfirmedOnce(pxMsg->port, pxMsg->data, pxMsg->length);
+        else
+            status = RAK3172_SendDataUnconfirmed(pxMsg->port, pxMsg->data, pxMsg->length);
+
+        if(status == RAK3172_OK)
+            break;
+
+        taskENTER_CRITICAL();
+        ulOutstandingSeq = 0;
+        taskEXIT_CRITICAL();
+
+        if(status == RAK3172_ERR_BUSY)
+            vTaskDelay(pdMS_TO_TICKS(RAK3172_SCHED_BUSY_BACKOFF_MS));
+        else if(status != RAK3172_ERR_DUTY_CYCLE)
+            break;
+    }
+
+    return status;
+}
+
+/* Confirmed uplink with retransmissions inside the airtime budget */
+static RAK3172_CfmResult_t prvDeliverConfirmed(const RAK3172_CfmMsg_t *pxMsg)
+{
+    RAK3172_CfmResult_t result = RAK3172_CFM_NO_ACK;
+    uint32_t spentMs = 0;
+
+    for(uint8_t attempt = 1; attempt <= RAK3172_CFM_MAX_ATTEMPTS; attempt++)
+    {
+        uint32_t airtimeMs = (RAK3172_UplinkAirtimeUs(RAK3172_GetDataRate(), pxMsg->length) + 999) / 1000;
+
+        if(attempt > 1 && spentMs + airtimeMs > ulBudgetMs)
+        {
+            prvCount(&xCfmStats.budgetStops, 1);
+            break;
+        }
+
+        if(prvSendOnce(pxMsg, true) != RAK3172_OK)
+        {
+            prvCount(&xCfmStats.sendErrors, 1);
+            result = RAK3172_CFM_SEND_ERROR;
+            break;
+        }
+
+        TickType_t sentTick = xTaskGetTickCount();
+        bool acked = false;
+
+        /* Learned ack delay after the uplink has left the air */
+        uint32_t ackWaitMs = airtimeMs + RAK3172_TimeoutGet(RAK3172_TMO_ACK_EVT, RAK3172_CFM_ACK_TIMEOUT_MS);
+        if(ackWaitMs > RAK3172_CFM_ACK_TIMEOUT_MS)
+            ackWaitMs = RAK3172_CFM_ACK_TIMEOUT_MS;
+
+        spentMs += airtimeMs;
+        prvCount(&xCfmStats.airtimeMs, airtimeMs);
+        if(attempt > 1)
+            prvCount(&xCfmStats.retransmissions, 1);
+
+        if(xQueueReceive(xAckQueue, &acked, pdMS_TO_TICKS(ackWaitMs)) != pdTRUE)
+        {
+            /* No URC at all, a late one is counted as unmatched */
+            taskENTER_CRITICAL();
+            ulOutstandingSeq = 0;
+            taskEXIT_CRITICAL();
+            RAK3172_TimeoutExpired(RAK3172_TMO_ACK_EVT);
+        }
+        else
+        {
+            uint32_t latencyMs = pdTICKS_TO_MS(xTaskGetTickCount() - sentTick);
+            RAK3172_TimeoutSample(RAK3172_TMO_ACK_EVT, latencyMs > airtimeMs ? latencyMs - airtimeMs : 0);
+        }
+
+        if(acked)
+        {
+            prvRecordLatency(pdTICKS_TO_MS(xTaskGetTickCount() - sentTick));
+            prvCount(&xCfmStats.acked, 1);
+            if(attempt == 1)
+                prvCount(&xCfmStats.ackedFirst, 1);
+            result = RAK3172_CFM_ACKED;
+            break;
+        }
+    }
+
+    if(result == RAK3172_CFM_NO_ACK)
+        prvCount(&xCfmStats.noAck, 1);
+
+    return result;
+}
+
+static RAK3172_CfmResult_t prvDeliver(const RAK3172_CfmMsg_t *pxMsg)
+{
+    if(prvFallenBack() && ++ucSinceProbe < RAK3172_CFM_PROBE_EVERY)
+    {
+        prvCount(&xCfmStats.fallbacks, 1);
+
+        if(prvSendOnce(pxMsg, false) != RAK3172_OK)
+        {
+            prvCount(&xCfmStats.sendErrors, 1);
+            return RAK3172_CFM_SEND_ERROR;
+        }
+
+        prvCount(&xCfmStats.airtimeMs, (RAK3172_UplinkAirtimeUs(RAK3172_GetDataRate(), pxMsg->length) + 999) / 1000);
+        return RAK3172_CFM_UNCONFIRMED;
+    }
+
+    bool probe = prvFallenBack();
+    if(probe)
+    {
+        ucSinceProbe = 0;
+        prvCount(&xCfmStats.probes, 1);
+    }
+
+    RAK3172_CfmResult_t result = prvDeliverConfirmed(pxMsg);
+
+    if(result == RAK3172_CFM_ACKED && probe)
+    {
+        /* Link is back, forget the bad history */
+        ulOutcomes = 0;
+        ucOutcomeCount = 0;
+    }
+    if(result != RAK3172_CFM_SEND_ERROR)
+        prvRecordOutcome(result == RAK3172_CFM_ACKED);
+
+    return result;
+}
+
+static void prvTaskConfirm(void *pvParameters)
+{
+    for(;;)
+    {
+        if(xQueueReceive(xCfmQueue, &xCurrent, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        RAK3172_CfmResult_t result = prvDeliver(&xCurrent);
+
+        if(xCurrent.callback)
+            xCurrent.callback(xCurrent.seq, result, xCurrent.ctx);
+    }
+}
+
+/* Ack URC, runs in the RAK3172 task. Only this task sends confirmed
+ * uplinks and only one at a time, so any URC belongs to the outstanding
+ * one; no per-sequence table is needed. */
+void RAK3172_ConfirmHandleUrc(bool acked)
+{
+    if(!xAckQueue)
+        return;
+
+    taskENTER_CRITICAL();
+    bool matched = (ulOutstandingSeq != 0);
+    ulOutstandingSeq = 0;
+    if(!matched)
+        xCfmStats.unmatched++;
+    taskEXIT_CRITICAL();
+
+    if(matched)
+        xQueueOverwrite(xAckQueue, &acked);
+}
+
+/* Create the manager task, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_ConfirmInit(void)
+{
+    if(xCfmQueue)
+        return RAK3172_OK;
+
+    xCfmQueue = xQueueCreate(RAK3172_CFM_QUEUE_LEN, sizeof(RAK3172_CfmMsg_t));
+    xAckQueue = xQueueCreate(1, sizeof(bool));
+
+    if(!xCfmQueue || !xAckQueue)
+        return RAK3172_ERR_INVALID;
+
+    if(xTaskCreate(prvTaskConfirm, "RAKCfm", 512, NULL, 1, &xCfmTaskHandle) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Queue a confirmed uplink. It is copied; callback (optional) reports the
+ * outcome from the manager task, seq (optional) gets its number. */
+RAK3172_Status_t RAK3172_ConfirmSend(uint8_t port, const uint8_t *data, uint8_t length,
+                                     RAK3172_CfmCallback_t callback, void *ctx, uint32_t *seq)
+{
+    RAK3172_CfmMsg_t xMsg;
+
+    if(!xCfmQueue || !data || length == 0)
+    {
+        prvCount(&xCfmStats.rejected, 1);
+        return RAK3172_ERR_INVALID;
+    }
+
+    if(length > RAK3172_GetMaxPayload())
+    {
+        prvCount(&xCfmStats.rejected, 1);
+        return RAK3172_ERR_PAYLOAD_SIZE;
+    }
+
+    memcpy(xMsg.data, data, length);
+    xMsg.length = length;
+    xMsg.port = port;
+    xMsg.callback = callback;
+    xMsg.ctx = ctx;
+
+    taskENTER_CRITICAL();
+    xMsg.seq = ulNextSeq++;
+    if(ulNextSeq == 0)
+        ulNextSeq = 1;
+    taskEXIT_CRITICAL();
+
+    if(xQueueSend(xCfmQueue, &xMsg, 0) != pdTRUE)
+    {
+        prvCount(&xCfmStats.rejected, 1);
+        return RAK3172_ERR_QUEUE_FULL;
+    }
+
+    prvCount(&xCfmStats.queued, 1);
+    if(seq)
+        *seq = xMsg.seq;
+
+    return RAK3172_OK;
+}
+
+/* Airtime all attempts of one uplink may use */
+void RAK3172_ConfirmSetBudget(uint32_t budget_ms)
+{
+    ulBudgetMs = budget_ms;
+}
+
+static void prvSendDataDone(uint32_t seq, RAK3172_CfmResult_t result, void *ctx)
+{
+    xTaskNotifyIndexed((TaskHandle_t)ctx, RAK3172_NOTIFY_INDEX, (uint32_t)result, eSetValueWithOverwrite);
+}
+
+/* Send confirmed data, waits until acknowledged or given up. An uplink
+ * sent unconfirmed because of a poor link counts as sent. */
+RAK3172_Status_t RAK3172_SendData(uint8_t port, const uint8_t *data, uint16_t length)
+{
+    uint32_t ulResult = RAK3172_CFM_SEND_ERROR;
+
+    /* Would wait for itself */
+    if(length > RAK3172_MAX_PAYLOAD || xTaskGetCurrentTaskHandle() == xCfmTaskHandle)
+        return RAK3172_ERR_INVALID;
+
+    xTaskNotifyStateClearIndexed(NULL, RAK3172_NOTIFY_INDEX);
+
+    RAK3172_Status_t status = RAK3172_ConfirmSend(port, data, (uint8_t)length, prvSendDataDone,
+                                                  xTaskGetCurrentTaskHandle(), NULL);
+    if(status != RAK3172_OK)
+        return status;
+
+    xTaskNotifyWaitIndexed(RAK3172_NOTIFY_INDEX, 0, UINT32_MAX, &ulResult, portMAX_DELAY);
+
+    switch((RAK3172_CfmResult_t)ulResult)
+    {
+        case RAK3172_CFM_ACKED:
+        case RAK3172_CFM_UNCONFIRMED:
+            return RAK3172_OK;
+        case RAK3172_CFM_NO_ACK:
+            return RAK3172_ERR_NO_ACK;
+        default:
+            return RAK3172_ERR_ERROR;
+    }
+}
+
+/* Get manager statistics */
+void RAK3172_GetConfirmStats(RAK3172_CfmStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xCfmStats;
+    stats->ratioPct = prvRatioPct();
+    stats->fallback = prvFallenBack();
+    stats->budgetMs = ulBudgetMs;
+    taskEXIT_CRITICAL();
+}
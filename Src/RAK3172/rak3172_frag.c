@@ -0,0 +1,637 @@
+#include "rak3172_frag.h"
+#include "rak3172_region.h"
+#include "rak3172_sched.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* TS004 commands */
+#define FRAG_CID_PACKAGE_VERSION    0x00
+#define FRAG_CID_SESSION_STATUS     0x01
+#define FRAG_CID_SESSION_SETUP      0x02
+#define FRAG_CID_SESSION_DELETE     0x03
+#define FRAG_CID_DATA_FRAGMENT      0x08
+
+#define FRAG_PACKAGE_ID             3
+#define FRAG_PACKAGE_VERSION        1
+
+#define FRAG_HEADER_LEN             3       /* CID + FragIndex:2 | N:14 */
+#define FRAG_SETUP_LEN              11
+#define FRAG_MAP_BYTES              (RAK3172_FRAG_MAX_FRAGMENTS / 8)
+#define FRAG_NONE                   0xFFFF
+
+/* Parity fragment, reduced to the fragments still missing */
+typedef struct {
+    uint8_t coeff[FRAG_MAP_BYTES];
+    uint8_t data[RAK3172_FRAG_MAX_SIZE];
+    uint16_t pivot;             /* In no other row */
+} FragRow_t;
+
+/* Downlink session, one at a time. The session fields of the stats are
+ * the decoder state. */
+static uint8_t ucBlock[RAK3172_FRAG_BUFFER_SIZE];
+static uint8_t ucReceived[FRAG_MAP_BYTES];
+static FragRow_t xRows[RAK3172_FRAG_MAX_PARITY];
+static uint8_t ucRowCount = 0;
+static uint8_t ucPadding = 0;
+static bool xMatrixFull = false;
+static volatile bool xTesting = false;
+static RAK3172_FragStats_t xFragStats = {0};
+static RAK3172_FragCallback_t pxBlockCallback = NULL;
+static uint8_t ucUplinkIndex = 0;
+
+static inline bool prvTestBit(const uint8_t *map, uint16_t bit)
+{
+    return (map[bit >> 3] & (1u << (bit & 7))) != 0;
+}
+
+static inline void prvSetBit(uint8_t *map, uint16_t bit)
+{
+    map[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+}
+
+static inline void prvClearBit(uint8_t *map, uint16_t bit)
+{
+    map[bit >> 3] &= (uint8_t)~(1u << (bit & 7));
+}
+
+static uint32_t prvPrbs23(uint32_t x)
+{
+    uint32_t b0 = x & 1;
+    uint32_t b1 = (x & 32) >> 5;
+
+    return (x >> 1) + ((b0 ^ b1) << 22);
+}
+
+/* TS004 parity matrix line n (from 1) over m fragments. A single
+ * fragment would get an empty line, it is simply repeated instead. */
+static void prvMatrixLine(uint8_t *line, uint16_t n, uint16_t m)
+{
+    uint32_t mm = ((m & (m - 1)) == 0) ? 1 : 0;
+    uint32_t x = 1 + 1001 * (uint32_t)n;
+
+    memset(line, 0, FRAG_MAP_BYTES);
+
+    if(m == 1)
+    {
+        prvSetBit(line, 0);
+        return;
+    }
+
+    for(uint16_t count = 0; count < m / 2; count++)
+    {
+        uint32_t r = m;
+        while(r >= m)
+        {
+            x = prvPrbs23(x);
+            r = x % (m + mm);
+        }
+        prvSetBit(line, (uint16_t)r);
+    }
+}
+
+static uint16_t prvLowestBit(const uint8_t *map, uint16_t bits)
+{
+    for(uint16_t i = 0; i < (bits + 7) / 8; i++)
+    {
+        if(map[i])
+            return (uint16_t)(i * 8 + __builtin_ctz(map[i]));
+    }
+    return FRAG_NONE;
+}
+
+static bool prvOnlyBit(const uint8_t *map, uint16_t bits, uint16_t bit)
+{
+    for(uint16_t i = 0; i < (bits + 7) / 8; i++)
+    {
+        uint8_t expected = (i == (bit >> 3)) ? (uint8_t)(1u << (bit & 7)) : 0;
+        if(map[i] != expected)
+            return false;
+    }
+    return true;
+}
+
+static void prvXorRow(FragRow_t *dst, const FragRow_t *src)
+{
+    for(int i = 0; i < FRAG_MAP_BYTES; i++)
+        dst->coeff[i] ^= src->coeff[i];
+    for(int i = 0; i < xFragStats.fragSize; i++)
+        dst->data[i] ^= src->data[i];
+}
+
+/* Take a fragment already in the block out of a row */
+static void prvEliminateKnown(FragRow_t *row, uint16_t col)
+{
+    const uint8_t *pucFrag = &ucBlock[(size_t)col * xFragStats.fragSize];
+
+    for(int i = 0; i < xFragStats.fragSize; i++)
+        row->data[i] ^= pucFrag[i];
+    prvClearBit(row->coeff, col);
+}
+
+/* Reduce the row in the first free slot against the others and keep it
+ * if it still says something new */
+static void prvInsertRow(void)
+{
+    FragRow_t *pxNew = &xRows[ucRowCount];
+
+    for(uint8_t i = 0; i < ucRowCount; i++)
+    {
+        if(prvTestBit(pxNew->coeff, xRows[i].pivot))
+            prvXorRow(pxNew, &xRows[i]);
+    }
+
+    pxNew->pivot = prvLowestBit(pxNew->coeff, xFragStats.nbFrag);
+    if(pxNew->pivot == FRAG_NONE)
+    {
+        xFragStats.parityDropped++;
+        return;
+    }
+
+    for(uint8_t i = 0; i < ucRowCount; i++)
+    {
+        if(prvTestBit(xRows[i].coeff, pxNew->pivot))
+            prvXorRow(&xRows[i], pxNew);
+    }
+
+    ucRowCount++;
+}
+
+/* Fragment col is now in the block, take it out of every row */
+static void prvKnown(uint16_t col)
+{
+    prvSetBit(ucReceived, col);
+
+    for(uint8_t i = 0; i < ucRowCount; )
+    {
+        FragRow_t *pxRow = &xRows[i];
+
+        if(!prvTestBit(pxRow->coeff, col))
+        {
+            i++;
+            continue;
+        }
+
+        prvEliminateKnown(pxRow, col);
+        if(pxRow->pivot != col)
+        {
+            i++;
+            continue;
+        }
+
+        /* Lost its pivot: move it to the free slot and insert it again,
+         * slot i now holds a row not looked at yet */
+        ucRowCount--;
+        if(i != ucRowCount)
+        {
+            FragRow_t xTmp = xRows[i];
+            xRows[i] = xRows[ucRowCount];
+            xRows[ucRowCount] = xTmp;
+        }
+        prvInsertRow();
+    }
+}
+
+/* A row down to its pivot is that fragment */
+static void prvSolve(void)
+{
+    uint8_t i = 0;
+
+    while(i < ucRowCount)
+    {
+        FragRow_t *pxRow = &xRows[i];
+
+        if(!prvOnlyBit(pxRow->coeff, xFragStats.nbFrag, pxRow->pivot))
+        {
+            i++;
+            continue;
+        }
+
+        memcpy(&ucBlock[(size_t)pxRow->pivot * xFragStats.fragSize], pxRow->data, xFragStats.fragSize);
+        prvSetBit(ucReceived, pxRow->pivot);
+        xFragStats.recovered++;
+
+        /* Pivots are in no other row, nothing else to update */
+        xRows[i] = xRows[--ucRowCount];
+    }
+}
+
+static size_t prvBlockLength(void)
+{
+    return (size_t)xFragStats.nbFrag * xFragStats.fragSize - ucPadding;
+}
+
+static void prvSessionReset(uint8_t index, uint16_t nbFrag, uint8_t size, uint8_t padding)
+{
+    memset(ucReceived, 0, sizeof(ucReceived));
+    ucRowCount = 0;
+    ucPadding = padding;
+    xMatrixFull = false;
+
+    taskENTER_CRITICAL();
+    xFragStats.active = true;
+    xFragStats.complete = false;
+    xFragStats.index = index;
+    xFragStats.nbFrag = nbFrag;
+    xFragStats.fragSize = size;
+    xFragStats.received = 0;
+    xFragStats.recovered = 0;
+    xFragStats.parityRows = 0;
+    xFragStats.parityReceived = 0;
+    xFragStats.parityDropped = 0;
+    xFragStats.duplicates = 0;
+    taskEXIT_CRITICAL();
+}
+
+/* Fragment n (from 1) of the open session */
+static void prvDataFragment(uint16_t n, const uint8_t *data, size_t length)
+{
+    uint16_t nbFrag = xFragStats.nbFrag;
+
+    if(!xFragStats.active || n == 0 || length < xFragStats.fragSize)
+        return;
+
+    if(xFragStats.complete)
+    {
+        xFragStats.duplicates++;
+        return;
+    }
+
+    if(n <= nbFrag)
+    {
+        uint16_t col = n - 1;
+
+        if(prvTestBit(ucReceived, col))
+        {
+            xFragStats.duplicates++;
+            return;
+        }
+
+        memcpy(&ucBlock[(size_t)col * xFragStats.fragSize], data, xFragStats.fragSize);
+        xFragStats.received++;
+        prvKnown(col);
+    }
+    else
+    {
+        xFragStats.parityReceived++;
+
+        if(ucRowCount >= RAK3172_FRAG_MAX_PARITY)
+        {
+            xFragStats.parityDropped++;
+            xMatrixFull = true;
+            return;
+        }
+
+        FragRow_t *pxNew = &xRows[ucRowCount];
+
+        prvMatrixLine(pxNew->coeff, n - nbFrag, nbFrag);
+        memcpy(pxNew->data, data, xFragStats.fragSize);
+        for(uint16_t col = 0; col < nbFrag; col++)
+        {
+            if(prvTestBit(pxNew->coeff, col) && prvTestBit(ucReceived, col))
+                prvEliminateKnown(pxNew, col);
+        }
+        prvInsertRow();
+    }
+
+    prvSolve();
+    xFragStats.parityRows = ucRowCount;
+
+    if(xFragStats.received + xFragStats.recovered == nbFrag)
+    {
+        xFragStats.complete = true;
+        xFragStats.blocks++;
+        ucRowCount = 0;
+        xFragStats.parityRows = 0;
+
+        if(pxBlockCallback && !xTesting)
+            pxBlockCallback(ucBlock, prvBlockLength());
+    }
+}
+
+/* FragSessionSetupReq, returns the status byte of the answer */
+static uint8_t prvSessionSetup(const uint8_t *p)
+{
+    uint8_t index = (p[0] >> 4) & 0x03;
+    uint16_t nbFrag = (uint16_t)(p[1] | (p[2] << 8));
+    uint8_t size = p[3];
+    uint8_t control = p[4];
+    uint8_t padding = p[5];
+    uint8_t status = (uint8_t)(index << 6);
+
+    /* Bits 2:0 are BlockAckDelay, the matrix is in bits 5:3 */
+    if(((control >> 3) & 0x07) != 0)
+        status |= 0x01;         /* Only the default matrix */
+    if(nbFrag == 0 || nbFrag > RAK3172_FRAG_MAX_FRAGMENTS ||
+       size == 0 || size > RAK3172_FRAG_MAX_SIZE || padding >= size ||
+       (size_t)nbFrag * size > RAK3172_FRAG_BUFFER_SIZE)
+        status |= 0x02;         /* Not enough memory */
+
+    if(status & 0x0F)
+        return status;
+
+    prvSessionReset(index, nbFrag, size, padding);
+
+    taskENTER_CRITICAL();
+    xFragStats.sessions++;
+    taskEXIT_CRITICAL();
+
+    return status;
+}
+
+/* Downlinks on RAK3172_FRAG_PORT, runs in the RAK3172 task. Commands may
+ * be concatenated, a data fragment takes the rest of the frame. */
+static void prvFragPortHandler(const RAK3172_RxData_t *rx)
+{
+    uint8_t answer[16];
+    size_t answerLength = 0;
+    size_t pos = 0;
+
+    if(xTesting)
+        return;
+
+    while(pos < rx->length && answerLength + 5 <= sizeof(answer))
+    {
+        uint8_t cid = rx->data[pos++];
+        const uint8_t *p = &rx->data[pos];
+        size_t left = rx->length - pos;
+
+        if(cid == FRAG_CID_PACKAGE_VERSION)
+        {
+            answer[answerLength++] = cid;
+            answer[answerLength++] = FRAG_PACKAGE_ID;
+            answer[answerLength++] = FRAG_PACKAGE_VERSION;
+        }
+        else if(cid == FRAG_CID_SESSION_STATUS && left >= 1)
+        {
+            uint8_t index = (p[0] >> 1) & 0x03;
+            bool all = (p[0] & 0x01) != 0;
+            pos += 1;
+
+            if(!xFragStats.active || xFragStats.index != index || (xFragStats.complete && !all))
+                continue;
+
+            uint32_t missing = xFragStats.nbFrag - xFragStats.received - xFragStats.recovered;
+            uint16_t received = (uint16_t)(((xFragStats.received + xFragStats.parityReceived) & 0x3FFF) |
+                                           ((uint16_t)index << 14));
+            answer[answerLength++] = cid;
+            answer[answerLength++] = (uint8_t)received;
+            answer[answerLength++] = (uint8_t)(received >> 8);
+            answer[answerLength++] = (uint8_t)((missing > 255) ? 255 : missing);
+            answer[answerLength++] = xMatrixFull ? 0x01 : 0x00;
+        }
+        else if(cid == FRAG_CID_SESSION_SETUP && left >= FRAG_SETUP_LEN - 1)
+        {
+            answer[answerLength++] = cid;
+            answer[answerLength++] = prvSessionSetup(p);
+            pos += FRAG_SETUP_LEN - 1;
+        }
+        else if(cid == FRAG_CID_SESSION_DELETE && left >= 1)
+        {
+            uint8_t index = p[0] & 0x03;
+            bool exists = xFragStats.active && xFragStats.index == index;
+            pos += 1;
+
+            if(exists)
+            {
+                taskENTER_CRITICAL();
+                xFragStats.active = false;
+                taskEXIT_CRITICAL();
+            }
+
+            answer[answerLength++] = cid;
+            answer[answerLength++] = (uint8_t)(index | (exists ? 0 : 0x04));
+        }
+        else if(cid == FRAG_CID_DATA_FRAGMENT && left >= 2)
+        {
+            uint16_t indexAndN = (uint16_t)(p[0] | (p[1] << 8));
+
+            if(xFragStats.index == (indexAndN >> 14))
+                prvDataFragment(indexAndN & 0x3FFF, &p[2], left - 2);
+            pos = rx->length;
+        }
+        else
+        {
+            /* Unknown or truncated, the rest cannot be parsed */
+            break;
+        }
+    }
+
+    if(answerLength)
+        RAK3172_SchedSend(RAK3172_FRAG_PORT, answer, (uint8_t)answerLength, 1);
+}
+
+/* Frame for fragment n (from 1): uncoded up to nbFrag, parity after.
+ * The block is zero padded to a whole number of fragments. */
+static uint8_t prvEncode(uint8_t *frame, uint8_t *line, const uint8_t *data, size_t length,
+                         uint8_t size, uint16_t nbFrag, uint8_t index, uint16_t n)
+{
+    uint16_t indexAndN = (uint16_t)(((uint16_t)index << 14) | n);
+    uint8_t *pucOut = &frame[FRAG_HEADER_LEN];
+
+    frame[0] = FRAG_CID_DATA_FRAGMENT;
+    frame[1] = (uint8_t)indexAndN;
+    frame[2] = (uint8_t)(indexAndN >> 8);
+    memset(pucOut, 0, size);
+
+    if(n > nbFrag)
+        prvMatrixLine(line, n - nbFrag, nbFrag);
+
+    for(uint16_t col = 0; col < nbFrag; col++)
+    {
+        if(n <= nbFrag ? (col != n - 1) : !prvTestBit(line, col))
+            continue;
+
+        size_t offset = (size_t)col * size;
+        for(uint8_t i = 0; i < size && offset + i < length; i++)
+            pucOut[i] ^= data[offset + i];
+    }
+
+    return (uint8_t)(FRAG_HEADER_LEN + size);
+}
+
+/* Queue on the scheduler, waiting for room */
+static RAK3172_Status_t prvQueue(const uint8_t *frame, uint8_t length)
+{
+    RAK3172_Status_t status;
+
+    while((status = RAK3172_SchedSend(RAK3172_FRAG_PORT, frame, length, 0)) == RAK3172_ERR_QUEUE_FULL)
+        vTaskDelay(pdMS_TO_TICKS(RAK3172_FRAG_RETRY_MS));
+
+    return status;
+}
+
+/* Register the downlink handler, call once after RAK3172_SchedInit() */
+RAK3172_Status_t RAK3172_FragInit(void)
+{
+    if(RAK3172_RegisterPortHandler(RAK3172_FRAG_PORT, prvFragPortHandler) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+void RAK3172_FragSetCallback(RAK3172_FragCallback_t callback)
+{
+    pxBlockCallback = callback;
+}
+
+/* Send a block as a fragmentation session with redundancy_pct % parity
+ * fragments. frag_size 0 takes the most the current data rate allows.
+ * Blocks until every frame is on the scheduler queue. */
+RAK3172_Status_t RAK3172_FragSend(const uint8_t *data, size_t length, uint8_t frag_size, uint8_t redundancy_pct)
+{
+    uint8_t frame[FRAG_HEADER_LEN + RAK3172_FRAG_MAX_SIZE];
+    uint8_t line[FRAG_MAP_BYTES];
+    uint8_t maxPayload = RAK3172_GetMaxPayload();
+
+    if(!data || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    if(frag_size == 0)
+    {
+        if(maxPayload <= FRAG_HEADER_LEN)
+            return RAK3172_ERR_PAYLOAD_SIZE;
+        frag_size = maxPayload - FRAG_HEADER_LEN;
+        if(frag_size > RAK3172_FRAG_MAX_SIZE)
+            frag_size = RAK3172_FRAG_MAX_SIZE;
+    }
+
+    if(frag_size > RAK3172_FRAG_MAX_SIZE || frag_size + FRAG_HEADER_LEN > maxPayload)
+        return RAK3172_ERR_PAYLOAD_SIZE;
+
+    size_t nbFrag = (length + frag_size - 1) / frag_size;
+    if(nbFrag > RAK3172_FRAG_MAX_FRAGMENTS)
+        return RAK3172_ERR_PAYLOAD_SIZE;
+
+    uint16_t nbParity = (uint16_t)((nbFrag * redundancy_pct + 99) / 100);
+    uint8_t index = ucUplinkIndex++ & 0x03;
+    uint8_t padding = (uint8_t)(nbFrag * frag_size - length);
+
+    /* Same layout as FragSessionSetupReq, default matrix, no descriptor */
+    frame[0] = FRAG_CID_SESSION_SETUP;
+    frame[1] = (uint8_t)(index << 4);
+    frame[2] = (uint8_t)nbFrag;
+    frame[3] = (uint8_t)(nbFrag >> 8);
+    frame[4] = frag_size;
+    frame[5] = 0;
+    frame[6] = padding;
+    memset(&frame[7], 0, 4);
+
+    RAK3172_Status_t status = prvQueue(frame, FRAG_SETUP_LEN);
+
+    for(uint16_t n = 1; n <= nbFrag + nbParity && status == RAK3172_OK; n++)
+    {
+        uint8_t frameLength = prvEncode(frame, line, data, length, frag_size, (uint16_t)nbFrag, index, n);
+
+        status = prvQueue(frame, frameLength);
+        if(status == RAK3172_OK)
+        {
+            taskENTER_CRITICAL();
+            xFragStats.uplinkFragments++;
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    return status;
+}
+
+/* Last completed downlink block, NULL if there is none */
+const uint8_t *RAK3172_FragGetBlock(size_t *length)
+{
+    if(!xFragStats.active || !xFragStats.complete)
+        return NULL;
+
+    if(length)
+        *length = prvBlockLength();
+    return ucBlock;
+}
+
+void RAK3172_GetFragStats(RAK3172_FragStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xFragStats;
+    taskEXIT_CRITICAL();
+}
+
+/* The source block sits in the upper half of the block buffer, the
+ * decoder fills the lower half */
+RAK3172_Status_t RAK3172_FragSelfTest(size_t length, uint8_t frag_size, uint8_t redundancy_pct,
+                                      uint8_t loss_pct, uint32_t runs, RAK3172_FragTestResult_t *result)
+{
+    uint8_t frame[FRAG_HEADER_LEN + RAK3172_FRAG_MAX_SIZE];
+    uint8_t line[FRAG_MAP_BYTES];
+    uint8_t *pucSource = &ucBlock[RAK3172_FRAG_BUFFER_SIZE / 2];
+    RAK3172_FragTestResult_t xResult = {0};
+
+    if(!result || length == 0 || frag_size == 0 || frag_size > RAK3172_FRAG_MAX_SIZE ||
+       loss_pct > 100 || runs == 0)
+        return RAK3172_ERR_INVALID;
+
+    size_t nbFrag = (length + frag_size - 1) / frag_size;
+    if(nbFrag > RAK3172_FRAG_MAX_FRAGMENTS || nbFrag * frag_size > RAK3172_FRAG_BUFFER_SIZE / 2)
+        return RAK3172_ERR_PAYLOAD_SIZE;
+
+    taskENTER_CRITICAL();
+    bool busy = xTesting || (xFragStats.active && !xFragStats.complete);
+    if(!busy)
+        xTesting = true;
+    taskEXIT_CRITICAL();
+
+    if(busy)
+        return RAK3172_ERR_BUSY;
+
+    RAK3172_FragStats_t xSaved;
+    RAK3172_GetFragStats(&xSaved);
+
+    xResult.nbFrag = (uint16_t)nbFrag;
+    xResult.nbParity = (uint16_t)((nbFrag * redundancy_pct + 99) / 100);
+
+    for(uint32_t run = 0; run < runs; run++)
+    {
+        uint32_t delivered = 0;
+
+        for(size_t i = 0; i < length; i++)
+            pucSource[i] = (uint8_t)rand();
+
+        prvSessionReset(0, (uint16_t)nbFrag, frag_size, (uint8_t)(nbFrag * frag_size - length));
+
+        for(uint16_t n = 1; n <= nbFrag + xResult.nbParity && !xFragStats.complete; n++)
+        {
+            if((uint32_t)(rand() % 100) < loss_pct)
+            {
+                xResult.lost++;
+                continue;
+            }
+
+            prvEncode(frame, line, pucSource, length, frag_size, (uint16_t)nbFrag, 0, n);
+            prvDataFragment(n, &frame[FRAG_HEADER_LEN], frag_size);
+            delivered++;
+        }
+
+        xResult.runs++;
+        if(xFragStats.complete && memcmp(ucBlock, pucSource, length) == 0)
+        {
+            xResult.recovered++;
+            xResult.needed += delivered;
+        }
+
+        /* Let the CLI and the RAK3172 task run on long tests */
+        taskYIELD();
+    }
+
+    /* The block buffer no longer holds a downlink block */
+    xSaved.active = false;
+    xSaved.complete = false;
+
+    taskENTER_CRITICAL();
+    xFragStats = xSaved;
+    xTesting = false;
+    taskEXIT_CRITICAL();
+
+    *result = xResult;
+    return RAK3172_OK;
+}
@@ -0,0 +1,157 @@
+#include "rak3172_health.h"
+#include "rak3172_config.h"
+#include "rak3172_join.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+static TaskHandle_t xHealthTaskHandle = NULL;
+static volatile bool xHealthEnabled = true;
+static TickType_t xLastRecoveryTick = 0;
+static RAK3172_HealthStats_t xHealthStats = {0};
+
+/* Settings known before the reset, written back after it */
+static char pcSaved[RAK3172_CFG_COUNT][RAK3172_CFG_VALUE_LEN];
+static bool xSavedValid[RAK3172_CFG_COUNT];
+
+static void prvCount(uint32_t *counter, uint32_t n)
+{
+    taskENTER_CRITICAL();
+    *counter += n;
+    taskEXIT_CRITICAL();
+}
+
+/* Copy the shadow, it is dropped by the reset */
+static void prvSaveConfig(void)
+{
+    for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+    {
+        xSavedValid[i] = (i != RAK3172_CFG_VERSION) &&
+                         RAK3172_ConfigPeek((RAK3172_ConfigItem_t)i, pcSaved[i], sizeof(pcSaved[i]), NULL);
+    }
+}
+
+/* Stage the saved settings and write them in one transaction */
+static RAK3172_Status_t prvRestoreConfig(void)
+{
+    uint32_t count = 0;
+
+    for(int i = 0; i < RAK3172_CFG_COUNT; i++)
+    {
+        if(xSavedValid[i] && RAK3172_ConfigStage((RAK3172_ConfigItem_t)i, pcSaved[i]) == RAK3172_OK)
+            count++;
+    }
+
+    if(count == 0)
+        return RAK3172_OK;
+
+    RAK3172_Status_t status = RAK3172_ConfigCommit(NULL, NULL);
+    if(status == RAK3172_OK)
+        prvCount(&xHealthStats.restored, count);
+    else
+        prvCount(&xHealthStats.restoreErrors, 1);
+
+    return status;
+}
+
+/* Reset the module and bring it back to where it was */
+static void prvRecover(void)
+{
+    /* Joined by any path, or a join attempt under way; the reset forgets both */
+    RAK3172_JoinState_t joinState = RAK3172_GetJoinState();
+    bool rejoin = RAK3172_IsJoined() || joinState == RAK3172_JOIN_JOINING ||
+                  joinState == RAK3172_JOIN_BACKOFF;
+    uint32_t start = time_us_32();
+
+    printf("RAK3172 not answering, resetting\n");
+
+    prvSaveConfig();
+
+    if(RAK3172_HardwareReset() != pdPASS)
+    {
+        prvCount(&xHealthStats.failedRecoveries, 1);
+        return;
+    }
+
+    RAK3172_Status_t status = prvRestoreConfig();
+
+    uint32_t elapsed = (time_us_32() - start) / 1000;
+
+    taskENTER_CRITICAL();
+    xHealthStats.recoveries++;
+    xHealthStats.consecutive = 0;
+    xHealthStats.lastRecoveryMs = elapsed;
+    xHealthStats.totalRecoveryMs += elapsed;
+    if(elapsed > xHealthStats.maxRecoveryMs)
+        xHealthStats.maxRecoveryMs = elapsed;
+    xLastRecoveryTick = xTaskGetTickCount();
+    taskEXIT_CRITICAL();
+
+    if(rejoin && RAK3172_JoinStart() == RAK3172_OK)
+        prvCount(&xHealthStats.rejoins, 1);
+
+    printf("RAK3172 recovered in %lu ms, settings %s%s\n", (unsigned long)elapsed,
+           status == RAK3172_OK ? "restored" : "NOT restored", rejoin ? ", rejoining" : "");
+}
+
+static void prvTaskHealth(void *pvParameters)
+{
+    for(;;)
+    {
+        vTaskDelay(pdMS_TO_TICKS(RAK3172_HEALTH_PERIOD_MS));
+
+        RAK3172_Dev_t *dev = RAK3172_GetDev(0);
+
+        if(!xHealthEnabled || !dev || RAK3172_DevRxIdleMs(dev) < RAK3172_HEALTH_IDLE_MS)
+        {
+            xHealthStats.consecutive = 0;
+            continue;
+        }
+
+        prvCount(&xHealthStats.probes, 1);
+
+        if(RAK3172_DevSendCommand(dev, "AT", NULL, 0, RAK3172_HEALTH_PROBE_TIMEOUT_MS) == RAK3172_OK)
+        {
+            xHealthStats.consecutive = 0;
+            continue;
+        }
+
+        prvCount(&xHealthStats.probeFailures, 1);
+
+        if(++xHealthStats.consecutive >= RAK3172_HEALTH_MAX_FAILURES)
+            prvRecover();
+    }
+}
+
+/* Start the monitor, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_HealthInit(void)
+{
+    if(xHealthTaskHandle)
+        return RAK3172_OK;
+
+    if(xTaskCreate(prvTaskHealth, "RAKHealth", 512, NULL, 1, &xHealthTaskHandle) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Pause or resume the probes */
+void RAK3172_HealthEnable(bool enable)
+{
+    xHealthEnabled = enable;
+}
+
+/* Get monitor statistics */
+void RAK3172_GetHealthStats(RAK3172_HealthStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xHealthStats;
+    stats->enabled = xHealthEnabled;
+    stats->sinceRecoveryMs = xHealthStats.recoveries ? pdTICKS_TO_MS(xTaskGetTickCount() - xLastRecoveryTick) : 0;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,303 @@
+#include "rak3172_join.h"
+#include "rak3172_timeout.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
+#include "pico/rand.h"
+#include <string.h>
+
+/* Join now, no auto-join, one attempt: retries belong to the state machine */
+#define RAK3172_JOIN_CMD        "AT+JOIN=1:0:10:1"
+#define RAK3172_JOIN_STOP_CMD   "AT+JOIN=0:0:10:1"
+
+static RAK3172_JoinState_t xJoinState = RAK3172_JOIN_IDLE;
+static uint8_t ucAttempt = 0;
+static TickType_t xStartTick = 0;
+static TickType_t xEndTick = 0;
+static TickType_t xNextAttemptTick = 0;
+static TickType_t xAttemptTick = 0;
+
+static SemaphoreHandle_t xJoinMutex = NULL;
+static SemaphoreHandle_t xJoinDoneSem = NULL;   /* Given on JOINED, FAILED or cancel */
+static TimerHandle_t xJoinTimer = NULL;
+
+static RAK3172_JoinStatus_t xJoinStats = {0};
+static uint32_t ulLatency[RAK3172_JOIN_LATENCY_SAMPLES];
+static uint8_t ucLatencyIdx = 0;
+
+static void prvAttemptLocked(void);
+
+/* Terminal state reached */
+static void prvFinishLocked(RAK3172_JoinState_t state)
+{
+    xJoinState = state;
+    xEndTick = xTaskGetTickCount();
+    xTimerStop(xJoinTimer, 0);
+    xSemaphoreGive(xJoinDoneSem);
+}
+
+/* Current attempt failed: back off, or give up */
+static void prvAttemptFailedLocked(void)
+{
+    xJoinStats.failures++;
+
+    if(ucAttempt >= RAK3172_JOIN_MAX_ATTEMPTS)
+    {
+        prvFinishLocked(RAK3172_JOIN_FAILED);
+        RAK3172_PostEvent(RAK3172_EVENT_JOIN_GAVE_UP);
+        return;
+    }
+
+    /* Exponential backoff with +/-25 % jitter so a rack of dongles powered
+     * together does not retry in lockstep (hardware seeded, unlike rand()) */
+    uint32_t backoff = RAK3172_JOIN_BACKOFF_MS;
+    for(uint8_t i = 1; i < ucAttempt && backoff < RAK3172_JOIN_BACKOFF_MAX_MS; i++)
+        backoff *= 2;
+    if(backoff > RAK3172_JOIN_BACKOFF_MAX_MS)
+        backoff = RAK3172_JOIN_BACKOFF_MAX_MS;
+    backoff = backoff / 4 * 3 + get_rand_32() % (backoff / 2 + 1);
+
+    xJoinState = RAK3172_JOIN_BACKOFF;
+    xNextAttemptTick = xTaskGetTickCount() + pdMS_TO_TICKS(backoff);
+    xTimerChangePeriod(xJoinTimer, pdMS_TO_TICKS(backoff), 0);
+
+    RAK3172_PostEvent(RAK3172_EVENT_JOIN_RETRY);
+}
+
+/* AT+JOIN result, runs in the RAK3172 task. OK only means the attempt
+ * started, the outcome comes later as a URC. */
+static void prvJoinCmdDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    if(status == RAK3172_OK)
+        return;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+    if(xJoinState == RAK3172_JOIN_JOINING)
+        prvAttemptFailedLocked();
+    xSemaphoreGive(xJoinMutex);
+}
+
+/* Start the next attempt */
+static void prvAttemptLocked(void)
+{
+    ucAttempt++;
+    xJoinStats.attempts++;
+    xJoinState = RAK3172_JOIN_JOINING;
+
+    xAttemptTick = xTaskGetTickCount();
+    xTimerChangePeriod(xJoinTimer,
+                       pdMS_TO_TICKS(RAK3172_TimeoutGet(RAK3172_TMO_JOIN_EVT, RAK3172_JOIN_ATTEMPT_TIMEOUT_MS)), 0);
+
+    if(RAK3172_SubmitCommand(RAK3172_JOIN_CMD, prvJoinCmdDone, NULL, 5000) != RAK3172_OK)
+        prvAttemptFailedLocked();
+}
+
+/* Attempt timeout or end of backoff, runs in the timer task */
+static void prvJoinTimerCallback(TimerHandle_t xTimer)
+{
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+
+    if(xJoinState == RAK3172_JOIN_JOINING)
+    {
+        xJoinStats.timeouts++;
+        RAK3172_TimeoutExpired(RAK3172_TMO_JOIN_EVT);
+        prvAttemptFailedLocked();
+    }
+    else if(xJoinState == RAK3172_JOIN_BACKOFF)
+    {
+        prvAttemptLocked();
+    }
+
+    xSemaphoreGive(xJoinMutex);
+}
+
+/* Join URC, runs in the RAK3172 task */
+void RAK3172_JoinHandleUrc(bool joined)
+{
+    if(!xJoinMutex)
+        return;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+
+    /* Either outcome tells how long the network takes to answer */
+    if(xJoinState == RAK3172_JOIN_JOINING)
+        RAK3172_TimeoutSample(RAK3172_TMO_JOIN_EVT, pdTICKS_TO_MS(xTaskGetTickCount() - xAttemptTick));
+
+    /* A late accept during the backoff still counts */
+    if(joined && (xJoinState == RAK3172_JOIN_JOINING || xJoinState == RAK3172_JOIN_BACKOFF))
+    {
+        prvFinishLocked(RAK3172_JOIN_JOINED);
+
+        xJoinStats.joins++;
+        ulLatency[ucLatencyIdx] = pdTICKS_TO_MS(xEndTick - xStartTick);
+        ucLatencyIdx = (ucLatencyIdx + 1) % RAK3172_JOIN_LATENCY_SAMPLES;
+        if(xJoinStats.samples < RAK3172_JOIN_LATENCY_SAMPLES)
+            xJoinStats.samples++;
+    }
+    else if(!joined && xJoinState == RAK3172_JOIN_JOINING)
+    {
+        prvAttemptFailedLocked();
+    }
+
+    xSemaphoreGive(xJoinMutex);
+}
+
+/* Module reset: the session is gone */
+void RAK3172_JoinReset(void)
+{
+    if(!xJoinMutex)
+        return;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+    if(xJoinState != RAK3172_JOIN_IDLE)
+        prvFinishLocked(RAK3172_JOIN_IDLE);
+    xSemaphoreGive(xJoinMutex);
+}
+
+/* Create the state machine resources, called by RAK3172_Init() */
+RAK3172_Status_t RAK3172_JoinInit(void)
+{
+    if(xJoinMutex)
+        return RAK3172_OK;
+
+    xJoinMutex = xSemaphoreCreateMutex();
+    xJoinDoneSem = xSemaphoreCreateBinary();
+    xJoinTimer = xTimerCreate("RAKJoin", 1, pdFALSE, NULL, prvJoinTimerCallback);
+
+    if(!xJoinMutex || !xJoinDoneSem || !xJoinTimer)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Start joining, returns at once */
+RAK3172_Status_t RAK3172_JoinStart(void)
+{
+    if(!xJoinMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+
+    if(xJoinState == RAK3172_JOIN_JOINING || xJoinState == RAK3172_JOIN_BACKOFF)
+    {
+        xSemaphoreGive(xJoinMutex);
+        return RAK3172_ERR_BUSY;
+    }
+
+    xSemaphoreTake(xJoinDoneSem, 0);
+    ucAttempt = 0;
+    xStartTick = xTaskGetTickCount();
+    prvAttemptLocked();
+
+    xSemaphoreGive(xJoinMutex);
+
+    return RAK3172_OK;
+}
+
+/* Stop joining */
+RAK3172_Status_t RAK3172_JoinCancel(void)
+{
+    if(!xJoinMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+
+    bool active = (xJoinState == RAK3172_JOIN_JOINING || xJoinState == RAK3172_JOIN_BACKOFF);
+    if(active)
+    {
+        if(xJoinState == RAK3172_JOIN_JOINING)
+            RAK3172_SubmitCommand(RAK3172_JOIN_STOP_CMD, NULL, NULL, 2000);
+        prvFinishLocked(RAK3172_JOIN_IDLE);
+    }
+
+    xSemaphoreGive(xJoinMutex);
+
+    return active ? RAK3172_OK : RAK3172_ERR_INVALID;
+}
+
+/* Join LoRaWAN network, blocking wrapper around the state machine */
+RAK3172_Status_t RAK3172_Join(uint32_t timeout_ms)
+{
+    RAK3172_Status_t status = RAK3172_JoinStart();
+    if(status != RAK3172_OK)
+        return status;
+
+    if(xSemaphoreTake(xJoinDoneSem, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+        return RAK3172_ERR_TIMEOUT;     /* Still trying in the background */
+
+    switch(xJoinState)
+    {
+        case RAK3172_JOIN_JOINED: return RAK3172_OK;
+        case RAK3172_JOIN_IDLE:   return RAK3172_ERR_ABORTED;
+        default:                  return RAK3172_ERR_ERROR;
+    }
+}
+
+/* Nearest-rank percentile of a sorted array */
+static uint32_t prvPercentile(const uint32_t *sorted, uint8_t n, uint8_t pct)
+{
+    uint32_t rank = ((uint32_t)pct * n + 99) / 100;
+
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/* Current join state, cheap enough to poll */
+RAK3172_JoinState_t RAK3172_GetJoinState(void)
+{
+    return xJoinState;
+}
+
+/* Get join state, counters and latency percentiles */
+void RAK3172_GetJoinStatus(RAK3172_JoinStatus_t *status)
+{
+    uint32_t sorted[RAK3172_JOIN_LATENCY_SAMPLES];
+    TickType_t now = xTaskGetTickCount();
+
+    if(!status || !xJoinMutex)
+        return;
+
+    xSemaphoreTake(xJoinMutex, portMAX_DELAY);
+
+    *status = xJoinStats;
+    status->state = xJoinState;
+    status->attempt = ucAttempt;
+    status->elapsedMs = pdTICKS_TO_MS(((xJoinState == RAK3172_JOIN_JOINING || xJoinState == RAK3172_JOIN_BACKOFF) ? now : xEndTick) - xStartTick);
+    status->nextAttemptMs = (xJoinState == RAK3172_JOIN_BACKOFF && (int32_t)(xNextAttemptTick - now) > 0) ?
+                            pdTICKS_TO_MS(xNextAttemptTick - now) : 0;
+    memcpy(sorted, ulLatency, sizeof(sorted));
+
+    xSemaphoreGive(xJoinMutex);
+
+    /* Insertion sort, at most RAK3172_JOIN_LATENCY_SAMPLES entries */
+    uint8_t n = status->samples;
+    for(uint8_t i = 1; i < n; i++)
+    {
+        uint32_t v = sorted[i];
+        int j = i - 1;
+        while(j >= 0 && sorted[j] > v)
+        {
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+
+    status->p50Ms = n ? prvPercentile(sorted, n, 50) : 0;
+    status->p90Ms = n ? prvPercentile(sorted, n, 90) : 0;
+    status->p99Ms = n ? prvPercentile(sorted, n, 99) : 0;
+}
+
+/* Human readable join state */
+const char *RAK3172_JoinStateString(RAK3172_JoinState_t state)
+{
+    switch(state)
+    {
+        case RAK3172_JOIN_IDLE:    return "IDLE";
+        case RAK3172_JOIN_JOINING: return "JOINING";
+        case RAK3172_JOIN_BACKOFF: return "BACKOFF";
+        case RAK3172_JOIN_JOINED:  return "JOINED";
+        case RAK3172_JOIN_FAILED:  return "FAILED";
+        default:                   return "UNKNOWN";
+    }
+}
@@ -0,0 +1,178 @@
+#include "rak3172_lb.h"
+#include "rak3172_join.h"
+#include "rak3172_sched.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* Single attempt join for the modules without a join state machine */
+#define RAK3172_LB_JOIN_CMD     "AT+JOIN=1:0:10:1"
+
+/* Uplink handed to a module, owned by it until its callback */
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    RAK3172_Dev_t *dev;
+    RAK3172_CmdCallback_t callback;
+    void *ctx;
+    bool used;
+} RAK3172_LbSlot_t;
+
+static RAK3172_LbSlot_t xSlots[RAK3172_LB_SLOTS];
+static uint8_t ucNextDev = 0;
+static RAK3172_LbStats_t xLbStats = {0};
+
+#if RAK3172_SECOND_MODULE
+static const RAK3172_DevConfig_t xSecondConfig = {
+    .name = "RAK1",
+    .uartIndex = RAK3172_UART2_INDEX,
+    .txPin = RAK3172_TX2_PIN,
+    .rxPin = RAK3172_RX2_PIN,
+    .rstPin = RAK3172_RST2_PIN,
+    .txPort = NULL,
+};
+#endif
+
+/* Uplink result, runs in the task of the module that sent it */
+static void prvLbDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    RAK3172_LbSlot_t *pxSlot = (RAK3172_LbSlot_t *)ctx;
+    RAK3172_LbDevStats_t *pxStats = &xLbStats.dev[RAK3172_DevIndex(pxSlot->dev)];
+    RAK3172_CmdCallback_t callback = pxSlot->callback;
+    void *cbCtx = pxSlot->ctx;
+
+    taskENTER_CRITICAL();
+    if(status == RAK3172_OK)
+        pxStats->sent++;
+    else
+        pxStats->errors++;
+    pxStats->inFlight--;
+    pxSlot->used = false;
+    taskEXIT_CRITICAL();
+
+    if(callback)
+        callback(status, response, cbCtx);
+}
+
+/* Joined module with duty-cycle budget left, the least loaded first.
+ * Called in a critical section. */
+static RAK3172_Dev_t *prvPickDev(void)
+{
+    RAK3172_Dev_t *pxBest = NULL;
+
+    for(uint8_t n = 0; n < RAK3172_MAX_DEVICES; n++)
+    {
+        uint8_t i = (ucNextDev + n) % RAK3172_MAX_DEVICES;
+        RAK3172_Dev_t *dev = RAK3172_GetDev(i);
+
+        if(!dev || !RAK3172_DevIsJoined(dev) || RAK3172_DevDutyCycleWaitMs(dev) > 0)
+            continue;
+
+        if(!pxBest || xLbStats.dev[i].inFlight < xLbStats.dev[RAK3172_DevIndex(pxBest)].inFlight)
+            pxBest = dev;
+    }
+
+    if(pxBest)
+        ucNextDev = (RAK3172_DevIndex(pxBest) + 1) % RAK3172_MAX_DEVICES;
+
+    return pxBest;
+}
+
+/* Open the second module when fitted, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_LbInit(void)
+{
+#if RAK3172_SECOND_MODULE
+    if(!RAK3172_GetDev(1) && !RAK3172_DevOpen(&xSecondConfig))
+        return RAK3172_ERR_INVALID;
+#endif
+
+    return RAK3172_OK;
+}
+
+/* Join every module: the primary through its join state machine, the
+ * others with a single attempt whose result arrives as a join event */
+RAK3172_Status_t RAK3172_LbJoin(void)
+{
+    RAK3172_Status_t status = RAK3172_JoinStart();
+
+    for(uint8_t i = 1; i < RAK3172_MAX_DEVICES; i++)
+    {
+        RAK3172_Dev_t *dev = RAK3172_GetDev(i);
+
+        if(dev && !RAK3172_DevIsJoined(dev))
+        {
+            RAK3172_Status_t devStatus = RAK3172_DevSubmitCommand(dev, RAK3172_LB_JOIN_CMD, NULL, NULL,
+                                                                  RAK3172_JOIN_ATTEMPT_TIMEOUT_MS);
+            if(status == RAK3172_OK)
+                status = devStatus;
+        }
+    }
+
+    return status;
+}
+
+/* Send an uplink on the best module. Returns RAK3172_ERR_DUTY_CYCLE when
+ * no joined module has budget right now. */
+RAK3172_Status_t RAK3172_LbSend(uint8_t port, const uint8_t *data, uint8_t length,
+                                RAK3172_CmdCallback_t callback, void *ctx)
+{
+    RAK3172_LbSlot_t *pxSlot = NULL;
+    RAK3172_Dev_t *dev;
+
+    if(!data || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    taskENTER_CRITICAL();
+    xLbStats.submitted++;
+
+    dev = prvPickDev();
+    for(int i = 0; dev && i < RAK3172_LB_SLOTS && !pxSlot; i++)
+    {
+        if(!xSlots[i].used)
+            pxSlot = &xSlots[i];
+    }
+
+    if(!dev)
+        xLbStats.noModule++;
+    else if(!pxSlot)
+        xLbStats.noSlot++;
+    else
+    {
+        pxSlot->used = true;
+        pxSlot->dev = dev;
+        pxSlot->callback = callback;
+        pxSlot->ctx = ctx;
+        xLbStats.dev[RAK3172_DevIndex(dev)].inFlight++;
+    }
+    taskEXIT_CRITICAL();
+
+    if(!dev)
+        return RAK3172_ERR_DUTY_CYCLE;
+    if(!pxSlot)
+        return RAK3172_ERR_QUEUE_FULL;
+
+    memcpy(pxSlot->data, data, length);
+
+    RAK3172_Status_t status = RAK3172_DevSubmitSend(dev, port, pxSlot->data, length,
+                                                    prvLbDone, pxSlot, RAK3172_LB_SEND_TIMEOUT_MS);
+    if(status != RAK3172_OK)
+    {
+        taskENTER_CRITICAL();
+        xLbStats.dev[RAK3172_DevIndex(dev)].inFlight--;
+        xLbStats.dev[RAK3172_DevIndex(dev)].errors++;
+        pxSlot->used = false;
+        taskEXIT_CRITICAL();
+    }
+
+    return status;
+}
+
+/* Get load balancer statistics */
+void RAK3172_GetLbStats(RAK3172_LbStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xLbStats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,317 @@
+#include "rak3172_log.h"
+#include <string.h>
+
+/* Slot layout: seq(4) port(1) length(1) crc(2) flags(4) data.
+ * flags stays 0xFFFFFFFF while pending and is programmed to 0 once the
+ * record is sent; the CRC covers seq, port, length and data. */
+#define LOG_OFS_SEQ         0
+#define LOG_OFS_PORT        4
+#define LOG_OFS_LENGTH      5
+#define LOG_OFS_CRC         6
+#define LOG_OFS_FLAGS       8
+
+#define LOG_FLAGS_LIVE      0xFFFFFFFFu
+#define LOG_FLAGS_CONSUMED  0x00000000u
+
+typedef enum {
+    LOG_SLOT_BLANK,
+    LOG_SLOT_LIVE,
+    LOG_SLOT_CONSUMED,
+    LOG_SLOT_BAD
+} LogSlot_t;
+
+/* CRC-16/CCITT-FALSE */
+static uint16_t prvCrc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+    while(len--)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for(int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+
+    return crc;
+}
+
+static uint32_t prvGet32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void prvPut32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static bool prvIsErased(const uint8_t *p, size_t len)
+{
+    while(len--)
+    {
+        if(*p++ != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+static uint16_t prvRecordCrc(const uint8_t *page)
+{
+    uint16_t crc = prvCrc16(0xFFFF, page, LOG_OFS_CRC);
+
+    return prvCrc16(crc, &page[RAK3172_LOG_HEADER_SIZE], page[LOG_OFS_LENGTH]);
+}
+
+static void prvReadSlot(RAK3172_Log_t *log, uint32_t slot, size_t len)
+{
+    log->dev->read(log->dev->ctx, slot * RAK3172_LOG_SLOT_SIZE, log->page, len);
+}
+
+/* Classify the slot in log->page. Only a live header needs the full
+ * page for its CRC, so the boot scan mostly reads headers. */
+static LogSlot_t prvClassify(RAK3172_Log_t *log, uint32_t slot, bool headerOnly)
+{
+    uint8_t *page = log->page;
+
+    if(prvIsErased(page, RAK3172_LOG_HEADER_SIZE))
+        return LOG_SLOT_BLANK;
+
+    if(page[LOG_OFS_LENGTH] == 0 || page[LOG_OFS_LENGTH] > RAK3172_LOG_MAX_DATA)
+        return LOG_SLOT_BAD;
+
+    if(prvGet32(&page[LOG_OFS_FLAGS]) != LOG_FLAGS_LIVE)
+        return LOG_SLOT_CONSUMED;
+
+    if(headerOnly)
+        prvReadSlot(log, slot, RAK3172_LOG_SLOT_SIZE);
+
+    uint16_t crc = (uint16_t)(page[LOG_OFS_CRC] | (page[LOG_OFS_CRC + 1] << 8));
+
+    return (crc == prvRecordCrc(page)) ? LOG_SLOT_LIVE : LOG_SLOT_BAD;
+}
+
+static bool prvSlotBlank(RAK3172_Log_t *log, uint32_t slot)
+{
+    prvReadSlot(log, slot, RAK3172_LOG_SLOT_SIZE);
+
+    return prvIsErased(log->page, RAK3172_LOG_SLOT_SIZE);
+}
+
+/* The head entered a sector: erase it unless blank. Pending records in
+ * it are the oldest ones and are dropped. */
+static bool prvPrepareSector(RAK3172_Log_t *log, uint32_t sector)
+{
+    uint32_t first = sector * log->slotsPerSector;
+    uint32_t dropped = 0;
+    bool blank = true;
+
+    for(uint32_t i = 0; i < log->slotsPerSector; i++)
+    {
+        prvReadSlot(log, first + i, RAK3172_LOG_SLOT_SIZE);
+
+        if(prvClassify(log, first + i, false) == LOG_SLOT_LIVE)
+            dropped++;
+        if(!prvIsErased(log->page, RAK3172_LOG_SLOT_SIZE))
+            blank = false;
+    }
+
+    if(blank)
+        return true;
+
+    if(!log->dev->erase(log->dev->ctx, sector * log->dev->sectorSize))
+        return false;
+
+    log->erases++;
+
+    if(dropped)
+    {
+        dropped = (dropped < log->pending) ? dropped : log->pending;
+        log->pending -= dropped;
+        log->dropped += dropped;
+
+        /* Survivors start right after the erased sector */
+        log->tail = (first + log->slotsPerSector) % log->slotCount;
+    }
+
+    return true;
+}
+
+/* Move the tail to the oldest live record, false if there is none */
+static bool prvSeekTail(RAK3172_Log_t *log)
+{
+    for(uint32_t n = 0; log->pending && n < log->slotCount; n++)
+    {
+        prvReadSlot(log, log->tail, RAK3172_LOG_SLOT_SIZE);
+
+        if(prvClassify(log, log->tail, false) == LOG_SLOT_LIVE)
+            return true;
+
+        log->tail = (log->tail + 1) % log->slotCount;
+    }
+
+    /* Count and slots disagree, trust the slots */
+    log->pending = 0;
+    log->tail = log->head;
+
+    return false;
+}
+
+/* Recovery scan: rebuild head, tail and the pending count from flash */
+bool RAK3172_LogInit(RAK3172_Log_t *log, const RAK3172_FlashDev_t *dev)
+{
+    if(!log || !dev || dev->sectorCount < 2 || dev->sectorSize % RAK3172_LOG_SLOT_SIZE)
+        return false;
+
+    memset(log, 0, sizeof(*log));
+    log->dev = dev;
+    log->slotsPerSector = dev->sectorSize / RAK3172_LOG_SLOT_SIZE;
+    log->slotCount = log->slotsPerSector * dev->sectorCount;
+
+    bool found = false, live = false;
+    uint32_t newestSeq = 0, newestSlot = 0;
+    uint32_t oldestSeq = 0, oldestSlot = 0;
+
+    for(uint32_t slot = 0; slot < log->slotCount; slot++)
+    {
+        prvReadSlot(log, slot, RAK3172_LOG_HEADER_SIZE);
+
+        LogSlot_t state = prvClassify(log, slot, true);
+        uint32_t seq = prvGet32(&log->page[LOG_OFS_SEQ]);
+
+        if(state == LOG_SLOT_BAD)
+            log->corrupt++;
+        if(state != LOG_SLOT_LIVE && state != LOG_SLOT_CONSUMED)
+            continue;
+
+        if(!found || (int32_t)(seq - newestSeq) > 0)
+        {
+            newestSeq = seq;
+            newestSlot = slot;
+            found = true;
+        }
+
+        if(state == LOG_SLOT_LIVE)
+        {
+            if(!live || (int32_t)(seq - oldestSeq) < 0)
+            {
+                oldestSeq = seq;
+                oldestSlot = slot;
+                live = true;
+            }
+            log->pending++;
+        }
+    }
+
+    log->head = found ? (newestSlot + 1) % log->slotCount : 0;
+    log->tail = live ? oldestSlot : log->head;
+    log->nextSeq = found ? newestSeq + 1 : 0;
+
+    return true;
+}
+
+/* Persist one record, dropping the oldest sector when the ring is full */
+bool RAK3172_LogAppend(RAK3172_Log_t *log, uint8_t port, const uint8_t *data, uint8_t length)
+{
+    if(!log || !log->dev || !data || length == 0 || length > RAK3172_LOG_MAX_DATA)
+        return false;
+
+    /* Skip slots left dirty by an interrupted write */
+    for(uint32_t n = 0; ; n++)
+    {
+        if(n > log->slotCount)
+            return false;
+
+        if(log->head % log->slotsPerSector == 0)
+        {
+            if(!prvPrepareSector(log, log->head / log->slotsPerSector))
+                return false;
+            break;
+        }
+
+        if(prvSlotBlank(log, log->head))
+            break;
+
+        log->head = (log->head + 1) % log->slotCount;
+    }
+
+    uint8_t *page = log->page;
+    memset(page, 0xFF, RAK3172_LOG_SLOT_SIZE);
+    prvPut32(&page[LOG_OFS_SEQ], log->nextSeq);
+    page[LOG_OFS_PORT] = port;
+    page[LOG_OFS_LENGTH] = length;
+    memcpy(&page[RAK3172_LOG_HEADER_SIZE], data, length);
+
+    uint16_t crc = prvRecordCrc(page);
+    page[LOG_OFS_CRC] = (uint8_t)crc;
+    page[LOG_OFS_CRC + 1] = (uint8_t)(crc >> 8);
+
+    uint32_t slot = log->head;
+    log->head = (log->head + 1) % log->slotCount;
+
+    if(!log->dev->program(log->dev->ctx, slot * RAK3172_LOG_SLOT_SIZE, page, RAK3172_LOG_SLOT_SIZE))
+        return false;
+
+    if(log->pending == 0)
+        log->tail = slot;
+    log->pending++;
+    log->nextSeq++;
+
+    return true;
+}
+
+/* Copy out the oldest pending record without consuming it */
+bool RAK3172_LogPeek(RAK3172_Log_t *log, uint8_t *port, uint8_t *data, uint8_t *length)
+{
+    if(!log || !log->dev || !prvSeekTail(log))
+        return false;
+
+    if(port)
+        *port = log->page[LOG_OFS_PORT];
+    if(length)
+        *length = log->page[LOG_OFS_LENGTH];
+    if(data)
+        memcpy(data, &log->page[RAK3172_LOG_HEADER_SIZE], log->page[LOG_OFS_LENGTH]);
+
+    return true;
+}
+
+/* Mark the oldest pending record as sent. Programming 0xFF leaves bits
+ * alone, so only the flags word changes. */
+bool RAK3172_LogConsume(RAK3172_Log_t *log)
+{
+    if(!log || !log->dev || !prvSeekTail(log))
+        return false;
+
+    memset(log->page, 0xFF, RAK3172_LOG_SLOT_SIZE);
+    prvPut32(&log->page[LOG_OFS_FLAGS], LOG_FLAGS_CONSUMED);
+
+    if(!log->dev->program(log->dev->ctx, log->tail * RAK3172_LOG_SLOT_SIZE, log->page, RAK3172_LOG_SLOT_SIZE))
+        return false;
+
+    log->pending--;
+    log->tail = log->pending ? (log->tail + 1) % log->slotCount : log->head;
+
+    return true;
+}
+
+/* Erase the whole region */
+bool RAK3172_LogClear(RAK3172_Log_t *log)
+{
+    if(!log || !log->dev)
+        return false;
+
+    for(uint32_t sector = 0; sector < log->dev->sectorCount; sector++)
+    {
+        if(!log->dev->erase(log->dev->ctx, sector * log->dev->sectorSize))
+            return false;
+        log->erases++;
+    }
+
+    log->head = 0;
+    log->tail = 0;
+    log->pending = 0;
+
+    return true;
+}
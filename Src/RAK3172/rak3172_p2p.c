@@ -0,0 +1,307 @@
+#include "rak3172_p2p.h"
+#include "rak3172_airtime.h"
+#include "rak3172_at.h"
+#include "rak3172_config.h"
+#include "rak3172_join.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Packet ring: single producer (RAK3172 task), single consumer */
+static RAK3172_P2pPacket_t xRing[RAK3172_P2P_RING_LEN];
+static volatile uint32_t ulRingHead = 0;
+static volatile uint32_t ulRingTail = 0;
+static SemaphoreHandle_t xRingCount = NULL;     /* Packets in the ring */
+
+static SemaphoreHandle_t xP2pMutex = NULL;      /* Mode changes and AT+PSEND */
+static SemaphoreHandle_t xTxDone = NULL;        /* +EVT:TXP2P DONE */
+static RAK3172_P2pConfig_t xConfig = {0};       /* Radio settings of the last start */
+static char pcSendCmd[12 + 2 * RAK3172_MAX_PAYLOAD];
+static uint32_t ulNextSeq = 0;
+static volatile bool xRunning = false;
+static RAK3172_P2pStats_t xP2pStats = {0};
+
+/* Network working mode, 0 = P2P, 1 = LoRaWAN */
+static RAK3172_Status_t prvReadMode(uint32_t *mode)
+{
+    char response[32];
+
+    RAK3172_Status_t status = RAK3172_SendCommand("AT+NWM=?", response, sizeof(response), 2000);
+    if(status != RAK3172_OK)
+        return status;
+
+    char *pcValue = strchr(response, '=');
+    pcValue = pcValue ? pcValue + 1 : response;
+    if(*pcValue < '0' || *pcValue > '9')
+        return RAK3172_ERR_ERROR;
+
+    *mode = (uint32_t)(*pcValue - '0');
+    return RAK3172_OK;
+}
+
+/* Change the working mode. The module restarts, everything the driver
+ * knew about its LoRaWAN state is gone. */
+static RAK3172_Status_t prvSetMode(uint32_t mode)
+{
+    uint32_t current;
+    char cmd[12];
+
+    if(prvReadMode(&current) == RAK3172_OK && current == mode)
+        return RAK3172_OK;
+
+    snprintf(cmd, sizeof(cmd), "AT+NWM=%lu", (unsigned long)mode);
+
+    /* The reply may be lost in the restart, the ping below decides */
+    RAK3172_SendCommand(cmd, NULL, 0, 2000);
+
+    RAK3172_ConfigInvalidateAll();
+    RAK3172_JoinReset();
+
+    TickType_t start = xTaskGetTickCount();
+    while(pdTICKS_TO_MS(xTaskGetTickCount() - start) < RAK3172_P2P_MODE_SWITCH_MS)
+    {
+        if(RAK3172_Ping(NULL) == RAK3172_OK && prvReadMode(&current) == RAK3172_OK)
+            return (current == mode) ? RAK3172_OK : RAK3172_ERR_MODE;
+        vTaskDelay(pdMS_TO_TICKS(RAK3172_BOOT_POLL_MS));
+    }
+
+    return RAK3172_ERR_TIMEOUT;
+}
+
+/* Create the ring, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_P2pInit(void)
+{
+    if(xP2pMutex)
+        return RAK3172_OK;
+
+    xRingCount = xSemaphoreCreateCounting(RAK3172_P2P_RING_LEN, 0);
+    xP2pMutex = xSemaphoreCreateMutex();
+    xTxDone = xSemaphoreCreateBinary();
+
+    if(!xRingCount || !xP2pMutex || !xTxDone)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Switch to P2P, apply the radio settings and start continuous receive */
+RAK3172_Status_t RAK3172_P2pStart(const RAK3172_P2pConfig_t *config)
+{
+    char cmd[64];
+
+    if(!xP2pMutex || !config)
+        return RAK3172_ERR_INVALID;
+
+    if(config->sf < 5 || config->sf > 12 || config->cr > 3 ||
+       (config->bwKhz != 125 && config->bwKhz != 250 && config->bwKhz != 500))
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xP2pMutex, portMAX_DELAY);
+
+    RAK3172_Status_t status = prvSetMode(0);
+
+    if(status == RAK3172_OK)
+    {
+        snprintf(cmd, sizeof(cmd), "AT+P2P=%lu:%u:%u:%u:%u:%d",
+                 (unsigned long)config->freqHz, config->sf, config->bwKhz,
+                 config->cr, config->preamble, config->txPower);
+        status = RAK3172_SendCommand(cmd, NULL, 0, 2000);
+    }
+
+    if(status == RAK3172_OK)
+    {
+        snprintf(cmd, sizeof(cmd), "AT+PRECV=%u", RAK3172_P2P_PRECV_CONTINUOUS);
+        status = RAK3172_SendCommand(cmd, NULL, 0, 2000);
+    }
+
+    xRunning = (status == RAK3172_OK);
+    if(xRunning)
+        xConfig = *config;
+
+    xSemaphoreGive(xP2pMutex);
+
+    return status;
+}
+
+/* Stop receiving, and go back to LoRaWAN if asked */
+RAK3172_Status_t RAK3172_P2pStop(bool lorawan)
+{
+    if(!xP2pMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xP2pMutex, portMAX_DELAY);
+
+    RAK3172_Status_t status = RAK3172_SendCommand("AT+PRECV=0", NULL, 0, 2000);
+    xRunning = false;
+
+    if(lorawan)
+        status = prvSetMode(1);
+
+    xSemaphoreGive(xP2pMutex);
+
+    return status;
+}
+
+/* Time on air of a P2P packet with the settings of the last start. The
+ * module sends explicit header and CRC, the preamble is configurable. */
+uint32_t RAK3172_P2pAirtimeUs(uint8_t length)
+{
+    RAK3172_DataRate_t xRate = {
+        .sf = xConfig.sf,
+        .bw_khz = xConfig.bwKhz,
+        .cr = (uint8_t)(xConfig.cr + 1),
+    };
+
+    if(xConfig.sf == 0)
+        return 0;
+
+    uint32_t symbolUs = ((uint32_t)1000 << xConfig.sf) / xConfig.bwKhz;
+    uint32_t airtime = RAK3172_TimeOnAirUs(&xRate, length);
+
+    /* RAK3172_TimeOnAirUs() assumes the LoRaWAN preamble of 8 symbols */
+    if(xConfig.preamble > 8)
+        airtime += (uint32_t)(xConfig.preamble - 8) * symbolUs;
+
+    return airtime;
+}
+
+/* Send one packet and wait until it is off air, the module returns to
+ * receive afterwards. The OK to AT+PSEND only means the packet was
+ * accepted, a second AT+PSEND before +EVT:TXP2P DONE is refused busy. */
+RAK3172_Status_t RAK3172_P2pSend(const uint8_t *data, uint8_t length)
+{
+    RAK3172_Status_t status;
+    uint32_t retries = 0;
+
+    if(!xP2pMutex || !data || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xP2pMutex, portMAX_DELAY);
+
+    memcpy(pcSendCmd, "AT+PSEND=", 9);
+    RAK3172_HexEncode(data, length, &pcSendCmd[9]);
+    pcSendCmd[9 + 2 * length] = '\0';
+
+    /* Drop a late event of an earlier packet */
+    xSemaphoreTake(xTxDone, 0);
+
+    while(true)
+    {
+        status = RAK3172_SendCommand(pcSendCmd, NULL, 0, 5000);
+        if(status != RAK3172_ERR_BUSY || retries >= RAK3172_P2P_BUSY_RETRIES)
+            break;
+
+        retries++;
+        vTaskDelay(pdMS_TO_TICKS(RAK3172_P2P_BUSY_RETRY_MS));
+    }
+
+    bool txDone = true;
+    if(status == RAK3172_OK)
+    {
+        uint32_t wait = RAK3172_P2pAirtimeUs(length) / 1000 + RAK3172_P2P_TX_DONE_MARGIN_MS;
+        txDone = (xSemaphoreTake(xTxDone, pdMS_TO_TICKS(wait)) == pdTRUE);
+    }
+
+    xSemaphoreGive(xP2pMutex);
+
+    taskENTER_CRITICAL();
+    xP2pStats.busyRetries += retries;
+    if(status == RAK3172_OK)
+        xP2pStats.sent++;
+    else
+        xP2pStats.sendErrors++;
+    if(!txDone)
+        xP2pStats.txDoneMissing++;
+    taskEXIT_CRITICAL();
+
+    return status;
+}
+
+/* +EVT:TXP2P DONE, runs in the RAK3172 task */
+void RAK3172_P2pHandleTxDone(void)
+{
+    if(xTxDone)
+        xSemaphoreGive(xTxDone);
+}
+
+/* Packet from the module, runs in the RAK3172 task */
+void RAK3172_P2pHandleRx(const RAK3172_RxData_t *rx)
+{
+    uint64_t now = time_us_64();
+
+    if(!xRingCount)
+        return;
+
+    uint32_t head = ulRingHead;
+    uint32_t fill = head - ulRingTail;
+
+    taskENTER_CRITICAL();
+    xP2pStats.received++;
+    if(xP2pStats.firstUs == 0)
+        xP2pStats.firstUs = now;
+    xP2pStats.lastUs = now;
+    if(fill >= RAK3172_P2P_RING_LEN)
+        xP2pStats.dropped++;
+    else if(fill + 1 > xP2pStats.highWater)
+        xP2pStats.highWater = (uint16_t)(fill + 1);
+    taskEXIT_CRITICAL();
+
+    if(fill >= RAK3172_P2P_RING_LEN)
+        return;
+
+    RAK3172_P2pPacket_t *pxPacket = &xRing[head % RAK3172_P2P_RING_LEN];
+
+    pxPacket->timestampUs = now;
+    pxPacket->seq = ulNextSeq++;
+    pxPacket->rssi = rx->rssi;
+    pxPacket->snr = rx->snr;
+    pxPacket->length = (uint8_t)rx->length;
+    memcpy(pxPacket->data, rx->data, rx->length);
+
+    /* Publish the packet before the consumer may see it */
+    ulRingHead = head + 1;
+    xSemaphoreGive(xRingCount);
+}
+
+/* Next received packet, oldest first */
+BaseType_t RAK3172_P2pRead(RAK3172_P2pPacket_t *packet, uint32_t timeout_ms)
+{
+    if(!xRingCount || !packet)
+        return pdFAIL;
+
+    if(xSemaphoreTake(xRingCount, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+        return pdFAIL;
+
+    uint32_t tail = ulRingTail;
+    *packet = xRing[tail % RAK3172_P2P_RING_LEN];
+    ulRingTail = tail + 1;
+
+    taskENTER_CRITICAL();
+    xP2pStats.delivered++;
+    taskEXIT_CRITICAL();
+
+    return pdPASS;
+}
+
+/* Start a new measurement, packets still in the ring are kept */
+void RAK3172_P2pClearStats(void)
+{
+    taskENTER_CRITICAL();
+    memset(&xP2pStats, 0, sizeof(xP2pStats));
+    taskEXIT_CRITICAL();
+}
+
+/* Get P2P statistics */
+void RAK3172_GetP2pStats(RAK3172_P2pStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xP2pStats;
+    stats->running = xRunning;
+    taskEXIT_CRITICAL();
+}
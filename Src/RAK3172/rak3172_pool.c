@@ -0,0 +1,79 @@
+#include "rak3172_pool.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Block storage, word aligned */
+#define RAK3172_POOL_BLOCK_WORDS    ((RAK3172_POOL_BLOCK_SIZE + 3) / 4)
+
+static uint32_t poolBlocks[RAK3172_POOL_BLOCKS][RAK3172_POOL_BLOCK_WORDS];
+
+/* Stack of free block indices */
+static RAK3172_PoolHandle_t poolFree[RAK3172_POOL_BLOCKS];
+static uint8_t poolFreeCount = 0;
+static RAK3172_PoolStats_t xPoolStats = {0};
+
+/* Initialize the pool, all blocks free */
+void RAK3172_PoolInit(void)
+{
+    taskENTER_CRITICAL();
+    for(int i = 0; i < RAK3172_POOL_BLOCKS; i++)
+    {
+        poolFree[i] = (RAK3172_PoolHandle_t)(RAK3172_POOL_BLOCKS - 1 - i);
+    }
+    poolFreeCount = RAK3172_POOL_BLOCKS;
+    xPoolStats.inUse = 0;
+    taskEXIT_CRITICAL();
+}
+
+/* Take a block, returns RAK3172_POOL_NONE when exhausted */
+RAK3172_PoolHandle_t RAK3172_PoolAlloc(void)
+{
+    RAK3172_PoolHandle_t handle = RAK3172_POOL_NONE;
+
+    taskENTER_CRITICAL();
+    if(poolFreeCount > 0)
+    {
+        handle = poolFree[--poolFreeCount];
+        xPoolStats.inUse++;
+        xPoolStats.allocs++;
+        if(xPoolStats.inUse > xPoolStats.highWater)
+            xPoolStats.highWater = xPoolStats.inUse;
+    }
+    else
+    {
+        xPoolStats.failures++;
+    }
+    taskEXIT_CRITICAL();
+
+    return handle;
+}
+
+/* Return a block to the pool */
+void RAK3172_PoolFree(RAK3172_PoolHandle_t handle)
+{
+    if(handle >= RAK3172_POOL_BLOCKS)
+        return;
+
+    taskENTER_CRITICAL();
+    configASSERT(poolFreeCount < RAK3172_POOL_BLOCKS);
+    poolFree[poolFreeCount++] = handle;
+    xPoolStats.inUse--;
+    taskEXIT_CRITICAL();
+}
+
+/* Block address of a handle */
+void *RAK3172_PoolGet(RAK3172_PoolHandle_t handle)
+{
+    return (handle < RAK3172_POOL_BLOCKS) ? (void *)poolBlocks[handle] : NULL;
+}
+
+/* Get pool usage statistics */
+void RAK3172_GetPoolStats(RAK3172_PoolStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xPoolStats;
+    taskEXIT_CRITICAL();
+}
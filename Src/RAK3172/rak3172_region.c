@@ -0,0 +1,155 @@
+#include "rak3172_region.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* LoRa data rate entry, coding rate 4/5 everywhere */
+#define LORA(sf, bw, n)     { (sf), (bw), 1, (n) }
+#define FSK(n)              { 0, 0, 0, (n) }
+#define RFU                 { 0, 0, 0, 0 }
+
+#define COUNT(a)            (sizeof(a) / sizeof((a)[0]))
+
+/* EU868 */
+static const RAK3172_DataRate_t xEu868Dr[] = {
+    LORA(12, 125,  51), LORA(11, 125,  51), LORA(10, 125,  51), LORA(9, 125, 115),
+    LORA( 8, 125, 222), LORA( 7, 125, 222), LORA( 7, 250, 222), FSK(222),
+};
+static const RAK3172_ChannelBlock_t xEu868Ch[] = {
+    { 868100000, 200000, 3 },
+};
+static const RAK3172_SubBand_t xEu868Bands[] = {
+    { "g",  868000000, 868600000,  100 },   /* 1 % */
+    { "g1", 868700000, 869200000, 1000 },   /* 0.1 % */
+    { "g2", 869400000, 869650000,   10 },   /* 10 % */
+    { "g3", 869700000, 870000000,  100 },   /* 1 % */
+};
+
+/* US915 */
+static const RAK3172_DataRate_t xUs915Dr[] = {
+    LORA(10, 125,  11), LORA( 9, 125,  53), LORA( 8, 125, 125), LORA(7, 125, 242),
+    LORA( 8, 500, 242),
+};
+static const RAK3172_ChannelBlock_t xUs915Ch[] = {
+    { 902300000, 200000, 64 },
+    { 903000000, 1600000, 8 },
+};
+
+/* AS923, uplink dwell time off */
+static const RAK3172_DataRate_t xAs923Dr[] = {
+    LORA(12, 125,  51), LORA(11, 125,  51), LORA(10, 125,  51), LORA(9, 125, 115),
+    LORA( 8, 125, 222), LORA( 7, 125, 222), LORA( 7, 250, 222), FSK(222),
+};
+static const RAK3172_ChannelBlock_t xAs923Ch[] = {
+    { 923200000, 200000, 2 },
+};
+
+/* AU915 */
+static const RAK3172_DataRate_t xAu915Dr[] = {
+    LORA(12, 125,  51), LORA(11, 125,  51), LORA(10, 125,  51), LORA(9, 125, 115),
+    LORA( 8, 125, 222), LORA( 7, 125, 222), LORA( 8, 500, 222),
+};
+static const RAK3172_ChannelBlock_t xAu915Ch[] = {
+    { 915200000, 200000, 64 },
+    { 915900000, 1600000, 8 },
+};
+
+/* IN865 */
+static const RAK3172_DataRate_t xIn865Dr[] = {
+    LORA(12, 125,  51), LORA(11, 125,  51), LORA(10, 125,  51), LORA(9, 125, 115),
+    LORA( 8, 125, 222), LORA( 7, 125, 222), RFU,                FSK(222),
+};
+static const RAK3172_ChannelBlock_t xIn865Ch[] = {
+    { 865062500, 0, 1 },
+    { 865402500, 0, 1 },
+    { 865985000, 0, 1 },
+};
+
+/* KR920 */
+static const RAK3172_DataRate_t xKr920Dr[] = {
+    LORA(12, 125,  51), LORA(11, 125,  51), LORA(10, 125,  51), LORA(9, 125, 115),
+    LORA( 8, 125, 222), LORA( 7, 125, 222),
+};
+static const RAK3172_ChannelBlock_t xKr920Ch[] = {
+    { 922100000, 200000, 3 },
+};
+
+#define REGION(n, code, dr, drTable, chTable, bandTable) \
+    { (n), (code), (dr), (drTable), COUNT(drTable), (chTable), COUNT(chTable), (bandTable), COUNT(bandTable) }
+
+#define REGION_NO_DC(n, code, dr, drTable, chTable) \
+    { (n), (code), (dr), (drTable), COUNT(drTable), (chTable), COUNT(chTable), NULL, 0 }
+
+/* Indexed by RAK3172_Region_t, band codes from RUI3 AT+BAND */
+static const RAK3172_RegionInfo_t xRegions[RAK3172_REGION_COUNT] = {
+    [RAK3172_REGION_EU868] = REGION("EU868", 4, 0, xEu868Dr, xEu868Ch, xEu868Bands),
+    [RAK3172_REGION_US915] = REGION_NO_DC("US915", 5, 0, xUs915Dr, xUs915Ch),
+    [RAK3172_REGION_AS923] = REGION_NO_DC("AS923", 8, 2, xAs923Dr, xAs923Ch),
+    [RAK3172_REGION_AU915] = REGION_NO_DC("AU915", 6, 2, xAu915Dr, xAu915Ch),
+    [RAK3172_REGION_IN865] = REGION_NO_DC("IN865", 3, 0, xIn865Dr, xIn865Ch),
+    [RAK3172_REGION_KR920] = REGION_NO_DC("KR920", 7, 0, xKr920Dr, xKr920Ch),
+};
+
+/* Region table, NULL if out of range */
+const RAK3172_RegionInfo_t *RAK3172_GetRegionInfo(RAK3172_Region_t region)
+{
+    if((unsigned)region >= RAK3172_REGION_COUNT)
+        return NULL;
+
+    return &xRegions[region];
+}
+
+/* Look a region up by name ("EU868", case insensitive) or AT+BAND code ("4") */
+bool RAK3172_FindRegion(const char *name, RAK3172_Region_t *region)
+{
+    if(!name || !region)
+        return false;
+
+    if(name[0] >= '0' && name[0] <= '9')
+        return RAK3172_FindRegionByCode((uint8_t)atoi(name), region);
+
+    for(int i = 0; i < RAK3172_REGION_COUNT; i++)
+    {
+        if(strcasecmp(name, xRegions[i].name) == 0)
+        {
+            *region = (RAK3172_Region_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Look a region up by AT+BAND code */
+bool RAK3172_FindRegionByCode(uint8_t bandCode, RAK3172_Region_t *region)
+{
+    for(int i = 0; i < RAK3172_REGION_COUNT; i++)
+    {
+        if(xRegions[i].bandCode == bandCode)
+        {
+            if(region)
+                *region = (RAK3172_Region_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Data rate of the current region, NULL if the region does not allow it */
+const RAK3172_DataRate_t *RAK3172_GetDataRateInfo(uint8_t dr)
+{
+    const RAK3172_RegionInfo_t *pxRegion = RAK3172_GetRegionInfo(RAK3172_GetRegion());
+
+    if(!pxRegion || dr >= pxRegion->numDataRates || pxRegion->dataRates[dr].maxPayload == 0)
+        return NULL;
+
+    return &pxRegion->dataRates[dr];
+}
+
+/* Largest uplink payload at the current region and data rate */
+uint8_t RAK3172_GetMaxPayload(void)
+{
+    const RAK3172_DataRate_t *pxDr = RAK3172_GetDataRateInfo(RAK3172_GetDataRate());
+
+    return pxDr ? pxDr->maxPayload : 0;
+}
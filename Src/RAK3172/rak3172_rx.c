@@ -0,0 +1,40 @@
+#include "rak3172_rx.h"
+
+/* Consumer: drain the ring into line and pass every complete line to
+ * handler. A partial line stays in line for the next call. The space of a
+ * line is handed back to the producer before the handler runs. Returns
+ * the number of lines. */
+uint32_t RAK3172_RxSplit(RAK3172_RxRing_t *ring, RAK3172_RxLine_t *line,
+                         RAK3172_LineHandler_t handler, void *ctx)
+{
+    uint32_t tail = ring->tail;
+    uint32_t head;
+    uint32_t lines = 0;
+
+    /* Bytes stored while a line was handled are taken in the same call */
+    while((head = ring->head) != tail)
+    {
+        while(tail != head)
+        {
+            uint8_t c = ring->data[tail & RAK3172_RX_RING_MASK];
+            tail++;
+
+            if(c == '\n')
+            {
+                line->data[line->length] = '\0';
+                ring->tail = tail;
+                handler(ctx, line->data, line->length);
+                line->length = 0;
+                lines++;
+            }
+            else if(c != '\r' && line->length < RAK3172_RX_BUFFER_SIZE - 1)
+            {
+                line->data[line->length++] = (char)c;
+            }
+        }
+
+        ring->tail = tail;
+    }
+
+    return lines;
+}
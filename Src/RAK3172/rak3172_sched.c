@@ -0,0 +1,387 @@
+#include "rak3172_sched.h"
+#include "rak3172_airtime.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
+#include <string.h>
+
+#define RAK3172_HOUR_MS     3600000UL
+
+/* Largest number of duty-cycle sub-bands in a region */
+#define RAK3172_MAX_SUB_BANDS   4
+
+/* Band off-time and hourly usage, shared by the driver and the scheduler.
+ * One set per module, each radio has its own off-time. */
+typedef struct {
+    TickType_t readyAt;
+    TickType_t hourStart;
+    uint32_t usedMs;
+} RAK3172_BandState_t;
+
+static RAK3172_BandState_t xBandState[RAK3172_MAX_DEVICES][RAK3172_MAX_SUB_BANDS];
+
+/* Queued uplink */
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint8_t length;
+    uint8_t port;
+    uint8_t priority;
+    bool used;
+    uint32_t seq;               /* FIFO order within a priority */
+    TickType_t submitTick;
+} RAK3172_SchedEntry_t;
+
+static RAK3172_SchedEntry_t xEntries[RAK3172_SCHED_QUEUE_LEN];
+static RAK3172_SchedEntry_t *pxInFlight = NULL;
+static uint32_t ulNextSeq = 0;
+
+static SemaphoreHandle_t xSchedMutex = NULL;
+static TimerHandle_t xSchedTimer = NULL;
+static RAK3172_SchedStats_t xSchedStats = {0};
+
+/* Duty-cycle sub-bands of the current region, none outside Europe */
+static uint8_t prvSubBands(const RAK3172_SubBand_t **ppxBands)
+{
+    const RAK3172_RegionInfo_t *pxRegion = RAK3172_GetRegionInfo(RAK3172_GetRegion());
+
+    *ppxBands = pxRegion ? pxRegion->subBands : NULL;
+    if(!pxRegion || pxRegion->numSubBands > RAK3172_MAX_SUB_BANDS)
+        return 0;
+
+    return pxRegion->numSubBands;
+}
+
+/* True when the default channel plan has a channel in the sub-band */
+static bool prvBandEnabled(const RAK3172_SubBand_t *pxBand)
+{
+    const RAK3172_RegionInfo_t *pxRegion = RAK3172_GetRegionInfo(RAK3172_GetRegion());
+
+    for(uint8_t b = 0; pxRegion && b < pxRegion->numChannelBlocks; b++)
+    {
+        const RAK3172_ChannelBlock_t *pxBlock = &pxRegion->channels[b];
+
+        for(uint8_t i = 0; i < pxBlock->count; i++)
+        {
+            uint32_t freq = pxBlock->firstFreq + i * pxBlock->step;
+
+            if(freq >= pxBand->minFreq && freq <= pxBand->maxFreq)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/* Band set of a module, the primary's when none is given */
+static RAK3172_BandState_t *prvBandState(const RAK3172_Dev_t *dev)
+{
+    return xBandState[dev ? RAK3172_DevIndex(dev) : 0];
+}
+
+static uint32_t prvBandWaitMs(const RAK3172_BandState_t *pxBand, TickType_t now)
+{
+    int32_t wait = (int32_t)(pxBand->readyAt - now);
+
+    return (wait > 0) ? pdTICKS_TO_MS(wait) : 0;
+}
+
+/* Time until a band is free, 0 if one is free now.
+ * The module picks the channel, any free band will do. */
+uint32_t RAK3172_DevDutyCycleWaitMs(const RAK3172_Dev_t *dev)
+{
+    RAK3172_BandState_t *pxState = prvBandState(dev);
+    TickType_t now = xTaskGetTickCount();
+    uint32_t best = UINT32_MAX;
+    const RAK3172_SubBand_t *pxBands;
+    uint8_t numBands = prvSubBands(&pxBands);
+
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < numBands; i++)
+    {
+        if(!prvBandEnabled(&pxBands[i]))
+            continue;
+
+        uint32_t wait = prvBandWaitMs(&pxState[i], now);
+        if(wait < best)
+            best = wait;
+    }
+    taskEXIT_CRITICAL();
+
+    /* No channel in any known band: nothing to enforce */
+    return (best == UINT32_MAX) ? 0 : best;
+}
+
+uint32_t RAK3172_DutyCycleWaitMs(void)
+{
+    return RAK3172_DevDutyCycleWaitMs(RAK3172_GetDev(0));
+}
+
+/* Charge an uplink to the free band, which stays off for airtime * divisor */
+void RAK3172_DevDutyCycleCharge(const RAK3172_Dev_t *dev, uint32_t airtimeUs)
+{
+    RAK3172_BandState_t *pxState = prvBandState(dev);
+    TickType_t now = xTaskGetTickCount();
+    uint32_t airtimeMs = (airtimeUs + 999) / 1000;
+    const RAK3172_SubBand_t *pxBands;
+    uint8_t numBands = prvSubBands(&pxBands);
+    int band = -1;
+
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < numBands; i++)
+    {
+        if(!prvBandEnabled(&pxBands[i]))
+            continue;
+
+        if(band < 0 || (int32_t)(pxState[i].readyAt - pxState[band].readyAt) < 0)
+            band = (int)i;
+    }
+
+    if(band >= 0)
+    {
+        RAK3172_BandState_t *pxBand = &pxState[band];
+
+        pxBand->readyAt = now + pdMS_TO_TICKS(airtimeMs * pxBands[band].dutyDivisor);
+
+        if(pdTICKS_TO_MS(now - pxBand->hourStart) >= RAK3172_HOUR_MS)
+        {
+            pxBand->hourStart = now;
+            pxBand->usedMs = 0;
+        }
+        pxBand->usedMs += airtimeMs;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void RAK3172_DutyCycleCharge(uint32_t airtimeUs)
+{
+    RAK3172_DevDutyCycleCharge(RAK3172_GetDev(0), airtimeUs);
+}
+
+/* Highest priority entry, oldest first within a priority */
+static RAK3172_SchedEntry_t *prvNextEntry(void)
+{
+    RAK3172_SchedEntry_t *pxBest = NULL;
+
+    for(int i = 0; i < RAK3172_SCHED_QUEUE_LEN; i++)
+    {
+        RAK3172_SchedEntry_t *pxEntry = &xEntries[i];
+
+        if(!pxEntry->used)
+            continue;
+
+        if(!pxBest || pxEntry->priority > pxBest->priority ||
+           (pxEntry->priority == pxBest->priority && (int32_t)(pxEntry->seq - pxBest->seq) < 0))
+        {
+            pxBest = pxEntry;
+        }
+    }
+
+    return pxBest;
+}
+
+static void prvUplinkDone(RAK3172_Status_t status, const char *response, void *ctx);
+
+/* Send the next uplink if a band is free, otherwise arm the timer for
+ * the moment one is. Called with the mutex held. */
+static void prvDispatchLocked(void)
+{
+    if(pxInFlight)
+        return;
+
+    RAK3172_SchedEntry_t *pxEntry = prvNextEntry();
+    if(!pxEntry)
+        return;
+
+    uint32_t waitMs = RAK3172_DutyCycleWaitMs();
+
+    if(waitMs == 0)
+    {
+        RAK3172_Status_t status = RAK3172_SubmitSend(pxEntry->port, pxEntry->data, pxEntry->length,
+                                                     prvUplinkDone, pxEntry, RAK3172_SCHED_SEND_TIMEOUT_MS);
+        if(status == RAK3172_OK)
+        {
+            pxInFlight = pxEntry;
+            return;
+        }
+
+        /* Too long since a data rate drop: retrying never helps */
+        if(status != RAK3172_ERR_QUEUE_FULL)
+        {
+            xSchedStats.errors++;
+            pxEntry->used = false;
+            prvDispatchLocked();
+            return;
+        }
+
+        /* Command queue full, try again shortly */
+        waitMs = RAK3172_SCHED_BUSY_BACKOFF_MS;
+    }
+    else
+    {
+        xSchedStats.deferred++;
+    }
+
+    xTimerChangePeriod(xSchedTimer, pdMS_TO_TICKS(waitMs) ? pdMS_TO_TICKS(waitMs) : 1, 0);
+}
+
+/* Uplink result, runs in the RAK3172 task */
+static void prvUplinkDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    RAK3172_SchedEntry_t *pxEntry = (RAK3172_SchedEntry_t *)ctx;
+
+    (void)response;
+
+    xSemaphoreTake(xSchedMutex, portMAX_DELAY);
+
+    pxInFlight = NULL;
+
+    switch(status)
+    {
+        case RAK3172_OK:
+            xSchedStats.sent++;
+            xSchedStats.totalWaitMs += pdTICKS_TO_MS(xTaskGetTickCount() - pxEntry->submitTick);
+            pxEntry->used = false;
+            break;
+
+        case RAK3172_ERR_DUTY_CYCLE:
+            /* Another sender used the band meanwhile, keep it queued */
+            break;
+
+        case RAK3172_ERR_BUSY:
+            /* The module disagrees with the model, back off before retrying */
+            xSchedStats.moduleBusy++;
+            xTimerChangePeriod(xSchedTimer, pdMS_TO_TICKS(RAK3172_SCHED_BUSY_BACKOFF_MS), 0);
+            xSemaphoreGive(xSchedMutex);
+            return;
+
+        default:
+            xSchedStats.errors++;
+            pxEntry->used = false;
+            break;
+    }
+
+    prvDispatchLocked();
+
+    xSemaphoreGive(xSchedMutex);
+}
+
+/* A band became free, runs in the timer task. Never blocks the timer
+ * task on the mutex, tries again shortly instead. */
+static void prvSchedTimerCallback(TimerHandle_t xTimer)
+{
+    if(xSemaphoreTake(xSchedMutex, 0) != pdTRUE)
+    {
+        xTimerChangePeriod(xTimer, pdMS_TO_TICKS(RAK3172_SCHED_LOCK_RETRY_MS), 0);
+        return;
+    }
+
+    prvDispatchLocked();
+    xSemaphoreGive(xSchedMutex);
+}
+
+/* Create the scheduler resources, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_SchedInit(void)
+{
+    if(xSchedMutex)
+        return RAK3172_OK;
+
+    xSchedMutex = xSemaphoreCreateMutex();
+    xSchedTimer = xTimerCreate("RAKSched", 1, pdFALSE, NULL, prvSchedTimerCallback);
+
+    if(!xSchedMutex || !xSchedTimer)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Queue an uplink. It is copied, sent once a band has budget; higher
+ * priority values go first. */
+RAK3172_Status_t RAK3172_SchedSend(uint8_t port, const uint8_t *data, uint8_t length, uint8_t priority)
+{
+    if(!xSchedMutex || !data || length == 0)
+        return RAK3172_ERR_INVALID;
+
+    const RAK3172_DataRate_t *pxDr = RAK3172_GetDataRateInfo(RAK3172_GetDataRate());
+    if(!pxDr || length > pxDr->maxPayload)
+    {
+        taskENTER_CRITICAL();
+        xSchedStats.rejected++;
+        taskEXIT_CRITICAL();
+        return pxDr ? RAK3172_ERR_PAYLOAD_SIZE : RAK3172_ERR_INVALID;
+    }
+
+    RAK3172_Status_t status = RAK3172_ERR_QUEUE_FULL;
+
+    xSemaphoreTake(xSchedMutex, portMAX_DELAY);
+
+    for(int i = 0; i < RAK3172_SCHED_QUEUE_LEN; i++)
+    {
+        RAK3172_SchedEntry_t *pxEntry = &xEntries[i];
+
+        if(pxEntry->used)
+            continue;
+
+        memcpy(pxEntry->data, data, length);
+        pxEntry->length = length;
+        pxEntry->port = port;
+        pxEntry->priority = priority;
+        pxEntry->seq = ulNextSeq++;
+        pxEntry->submitTick = xTaskGetTickCount();
+        pxEntry->used = true;
+
+        xSchedStats.queued++;
+        status = RAK3172_OK;
+        break;
+    }
+
+    if(status == RAK3172_OK)
+        prvDispatchLocked();
+    else
+        xSchedStats.rejected++;
+
+    xSemaphoreGive(xSchedMutex);
+
+    return status;
+}
+
+/* Get scheduler statistics */
+void RAK3172_GetSchedStats(RAK3172_SchedStats_t *stats)
+{
+    if(!stats)
+        return;
+
+    taskENTER_CRITICAL();
+    *stats = xSchedStats;
+    taskEXIT_CRITICAL();
+}
+
+/* Snapshot of every sub-band of the primary module, returns the number written */
+uint8_t RAK3172_GetBandStatus(RAK3172_BandStatus_t *bands, uint8_t max_bands)
+{
+    const RAK3172_BandState_t *pxState = xBandState[0];
+    TickType_t now = xTaskGetTickCount();
+    const RAK3172_SubBand_t *pxBands;
+    uint8_t numBands = prvSubBands(&pxBands);
+    uint8_t count = 0;
+
+    if(!bands)
+        return 0;
+
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < numBands && count < max_bands; i++)
+    {
+        RAK3172_BandStatus_t *pxStatus = &bands[count++];
+        bool expired = pdTICKS_TO_MS(now - pxState[i].hourStart) >= RAK3172_HOUR_MS;
+
+        pxStatus->name = pxBands[i].name;
+        pxStatus->dutyDivisor = pxBands[i].dutyDivisor;
+        pxStatus->enabled = prvBandEnabled(&pxBands[i]);
+        pxStatus->readyInMs = prvBandWaitMs(&pxState[i], now);
+        pxStatus->usedMs = expired ? 0 : pxState[i].usedMs;
+        pxStatus->budgetMs = RAK3172_HOUR_MS / pxBands[i].dutyDivisor;
+    }
+    taskEXIT_CRITICAL();
+
+    return count;
+}
@@ -0,0 +1,334 @@
+#include "rak3172_store.h"
+#include "rak3172_sched.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "queue.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Keep clear of the program image, which grows from the start of flash */
+#define RAK3172_STORE_OFFSET    (PICO_FLASH_SIZE_BYTES - RAK3172_STORE_SECTORS * FLASH_SECTOR_SIZE)
+
+/* Record accepted by RAK3172_StoreSend(), waiting for the flash */
+typedef struct {
+    uint8_t port;
+    uint8_t length;
+    uint8_t data[RAK3172_LOG_MAX_DATA];
+} RAK3172_StoreRecord_t;
+
+static RAK3172_Log_t xLog;
+static SemaphoreHandle_t xStoreMutex = NULL;
+static QueueHandle_t xAppendQueue = NULL;
+static TaskHandle_t xStoreTaskHandle = NULL;
+static RAK3172_StoreStats_t xStoreStats = {0};
+static RAK3172_StoreRecord_t xAppendRec;        /* Store task only */
+
+/* Record on the air, the log keeps it pending until the module accepts it
+ * and the store task has marked it */
+static uint8_t ucDrainBuf[RAK3172_LOG_MAX_DATA];
+static bool bInFlight = false;
+static bool bConsumePending = false;
+static bool bClearPending = false;
+static uint32_t ulInFlightSlot = 0;
+
+/* On-board flash. Erase and program stall XIP, so nothing may run from
+ * flash meanwhile: interrupts are off, FreeRTOS runs on one core. The
+ * UART RX FIFO overflows in well under a page program at the fast link
+ * rates, so only the store task gets here, once the module is quiet. */
+static void prvFlashRead(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    memcpy(buf, (const uint8_t *)(uintptr_t)(XIP_BASE + RAK3172_STORE_OFFSET + offset), len);
+}
+
+static bool prvFlashProgram(void *ctx, uint32_t offset, const void *data, size_t len)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program(RAK3172_STORE_OFFSET + offset, (const uint8_t *)data, len);
+    restore_interrupts(ints);
+
+    return true;
+}
+
+static bool prvFlashErase(void *ctx, uint32_t offset)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(RAK3172_STORE_OFFSET + offset, FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+
+    return true;
+}
+
+static const RAK3172_FlashDev_t xFlashDev = {
+    .sectorSize = FLASH_SECTOR_SIZE,
+    .sectorCount = RAK3172_STORE_SECTORS,
+    .ctx = NULL,
+    .read = prvFlashRead,
+    .program = prvFlashProgram,
+    .erase = prvFlashErase
+};
+
+static void prvDrainDone(RAK3172_Status_t status, const char *response, void *ctx);
+
+/* Send the oldest pending record when joined and a band is free. The
+ * module's join URC decides, whoever started the join. Called with the
+ * mutex held. */
+static void prvDrainLocked(void)
+{
+    uint8_t port, length;
+
+    if(bInFlight || xLog.pending == 0)
+        return;
+
+    if(!RAK3172_IsJoined() || RAK3172_DutyCycleWaitMs() > 0)
+        return;
+
+    if(!RAK3172_LogPeek(&xLog, &port, ucDrainBuf, &length))
+        return;
+
+    if(RAK3172_SubmitSend(port, ucDrainBuf, length, prvDrainDone, NULL,
+                          RAK3172_STORE_SEND_TIMEOUT_MS) == RAK3172_OK)
+    {
+        bInFlight = true;
+        ulInFlightSlot = xLog.tail;
+    }
+}
+
+/* Mark the record sent, with the flash time accounted */
+static void prvConsumeLocked(void)
+{
+    uint32_t start = time_us_32();
+
+    /* Overwritten by a wrap while on the air */
+    if(xLog.tail != ulInFlightSlot)
+        return;
+
+    RAK3172_LogConsume(&xLog);
+    xStoreStats.consumeUs += time_us_32() - start;
+}
+
+/* Uplink result, runs in the RAK3172 task. No flash work here: the
+ * mark is left to the store task. */
+static void prvDrainDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    bool consume = false;
+
+    xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+
+    switch(status)
+    {
+        case RAK3172_OK:
+            xStoreStats.drained++;
+            consume = true;
+            break;
+
+        case RAK3172_ERR_PAYLOAD_SIZE:
+        case RAK3172_ERR_INVALID:
+            /* Would never go through, do not block the log behind it */
+            xStoreStats.sendErrors++;
+            consume = true;
+            break;
+
+        default:
+            /* Busy, duty cycle, timeout: keep it, the poll retries */
+            bInFlight = false;
+            break;
+    }
+
+    bConsumePending = consume;
+
+    xSemaphoreGive(xStoreMutex);
+
+    if(consume)
+        xTaskNotifyGive(xStoreTaskHandle);
+}
+
+/* Hold flash work until the module has nothing to say. Interrupts are
+ * off for a page program or a sector erase and bytes arriving meanwhile
+ * are lost. A module that never goes quiet (Class C, P2P receive) only
+ * delays the write, it does not block the log. */
+static void prvWaitQuiet(void)
+{
+    RAK3172_Dev_t *dev = RAK3172_GetDev(0);
+    TickType_t start = xTaskGetTickCount();
+
+    while(!RAK3172_DevIsQuiet(dev, RAK3172_STORE_QUIET_MS))
+    {
+        if(pdTICKS_TO_MS(xTaskGetTickCount() - start) >= RAK3172_STORE_QUIET_MAX_MS)
+        {
+            xStoreStats.noisyWrites++;
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(RAK3172_STORE_QUIET_POLL_MS));
+    }
+}
+
+static void prvAppend(const RAK3172_StoreRecord_t *rec)
+{
+    prvWaitQuiet();
+
+    xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+
+    uint32_t start = time_us_32();
+    bool ok = RAK3172_LogAppend(&xLog, rec->port, rec->data, rec->length);
+    uint32_t elapsed = time_us_32() - start;
+
+    if(ok)
+    {
+        xStoreStats.appended++;
+        xStoreStats.appendUs += elapsed;
+        if(elapsed > xStoreStats.appendMaxUs)
+            xStoreStats.appendMaxUs = elapsed;
+    }
+    else
+    {
+        xStoreStats.rejected++;
+    }
+
+    xSemaphoreGive(xStoreMutex);
+}
+
+/* Owns every flash program and erase. Low priority, so it only runs when
+ * the driver and the application have nothing to do. */
+static void prvTaskStore(void *pvParameters)
+{
+    for(;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RAK3172_STORE_POLL_MS));
+
+        if(bClearPending)
+        {
+            prvWaitQuiet();
+
+            xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+            if(!bInFlight)
+            {
+                while(xQueueReceive(xAppendQueue, &xAppendRec, 0) == pdTRUE)
+                    ;
+                RAK3172_LogClear(&xLog);
+                bClearPending = false;
+            }
+            xSemaphoreGive(xStoreMutex);
+        }
+
+        if(bConsumePending)
+        {
+            prvWaitQuiet();
+
+            xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+            prvConsumeLocked();
+            bConsumePending = false;
+            bInFlight = false;
+            xSemaphoreGive(xStoreMutex);
+        }
+
+        while(xQueueReceive(xAppendQueue, &xAppendRec, 0) == pdTRUE)
+            prvAppend(&xAppendRec);
+
+        xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+        prvDrainLocked();
+        xSemaphoreGive(xStoreMutex);
+    }
+}
+
+/* Scan the log and start draining, call once after RAK3172_Init() */
+RAK3172_Status_t RAK3172_StoreInit(void)
+{
+    if(xStoreMutex)
+        return RAK3172_OK;
+
+    xStoreMutex = xSemaphoreCreateMutex();
+    xAppendQueue = xQueueCreate(RAK3172_STORE_QUEUE_LEN, sizeof(RAK3172_StoreRecord_t));
+
+    if(!xStoreMutex || !xAppendQueue || !RAK3172_LogInit(&xLog, &xFlashDev))
+        return RAK3172_ERR_INVALID;
+
+    xStoreStats.recovered = xLog.pending;
+    printf("RAK3172 store: %lu pending uplinks recovered\n", (unsigned long)xLog.pending);
+
+    if(xTaskCreate(prvTaskStore, "RAKStore", 512, NULL, 1, &xStoreTaskHandle) != pdPASS)
+        return RAK3172_ERR_INVALID;
+
+    return RAK3172_OK;
+}
+
+/* Accept an uplink, it is persisted by the store task as soon as the
+ * module is quiet and sent as soon as possible. Never touches the flash
+ * itself; a record still queued here is lost with a reset. */
+RAK3172_Status_t RAK3172_StoreSend(uint8_t port, const uint8_t *data, uint8_t length)
+{
+    RAK3172_StoreRecord_t xRec;
+
+    if(!xStoreMutex || !data || length == 0 || length > RAK3172_LOG_MAX_DATA)
+    {
+        taskENTER_CRITICAL();
+        xStoreStats.rejected++;
+        taskEXIT_CRITICAL();
+        return RAK3172_ERR_INVALID;
+    }
+
+    xRec.port = port;
+    xRec.length = length;
+    memcpy(xRec.data, data, length);
+
+    if(xQueueSend(xAppendQueue, &xRec, 0) != pdTRUE)
+    {
+        taskENTER_CRITICAL();
+        xStoreStats.rejected++;
+        taskEXIT_CRITICAL();
+        return RAK3172_ERR_QUEUE_FULL;
+    }
+
+    xTaskNotifyGive(xStoreTaskHandle);
+
+    return RAK3172_OK;
+}
+
+/* Try to send now rather than at the next poll */
+RAK3172_Status_t RAK3172_StoreDrain(void)
+{
+    if(!xStoreMutex)
+        return RAK3172_ERR_INVALID;
+
+    xTaskNotifyGive(xStoreTaskHandle);
+
+    return RAK3172_OK;
+}
+
+/* Drop every pending record. The store task erases the region once the
+ * module is quiet and no record is on the air. */
+RAK3172_Status_t RAK3172_StoreClear(void)
+{
+    if(!xStoreMutex)
+        return RAK3172_ERR_INVALID;
+
+    xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+    bClearPending = true;
+    xSemaphoreGive(xStoreMutex);
+
+    xTaskNotifyGive(xStoreTaskHandle);
+
+    return RAK3172_OK;
+}
+
+/* Get store statistics */
+void RAK3172_GetStoreStats(RAK3172_StoreStats_t *stats)
+{
+    if(!stats || !xStoreMutex)
+        return;
+
+    xSemaphoreTake(xStoreMutex, portMAX_DELAY);
+
+    *stats = xStoreStats;
+    stats->queued = (uint32_t)uxQueueMessagesWaiting(xAppendQueue);
+    stats->pending = xLog.pending;
+    stats->capacity = xLog.slotCount;
+    stats->dropped = xLog.dropped;
+    stats->corrupt = xLog.corrupt;
+    stats->erases = xLog.erases;
+
+    xSemaphoreGive(xStoreMutex);
+}
@@ -0,0 +1,184 @@
+#include "rak3172_timeout.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+/* Fixed bounds of each class */
+typedef struct {
+    const char *name;
+    uint32_t floorMs;
+    uint32_t ceilingMs;
+} RAK3172_TmoBounds_t;
+
+static const RAK3172_TmoBounds_t xBounds[RAK3172_TMO_CLASS_COUNT] = {
+    [RAK3172_TMO_PING]      = { "ping",     100,  2000 },
+    [RAK3172_TMO_QUERY]     = { "query",    150,  2000 },
+    [RAK3172_TMO_SET]       = { "set",      200,  2000 },
+    [RAK3172_TMO_SEND]      = { "send",     200, 10000 },
+    [RAK3172_TMO_JOIN]      = { "join",     200,  5000 },
+    [RAK3172_TMO_OTHER]     = { "other",    200, 10000 },
+    [RAK3172_TMO_SLOW]      = { "slow",       0,     0 },   /* Never learned */
+    [RAK3172_TMO_JOIN_EVT]  = { "join-evt", 3000, 30000 },
+    [RAK3172_TMO_ACK_EVT]   = { "ack-evt",  2000, 30000 },
+};
+
+/* Commands of RAK3172_TMO_SLOW, by prefix */
+static const char * const pcSlowCommands[] = {
+    "AT+BAND=", "AT+NWM=", "AT+P2P=", "AT+PRECV=", "AT+BAUD=", "ATZ", "ATR",
+};
+
+/* Estimator state, fixed point: srtt in 1/8 ms, rttvar in 1/4 ms */
+typedef struct {
+    uint32_t srtt8;
+    uint32_t rttvar4;
+    uint32_t samples;
+    uint32_t timeouts;
+    uint32_t maxMs;
+    uint8_t backoff;
+} RAK3172_TmoState_t;
+
+static RAK3172_TmoState_t xState[RAK3172_TMO_CLASS_COUNT];
+
+/* Learned deadline within the class bounds, 0 while still learning.
+ * Called in a critical section. */
+static uint32_t prvTimeoutLocked(RAK3172_TmoClass_t cls)
+{
+    const RAK3172_TmoState_t *pxState = &xState[cls];
+
+    if(pxState->samples < RAK3172_TMO_MIN_SAMPLES || xBounds[cls].ceilingMs == 0)
+        return 0;
+
+    uint32_t timeout = pxState->srtt8 / 8 + RAK3172_TMO_VAR_MULT * (pxState->rttvar4 / 4) + RAK3172_TMO_MARGIN_MS;
+
+    if(timeout < xBounds[cls].floorMs)
+        timeout = xBounds[cls].floorMs;
+
+    timeout <<= pxState->backoff;
+
+    if(timeout > xBounds[cls].ceilingMs)
+        timeout = xBounds[cls].ceilingMs;
+
+    return timeout;
+}
+
+/* Class of an AT command line, NULL for an AT+SEND request */
+RAK3172_TmoClass_t RAK3172_TimeoutClassify(const char *cmd)
+{
+    if(!cmd || strncmp(cmd, "AT+SEND", 7) == 0)
+        return RAK3172_TMO_SEND;
+
+    if(strcmp(cmd, "AT") == 0)
+        return RAK3172_TMO_PING;
+
+    if(strncmp(cmd, "AT+JOIN", 7) == 0)
+        return RAK3172_TMO_JOIN;
+
+    size_t len = strlen(cmd);
+    if(len > 0 && cmd[len - 1] == '?')
+        return RAK3172_TMO_QUERY;
+
+    for(size_t i = 0; i < sizeof(pcSlowCommands) / sizeof(pcSlowCommands[0]); i++)
+    {
+        if(strncmp(cmd, pcSlowCommands[i], strlen(pcSlowCommands[i])) == 0)
+            return RAK3172_TMO_SLOW;
+    }
+
+    if(strchr(cmd, '='))
+        return RAK3172_TMO_SET;
+
+    return RAK3172_TMO_OTHER;
+}
+
+/* Deadline for the next operation of a class, never above max_ms */
+uint32_t RAK3172_TimeoutGet(RAK3172_TmoClass_t cls, uint32_t max_ms)
+{
+    if(cls >= RAK3172_TMO_CLASS_COUNT)
+        return max_ms;
+
+    taskENTER_CRITICAL();
+    uint32_t timeout = prvTimeoutLocked(cls);
+    taskEXIT_CRITICAL();
+
+    return (timeout == 0 || timeout > max_ms) ? max_ms : timeout;
+}
+
+/* Reply seen after latency_ms */
+void RAK3172_TimeoutSample(RAK3172_TmoClass_t cls, uint32_t latency_ms)
+{
+    if(cls >= RAK3172_TMO_CLASS_COUNT)
+        return;
+
+    taskENTER_CRITICAL();
+    RAK3172_TmoState_t *pxState = &xState[cls];
+
+    if(pxState->samples == 0)
+    {
+        pxState->srtt8 = latency_ms * 8;
+        pxState->rttvar4 = latency_ms * 2;
+    }
+    else
+    {
+        int32_t err = (int32_t)latency_ms - (int32_t)(pxState->srtt8 / 8);
+        uint32_t absErr = (err < 0) ? (uint32_t)-err : (uint32_t)err;
+
+        /* srtt += err / 8, rttvar += (|err| - rttvar) / 4 */
+        pxState->srtt8 = (uint32_t)((int32_t)pxState->srtt8 + err);
+        pxState->rttvar4 = pxState->rttvar4 - pxState->rttvar4 / 4 + absErr;
+    }
+
+    pxState->samples++;
+    pxState->backoff = 0;
+    if(latency_ms > pxState->maxMs)
+        pxState->maxMs = latency_ms;
+    taskEXIT_CRITICAL();
+}
+
+/* No reply before the deadline: back off until the next reply */
+void RAK3172_TimeoutExpired(RAK3172_TmoClass_t cls)
+{
+    if(cls >= RAK3172_TMO_CLASS_COUNT)
+        return;
+
+    taskENTER_CRITICAL();
+    xState[cls].timeouts++;
+    if(xState[cls].samples >= RAK3172_TMO_MIN_SAMPLES && xState[cls].backoff < RAK3172_TMO_MAX_BACKOFF)
+        xState[cls].backoff++;
+    taskEXIT_CRITICAL();
+}
+
+/* Forget everything learned, e.g. after a link rate change */
+void RAK3172_TimeoutReset(void)
+{
+    taskENTER_CRITICAL();
+    memset(xState, 0, sizeof(xState));
+    taskEXIT_CRITICAL();
+}
+
+/* Snapshot of the learned table, returns the number of entries written */
+uint8_t RAK3172_GetTimeoutTable(RAK3172_TmoEntry_t *entries, uint8_t max_entries)
+{
+    uint8_t count = 0;
+
+    if(!entries)
+        return 0;
+
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < RAK3172_TMO_CLASS_COUNT && count < max_entries; i++)
+    {
+        RAK3172_TmoEntry_t *pxEntry = &entries[count++];
+
+        pxEntry->name = xBounds[i].name;
+        pxEntry->samples = xState[i].samples;
+        pxEntry->timeouts = xState[i].timeouts;
+        pxEntry->srttMs = xState[i].srtt8 / 8;
+        pxEntry->rttvarMs = xState[i].rttvar4 / 4;
+        pxEntry->maxMs = xState[i].maxMs;
+        pxEntry->floorMs = xBounds[i].floorMs;
+        pxEntry->ceilingMs = xBounds[i].ceilingMs;
+        pxEntry->timeoutMs = prvTimeoutLocked((RAK3172_TmoClass_t)i);
+        pxEntry->backoff = xState[i].backoff;
+    }
+    taskEXIT_CRITICAL();
+
+    return count;
+}
@@ -0,0 +1,109 @@
+#include "rak3172.h"
+#include "rak3172_tx.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+/* DMA transmit, one channel per module sharing DMA_IRQ_1 */
+static RAK3172_TxChannel_t *pxDmaChannels[RAK3172_MAX_DEVICES] = {0};
+
+static void rak3172_tx_dma_irq_handler(void)
+{
+    for(int i = 0; i < RAK3172_MAX_DEVICES; i++)
+    {
+        RAK3172_TxChannel_t *chan = pxDmaChannels[i];
+
+        if(chan && dma_channel_get_irq1_status(chan->dmaChannel))
+        {
+            dma_channel_acknowledge_irq1(chan->dmaChannel);
+
+            if(chan->done)
+                chan->done(chan->ctx);
+        }
+    }
+}
+
+static bool prvDmaTxInit(RAK3172_TxChannel_t *chan)
+{
+    int slot = -1;
+
+    for(int i = 0; i < RAK3172_MAX_DEVICES && slot < 0; i++)
+    {
+        if(!pxDmaChannels[i])
+            slot = i;
+    }
+
+    chan->dmaChannel = (slot >= 0) ? dma_claim_unused_channel(false) : -1;
+    if(chan->dmaChannel < 0)
+        return false;
+
+    uart_inst_t *uart = uart_get_instance(chan->uartIndex);
+
+    dma_channel_config cfg = dma_channel_get_default_config(chan->dmaChannel);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, uart_get_dreq(uart, true));
+    dma_channel_configure(chan->dmaChannel, &cfg,
+                          &uart_get_hw(uart)->dr,
+                          NULL, 0, false);
+
+    /* DMA_IRQ_1 may be shared with other users of the DMA */
+    dma_channel_set_irq1_enabled(chan->dmaChannel, true);
+    if(slot == 0)
+    {
+        irq_add_shared_handler(DMA_IRQ_1, rak3172_tx_dma_irq_handler,
+                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+    pxDmaChannels[slot] = chan;
+
+    return true;
+}
+
+static bool prvDmaTxWrite(RAK3172_TxChannel_t *chan, const uint8_t * const data, size_t length)
+{
+    if(chan->dmaChannel < 0 || dma_channel_is_busy(chan->dmaChannel))
+        return false;
+
+    dma_channel_transfer_from_buffer_now(chan->dmaChannel, data, length);
+    return true;
+}
+
+static bool prvDmaTxBusy(RAK3172_TxChannel_t *chan)
+{
+    return (chan->dmaChannel >= 0) && dma_channel_is_busy(chan->dmaChannel);
+}
+
+const RAK3172_TxPort_t xRak3172DmaTx =
+{
+    .init  = prvDmaTxInit,
+    .write = prvDmaTxWrite,
+    .busy  = prvDmaTxBusy
+};
+
+/* Blocking transmit, write() returns once the data is in the FIFO so
+ * there is never a completion to report */
+static bool prvBlockingTxInit(RAK3172_TxChannel_t *chan)
+{
+    chan->dmaChannel = -1;
+    return true;
+}
+
+static bool prvBlockingTxWrite(RAK3172_TxChannel_t *chan, const uint8_t * const data, size_t length)
+{
+    uart_write_blocking(uart_get_instance(chan->uartIndex), data, length);
+    return true;
+}
+
+static bool prvBlockingTxBusy(RAK3172_TxChannel_t *chan)
+{
+    return false;
+}
+
+const RAK3172_TxPort_t xRak3172BlockingTx =
+{
+    .init  = prvBlockingTxInit,
+    .write = prvBlockingTxWrite,
+    .busy  = prvBlockingTxBusy
+};
@@ -21,6 +21,15 @@
 #include "cli.h"
 
 #include "rak3172.h"
+#include "rak3172_batch.h"
+#include "rak3172_sched.h"
+#include "rak3172_confirm.h"
+#include "rak3172_store.h"
+#include "rak3172_lb.h"
+#include "rak3172_health.h"
+#include "rak3172_p2p.h"
+#include "rak3172_frag.h"
+#include "rak3172_classc.h"
 
 #define TFT_SPI_PORT spi1
 
@@ -104,8 +113,7 @@ int main()
     // Initialiser stdio en premier
     stdio_init_all();
 
-    // Délai pour stabiliser USB CDC
-    sleep_ms(2000);
+    // USB CDC enumerates in the background, Task_CLI waits for the host
 
     gpio_init(GPIO_WATCH_PIN2);
     gpio_set_dir(GPIO_WATCH_PIN2, GPIO_IN);
@@ -137,6 +145,15 @@ int main()
 
     /* Initialize RAK3172 */
     RAK3172_Init();
+    RAK3172_BatchInit();
+    RAK3172_SchedInit();
+    RAK3172_ConfirmInit();
+    RAK3172_StoreInit();
+    RAK3172_LbInit();
+    RAK3172_HealthInit();
+    RAK3172_P2pInit();
+    RAK3172_FragInit();
+    RAK3172_ClassCInit();
     
     BaseType_t xResult;
 
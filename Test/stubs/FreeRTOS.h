@@ -0,0 +1,27 @@
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* Host build of the driver modules: the kernel types and macros they use,
+ * the functions are in stub_kernel.c. One tick is one millisecond and
+ * nothing preempts a host test. */
+#include <stdint.h>
+#include <stddef.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE     0
+#define pdTRUE      1
+#define pdFAIL      0
+#define pdPASS      1
+
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFFUL)
+
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+#define pdTICKS_TO_MS(t)    ((uint32_t)(t))
+
+#define taskENTER_CRITICAL()    do { } while(0)
+#define taskEXIT_CRITICAL()     do { } while(0)
+
+#endif /* INC_FREERTOS_H */
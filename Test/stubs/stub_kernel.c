@@ -0,0 +1,298 @@
+#include "stub_kernel.h"
+#include "queue.h"
+#include "semphr.h"
+#include "timers.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STUB_MAX_OBJECTS    32
+
+typedef struct {
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+} StubQueue_t;
+
+typedef struct {
+    TimerCallbackFunction_t callback;
+    void *id;
+    TickType_t period;
+    TickType_t expiry;
+    UBaseType_t autoReload;
+    BaseType_t active;
+} StubTimer_t;
+
+typedef enum {
+    STUB_QUEUE,
+    STUB_MUTEX,
+    STUB_TIMER,
+} StubKind_t;
+
+static TickType_t xTick = 0;
+static void *pvObjects[STUB_MAX_OBJECTS];
+static StubKind_t xKinds[STUB_MAX_OBJECTS];
+
+static void *prvAlloc(size_t size, StubKind_t kind)
+{
+    for(int i = 0; i < STUB_MAX_OBJECTS; i++)
+    {
+        if(!pvObjects[i])
+        {
+            pvObjects[i] = calloc(1, size);
+            xKinds[i] = kind;
+            return pvObjects[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Earliest active timer due by limit, NULL if none */
+static StubTimer_t *prvNextTimer(TickType_t limit)
+{
+    StubTimer_t *pxNext = NULL;
+
+    for(int i = 0; i < STUB_MAX_OBJECTS; i++)
+    {
+        StubTimer_t *pxTimer = pvObjects[i];
+
+        if(pxTimer && xKinds[i] == STUB_TIMER && pxTimer->active && (int32_t)(pxTimer->expiry - limit) <= 0 &&
+           (!pxNext || (int32_t)(pxTimer->expiry - pxNext->expiry) < 0))
+            pxNext = pxTimer;
+    }
+
+    return pxNext;
+}
+
+void vStubTickAdvance(TickType_t ticks)
+{
+    TickType_t target = xTick + ticks;
+    StubTimer_t *pxTimer;
+
+    while((pxTimer = prvNextTimer(target)) != NULL)
+    {
+        if((int32_t)(pxTimer->expiry - xTick) > 0)
+            xTick = pxTimer->expiry;
+
+        if(pxTimer->autoReload)
+            pxTimer->expiry = xTick + pxTimer->period;
+        else
+            pxTimer->active = pdFALSE;
+
+        pxTimer->callback(pxTimer);
+    }
+
+    xTick = target;
+}
+
+void vStubTickSet(TickType_t tick)
+{
+    xTick = tick;
+}
+
+void vStubKernelReset(void)
+{
+    for(int i = 0; i < STUB_MAX_OBJECTS; i++)
+    {
+        if(pvObjects[i] && xKinds[i] == STUB_QUEUE)
+            free(((StubQueue_t *)pvObjects[i])->items);
+        free(pvObjects[i]);
+        pvObjects[i] = NULL;
+    }
+
+    xTick = 0;
+}
+
+/* Tasks */
+TickType_t xTaskGetTickCount(void)
+{
+    return xTick;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    vStubTickAdvance(ticks);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters,
+                       UBaseType_t priority, TaskHandle_t *created)
+{
+    (void)code; (void)name; (void)stackDepth; (void)parameters; (void)priority; (void)created;
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)&xTick;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    (void)task;
+    return 1;
+}
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index)
+{
+    (void)task; (void)index;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t wait)
+{
+    (void)index; (void)clear; (void)wait;
+    return 0;
+}
+
+/* Queues: nobody else runs, so a blocking call fails at once */
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    StubQueue_t *pxQueue = prvAlloc(sizeof(StubQueue_t), STUB_QUEUE);
+
+    if(!pxQueue)
+        return NULL;
+
+    pxQueue->items = malloc(length * itemSize);
+    pxQueue->length = length;
+    pxQueue->itemSize = itemSize;
+    return pxQueue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    StubQueue_t *pxQueue = queue;
+
+    (void)wait;
+
+    if(pxQueue->count == pxQueue->length)
+        return pdFALSE;
+
+    UBaseType_t tail = (pxQueue->head + pxQueue->count) % pxQueue->length;
+    memcpy(&pxQueue->items[tail * pxQueue->itemSize], item, pxQueue->itemSize);
+    pxQueue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    StubQueue_t *pxQueue = queue;
+
+    (void)wait;
+
+    if(pxQueue->count == 0)
+        return pdFALSE;
+
+    memcpy(item, &pxQueue->items[pxQueue->head * pxQueue->itemSize], pxQueue->itemSize);
+    pxQueue->head = (pxQueue->head + 1) % pxQueue->length;
+    pxQueue->count--;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    StubQueue_t *pxQueue = queue;
+
+    pxQueue->head = 0;
+    pxQueue->count = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return ((StubQueue_t *)queue)->count;
+}
+
+/* Mutexes: a take of a held mutex would deadlock on target, fail it */
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return prvAlloc(sizeof(BaseType_t), STUB_MUTEX);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    BaseType_t *pxHeld = sem;
+
+    (void)wait;
+
+    if(*pxHeld)
+        return pdFALSE;
+
+    *pxHeld = pdTRUE;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t *pxHeld = sem;
+
+    if(!*pxHeld)
+        return pdFALSE;
+
+    *pxHeld = pdFALSE;
+    return pdTRUE;
+}
+
+/* Timers */
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t autoReload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    StubTimer_t *pxTimer = prvAlloc(sizeof(StubTimer_t), STUB_TIMER);
+
+    (void)name;
+
+    if(!pxTimer)
+        return NULL;
+
+    pxTimer->callback = callback;
+    pxTimer->id = id;
+    pxTimer->period = period;
+    pxTimer->autoReload = autoReload;
+    return pxTimer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    StubTimer_t *pxTimer = timer;
+
+    (void)wait;
+
+    pxTimer->expiry = xTick + pxTimer->period;
+    pxTimer->active = pdTRUE;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+
+    ((StubTimer_t *)timer)->active = pdFALSE;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    ((StubTimer_t *)timer)->period = period;
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return ((StubTimer_t *)timer)->active;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return ((StubTimer_t *)timer)->id;
+}
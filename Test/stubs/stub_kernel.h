@@ -0,0 +1,15 @@
+#ifndef STUB_KERNEL_H
+#define STUB_KERNEL_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Test side of the kernel stubs. Time only moves when a test moves it,
+ * timers due on the way fire in expiry order. */
+void vStubTickAdvance(TickType_t ticks);
+void vStubTickSet(TickType_t tick);
+
+/* Free every queue, mutex and timer and rewind the tick */
+void vStubKernelReset(void);
+
+#endif /* STUB_KERNEL_H */
@@ -0,0 +1,36 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Minimal host test harness: a failed CHECK prints and is counted, main
+ * returns the count so ctest sees the failure. */
+extern uint32_t ulTestFailures;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) \
+        { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ulTestFailures++; \
+        } \
+    } while(0)
+
+#define RUN(test) \
+    do { \
+        uint32_t ulBefore = ulTestFailures; \
+        test(); \
+        printf("%-40s %s\n", #test, ulTestFailures == ulBefore ? "ok" : "FAILED"); \
+    } while(0)
+
+static inline uint64_t ullTestNowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* TEST_H */
@@ -0,0 +1,312 @@
+#include "test.h"
+#include "rak3172_at.h"
+#include <string.h>
+
+uint32_t ulTestFailures = 0;
+
+static RAK3172_LineType_t prvClassify(const char *line, const char *cmd, RAK3172_Status_t *status)
+{
+    return RAK3172_ClassifyLine(line, strlen(line), cmd, status);
+}
+
+static RAK3172_UrcType_t prvParse(RAK3172_UrcParser_t *parser, const char *line, RAK3172_RxData_t *rx)
+{
+    return RAK3172_ParseUrc(parser, line, strlen(line), rx);
+}
+
+static void test_classify_results(void)
+{
+    RAK3172_Status_t status;
+
+    CHECK(prvClassify("", NULL, NULL) == RAK3172_LINE_EMPTY);
+    CHECK(prvClassify("OK", NULL, NULL) == RAK3172_LINE_OK);
+    CHECK(prvClassify("OKAY", NULL, NULL) == RAK3172_LINE_DATA);
+
+    status = RAK3172_OK;
+    CHECK(prvClassify("ERROR", NULL, &status) == RAK3172_LINE_ERROR);
+    CHECK(status == RAK3172_ERR_ERROR);
+
+    status = RAK3172_OK;
+    CHECK(prvClassify("AT_PARAM_ERROR", NULL, &status) == RAK3172_LINE_ERROR);
+    CHECK(status == RAK3172_ERR_PARAM);
+
+    status = RAK3172_OK;
+    CHECK(prvClassify("AT_BUSY_ERROR", NULL, &status) == RAK3172_LINE_ERROR);
+    CHECK(status == RAK3172_ERR_BUSY);
+
+    status = RAK3172_OK;
+    CHECK(prvClassify("AT_NO_NETWORK_JOINED", NULL, &status) == RAK3172_LINE_ERROR);
+    CHECK(status == RAK3172_ERR_NO_NETWORK);
+
+    /* A code this driver does not know still ends the command */
+    status = RAK3172_OK;
+    CHECK(prvClassify("AT_DUTYCYCLE_ERROR", NULL, &status) == RAK3172_LINE_ERROR);
+    CHECK(status == RAK3172_ERR_ERROR);
+
+    /* No status pointer is fine */
+    CHECK(prvClassify("AT_RX_ERROR", NULL, NULL) == RAK3172_LINE_ERROR);
+
+    /* Near misses are data */
+    CHECK(prvClassify("ERRORS", NULL, NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("AT_", NULL, NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("AT_PARAM", NULL, NULL) == RAK3172_LINE_DATA);
+}
+
+static void test_classify_echo_data_urc(void)
+{
+    CHECK(prvClassify("AT+DR=?", "AT+DR=?", NULL) == RAK3172_LINE_ECHO);
+    CHECK(prvClassify("AT+DR=?", "AT+DR=5", NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("AT+DR", "AT+DR=?", NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("AT+DR=5", NULL, NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("AT", "AT", NULL) == RAK3172_LINE_ECHO);
+
+    /* The line is not terminated, only len counts */
+    CHECK(RAK3172_ClassifyLine("OKxx", 2, NULL, NULL) == RAK3172_LINE_OK);
+    CHECK(RAK3172_ClassifyLine("AT+VERxx", 6, "AT+VER", NULL) == RAK3172_LINE_ECHO);
+
+    CHECK(prvClassify("+EVT:JOINED", NULL, NULL) == RAK3172_LINE_URC);
+    CHECK(prvClassify("+EVT:", NULL, NULL) == RAK3172_LINE_DATA);
+    CHECK(prvClassify("+EVENT", NULL, NULL) == RAK3172_LINE_DATA);
+}
+
+static void test_urc_fixed(void)
+{
+    RAK3172_UrcParser_t parser = {0};
+    RAK3172_RxData_t rx;
+
+    CHECK(prvParse(&parser, "+EVT:JOINED", &rx) == RAK3172_URC_JOINED);
+    CHECK(prvParse(&parser, "+EVT:JOIN_FAILED_RX_TIMEOUT", &rx) == RAK3172_URC_JOIN_FAILED);
+    CHECK(prvParse(&parser, "+EVT:JOIN FAILED", &rx) == RAK3172_URC_JOIN_FAILED);
+    CHECK(prvParse(&parser, "+EVT:SEND_CONFIRMED_OK", &rx) == RAK3172_URC_SEND_CONFIRMED_OK);
+    CHECK(prvParse(&parser, "+EVT:SEND_CONFIRMED_FAILED(4)", &rx) == RAK3172_URC_SEND_CONFIRMED_FAILED);
+    CHECK(prvParse(&parser, "+EVT:TX_DONE", &rx) == RAK3172_URC_TX_DONE);
+    CHECK(prvParse(&parser, "+EVT:TXP2P DONE", &rx) == RAK3172_URC_TX_P2P_DONE);
+    CHECK(prvParse(&parser, "+EVT:LINKCHECK:0:5:1:-40:7", &rx) == RAK3172_URC_UNKNOWN);
+    CHECK(prvParse(&parser, "+EVX:JOINED", &rx) == RAK3172_URC_UNKNOWN);
+    CHECK(prvParse(&parser, "+EVT", &rx) == RAK3172_URC_UNKNOWN);
+}
+
+/* RUI3 v4: everything on one line */
+static void test_urc_rx_single_line(void)
+{
+    RAK3172_UrcParser_t parser = {0};
+    RAK3172_RxData_t rx;
+
+    memset(&rx, 0, sizeof(rx));
+    CHECK(prvParse(&parser, "+EVT:RX_1:-70:8:UNICAST:2:DEADBEEF", &rx) == RAK3172_URC_RX);
+    CHECK(rx.port == 2);
+    CHECK(rx.rssi == -70 && rx.snr == 8);
+    CHECK(rx.window == RAK3172_RX_WINDOW_1);
+    CHECK(!rx.multicast);
+    CHECK(rx.length == 4);
+    CHECK(rx.data[0] == 0xDE && rx.data[3] == 0xEF);
+
+    CHECK(prvParse(&parser, "+EVT:RX_C:-101:-12:MULTICAST:200:00ff", &rx) == RAK3172_URC_RX);
+    CHECK(rx.port == 200);
+    CHECK(rx.rssi == -101 && rx.snr == -12);
+    CHECK(rx.window == RAK3172_RX_WINDOW_C);
+    CHECK(rx.multicast);
+    CHECK(rx.length == 2 && rx.data[1] == 0xFF);
+
+    /* Empty payload, e.g. a bare ACK or MAC-only downlink */
+    CHECK(prvParse(&parser, "+EVT:RX_2:-60:5:UNICAST:0:", &rx) == RAK3172_URC_RX);
+    CHECK(rx.window == RAK3172_RX_WINDOW_2 && rx.length == 0);
+
+    CHECK(prvParse(&parser, "+EVT:RX_9:-60:5:UNICAST:1:00", &rx) == RAK3172_URC_UNKNOWN);
+    CHECK(prvParse(&parser, "+EVT:RX_1:-60:5:UNICAST:1:0", &rx) == RAK3172_URC_UNKNOWN);
+    CHECK(prvParse(&parser, "+EVT:RX_1:-60:5:UNICAST:1:0G", &rx) == RAK3172_URC_UNKNOWN);
+    CHECK(prvParse(&parser, "+EVT:RX_1:-60", &rx) == RAK3172_URC_UNKNOWN);
+}
+
+/* RUI3 v3: radio line, cast line, then port and payload */
+static void test_urc_rx_multi_line(void)
+{
+    RAK3172_UrcParser_t parser = {0};
+    RAK3172_RxData_t rx;
+
+    memset(&rx, 0, sizeof(rx));
+    CHECK(prvParse(&parser, "+EVT:RX_1, RSSI -70, SNR 8", &rx) == RAK3172_URC_PARTIAL);
+    CHECK(prvParse(&parser, "+EVT:MULTICAST", &rx) == RAK3172_URC_PARTIAL);
+    CHECK(prvParse(&parser, "+EVT:2:1234", &rx) == RAK3172_URC_RX);
+    CHECK(rx.port == 2);
+    CHECK(rx.rssi == -70 && rx.snr == 8);
+    CHECK(rx.multicast);
+    CHECK(rx.length == 2 && rx.data[0] == 0x12 && rx.data[1] == 0x34);
+    CHECK(parser.pending == RAK3172_URC_UNKNOWN);
+
+    /* Without a pending header a port line means nothing */
+    CHECK(prvParse(&parser, "+EVT:2:1234", &rx) == RAK3172_URC_UNKNOWN);
+
+    /* Fixed events in between do not lose the pending downlink */
+    CHECK(prvParse(&parser, "+EVT:RX_2, RSSI -90, SNR -3", &rx) == RAK3172_URC_PARTIAL);
+    CHECK(prvParse(&parser, "+EVT:TX_DONE", &rx) == RAK3172_URC_TX_DONE);
+    CHECK(prvParse(&parser, "+EVT:UNICAST", &rx) == RAK3172_URC_PARTIAL);
+    CHECK(prvParse(&parser, "+EVT:10:AB", &rx) == RAK3172_URC_RX);
+    CHECK(rx.window == RAK3172_RX_WINDOW_2 && rx.port == 10 && !rx.multicast);
+    CHECK(rx.rssi == -90 && rx.snr == -3);
+}
+
+static void test_urc_p2p(void)
+{
+    RAK3172_UrcParser_t parser = {0};
+    RAK3172_RxData_t rx;
+
+    memset(&rx, 0, sizeof(rx));
+    CHECK(prvParse(&parser, "+EVT:RXP2P:-45:11:48656C6C6F", &rx) == RAK3172_URC_RX_P2P);
+    CHECK(rx.window == RAK3172_RX_WINDOW_P2P && rx.port == 0);
+    CHECK(rx.rssi == -45 && rx.snr == 11);
+    CHECK(rx.length == 5 && memcmp(rx.data, "Hello", 5) == 0);
+
+    CHECK(prvParse(&parser, "+EVT:RXP2P, RSSI -80, SNR -2", &rx) == RAK3172_URC_PARTIAL);
+    CHECK(prvParse(&parser, "+EVT:CAFE", &rx) == RAK3172_URC_RX_P2P);
+    CHECK(rx.rssi == -80 && rx.snr == -2);
+    CHECK(rx.length == 2 && rx.data[0] == 0xCA);
+
+    CHECK(prvParse(&parser, "+EVT:RXP2P:-45", &rx) == RAK3172_URC_UNKNOWN);
+}
+
+static void test_hex_encode(void)
+{
+    static const uint8_t ucData[] = { 0x00, 0x01, 0x7F, 0x80, 0xA5, 0xFF };
+    char out[2 * sizeof(ucData) + 1];
+
+    memset(out, '#', sizeof(out));
+    RAK3172_HexEncode(ucData, sizeof(ucData), out);
+    CHECK(memcmp(out, "00017F80A5FF", 12) == 0);
+
+    /* No terminator written */
+    CHECK(out[12] == '#');
+
+    /* Zero length touches nothing */
+    RAK3172_HexEncode(ucData, 0, out);
+    CHECK(out[0] == '0');
+}
+
+static void test_hex_decode(void)
+{
+    uint8_t out[8];
+
+    memset(out, 0, sizeof(out));
+    CHECK(RAK3172_HexDecode("00017f80A5Ff", 12, out, sizeof(out)) == 6);
+    CHECK(out[0] == 0x00 && out[2] == 0x7F && out[3] == 0x80 && out[4] == 0xA5 && out[5] == 0xFF);
+
+    CHECK(RAK3172_HexDecode("", 0, out, sizeof(out)) == 0);
+
+    /* Odd length, bad digits, too long for out */
+    CHECK(RAK3172_HexDecode("123", 3, out, sizeof(out)) == -1);
+    CHECK(RAK3172_HexDecode("0g", 2, out, sizeof(out)) == -1);
+    CHECK(RAK3172_HexDecode("g0", 2, out, sizeof(out)) == -1);
+    CHECK(RAK3172_HexDecode(" 0", 2, out, sizeof(out)) == -1);
+    CHECK(RAK3172_HexDecode("0011223344556677", 16, out, sizeof(out)) == 8);
+    CHECK(RAK3172_HexDecode("001122334455667788", 18, out, sizeof(out)) == -1);
+
+    /* Bytes above 0x7F are not digits either */
+    char high[2] = { (char)0xB0, '0' };
+    CHECK(RAK3172_HexDecode(high, 2, out, sizeof(out)) == -1);
+
+    /* Only hex_len counts, the rest of the string is ignored */
+    CHECK(RAK3172_HexDecode("ABCDxyz", 4, out, sizeof(out)) == 2);
+    CHECK(out[0] == 0xAB && out[1] == 0xCD);
+}
+
+static void test_hex_round_trip(void)
+{
+    uint8_t data[256], back[256];
+    char hex[512];
+
+    for(uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)i;
+
+    RAK3172_HexEncode(data, sizeof(data), hex);
+    CHECK(RAK3172_HexDecode(hex, sizeof(hex), back, sizeof(back)) == (int32_t)sizeof(back));
+    CHECK(memcmp(data, back, sizeof(data)) == 0);
+}
+
+/* Per line cost of the receive path: classify, then decode the event */
+static void bench_parser(void)
+{
+    static const char * const pcLines[] = {
+        "OK",
+        "AT+DR=5",
+        "AT_BUSY_ERROR",
+        "+EVT:TX_DONE",
+        "+EVT:RX_1:-70:8:UNICAST:2:00112233445566778899AABBCCDDEEFF00112233445566778899AABBCCDDEEFF",
+    };
+    const uint32_t ulRounds = 200000;
+    RAK3172_UrcParser_t parser = {0};
+    RAK3172_RxData_t rx;
+    size_t lengths[sizeof(pcLines) / sizeof(pcLines[0])];
+    volatile uint32_t sink = 0;
+
+    for(size_t i = 0; i < sizeof(pcLines) / sizeof(pcLines[0]); i++)
+        lengths[i] = strlen(pcLines[i]);
+
+    for(size_t i = 0; i < sizeof(pcLines) / sizeof(pcLines[0]); i++)
+    {
+        uint64_t start = ullTestNowNs();
+        for(uint32_t n = 0; n < ulRounds; n++)
+        {
+            RAK3172_Status_t status;
+            RAK3172_LineType_t type = RAK3172_ClassifyLine(pcLines[i], lengths[i], "AT+DR=?", &status);
+            if(type == RAK3172_LINE_URC)
+                type += RAK3172_ParseUrc(&parser, pcLines[i], lengths[i], &rx);
+            sink += type;
+        }
+        uint64_t elapsed = ullTestNowNs() - start;
+
+        printf("  %-24.24s %6lu ns/line\n", pcLines[i], (unsigned long)(elapsed / ulRounds));
+    }
+
+    (void)sink;
+}
+
+/* Full AT+SEND payload both ways */
+static void bench_codec(void)
+{
+    const uint32_t ulRounds = 200000;
+    uint8_t data[RAK3172_MAX_PAYLOAD], back[RAK3172_MAX_PAYLOAD];
+    char hex[2 * RAK3172_MAX_PAYLOAD];
+    volatile int32_t sink = 0;
+
+    for(uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)(i * 7);
+
+    uint64_t start = ullTestNowNs();
+    for(uint32_t n = 0; n < ulRounds; n++)
+    {
+        data[0] = (uint8_t)n;
+        RAK3172_HexEncode(data, sizeof(data), hex);
+        sink += hex[1];
+    }
+    uint64_t encodeNs = ullTestNowNs() - start;
+
+    start = ullTestNowNs();
+    for(uint32_t n = 0; n < ulRounds; n++)
+    {
+        hex[1] = cRak3172HexDigits[n & 0x0F];
+        sink += RAK3172_HexDecode(hex, sizeof(hex), back, sizeof(back));
+    }
+    uint64_t decodeNs = ullTestNowNs() - start;
+
+    printf("  encode %u bytes:  %6lu ns\n", (unsigned)sizeof(data), (unsigned long)(encodeNs / ulRounds));
+    printf("  decode %u bytes:  %6lu ns\n", (unsigned)sizeof(data), (unsigned long)(decodeNs / ulRounds));
+
+    (void)sink;
+}
+
+int main(void)
+{
+    RUN(test_classify_results);
+    RUN(test_classify_echo_data_urc);
+    RUN(test_urc_fixed);
+    RUN(test_urc_rx_single_line);
+    RUN(test_urc_rx_multi_line);
+    RUN(test_urc_p2p);
+    RUN(test_hex_encode);
+    RUN(test_hex_decode);
+    RUN(test_hex_round_trip);
+    RUN(bench_parser);
+    RUN(bench_codec);
+
+    return ulTestFailures ? 1 : 0;
+}
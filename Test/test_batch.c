@@ -0,0 +1,375 @@
+#include "test.h"
+#include "stub_kernel.h"
+#include "rak3172_batch.c"
+
+uint32_t ulTestFailures = 0;
+
+/* Uplinks handed to the driver, the callback runs when the test says so */
+typedef struct {
+    uint8_t port;
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint16_t length;
+} TestUplink_t;
+
+#define TEST_MAX_UPLINKS    16
+
+static TestUplink_t xUplinks[TEST_MAX_UPLINKS];
+static uint32_t ulUplinks;
+static RAK3172_CmdCallback_t xPendingCallback;
+static void *pvPendingCtx;
+static RAK3172_Status_t xSubmitStatus;
+static uint8_t ucDataRate;
+static uint32_t ulDutyWaitMs;
+
+/* Driver side, EU868 at the data rate the test sets */
+RAK3172_Region_t RAK3172_GetRegion(void)
+{
+    return RAK3172_REGION_EU868;
+}
+
+uint8_t RAK3172_GetDataRate(void)
+{
+    return ucDataRate;
+}
+
+uint32_t RAK3172_DutyCycleWaitMs(void)
+{
+    return ulDutyWaitMs;
+}
+
+RAK3172_Status_t RAK3172_SubmitSend(uint8_t port, const uint8_t *data, uint16_t length,
+                                    RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+
+    if(xSubmitStatus != RAK3172_OK)
+        return xSubmitStatus;
+
+    if(ulUplinks < TEST_MAX_UPLINKS)
+    {
+        xUplinks[ulUplinks].port = port;
+        xUplinks[ulUplinks].length = length;
+        memcpy(xUplinks[ulUplinks].data, data, length);
+    }
+    ulUplinks++;
+
+    xPendingCallback = callback;
+    pvPendingCtx = ctx;
+    return RAK3172_OK;
+}
+
+/* The driver reports the last uplink */
+static void prvComplete(RAK3172_Status_t status)
+{
+    RAK3172_CmdCallback_t callback = xPendingCallback;
+
+    xPendingCallback = NULL;
+    if(callback)
+        callback(status, "", pvPendingCtx);
+}
+
+static void prvReset(uint8_t dr)
+{
+    vStubKernelReset();
+
+    memset(xFrames, 0, sizeof(xFrames));
+    ucFillIdx = 0;
+    xInFlight = false;
+    xFlushPending = false;
+    memset(&xBatchStats, 0, sizeof(xBatchStats));
+    xBatchMutex = NULL;
+
+    ulUplinks = 0;
+    xPendingCallback = NULL;
+    xSubmitStatus = RAK3172_OK;
+    ucDataRate = dr;
+    ulDutyWaitMs = 0;
+
+    RAK3172_BatchInit();
+}
+
+/* Record n: length bytes of value n */
+static RAK3172_Status_t prvAdd(uint8_t n, uint8_t length)
+{
+    uint8_t record[RAK3172_MAX_PAYLOAD];
+
+    memset(record, n, length);
+    return RAK3172_BatchAdd(record, length);
+}
+
+/* Uplink u holds records first.. of length bytes each */
+static bool prvUplinkHolds(uint32_t u, uint8_t first, uint8_t count, uint8_t length)
+{
+    const TestUplink_t *pxUp = &xUplinks[u];
+
+    if(pxUp->port != RAK3172_BATCH_PORT || pxUp->length != count * (1 + length))
+        return false;
+
+    for(uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t *rec = &pxUp->data[i * (1 + length)];
+
+        if(rec[0] != length)
+            return false;
+        for(uint8_t j = 0; j < length; j++)
+        {
+            if(rec[1 + j] != (uint8_t)(first + i))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void test_pack_until_full(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    /* 20 records of 1 + 10 bytes fill 220 of 222 bytes */
+    for(uint8_t i = 0; i < 20; i++)
+        CHECK(prvAdd(i, 10) == RAK3172_OK);
+    CHECK(ulUplinks == 0);
+
+    CHECK(prvAdd(20, 10) == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+    CHECK(prvUplinkHolds(0, 0, 20, 10));
+
+    prvComplete(RAK3172_OK);
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.records == 21);
+    CHECK(stats.frames == 1);
+    CHECK(stats.bytes == 220);
+    CHECK(stats.flushSize == 1);
+    CHECK(stats.airtimeMs > 0);
+    CHECK(stats.airtimeSavedMs > stats.airtimeMs);
+    CHECK(!xInFlight);
+
+    /* The 21st record waits in the other buffer */
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 2);
+    CHECK(prvUplinkHolds(1, 20, 1, 10));
+}
+
+static void test_flush_on_age(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    CHECK(prvAdd(1, 4) == RAK3172_OK);
+    vStubTickAdvance(pdMS_TO_TICKS(RAK3172_BATCH_MAX_AGE_MS) - 1);
+    CHECK(ulUplinks == 0);
+    vStubTickAdvance(1);
+    CHECK(ulUplinks == 1);
+    CHECK(prvUplinkHolds(0, 1, 1, 4));
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.flushAge == 1);
+
+    /* A flush empties the timer too */
+    prvComplete(RAK3172_OK);
+    CHECK(prvAdd(2, 4) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    prvComplete(RAK3172_OK);
+    vStubTickAdvance(pdMS_TO_TICKS(RAK3172_BATCH_MAX_AGE_MS) * 2);
+    CHECK(ulUplinks == 2);
+}
+
+static void test_flush_while_in_flight(void)
+{
+    prvReset(5);
+
+    CHECK(prvAdd(1, 8) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+
+    /* Second frame fills while the first is on the air, sent after it */
+    CHECK(prvAdd(2, 8) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+
+    prvComplete(RAK3172_OK);
+    CHECK(ulUplinks == 2);
+    CHECK(prvUplinkHolds(1, 2, 1, 8));
+
+    /* Both buffers busy: the next record that does not fit is refused */
+    prvReset(0);
+    for(uint8_t i = 0; i < 5; i++)
+        CHECK(prvAdd(i, 9) == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+    for(uint8_t i = 5; i < 10; i++)
+        CHECK(prvAdd(i, 9) == RAK3172_OK);
+    CHECK(prvAdd(10, 9) == RAK3172_ERR_BUSY);
+
+    RAK3172_BatchStats_t stats;
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.rejected == 1);
+}
+
+static void test_reject_too_long(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(0);
+
+    /* 51 bytes at DR0, the length byte comes on top */
+    CHECK(prvAdd(1, 51) == RAK3172_ERR_PAYLOAD_SIZE);
+    CHECK(prvAdd(1, 50) == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.rejected == 1);
+    CHECK(stats.records == 1);
+}
+
+static void test_split_on_data_rate_drop(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    for(uint8_t i = 0; i < 20; i++)
+        CHECK(prvAdd(i, 10) == RAK3172_OK);
+
+    /* 51 bytes at DR0: four records per uplink */
+    ucDataRate = 0;
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+
+    for(uint32_t u = 0; u < 5; u++)
+    {
+        CHECK(ulUplinks == u + 1);
+        CHECK(prvUplinkHolds(u, (uint8_t)(u * 4), 4, 10));
+        prvComplete(RAK3172_OK);
+    }
+
+    CHECK(ulUplinks == 5);
+    CHECK(!xInFlight);
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.frames == 5);
+    CHECK(stats.bytes == 220);
+    CHECK(stats.recordsLost == 0);
+
+    /* A record that no longer fits on its own is dropped */
+    prvReset(5);
+    CHECK(prvAdd(1, 100) == RAK3172_OK);
+    CHECK(prvAdd(2, 10) == RAK3172_OK);
+    ucDataRate = 0;
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+    CHECK(prvUplinkHolds(0, 2, 1, 10));
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.recordsLost == 1);
+}
+
+static void test_queue_full_retried(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    CHECK(prvAdd(1, 10) == RAK3172_OK);
+    xSubmitStatus = RAK3172_ERR_QUEUE_FULL;
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 0);
+    CHECK(xInFlight);
+
+    xSubmitStatus = RAK3172_OK;
+    vStubTickAdvance(pdMS_TO_TICKS(RAK3172_BATCH_RETRY_MS));
+    CHECK(ulUplinks == 1);
+    CHECK(prvUplinkHolds(0, 1, 1, 10));
+
+    prvComplete(RAK3172_OK);
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.frames == 1);
+    CHECK(stats.sendErrors == 0);
+    CHECK(stats.recordsLost == 0);
+}
+
+static void test_refused_chunk_dropped(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    for(uint8_t i = 0; i < 8; i++)
+        CHECK(prvAdd(i, 10) == RAK3172_OK);
+
+    /* Not joined: both DR0 chunks are dropped at once, no retry timer */
+    ucDataRate = 0;
+    xSubmitStatus = RAK3172_ERR_NO_NETWORK;
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(!xInFlight);
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.sendErrors == 2);
+    CHECK(stats.recordsLost == 8);
+
+    xSubmitStatus = RAK3172_OK;
+    vStubTickAdvance(pdMS_TO_TICKS(RAK3172_BATCH_RETRY_MS) * 2);
+    CHECK(ulUplinks == 0);
+
+    /* The buffer is free for new records */
+    CHECK(prvAdd(9, 10) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    CHECK(ulUplinks == 1);
+}
+
+static void test_duty_cycle_retries(void)
+{
+    RAK3172_BatchStats_t stats;
+
+    prvReset(5);
+
+    CHECK(prvAdd(1, 10) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+
+    /* Sent again once the off-time has run out, up to the retry limit */
+    ulDutyWaitMs = 500;
+    for(uint32_t i = 0; i < RAK3172_BATCH_MAX_RETRIES; i++)
+    {
+        CHECK(ulUplinks == i + 1);
+        prvComplete(RAK3172_ERR_DUTY_CYCLE);
+        vStubTickAdvance(pdMS_TO_TICKS(ulDutyWaitMs) - 1);
+        CHECK(ulUplinks == i + 1);
+        vStubTickAdvance(1);
+    }
+
+    CHECK(ulUplinks == RAK3172_BATCH_MAX_RETRIES + 1);
+    prvComplete(RAK3172_ERR_DUTY_CYCLE);
+    CHECK(!xInFlight);
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.retries == RAK3172_BATCH_MAX_RETRIES);
+    CHECK(stats.sendErrors == 1);
+    CHECK(stats.recordsLost == 1);
+    CHECK(stats.frames == 0);
+
+    /* A failure that is not worth another try ends the chunk at once */
+    prvReset(5);
+    CHECK(prvAdd(1, 10) == RAK3172_OK);
+    CHECK(RAK3172_BatchFlush() == RAK3172_OK);
+    prvComplete(RAK3172_ERR_TIMEOUT);
+    CHECK(!xInFlight);
+
+    RAK3172_GetBatchStats(&stats);
+    CHECK(stats.retries == 0);
+    CHECK(stats.sendErrors == 1);
+}
+
+int main(void)
+{
+    RUN(test_pack_until_full);
+    RUN(test_flush_on_age);
+    RUN(test_flush_while_in_flight);
+    RUN(test_reject_too_long);
+    RUN(test_split_on_data_rate_drop);
+    RUN(test_queue_full_retried);
+    RUN(test_refused_chunk_dropped);
+    RUN(test_duty_cycle_retries);
+
+    return ulTestFailures ? 1 : 0;
+}
@@ -0,0 +1,330 @@
+#include "test.h"
+#include "stub_kernel.h"
+#include "rak3172_bulk.h"
+#include "rak3172_p2p.h"
+#include <stdbool.h>
+#include <string.h>
+#include <ucontext.h>
+
+uint32_t ulTestFailures = 0;
+
+/* Sender and receiver run as coroutines on the fake tick. A frame is on
+ * the air for a time that grows with its length and lands in the peer
+ * inbox afterwards, unless the channel drops it. When neither end can
+ * run, the tick jumps to the earliest wake-up. */
+
+#define TEST_STACK_SIZE     (256 * 1024)
+#define TEST_INBOX_LEN      RAK3172_P2P_RING_LEN
+
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint8_t length;
+} TestFrame_t;
+
+typedef struct xTEST_END
+{
+    ucontext_t ctx;
+    struct xTEST_END *peer;
+    TestFrame_t inbox[TEST_INBOX_LEN];
+    uint8_t head;
+    uint8_t count;
+    uint8_t lossPct;            /* Of the frames this end sends */
+    TickType_t wake;
+    bool waitFrame;             /* A frame wakes it before wake */
+    bool done;
+} TestEnd_t;
+
+static ucontext_t xMainCtx;
+static TestEnd_t xEnd[2];
+static RAK3172_BulkLink_t xLink[2];
+static uint8_t ucStack[2][TEST_STACK_SIZE];
+static uint32_t ulSeed;
+
+static uint8_t ucSource[RAK3172_BULK_CHUNK * RAK3172_BULK_MAX_FRAGMENTS];
+static uint8_t ucDest[RAK3172_BULK_CHUNK * RAK3172_BULK_MAX_FRAGMENTS];
+static size_t xLength;
+static size_t xRxLength;
+static RAK3172_Status_t xTxStatus;
+static RAK3172_Status_t xRxStatus;
+static RAK3172_BulkStats_t xTxStats;
+static RAK3172_BulkStats_t xRxStats;
+
+/* Never used, the P2P link is not under test */
+RAK3172_Status_t RAK3172_P2pSend(const uint8_t *data, uint8_t length)
+{
+    (void)data; (void)length;
+    return RAK3172_ERR_INVALID;
+}
+
+uint32_t RAK3172_P2pAirtimeUs(uint8_t length)
+{
+    (void)length;
+    return 0;
+}
+
+BaseType_t RAK3172_P2pRead(RAK3172_P2pPacket_t *packet, uint32_t timeout_ms)
+{
+    (void)packet; (void)timeout_ms;
+    return pdFAIL;
+}
+
+static uint32_t prvRandom(void)
+{
+    ulSeed = ulSeed * 1103515245u + 12345u;
+    return ulSeed >> 16;
+}
+
+/* Back to the scheduler until the tick reaches wake, or a frame arrives */
+static void prvWait(TestEnd_t *end, TickType_t wake, bool waitFrame)
+{
+    end->wake = wake;
+    end->waitFrame = waitFrame;
+    swapcontext(&end->ctx, &xMainCtx);
+}
+
+/* Roughly SF7 at 125 kHz: 20 ms preamble and header, 1.6 ms per byte */
+static uint32_t prvAirtimeMs(void *ctx, uint8_t length)
+{
+    (void)ctx;
+    return 20 + (uint32_t)length * 8 / 5;
+}
+
+static RAK3172_Status_t prvSend(void *ctx, const uint8_t *data, uint8_t length)
+{
+    TestEnd_t *end = ctx;
+    TestEnd_t *peer = end->peer;
+
+    /* Returns once the frame is off the air */
+    prvWait(end, xTaskGetTickCount() + prvAirtimeMs(ctx, length), false);
+
+    if(prvRandom() % 100 < end->lossPct || peer->count == TEST_INBOX_LEN)
+        return RAK3172_OK;
+
+    TestFrame_t *pxFrame = &peer->inbox[(peer->head + peer->count) % TEST_INBOX_LEN];
+    memcpy(pxFrame->data, data, length);
+    pxFrame->length = length;
+    peer->count++;
+
+    return RAK3172_OK;
+}
+
+static BaseType_t prvRecv(void *ctx, uint8_t *data, uint8_t *length, uint32_t timeout_ms)
+{
+    TestEnd_t *end = ctx;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+
+    while(end->count == 0)
+    {
+        if((int32_t)(xTaskGetTickCount() - deadline) >= 0)
+            return pdFAIL;
+        prvWait(end, deadline, true);
+    }
+
+    TestFrame_t *pxFrame = &end->inbox[end->head];
+    memcpy(data, pxFrame->data, pxFrame->length);
+    *length = pxFrame->length;
+    end->head = (end->head + 1) % TEST_INBOX_LEN;
+    end->count--;
+
+    return pdPASS;
+}
+
+static void prvSenderMain(void)
+{
+    xTxStatus = RAK3172_BulkSend(&xLink[0], 7, ucSource, xLength, &xTxStats);
+    xEnd[0].done = true;
+}
+
+static void prvReceiverMain(void)
+{
+    xRxStatus = RAK3172_BulkReceive(&xLink[1], ucDest, sizeof(ucDest), &xRxLength,
+                                    RAK3172_BULK_ACK_TIMEOUT_MS * RAK3172_BULK_MAX_TIMEOUTS, &xRxStats);
+    xEnd[1].done = true;
+}
+
+static bool prvReady(const TestEnd_t *end)
+{
+    if(end->done)
+        return false;
+
+    return (int32_t)(xTaskGetTickCount() - end->wake) >= 0 || (end->waitFrame && end->count > 0);
+}
+
+/* Transfer length bytes, dataLossPct % of the data frames and ackLossPct %
+ * of the ACKs lost. Returns the simulated time taken. */
+static uint32_t prvTransfer(size_t length, uint8_t dataLossPct, uint8_t ackLossPct, uint32_t seed)
+{
+    void (*entry[2])(void) = { prvSenderMain, prvReceiverMain };
+
+    vStubKernelReset();
+    ulSeed = seed;
+    xLength = length;
+    for(size_t i = 0; i < length; i++)
+        ucSource[i] = (uint8_t)prvRandom();
+    memset(ucDest, 0, sizeof(ucDest));
+    xRxLength = 0;
+
+    memset(xEnd, 0, sizeof(xEnd));
+    for(int i = 0; i < 2; i++)
+    {
+        xEnd[i].peer = &xEnd[i ^ 1];
+        xLink[i].send = prvSend;
+        xLink[i].recv = prvRecv;
+        xLink[i].airtimeMs = prvAirtimeMs;
+        xLink[i].ctx = &xEnd[i];
+
+        getcontext(&xEnd[i].ctx);
+        xEnd[i].ctx.uc_stack.ss_sp = ucStack[i];
+        xEnd[i].ctx.uc_stack.ss_size = sizeof(ucStack[i]);
+        xEnd[i].ctx.uc_link = &xMainCtx;
+        makecontext(&xEnd[i].ctx, entry[i], 0);
+    }
+    xEnd[0].lossPct = dataLossPct;
+    xEnd[1].lossPct = ackLossPct;
+
+    while(!xEnd[0].done || !xEnd[1].done)
+    {
+        bool ran = false;
+
+        for(int i = 0; i < 2; i++)
+        {
+            if(prvReady(&xEnd[i]))
+            {
+                swapcontext(&xMainCtx, &xEnd[i].ctx);
+                ran = true;
+            }
+        }
+
+        if(ran)
+            continue;
+
+        /* Both waiting: move on to the first wake-up */
+        TickType_t next = 0;
+        bool found = false;
+        for(int i = 0; i < 2; i++)
+        {
+            if(!xEnd[i].done && (!found || (int32_t)(xEnd[i].wake - next) < 0))
+            {
+                next = xEnd[i].wake;
+                found = true;
+            }
+        }
+        vStubTickSet(next);
+    }
+
+    return pdTICKS_TO_MS(xTaskGetTickCount());
+}
+
+static void prvCheckDelivered(void)
+{
+    CHECK(xTxStatus == RAK3172_OK);
+    CHECK(xRxStatus == RAK3172_OK);
+    CHECK(xRxLength == xLength);
+    CHECK(memcmp(ucDest, ucSource, xLength) == 0);
+    CHECK(xTxStats.bytes == xLength);
+    CHECK(xRxStats.bytes == xLength);
+    CHECK(xTxStats.fragments == (xLength + RAK3172_BULK_CHUNK - 1) / RAK3172_BULK_CHUNK);
+    CHECK(xTxStats.framesSent == xTxStats.fragments + xTxStats.retransmissions);
+}
+
+static void test_no_loss(void)
+{
+    prvTransfer(4000, 0, 0, 1);
+    prvCheckDelivered();
+
+    /* 20 fragments in bursts of 4, 5, 6 and the last 5: one ACK each */
+    CHECK(xTxStats.retransmissions == 0);
+    CHECK(xTxStats.timeouts == 0);
+    CHECK(xRxStats.duplicates == 0);
+    CHECK(xRxStats.framesSent == 4);
+    CHECK(xTxStats.windowMin == RAK3172_BULK_WINDOW_INIT);
+    CHECK(xTxStats.window == RAK3172_BULK_WINDOW_INIT + 4);
+    CHECK(xTxStats.windowMax == xTxStats.window);
+
+    /* A long clean transfer opens the window all the way */
+    prvTransfer(sizeof(ucSource), 0, 0, 2);
+    prvCheckDelivered();
+    CHECK(xTxStats.retransmissions == 0);
+    CHECK(xTxStats.windowMax > 16);
+
+    /* Short last fragment */
+    prvTransfer(10007, 0, 0, 3);
+    prvCheckDelivered();
+}
+
+static void test_data_loss(void)
+{
+    static const uint8_t lossPct[] = { 5, 10, 20, 30 };
+
+    for(size_t l = 0; l < sizeof(lossPct); l++)
+    {
+        for(uint32_t seed = 1; seed <= 5; seed++)
+        {
+            uint32_t ms = prvTransfer(20003, lossPct[l], 0, seed * 31 + l);
+            prvCheckDelivered();
+
+            /* Only lost fragments go again, the window backs off */
+            CHECK(xTxStats.retransmissions > 0);
+            CHECK(xTxStats.windowMin < xTxStats.windowMax);
+            CHECK(xTxStats.retransmissions <= xTxStats.fragments);
+
+            if(seed == 1)
+                printf("  data loss %2u %%: %3u retransmissions, %u timeouts, window %u..%u, %u B/s (%u ms)\n",
+                       lossPct[l], xTxStats.retransmissions, xTxStats.timeouts,
+                       xTxStats.windowMin, xTxStats.windowMax, xTxStats.bytesPerSec, ms);
+        }
+    }
+}
+
+static void test_ack_loss(void)
+{
+    uint32_t timeouts = 0;
+    uint32_t duplicates = 0;
+
+    /* Every fragment arrives: a lost ACK costs a timeout and duplicates,
+     * the window drops to one after each */
+    for(uint32_t seed = 1; seed <= 5; seed++)
+    {
+        prvTransfer(20000, 0, 30, seed);
+        prvCheckDelivered();
+        CHECK(xRxStats.duplicates == xTxStats.retransmissions);
+
+        timeouts += xTxStats.timeouts;
+        duplicates += xRxStats.duplicates;
+        if(xTxStats.timeouts > 0)
+            CHECK(xTxStats.windowMin == 1);
+    }
+
+    CHECK(timeouts > 0);
+    CHECK(duplicates > 0);
+
+    /* Both ways at once */
+    for(uint32_t seed = 1; seed <= 5; seed++)
+    {
+        prvTransfer(20000, 20, 20, seed);
+        prvCheckDelivered();
+    }
+}
+
+static void test_dead_link(void)
+{
+    uint32_t ms = prvTransfer(1000, 100, 0, 1);
+
+    CHECK(xTxStatus == RAK3172_ERR_TIMEOUT);
+    CHECK(xRxStatus == RAK3172_ERR_TIMEOUT);
+    CHECK(xRxLength == 0);
+    CHECK(xTxStats.timeouts == RAK3172_BULK_MAX_TIMEOUTS);
+    CHECK(xTxStats.window == 1);
+    CHECK(xRxStats.framesReceived == 0);
+    CHECK(ms >= RAK3172_BULK_ACK_TIMEOUT_MS * RAK3172_BULK_MAX_TIMEOUTS);
+}
+
+int main(void)
+{
+    RUN(test_no_loss);
+    RUN(test_data_loss);
+    RUN(test_ack_loss);
+    RUN(test_dead_link);
+
+    return ulTestFailures ? 1 : 0;
+}
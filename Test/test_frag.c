@@ -0,0 +1,345 @@
+#include "test.h"
+#include "stub_kernel.h"
+#include "rak3172_frag.c"
+
+uint32_t ulTestFailures = 0;
+
+/* Frames queued on the scheduler */
+typedef struct {
+    uint8_t data[RAK3172_MAX_PAYLOAD];
+    uint8_t length;
+    uint8_t priority;
+} TestFrame_t;
+
+#define TEST_MAX_FRAMES     64
+
+static TestFrame_t xSent[TEST_MAX_FRAMES];
+static uint32_t ulSent;
+static uint32_t ulQueueFull;            /* Refuse this many frames first */
+static RAK3172_RxCallback_t pxHandler;
+static const uint8_t *pucDelivered;
+static size_t xDeliveredLength;
+
+RAK3172_Status_t RAK3172_SchedSend(uint8_t port, const uint8_t *data, uint8_t length, uint8_t priority)
+{
+    if(port != RAK3172_FRAG_PORT)
+        return RAK3172_ERR_INVALID;
+
+    if(ulQueueFull > 0)
+    {
+        ulQueueFull--;
+        return RAK3172_ERR_QUEUE_FULL;
+    }
+
+    if(ulSent < TEST_MAX_FRAMES)
+    {
+        memcpy(xSent[ulSent].data, data, length);
+        xSent[ulSent].length = length;
+        xSent[ulSent].priority = priority;
+    }
+    ulSent++;
+
+    return RAK3172_OK;
+}
+
+BaseType_t RAK3172_RegisterPortHandler(uint8_t port, RAK3172_RxCallback_t callback)
+{
+    if(port != RAK3172_FRAG_PORT)
+        return pdFAIL;
+
+    pxHandler = callback;
+    return pdPASS;
+}
+
+uint8_t RAK3172_GetMaxPayload(void)
+{
+    return 222;
+}
+
+static void prvBlockDone(const uint8_t *block, size_t length)
+{
+    pucDelivered = block;
+    xDeliveredLength = length;
+}
+
+static void prvReset(void)
+{
+    vStubKernelReset();
+    memset(&xFragStats, 0, sizeof(xFragStats));
+    ucUplinkIndex = 0;
+    ulSent = 0;
+    ulQueueFull = 0;
+    pucDelivered = NULL;
+    xDeliveredLength = 0;
+}
+
+/* Downlink on the fragmentation port */
+static void prvDownlink(const uint8_t *data, size_t length)
+{
+    RAK3172_RxData_t xRx = {0};
+
+    xRx.port = RAK3172_FRAG_PORT;
+    memcpy(xRx.data, data, length);
+    xRx.length = (uint16_t)length;
+    pxHandler(&xRx);
+}
+
+static void prvSource(uint8_t *data, size_t length, uint32_t seed)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+/* Encode every fragment, drop those lost[] marks, decode the rest. Returns
+ * the fragments fed to the decoder before it completed, 0 if it did not. */
+static uint32_t prvTransfer(const uint8_t *source, size_t length, uint8_t size, uint16_t nbParity,
+                            const bool *lost)
+{
+    uint8_t frame[FRAG_HEADER_LEN + RAK3172_FRAG_MAX_SIZE];
+    uint8_t line[FRAG_MAP_BYTES];
+    uint16_t nbFrag = (uint16_t)((length + size - 1) / size);
+    uint32_t delivered = 0;
+
+    prvSessionReset(0, nbFrag, size, (uint8_t)(nbFrag * size - length));
+
+    for(uint16_t n = 1; n <= nbFrag + nbParity && !xFragStats.complete; n++)
+    {
+        if(lost[n - 1])
+            continue;
+
+        CHECK(prvEncode(frame, line, source, length, size, nbFrag, 0, n) == FRAG_HEADER_LEN + size);
+        prvDataFragment(n, &frame[FRAG_HEADER_LEN], size);
+        delivered++;
+    }
+
+    return xFragStats.complete ? delivered : 0;
+}
+
+static void test_matrix_line(void)
+{
+    uint8_t line[FRAG_MAP_BYTES];
+    uint8_t other[FRAG_MAP_BYTES];
+
+    /* One fragment is repeated */
+    prvMatrixLine(line, 1, 1);
+    CHECK(prvOnlyBit(line, 1, 0));
+
+    for(uint16_t m = 2; m <= RAK3172_FRAG_MAX_FRAGMENTS; m = (uint16_t)(m * 2 + 1))
+    {
+        for(uint16_t n = 1; n <= 8; n++)
+        {
+            uint16_t bits = 0;
+
+            prvMatrixLine(line, n, m);
+            for(uint16_t col = 0; col < RAK3172_FRAG_MAX_FRAGMENTS; col++)
+            {
+                if(prvTestBit(line, col))
+                {
+                    CHECK(col < m);
+                    bits++;
+                }
+            }
+            CHECK(bits > 0 && bits <= m / 2);
+
+            /* Same line for the same n, another one for the next */
+            prvMatrixLine(other, n, m);
+            CHECK(memcmp(line, other, sizeof(line)) == 0);
+            prvMatrixLine(other, n + 1, m);
+            CHECK(m < 16 || memcmp(line, other, sizeof(line)) != 0);
+        }
+    }
+}
+
+static void test_no_loss(void)
+{
+    static uint8_t source[1000];
+    bool lost[64] = {false};
+
+    prvReset();
+    prvSource(source, sizeof(source), 1);
+
+    /* 20 fragments of 50 bytes, then 10 bytes less: the last one padded */
+    CHECK(prvTransfer(source, sizeof(source), 50, 0, lost) == 20);
+    CHECK(memcmp(ucBlock, source, sizeof(source)) == 0);
+    CHECK(prvTransfer(source, 990, 50, 0, lost) == 20);
+    CHECK(xFragStats.complete);
+    CHECK(xFragStats.recovered == 0);
+    CHECK(prvBlockLength() == 990);
+    CHECK(memcmp(ucBlock, source, 990) == 0);
+
+    /* Anything after completion is a duplicate */
+    prvDataFragment(1, source, 50);
+    CHECK(xFragStats.duplicates == 1);
+}
+
+static void test_parity_fills_gaps(void)
+{
+    static uint8_t source[1200];
+    bool lost[64] = {false};
+
+    prvReset();
+    prvSource(source, sizeof(source), 2);
+
+    /* 30 fragments of 40 bytes, three of them lost */
+    lost[1] = lost[9] = lost[29] = true;
+    uint32_t delivered = prvTransfer(source, sizeof(source), 40, 15, lost);
+
+    CHECK(delivered >= 30);
+    CHECK(xFragStats.received == 27);
+    CHECK(xFragStats.recovered == 3);
+    CHECK(memcmp(ucBlock, source, sizeof(source)) == 0);
+
+    /* Every uncoded fragment lost: parity alone rebuilds the block */
+    prvReset();
+    memset(lost, 0, sizeof(lost));
+    for(int i = 0; i < 8; i++)
+        lost[i] = true;
+    delivered = prvTransfer(source, 320, 40, 40, lost);
+
+    CHECK(delivered >= 8);
+    CHECK(xFragStats.received == 0);
+    CHECK(xFragStats.recovered == 8);
+    CHECK(memcmp(ucBlock, source, 320) == 0);
+}
+
+static void test_loss_sweep(void)
+{
+    /* Loss rate, blocks rebuilt at least. Past 10 % a run may not get 40
+     * independent fragments through. */
+    static const struct { uint8_t lossPct; uint8_t minPct; } xCases[] = {
+        { 0, 100 }, { 5, 100 }, { 10, 100 }, { 20, 95 }, { 30, 95 }, { 40, 80 },
+    };
+    static uint8_t source[2000];
+    bool lost[RAK3172_FRAG_MAX_FRAGMENTS];
+    uint32_t seed = 3;
+
+    /* 40 fragments and 40 parity: completes whenever 40 independent
+     * fragments get through and no more than 32 are missing at once */
+    for(size_t c = 0; c < sizeof(xCases) / sizeof(xCases[0]); c++)
+    {
+        uint32_t recovered = 0;
+        uint32_t needed = 0;
+        const uint32_t runs = 100;
+
+        for(uint32_t run = 0; run < runs; run++)
+        {
+            prvReset();
+            prvSource(source, sizeof(source), ++seed);
+
+            for(int i = 0; i < 80; i++)
+            {
+                seed = seed * 1103515245u + 12345u;
+                lost[i] = ((seed >> 16) % 100) < xCases[c].lossPct;
+            }
+
+            uint32_t delivered = prvTransfer(source, sizeof(source), 50, 40, lost);
+            if(delivered)
+            {
+                /* A completed block is always the right one */
+                CHECK(memcmp(ucBlock, source, sizeof(source)) == 0);
+                CHECK(delivered >= 40);
+                CHECK(xFragStats.received + xFragStats.recovered == 40);
+                recovered++;
+                needed += delivered;
+            }
+        }
+
+        printf("  loss %2u %%: %3u/%u blocks, %.1f fragments per block of 40\n",
+               xCases[c].lossPct, recovered, runs, recovered ? (double)needed / recovered : 0.0);
+
+        CHECK(recovered * 100 >= runs * xCases[c].minPct);
+    }
+}
+
+static void test_session_setup(void)
+{
+    uint8_t setup[FRAG_SETUP_LEN] = { FRAG_CID_SESSION_SETUP, 1 << 4, 4, 0, 50, 0, 20, 0, 0, 0, 0 };
+
+    prvReset();
+    CHECK(RAK3172_FragInit() == RAK3172_OK);
+    CHECK(pxHandler != NULL);
+
+    /* A matrix other than the default is refused */
+    setup[5] = 1 << 3;
+    prvDownlink(setup, sizeof(setup));
+    CHECK(ulSent == 1);
+    CHECK(xSent[0].length == 2);
+    CHECK(xSent[0].data[0] == FRAG_CID_SESSION_SETUP);
+    CHECK(xSent[0].data[1] == ((1 << 6) | 0x01));
+    CHECK(!xFragStats.active);
+
+    /* BlockAckDelay in bits 2:0 does not matter */
+    setup[5] = 0x05;
+    prvDownlink(setup, sizeof(setup));
+    CHECK(ulSent == 2);
+    CHECK(xSent[1].data[1] == (1 << 6));
+    CHECK(xFragStats.active);
+    CHECK(xFragStats.index == 1);
+    CHECK(xFragStats.nbFrag == 4);
+    CHECK(xFragStats.sessions == 1);
+
+    /* Too big for the buffer */
+    setup[2] = 0xFF;
+    setup[3] = 0x00;
+    setup[4] = 240;
+    setup[5] = 0;
+    prvDownlink(setup, sizeof(setup));
+    CHECK(xSent[2].data[1] == ((1 << 6) | 0x02));
+    CHECK(xFragStats.nbFrag == 4);
+}
+
+/* What RAK3172_FragSend() queues, fed back as downlinks, is the block */
+static void test_send_loopback(void)
+{
+    static uint8_t source[1500];
+
+    prvReset();
+    prvSource(source, sizeof(source), 4);
+    CHECK(RAK3172_FragInit() == RAK3172_OK);
+    RAK3172_FragSetCallback(prvBlockDone);
+
+    /* 219 byte fragments: 7 uncoded and 2 parity, after a full queue */
+    ulQueueFull = 2;
+    CHECK(RAK3172_FragSend(source, sizeof(source), 0, 25) == RAK3172_OK);
+    CHECK(xTaskGetTickCount() == 2 * pdMS_TO_TICKS(RAK3172_FRAG_RETRY_MS));
+    CHECK(ulSent == 1 + 7 + 2);
+    CHECK(xSent[0].length == FRAG_SETUP_LEN);
+    CHECK(xSent[1].length == FRAG_HEADER_LEN + 219);
+    CHECK(xFragStats.uplinkFragments == 9);
+
+    /* Lose the fifth and sixth fragment, parity lines 1 and 2 over 7
+     * fragments cover one of them each */
+    uint32_t frames = ulSent;
+    for(uint32_t i = 0; i < frames; i++)
+    {
+        if(i != 5 && i != 6)
+            prvDownlink(xSent[i].data, xSent[i].length);
+    }
+
+    CHECK(xFragStats.complete);
+    CHECK(xFragStats.recovered == 2);
+    CHECK(pucDelivered == ucBlock);
+    CHECK(xDeliveredLength == sizeof(source));
+    CHECK(memcmp(ucBlock, source, sizeof(source)) == 0);
+
+    size_t length = 0;
+    CHECK(RAK3172_FragGetBlock(&length) == ucBlock);
+    CHECK(length == sizeof(source));
+
+    RAK3172_FragSetCallback(NULL);
+}
+
+int main(void)
+{
+    RUN(test_matrix_line);
+    RUN(test_no_loss);
+    RUN(test_parity_fills_gaps);
+    RUN(test_loss_sweep);
+    RUN(test_session_setup);
+    RUN(test_send_loopback);
+
+    return ulTestFailures ? 1 : 0;
+}
@@ -0,0 +1,308 @@
+#include "test.h"
+#include "stub_kernel.h"
+#include "rak3172_lb.c"
+#include "rak3172_sched.c"
+
+uint32_t ulTestFailures = 0;
+
+/* Stand-in module: takes uplinks and holds their callbacks until the test
+ * completes them. A sent uplink charges the module's duty cycle in
+ * rak3172_sched.c like the driver task does. */
+#define TEST_MAX_PENDING    RAK3172_LB_SLOTS
+
+struct RAK3172_Dev {
+    bool open;
+    bool joined;
+    RAK3172_Status_t submitStatus;
+    uint32_t uplinks;
+    uint32_t joins;
+    uint16_t length[TEST_MAX_PENDING];
+    const uint8_t *data[TEST_MAX_PENDING];
+    RAK3172_CmdCallback_t callback[TEST_MAX_PENDING];
+    void *ctx[TEST_MAX_PENDING];
+    uint8_t pending;
+};
+
+static struct RAK3172_Dev xDevs[RAK3172_MAX_DEVICES];
+static RAK3172_Region_t xRegion;
+static uint32_t ulJoinStarts;
+
+/* Uplink results seen by the caller */
+static uint32_t ulDone[RAK3172_ERR_NO_ACK + 1];
+static void *pvLastCtx;
+
+RAK3172_Dev_t *RAK3172_GetDev(uint8_t index)
+{
+    return (index < RAK3172_MAX_DEVICES && xDevs[index].open) ? &xDevs[index] : NULL;
+}
+
+uint8_t RAK3172_DevIndex(const RAK3172_Dev_t *dev)
+{
+    return (uint8_t)(dev - xDevs);
+}
+
+bool RAK3172_DevIsJoined(const RAK3172_Dev_t *dev)
+{
+    return dev->joined;
+}
+
+RAK3172_Status_t RAK3172_DevSubmitSend(RAK3172_Dev_t *dev, uint8_t port, const uint8_t *data, uint16_t length,
+                                       RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    (void)port; (void)timeout_ms;
+
+    if(dev->submitStatus != RAK3172_OK)
+        return dev->submitStatus;
+    if(dev->pending == TEST_MAX_PENDING)
+        return RAK3172_ERR_QUEUE_FULL;
+
+    dev->data[dev->pending] = data;
+    dev->length[dev->pending] = length;
+    dev->callback[dev->pending] = callback;
+    dev->ctx[dev->pending] = ctx;
+    dev->pending++;
+    dev->uplinks++;
+    return RAK3172_OK;
+}
+
+RAK3172_Status_t RAK3172_DevSubmitCommand(RAK3172_Dev_t *dev, const char *cmd,
+                                          RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    (void)callback; (void)ctx; (void)timeout_ms;
+
+    if(strncmp(cmd, "AT+JOIN=", 8) == 0)
+        dev->joins++;
+    return RAK3172_OK;
+}
+
+RAK3172_Status_t RAK3172_JoinStart(void)
+{
+    ulJoinStarts++;
+    return RAK3172_OK;
+}
+
+/* The primary module, for rak3172_sched.c */
+RAK3172_Status_t RAK3172_SubmitSend(uint8_t port, const uint8_t *data, uint16_t length,
+                                    RAK3172_CmdCallback_t callback, void *ctx, uint32_t timeout_ms)
+{
+    return RAK3172_DevSubmitSend(&xDevs[0], port, data, length, callback, ctx, timeout_ms);
+}
+
+uint8_t RAK3172_GetDataRate(void)
+{
+    return 5;
+}
+
+RAK3172_Region_t RAK3172_GetRegion(void)
+{
+    return xRegion;
+}
+
+/* The module reports its oldest uplink */
+static void prvComplete(RAK3172_Dev_t *dev, RAK3172_Status_t status)
+{
+    if(dev->pending == 0)
+    {
+        CHECK(dev->pending > 0);
+        return;
+    }
+
+    RAK3172_CmdCallback_t callback = dev->callback[0];
+    void *ctx = dev->ctx[0];
+
+    if(status == RAK3172_OK)
+        RAK3172_DevDutyCycleCharge(dev, RAK3172_UplinkAirtimeUs(5, dev->length[0]));
+
+    dev->pending--;
+    memmove(&dev->data[0], &dev->data[1], dev->pending * sizeof(dev->data[0]));
+    memmove(&dev->length[0], &dev->length[1], dev->pending * sizeof(dev->length[0]));
+    memmove(&dev->callback[0], &dev->callback[1], dev->pending * sizeof(dev->callback[0]));
+    memmove(&dev->ctx[0], &dev->ctx[1], dev->pending * sizeof(dev->ctx[0]));
+
+    callback(status, "", ctx);
+}
+
+static void prvDone(RAK3172_Status_t status, const char *response, void *ctx)
+{
+    (void)response;
+
+    ulDone[status]++;
+    pvLastCtx = ctx;
+}
+
+static void prvReset(RAK3172_Region_t region)
+{
+    vStubKernelReset();
+
+    memset(xSlots, 0, sizeof(xSlots));
+    memset(&xLbStats, 0, sizeof(xLbStats));
+    ucNextDev = 0;
+    memset(xBandState, 0, sizeof(xBandState));
+
+    memset(xDevs, 0, sizeof(xDevs));
+    for(int i = 0; i < RAK3172_MAX_DEVICES; i++)
+    {
+        xDevs[i].open = true;
+        xDevs[i].joined = true;
+    }
+
+    xRegion = region;
+    ulJoinStarts = 0;
+    memset(ulDone, 0, sizeof(ulDone));
+    pvLastCtx = NULL;
+}
+
+static RAK3172_Status_t prvSend(uint8_t value)
+{
+    uint8_t data[10];
+
+    memset(data, value, sizeof(data));
+    return RAK3172_LbSend(2, data, sizeof(data), prvDone, &xDevs);
+}
+
+/* No duty-cycle limit in US915: the load alone decides */
+static void test_least_loaded(void)
+{
+    RAK3172_LbStats_t stats;
+
+    prvReset(RAK3172_REGION_US915);
+
+    /* Round robin on a tie */
+    CHECK(prvSend(1) == RAK3172_OK);
+    CHECK(prvSend(2) == RAK3172_OK);
+    CHECK(prvSend(3) == RAK3172_OK);
+    CHECK(xDevs[0].uplinks == 2);
+    CHECK(xDevs[1].uplinks == 1);
+
+    /* The payload was copied */
+    CHECK(xDevs[0].data[0][0] == 1);
+    CHECK(xDevs[1].data[0][0] == 2);
+    CHECK(xDevs[0].data[1][0] == 3);
+
+    /* Module 1 has fewer in flight */
+    CHECK(prvSend(4) == RAK3172_OK);
+    CHECK(xDevs[1].uplinks == 2);
+
+    /* Every slot taken */
+    CHECK(prvSend(5) == RAK3172_ERR_QUEUE_FULL);
+
+    /* Module 1 frees its uplinks first, so it gets the next ones */
+    prvComplete(&xDevs[1], RAK3172_OK);
+    CHECK(ulDone[RAK3172_OK] == 1);
+    CHECK(pvLastCtx == &xDevs);
+    CHECK(prvSend(6) == RAK3172_OK);
+    CHECK(xDevs[1].uplinks == 3);
+
+    prvComplete(&xDevs[1], RAK3172_OK);
+    prvComplete(&xDevs[1], RAK3172_ERR_NO_NETWORK);
+    CHECK(ulDone[RAK3172_ERR_NO_NETWORK] == 1);
+    CHECK(prvSend(7) == RAK3172_OK);
+    CHECK(xDevs[1].uplinks == 4);
+
+    RAK3172_GetLbStats(&stats);
+    CHECK(stats.submitted == 7);
+    CHECK(stats.noSlot == 1);
+    CHECK(stats.noModule == 0);
+    CHECK(stats.dev[0].inFlight == 2);
+    CHECK(stats.dev[1].inFlight == 1);
+    CHECK(stats.dev[1].sent == 2);
+    CHECK(stats.dev[1].errors == 1);
+}
+
+/* EU868: a module whose sub-band is off is skipped */
+static void test_duty_cycle(void)
+{
+    RAK3172_LbStats_t stats;
+
+    prvReset(RAK3172_REGION_EU868);
+
+    CHECK(prvSend(1) == RAK3172_OK);
+    prvComplete(&xDevs[0], RAK3172_OK);
+    uint32_t waitMs = RAK3172_DevDutyCycleWaitMs(&xDevs[0]);
+    CHECK(waitMs > 0);
+    CHECK(RAK3172_DevDutyCycleWaitMs(&xDevs[1]) == 0);
+
+    /* Module 0 is idle but off */
+    CHECK(prvSend(2) == RAK3172_OK);
+    CHECK(prvSend(3) == RAK3172_OK);
+    CHECK(xDevs[0].uplinks == 1);
+    CHECK(xDevs[1].uplinks == 2);
+
+    /* Both off */
+    prvComplete(&xDevs[1], RAK3172_OK);
+    CHECK(prvSend(4) == RAK3172_ERR_DUTY_CYCLE);
+
+    /* The primary's budget is back first */
+    vStubTickAdvance(pdMS_TO_TICKS(waitMs));
+    CHECK(RAK3172_DutyCycleWaitMs() == 0);
+    CHECK(prvSend(5) == RAK3172_OK);
+    CHECK(xDevs[0].uplinks == 2);
+
+    RAK3172_GetLbStats(&stats);
+    CHECK(stats.noModule == 1);
+    CHECK(stats.dev[0].sent == 1);
+    CHECK(stats.dev[1].sent == 1);
+    CHECK(stats.dev[1].inFlight == 1);
+}
+
+static void test_unavailable_module(void)
+{
+    RAK3172_LbStats_t stats;
+
+    prvReset(RAK3172_REGION_US915);
+
+    /* Not joined, then not fitted: everything goes to the primary */
+    xDevs[1].joined = false;
+    CHECK(prvSend(1) == RAK3172_OK);
+    CHECK(prvSend(2) == RAK3172_OK);
+    xDevs[1].open = false;
+    CHECK(prvSend(3) == RAK3172_OK);
+    CHECK(xDevs[0].uplinks == 3);
+    CHECK(xDevs[1].uplinks == 0);
+
+    /* No module joined */
+    xDevs[0].joined = false;
+    CHECK(prvSend(4) == RAK3172_ERR_DUTY_CYCLE);
+
+    /* A refused uplink frees its slot */
+    xDevs[0].joined = true;
+    xDevs[0].submitStatus = RAK3172_ERR_QUEUE_FULL;
+    CHECK(prvSend(5) == RAK3172_ERR_QUEUE_FULL);
+    xDevs[0].submitStatus = RAK3172_OK;
+    CHECK(prvSend(6) == RAK3172_OK);
+
+    RAK3172_GetLbStats(&stats);
+    CHECK(stats.noModule == 1);
+    CHECK(stats.dev[0].errors == 1);
+    CHECK(stats.dev[0].inFlight == 4);
+
+    CHECK(RAK3172_LbSend(2, NULL, 4, prvDone, NULL) == RAK3172_ERR_INVALID);
+    CHECK(prvSend(0) == RAK3172_ERR_QUEUE_FULL);
+}
+
+static void test_join(void)
+{
+    prvReset(RAK3172_REGION_EU868);
+
+    /* The primary through the join state machine, the others directly */
+    xDevs[1].joined = false;
+    CHECK(RAK3172_LbJoin() == RAK3172_OK);
+    CHECK(ulJoinStarts == 1);
+    CHECK(xDevs[0].joins == 0);
+    CHECK(xDevs[1].joins == 1);
+
+    xDevs[1].joined = true;
+    CHECK(RAK3172_LbJoin() == RAK3172_OK);
+    CHECK(ulJoinStarts == 2);
+    CHECK(xDevs[1].joins == 1);
+}
+
+int main(void)
+{
+    RUN(test_least_loaded);
+    RUN(test_duty_cycle);
+    RUN(test_unavailable_module);
+    RUN(test_join);
+
+    return ulTestFailures ? 1 : 0;
+}
@@ -0,0 +1,512 @@
+#include "test.h"
+#include "rak3172_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Log region used by most tests: 4 sectors of 16 slots */
+#define SECTOR_SIZE     4096u
+#define SECTORS         4u
+#define SLOTS           (SECTORS * SECTOR_SIZE / RAK3172_LOG_SLOT_SIZE)
+
+/* Pending records the power-loss workload keeps, well under a sector's
+ * worth so a wrap never drops a record */
+#define WORKLOAD_RECORDS    200
+#define WORKLOAD_PENDING    10
+
+uint32_t ulTestFailures = 0;
+
+/* NOR flash in RAM. Program can only clear bits, erase sets a sector to
+ * 0xFF. With opsLeft >= 0 power fails on that operation: only its first
+ * tornBytes reach the flash and every later operation fails. */
+typedef struct {
+    uint8_t *mem;
+    uint32_t size;
+    int32_t opsLeft;
+    uint32_t tornBytes;
+    bool dead;
+    uint32_t ops;
+    uint32_t programs;
+    uint32_t erases;
+    uint64_t readBytes;
+} RamFlash_t;
+
+static void prvRamRead(void *ctx, uint32_t offset, void *buf, size_t len)
+{
+    RamFlash_t *flash = ctx;
+
+    CHECK(offset + len <= flash->size);
+    memcpy(buf, &flash->mem[offset], len);
+    flash->readBytes += len;
+}
+
+/* Count the operation, false once power is gone. *limit is how many
+ * bytes of it reach the flash. */
+static bool prvRamPower(RamFlash_t *flash, size_t len, size_t *limit)
+{
+    *limit = len;
+
+    if(flash->dead)
+        return false;
+
+    flash->ops++;
+
+    if(flash->opsLeft < 0)
+        return true;
+
+    if(flash->opsLeft-- > 0)
+        return true;
+
+    flash->dead = true;
+    *limit = (flash->tornBytes < len) ? flash->tornBytes : len;
+    return false;
+}
+
+static bool prvRamProgram(void *ctx, uint32_t offset, const void *data, size_t len)
+{
+    RamFlash_t *flash = ctx;
+    const uint8_t *src = data;
+    size_t limit;
+
+    CHECK(offset % RAK3172_LOG_SLOT_SIZE == 0 && len == RAK3172_LOG_SLOT_SIZE);
+    CHECK(offset + len <= flash->size);
+
+    bool ok = prvRamPower(flash, len, &limit);
+
+    for(size_t i = 0; i < limit; i++)
+        flash->mem[offset + i] &= src[i];
+
+    flash->programs++;
+    return ok;
+}
+
+static bool prvRamErase(void *ctx, uint32_t offset)
+{
+    RamFlash_t *flash = ctx;
+    size_t limit;
+
+    CHECK(offset % SECTOR_SIZE == 0 && offset + SECTOR_SIZE <= flash->size);
+
+    bool ok = prvRamPower(flash, SECTOR_SIZE, &limit);
+
+    memset(&flash->mem[offset], 0xFF, limit);
+
+    flash->erases++;
+    return ok;
+}
+
+static void prvRamOpen(RamFlash_t *flash, RAK3172_FlashDev_t *dev, uint8_t *mem, uint32_t sectors)
+{
+    memset(flash, 0, sizeof(*flash));
+    flash->mem = mem;
+    flash->size = sectors * SECTOR_SIZE;
+    flash->opsLeft = -1;
+
+    dev->sectorSize = SECTOR_SIZE;
+    dev->sectorCount = sectors;
+    dev->ctx = flash;
+    dev->read = prvRamRead;
+    dev->program = prvRamProgram;
+    dev->erase = prvRamErase;
+}
+
+/* Record contents follow from its id, so a record read back can be
+ * checked on its own */
+static uint8_t prvRecord(uint32_t id, uint8_t *data, uint8_t *port)
+{
+    uint8_t length = (uint8_t)(4 + (id * 37) % (RAK3172_LOG_MAX_DATA - 3));
+
+    data[0] = (uint8_t)id;
+    data[1] = (uint8_t)(id >> 8);
+    data[2] = (uint8_t)(id >> 16);
+    data[3] = (uint8_t)(id >> 24);
+    for(uint8_t i = 4; i < length; i++)
+        data[i] = (uint8_t)(id * 31 + i);
+
+    *port = (uint8_t)(1 + id % 223);
+    return length;
+}
+
+static bool prvAppendId(RAK3172_Log_t *log, uint32_t id)
+{
+    uint8_t data[RAK3172_LOG_MAX_DATA];
+    uint8_t port;
+    uint8_t length = prvRecord(id, data, &port);
+
+    return RAK3172_LogAppend(log, port, data, length);
+}
+
+/* Peek the oldest record, check it is intact and return its id */
+static bool prvPeekId(RAK3172_Log_t *log, uint32_t *id)
+{
+    uint8_t data[RAK3172_LOG_MAX_DATA];
+    uint8_t expect[RAK3172_LOG_MAX_DATA];
+    uint8_t port, length, expectPort;
+
+    if(!RAK3172_LogPeek(log, &port, data, &length))
+        return false;
+
+    CHECK(length >= 4);
+    *id = (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+
+    uint8_t expectLength = prvRecord(*id, expect, &expectPort);
+    CHECK(length == expectLength);
+    CHECK(port == expectPort);
+    CHECK(memcmp(data, expect, length) == 0);
+
+    return true;
+}
+
+/* Consume every pending record, ids in order into ids[] */
+static uint32_t prvDrain(RAK3172_Log_t *log, uint32_t *ids, uint32_t max)
+{
+    uint32_t count = 0;
+    uint32_t id;
+
+    while(count < max && prvPeekId(log, &id))
+    {
+        ids[count++] = id;
+        CHECK(RAK3172_LogConsume(log));
+    }
+
+    CHECK(log->pending == 0);
+    return count;
+}
+
+static void test_empty_mount(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.slotCount == SLOTS);
+    CHECK(log.pending == 0);
+    CHECK(log.head == 0 && log.tail == 0);
+    CHECK(log.corrupt == 0);
+    CHECK(!RAK3172_LogPeek(&log, NULL, NULL, NULL));
+    CHECK(!RAK3172_LogConsume(&log));
+
+    /* One sector cannot rotate */
+    prvRamOpen(&flash, &dev, mem, 1);
+    CHECK(!RAK3172_LogInit(&log, &dev));
+}
+
+static void test_append_peek_consume(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    uint32_t ids[SLOTS];
+    uint8_t data[RAK3172_LOG_MAX_DATA + 1] = {0};
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    CHECK(!RAK3172_LogAppend(&log, 1, data, 0));
+    CHECK(!RAK3172_LogAppend(&log, 1, data, RAK3172_LOG_MAX_DATA + 1));
+
+    for(uint32_t id = 0; id < 10; id++)
+        CHECK(prvAppendId(&log, id));
+    CHECK(log.pending == 10);
+
+    uint32_t id;
+    CHECK(prvPeekId(&log, &id) && id == 0);
+    CHECK(prvPeekId(&log, &id) && id == 0);
+
+    uint32_t count = prvDrain(&log, ids, SLOTS);
+    CHECK(count == 10);
+    for(uint32_t i = 0; i < count; i++)
+        CHECK(ids[i] == i);
+
+    /* Consumed records stay consumed after a reboot */
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.pending == 0);
+    CHECK(log.head == 10);
+    CHECK(log.nextSeq == 10);
+}
+
+static void test_wrap_drops_oldest_sector(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    uint32_t ids[SLOTS];
+    uint32_t perSector = SECTOR_SIZE / RAK3172_LOG_SLOT_SIZE;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    /* Fill the ring, then five more: the first sector goes */
+    for(uint32_t id = 0; id < SLOTS + 5; id++)
+        CHECK(prvAppendId(&log, id));
+
+    CHECK(log.dropped == perSector);
+    CHECK(log.pending == SLOTS - perSector + 5);
+    CHECK(flash.erases == 1);
+
+    /* Same picture after a reboot */
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.pending == SLOTS - perSector + 5);
+    CHECK(log.nextSeq == SLOTS + 5);
+
+    uint32_t count = prvDrain(&log, ids, SLOTS);
+    CHECK(count == SLOTS - perSector + 5);
+    for(uint32_t i = 0; i < count; i++)
+        CHECK(ids[i] == perSector + i);
+}
+
+/* Many laps with a short backlog: erases rotate over every sector */
+static void test_wrap_wear(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    uint32_t next = 0;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    for(uint32_t id = 0; id < SLOTS * 10; id++)
+    {
+        CHECK(prvAppendId(&log, id));
+
+        if(log.pending > WORKLOAD_PENDING)
+        {
+            uint32_t got;
+            CHECK(prvPeekId(&log, &got) && got == next);
+            CHECK(RAK3172_LogConsume(&log));
+            next++;
+        }
+    }
+
+    CHECK(log.dropped == 0);
+    CHECK(log.corrupt == 0);
+
+    /* First lap finds blank sectors, every later sector entry erases */
+    CHECK(flash.erases == SECTORS * 9);
+
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.pending == WORKLOAD_PENDING);
+    uint32_t got;
+    CHECK(prvPeekId(&log, &got) && got == next);
+}
+
+static void test_crc_rejects_damaged_record(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    uint32_t ids[SLOTS];
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    for(uint32_t id = 0; id < 6; id++)
+        CHECK(prvAppendId(&log, id));
+
+    /* One bit in the data of record 2, one in the length of record 4 */
+    mem[2 * RAK3172_LOG_SLOT_SIZE + RAK3172_LOG_HEADER_SIZE + 5] ^= 0x10;
+    mem[4 * RAK3172_LOG_SLOT_SIZE + 5] ^= 0x01;
+
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.corrupt == 2);
+    CHECK(log.pending == 4);
+
+    uint32_t count = prvDrain(&log, ids, SLOTS);
+    CHECK(count == 4);
+    CHECK(ids[0] == 0 && ids[1] == 1 && ids[2] == 3 && ids[3] == 5);
+
+    /* The damaged slots are skipped, not reused before the next erase */
+    CHECK(prvAppendId(&log, 6));
+    CHECK(log.head == 7);
+}
+
+/* Run the workload with power cut at operation cut, tornBytes of that
+ * operation reaching the flash, then reboot and check the log. */
+static bool prvPowerLossCase(uint32_t cut, uint32_t tornBytes)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    static uint32_t expected[WORKLOAD_RECORDS];
+    static uint32_t ids[SLOTS + 8];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    uint32_t head = 0, tail = 0;
+    int64_t appending = -1, consuming = -1;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    flash.opsLeft = (int32_t)cut;
+    flash.tornBytes = tornBytes;
+
+    for(uint32_t id = 0; id < WORKLOAD_RECORDS && !flash.dead; id++)
+    {
+        if(!prvAppendId(&log, id))
+        {
+            appending = id;
+            break;
+        }
+        expected[head++] = id;
+
+        if(log.pending > WORKLOAD_PENDING)
+        {
+            if(!RAK3172_LogConsume(&log))
+            {
+                consuming = expected[tail];
+                break;
+            }
+            tail++;
+        }
+    }
+
+    /* Ran to the end: every cut point has been tried */
+    if(!flash.dead)
+        return false;
+
+    /* Reboot, add two records, then read everything back */
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(prvAppendId(&log, 1000));
+    CHECK(prvAppendId(&log, 1001));
+
+    uint32_t count = prvDrain(&log, ids, SLOTS + 8);
+    uint32_t i = 0;
+
+    /* The record being marked may still be pending */
+    if(consuming >= 0 && i < count && ids[i] == (uint32_t)consuming)
+        i++;
+
+    for(uint32_t e = tail + (consuming >= 0 ? 1 : 0); e < head; e++, i++)
+        CHECK(i < count && ids[i] == expected[e]);
+
+    /* The record being written may have made it */
+    if(appending >= 0 && i < count && ids[i] == (uint32_t)appending)
+        i++;
+
+    CHECK(count == i + 2);
+    CHECK(count >= 2 && ids[count - 2] == 1000 && ids[count - 1] == 1001);
+    CHECK(log.dropped == 0);
+
+    return true;
+}
+
+static void test_power_loss(void)
+{
+    /* Nothing, part of the header, the header and a little data, most of
+     * a page, a whole operation; for erases also half a sector */
+    static const uint32_t ulTorn[] = { 0, 6, 11, 40, 200, RAK3172_LOG_SLOT_SIZE, SECTOR_SIZE / 2 };
+    uint32_t cases = 0;
+
+    for(size_t t = 0; t < sizeof(ulTorn) / sizeof(ulTorn[0]); t++)
+    {
+        uint32_t before = ulTestFailures;
+
+        for(uint32_t cut = 0; prvPowerLossCase(cut, ulTorn[t]); cut++)
+        {
+            cases++;
+            if(ulTestFailures != before)
+            {
+                printf("  power cut at operation %u, %u bytes torn\n", (unsigned)cut, (unsigned)ulTorn[t]);
+                return;
+            }
+        }
+    }
+
+    CHECK(cases > WORKLOAD_RECORDS * 7);
+}
+
+static void test_clear(void)
+{
+    static uint8_t mem[SECTORS * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, SECTORS);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    for(uint32_t id = 0; id < 20; id++)
+        CHECK(prvAppendId(&log, id));
+
+    CHECK(RAK3172_LogClear(&log));
+    CHECK(log.pending == 0);
+    CHECK(flash.erases == SECTORS);
+
+    CHECK(RAK3172_LogInit(&log, &dev));
+    CHECK(log.pending == 0);
+    CHECK(log.head == 0);
+}
+
+/* Host time says little about the RP2040, flash traffic per operation
+ * carries over */
+static void bench_log(void)
+{
+    static uint8_t mem[16 * SECTOR_SIZE];
+    RamFlash_t flash;
+    RAK3172_FlashDev_t dev;
+    RAK3172_Log_t log;
+    const uint32_t ulRecords = 16 * SLOTS;
+
+    memset(mem, 0xFF, sizeof(mem));
+    prvRamOpen(&flash, &dev, mem, 16);
+    CHECK(RAK3172_LogInit(&log, &dev));
+
+    uint64_t start = ullTestNowNs();
+    for(uint32_t id = 0; id < ulRecords; id++)
+        CHECK(prvAppendId(&log, id));
+    uint64_t appendNs = ullTestNowNs() - start;
+    uint32_t programs = flash.programs, erases = flash.erases;
+    uint64_t readBytes = flash.readBytes;
+
+    flash.readBytes = 0;
+    start = ullTestNowNs();
+    CHECK(RAK3172_LogInit(&log, &dev));
+    uint64_t mountNs = ullTestNowNs() - start;
+    uint64_t mountRead = flash.readBytes;
+
+    flash.programs = 0;
+    flash.readBytes = 0;
+    uint32_t drained = 0;
+    start = ullTestNowNs();
+    while(RAK3172_LogPeek(&log, NULL, NULL, NULL) && RAK3172_LogConsume(&log))
+        drained++;
+    uint64_t drainNs = ullTestNowNs() - start;
+
+    printf("  append:  %6lu ns, %lu programs, %lu erases, %lu bytes read per 100 records\n",
+           (unsigned long)(appendNs / ulRecords), (unsigned long)(programs * 100 / ulRecords),
+           (unsigned long)(erases * 100 / ulRecords), (unsigned long)(readBytes * 100 / ulRecords));
+    printf("  mount:   %6lu us, %lu bytes read, %lu pending\n",
+           (unsigned long)(mountNs / 1000), (unsigned long)mountRead, (unsigned long)drained);
+    printf("  drain:   %6lu ns, %lu bytes read per record\n",
+           (unsigned long)(drained ? drainNs / drained : 0),
+           (unsigned long)(drained ? flash.readBytes / drained : 0));
+}
+
+int main(void)
+{
+    RUN(test_empty_mount);
+    RUN(test_append_peek_consume);
+    RUN(test_wrap_drops_oldest_sector);
+    RUN(test_wrap_wear);
+    RUN(test_crc_rejects_damaged_record);
+    RUN(test_power_loss);
+    RUN(test_clear);
+    RUN(bench_log);
+
+    return ulTestFailures ? 1 : 0;
+}
@@ -0,0 +1,487 @@
+#include "test.h"
+#include "stub_kernel.h"
+#include "queue.h"
+#include "rak3172_rx.h"
+#include <string.h>
+
+uint32_t ulTestFailures = 0;
+
+#define TEST_MAX_LINES      8
+
+/* Lines handed over by RAK3172_RxSplit() */
+static char cLines[TEST_MAX_LINES][RAK3172_RX_BUFFER_SIZE];
+static size_t xLineLengths[TEST_MAX_LINES];
+static uint32_t ulLines;
+
+static void prvCollect(void *ctx, char *line, size_t length)
+{
+    (void)ctx;
+
+    CHECK(strlen(line) == length);
+    if(ulLines < TEST_MAX_LINES)
+    {
+        memcpy(cLines[ulLines], line, length + 1);
+        xLineLengths[ulLines] = length;
+    }
+    ulLines++;
+}
+
+/* Producer side of the IRQ: push and publish */
+static size_t prvFeed(RAK3172_RxRing_t *ring, const char *data, size_t length)
+{
+    uint32_t head = ring->head;
+    size_t count = 0;
+
+    while(count < length && RAK3172_RxRingPush(ring, &head, (uint8_t)data[count]))
+        count++;
+
+    ring->head = head;
+    return count;
+}
+
+static void test_split_lines(void)
+{
+    static RAK3172_RxRing_t ring;
+    static RAK3172_RxLine_t line;
+
+    memset(&ring, 0, sizeof(ring));
+    memset(&line, 0, sizeof(line));
+    ulLines = 0;
+
+    /* CR LF, bare LF, blank line */
+    prvFeed(&ring, "OK\r\nAT+DR=5\n\r\n", 14);
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 3);
+    CHECK(ulLines == 3);
+    CHECK(strcmp(cLines[0], "OK") == 0);
+    CHECK(strcmp(cLines[1], "AT+DR=5") == 0);
+    CHECK(xLineLengths[2] == 0);
+    CHECK(RAK3172_RxRingEmpty(&ring));
+
+    /* A partial line waits for its terminator */
+    prvFeed(&ring, "+EVT:TX", 7);
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 0);
+    CHECK(RAK3172_RxRingEmpty(&ring));
+    prvFeed(&ring, "_DONE\r\n", 7);
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 1);
+    CHECK(strcmp(cLines[3], "+EVT:TX_DONE") == 0);
+
+    /* Nothing to do */
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 0);
+}
+
+static void test_long_line(void)
+{
+    static RAK3172_RxRing_t ring;
+    static RAK3172_RxLine_t line;
+    char data[RAK3172_RX_BUFFER_SIZE + 10];
+
+    memset(&ring, 0, sizeof(ring));
+    memset(&line, 0, sizeof(line));
+    ulLines = 0;
+
+    /* Cut to the buffer, the terminator still ends it */
+    memset(data, 'A', sizeof(data) - 1);
+    data[sizeof(data) - 1] = '\n';
+    CHECK(prvFeed(&ring, data, sizeof(data)) == sizeof(data));
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 1);
+    CHECK(xLineLengths[0] == RAK3172_RX_BUFFER_SIZE - 1);
+
+    prvFeed(&ring, "OK\r\n", 4);
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 1);
+    CHECK(strcmp(cLines[1], "OK") == 0);
+}
+
+static void test_ring_full_and_wrap(void)
+{
+    static RAK3172_RxRing_t ring;
+    static RAK3172_RxLine_t line;
+    char data[RAK3172_RX_RING_SIZE];
+    uint32_t head;
+
+    memset(&ring, 0, sizeof(ring));
+    memset(&line, 0, sizeof(line));
+    ulLines = 0;
+
+    /* Fill levels, then drops once full */
+    head = ring.head;
+    CHECK(RAK3172_RxRingPush(&ring, &head, 'x') == 1);
+    CHECK(RAK3172_RxRingPush(&ring, &head, 'y') == 2);
+    ring.head = head;
+
+    memset(data, 'z', sizeof(data));
+    CHECK(prvFeed(&ring, data, sizeof(data)) == RAK3172_RX_RING_SIZE - 2);
+    head = ring.head;
+    CHECK(RAK3172_RxRingPush(&ring, &head, '\n') == 0);
+
+    /* Drained, the indexes keep running across the wrap */
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 0);
+    line.length = 0;
+
+    ring.head = ring.tail = UINT32_MAX - 3;
+    CHECK(prvFeed(&ring, "+EVT:JOINED\r\nOK\r\n", 17) == 17);
+    CHECK(RAK3172_RxSplit(&ring, &line, prvCollect, NULL) == 2);
+    CHECK(strcmp(cLines[0], "+EVT:JOINED") == 0);
+    CHECK(strcmp(cLines[1], "OK") == 0);
+    CHECK(ring.tail == (uint32_t)(UINT32_MAX - 3 + 17));
+}
+
+/* The module's side of a few exchanges, CR LF terminated */
+static const char * const pcTraffic[] = {
+    "OK\r\n",
+    "AT+DR=5\r\nOK\r\n",
+    "+EVT:TX_DONE\r\n",
+    "+EVT:RX_1:-70:8:UNICAST:2:00112233445566778899AABBCCDDEEFF00112233445566778899AABBCCDDEEFF"
+    "00112233445566778899AABBCCDDEEFF00112233445566778899AABBCCDDEEFF\r\n",
+};
+
+#define TEST_BYTE_US        87      /* 10 bits at 115200 baud */
+#define TEST_HW_FIFO        32      /* RP2040 UART RX FIFO */
+#define TEST_IRQ_LEVEL      4       /* RX FIFO level interrupt, 1/8 full */
+#define TEST_IRQ_TIMEOUT_US 278     /* RX timeout interrupt, 32 bit periods */
+#define TEST_POLL_US        10000   /* Old task loop: vTaskDelay(10 ms) */
+#define TEST_MAX_BYTES      65536
+
+/* Simulated UART traffic: byte and arrival time */
+static uint8_t ucStream[TEST_MAX_BYTES];
+static uint32_t ulStreamUs[TEST_MAX_BYTES];
+static size_t xStreamLength;
+static uint32_t ulStreamLines;
+
+static void prvBuildStream(uint32_t exchanges)
+{
+    uint32_t t = 0;
+
+    xStreamLength = 0;
+    ulStreamLines = 0;
+
+    for(uint32_t i = 0; i < exchanges; i++)
+    {
+        const char *reply = pcTraffic[i % (sizeof(pcTraffic) / sizeof(pcTraffic[0]))];
+        size_t length = strlen(reply);
+
+        if(xStreamLength + length > TEST_MAX_BYTES)
+            break;
+
+        /* Replies start at odd times so they fall anywhere in a poll period */
+        t += 3000 + (i * 7919) % 20000;
+        for(size_t j = 0; j < length; j++)
+        {
+            ucStream[xStreamLength] = (uint8_t)reply[j];
+            ulStreamUs[xStreamLength++] = t;
+            t += TEST_BYTE_US;
+            if(reply[j] == '\n')
+                ulStreamLines++;
+        }
+    }
+}
+
+static bool prvKnownLine(const char *line)
+{
+    for(size_t i = 0; i < sizeof(pcTraffic) / sizeof(pcTraffic[0]); i++)
+    {
+        const char *p = pcTraffic[i];
+
+        /* Each traffic entry holds one or two lines */
+        while(*p)
+        {
+            size_t length = strcspn(p, "\r");
+            if(strlen(line) == length && strncmp(line, p, length) == 0)
+                return true;
+            p += length + 2;
+        }
+    }
+
+    return false;
+}
+
+typedef struct {
+    uint32_t lines;
+    uint32_t badLines;
+    uint32_t lostBytes;
+    uint64_t latencySumUs;
+    uint32_t latencyMaxUs;
+} TestRxResult_t;
+
+/* Hardware RX FIFO with the arrival time of each byte */
+typedef struct {
+    uint8_t data[TEST_HW_FIFO];
+    uint32_t us[TEST_HW_FIFO];
+    uint8_t head;
+    uint8_t count;
+} TestFifo_t;
+
+static void prvFifoPush(TestFifo_t *fifo, size_t i, TestRxResult_t *result)
+{
+    if(fifo->count == TEST_HW_FIFO)
+    {
+        result->lostBytes++;
+        return;
+    }
+
+    uint8_t slot = (fifo->head + fifo->count++) % TEST_HW_FIFO;
+    fifo->data[slot] = ucStream[i];
+    fifo->us[slot] = ulStreamUs[i];
+}
+
+static uint8_t prvFifoPop(TestFifo_t *fifo, uint32_t *us)
+{
+    uint8_t c = fifo->data[fifo->head];
+
+    *us = fifo->us[fifo->head];
+    fifo->head = (fifo->head + 1) % TEST_HW_FIFO;
+    fifo->count--;
+    return c;
+}
+
+static void prvLineDone(TestRxResult_t *result, const char *line, uint32_t nowUs, uint32_t endUs)
+{
+    uint32_t latency = nowUs - endUs;
+
+    result->lines++;
+    if(!prvKnownLine(line))
+        result->badLines++;
+    result->latencySumUs += latency;
+    if(latency > result->latencyMaxUs)
+        result->latencyMaxUs = latency;
+}
+
+/* Old receive path: the task polls the UART every 10 ms, assembles lines
+ * and copies every byte through a queue */
+static void prvPollPath(TestRxResult_t *result)
+{
+    static TestFifo_t fifo;
+    char line[RAK3172_RX_BUFFER_SIZE];
+    uint16_t lineIdx = 0;
+    uint32_t pollUs = TEST_POLL_US;
+
+    vStubKernelReset();
+    QueueHandle_t xRxQueue = xQueueCreate(256, sizeof(char));
+    memset(&fifo, 0, sizeof(fifo));
+    memset(result, 0, sizeof(*result));
+
+    for(size_t i = 0; i <= xStreamLength; i++)
+    {
+        uint32_t now = (i < xStreamLength) ? ulStreamUs[i] : UINT32_MAX;
+
+        while(pollUs <= now && (i < xStreamLength || fifo.count))
+        {
+            while(fifo.count)
+            {
+                uint32_t us;
+                char c = (char)prvFifoPop(&fifo, &us);
+                char q;
+
+                /* Send to queue for RAK3172_SendCommand, which pops it */
+                xQueueSend(xRxQueue, &c, 0);
+                xQueueReceive(xRxQueue, &q, 0);
+
+                if(q == '\n')
+                {
+                    line[lineIdx] = '\0';
+                    prvLineDone(result, line, pollUs, us);
+                    lineIdx = 0;
+                }
+                else if(q != '\r' && lineIdx < RAK3172_RX_BUFFER_SIZE - 1)
+                {
+                    line[lineIdx++] = q;
+                }
+            }
+            pollUs += TEST_POLL_US;
+        }
+
+        if(i < xStreamLength)
+            prvFifoPush(&fifo, i, result);
+    }
+}
+
+typedef struct {
+    TestRxResult_t *result;
+    uint32_t nowUs;
+    uint32_t endUs[TEST_HW_FIFO];   /* Terminators in the ring, oldest first */
+    uint8_t endHead;
+    uint8_t endCount;
+} TestIrqCtx_t;
+
+static void prvIrqLine(void *ctx, char *line, size_t length)
+{
+    TestIrqCtx_t *pxCtx = ctx;
+
+    (void)length;
+
+    prvLineDone(pxCtx->result, line, pxCtx->nowUs, pxCtx->endUs[pxCtx->endHead]);
+    pxCtx->endHead = (pxCtx->endHead + 1) % TEST_HW_FIFO;
+    pxCtx->endCount--;
+}
+
+/* New receive path: the FIFO level and timeout interrupts move bytes to
+ * the ring, the task splits lines as soon as the IRQ saw a terminator */
+static void prvIrqPath(TestRxResult_t *result)
+{
+    static TestFifo_t fifo;
+    static RAK3172_RxRing_t ring;
+    static RAK3172_RxLine_t line;
+    TestIrqCtx_t xCtx = { .result = result };
+
+    memset(&fifo, 0, sizeof(fifo));
+    memset(&ring, 0, sizeof(ring));
+    memset(&line, 0, sizeof(line));
+    memset(result, 0, sizeof(*result));
+
+    for(size_t i = 0; i <= xStreamLength; i++)
+    {
+        uint32_t now = (i < xStreamLength) ? ulStreamUs[i] : UINT32_MAX;
+
+        if(i < xStreamLength)
+            prvFifoPush(&fifo, i, result);
+
+        /* Level interrupt, or the line went quiet before the next byte */
+        bool level = fifo.count >= TEST_IRQ_LEVEL;
+        bool timeout = fifo.count && (i + 1 >= xStreamLength ||
+                                      ulStreamUs[i + 1] - now >= TEST_IRQ_TIMEOUT_US);
+        if(!level && !timeout)
+            continue;
+
+        xCtx.nowUs = (i >= xStreamLength) ? ulStreamUs[xStreamLength - 1] + TEST_IRQ_TIMEOUT_US :
+                     level ? now : now + TEST_IRQ_TIMEOUT_US;
+
+        uint32_t head = ring.head;
+        bool lineComplete = false;
+
+        while(fifo.count)
+        {
+            uint32_t us;
+            uint8_t c = prvFifoPop(&fifo, &us);
+
+            if(!RAK3172_RxRingPush(&ring, &head, c))
+            {
+                result->lostBytes++;
+                continue;
+            }
+            if(c == '\n')
+            {
+                xCtx.endUs[(xCtx.endHead + xCtx.endCount++) % TEST_HW_FIFO] = us;
+                lineComplete = true;
+            }
+        }
+        ring.head = head;
+
+        if(lineComplete)
+            RAK3172_RxSplit(&ring, &line, prvIrqLine, &xCtx);
+    }
+}
+
+/* Both paths over the same simulated UART bytes */
+static void test_rx_latency(void)
+{
+    TestRxResult_t xPoll, xIrq;
+
+    prvBuildStream(400);
+    prvPollPath(&xPoll);
+    prvIrqPath(&xIrq);
+
+    printf("  %u lines, %u bytes at 115200 baud\n", (unsigned)ulStreamLines, (unsigned)xStreamLength);
+    printf("  per-byte queue, 10 ms poll: %4u lines (%3u bad), %5u bytes lost, latency avg %5lu us max %5u us\n",
+           xPoll.lines, xPoll.badLines, xPoll.lostBytes,
+           (unsigned long)(xPoll.lines ? xPoll.latencySumUs / xPoll.lines : 0), xPoll.latencyMaxUs);
+    printf("  ring and line splitter:     %4u lines (%3u bad), %5u bytes lost, latency avg %5lu us max %5u us\n",
+           xIrq.lines, xIrq.badLines, xIrq.lostBytes,
+           (unsigned long)(xIrq.lines ? xIrq.latencySumUs / xIrq.lines : 0), xIrq.latencyMaxUs);
+
+    /* Every line intact and handled within one FIFO timeout */
+    CHECK(xIrq.lines == ulStreamLines);
+    CHECK(xIrq.badLines == 0);
+    CHECK(xIrq.lostBytes == 0);
+    CHECK(xIrq.latencyMaxUs <= TEST_IRQ_TIMEOUT_US);
+
+    /* The 32 byte FIFO overflows between polls on long lines */
+    CHECK(xPoll.lostBytes > 0);
+    CHECK(xPoll.latencySumUs > xIrq.latencySumUs);
+}
+
+static volatile uint32_t ulSink;
+
+static void prvCountLine(void *ctx, char *line, size_t length)
+{
+    (void)ctx;
+    ulSink += (uint32_t)length + (uint8_t)line[0];
+}
+
+/* CPU per byte on the host, same bytes, no FIFO model: a queue send and
+ * receive per byte against a push per byte and a split per burst */
+static void bench_rx_cpu(void)
+{
+    static RAK3172_RxRing_t ring;
+    static RAK3172_RxLine_t line;
+    char lineBuf[RAK3172_RX_BUFFER_SIZE];
+    uint16_t lineIdx = 0;
+    const uint32_t rounds = 200;
+    uint64_t bytes = (uint64_t)xStreamLength * rounds;
+
+    vStubKernelReset();
+    QueueHandle_t xRxQueue = xQueueCreate(256, sizeof(char));
+
+    uint64_t start = ullTestNowNs();
+    for(uint32_t r = 0; r < rounds; r++)
+    {
+        for(size_t i = 0; i < xStreamLength; i++)
+        {
+            char c = (char)ucStream[i];
+            char q;
+
+            xQueueSend(xRxQueue, &c, 0);
+            xQueueReceive(xRxQueue, &q, 0);
+
+            if(q == '\n')
+            {
+                lineBuf[lineIdx] = '\0';
+                prvCountLine(NULL, lineBuf, lineIdx);
+                lineIdx = 0;
+            }
+            else if(q != '\r' && lineIdx < RAK3172_RX_BUFFER_SIZE - 1)
+            {
+                lineBuf[lineIdx++] = q;
+            }
+        }
+    }
+    uint64_t queueNs = ullTestNowNs() - start;
+
+    memset(&ring, 0, sizeof(ring));
+    memset(&line, 0, sizeof(line));
+
+    start = ullTestNowNs();
+    for(uint32_t r = 0; r < rounds; r++)
+    {
+        /* Bursts of one FIFO level interrupt */
+        for(size_t i = 0; i < xStreamLength; )
+        {
+            uint32_t head = ring.head;
+            size_t end = i + TEST_IRQ_LEVEL < xStreamLength ? i + TEST_IRQ_LEVEL : xStreamLength;
+            bool lineComplete = false;
+
+            for(; i < end; i++)
+            {
+                RAK3172_RxRingPush(&ring, &head, ucStream[i]);
+                lineComplete |= ucStream[i] == '\n';
+            }
+            ring.head = head;
+
+            if(lineComplete)
+                RAK3172_RxSplit(&ring, &line, prvCountLine, NULL);
+        }
+    }
+    uint64_t ringNs = ullTestNowNs() - start;
+
+    printf("  %-28.28s %6.2f ns/byte\n", "per-byte queue", (double)queueNs / bytes);
+    printf("  %-28.28s %6.2f ns/byte\n", "ring and line splitter", (double)ringNs / bytes);
+}
+
+int main(void)
+{
+    RUN(test_split_lines);
+    RUN(test_long_line);
+    RUN(test_ring_full_and_wrap);
+    RUN(test_rx_latency);
+    RUN(bench_rx_cpu);
+
+    return ulTestFailures ? 1 : 0;
+}